@@ -0,0 +1,266 @@
+//
+//  allocator.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "parallel.h"
+#include "msym_error.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK msym_arena_lock_t;
+#define arenaLockInit(l) InitializeSRWLock(l)
+#define arenaLockDestroy(l)
+#define arenaLock(l) AcquireSRWLockExclusive(l)
+#define arenaUnlock(l) ReleaseSRWLockExclusive(l)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t msym_arena_lock_t;
+#define arenaLockInit(l) pthread_mutex_init(l, NULL)
+#define arenaLockDestroy(l) pthread_mutex_destroy(l)
+#define arenaLock(l) pthread_mutex_lock(l)
+#define arenaUnlock(l) pthread_mutex_unlock(l)
+#endif
+
+#define ARENA_DEFAULT_BLOCK (64*1024)
+
+/* Every allocation starts with a header recording where it came from, so memory from an arena
+ * and from the allocator can be mixed and freed with the same function */
+typedef union _msym_allocation {
+    struct {
+        msym_arena_t *arena;    // NULL if allocated directly with the allocator
+        size_t size;
+        int large;              // has an arena block of its own
+    } h;
+    long double align;
+} msym_allocation_t;
+
+typedef union _msym_arena_block {
+    struct {
+        union _msym_arena_block *next;
+        size_t size;
+        size_t used;
+    } b;
+    long double align;
+} msym_arena_block_t;
+
+/* Small allocations are taken from blocks and only returned when the arena is destroyed, except for the
+ * last one taken from the current block which is reused when it is freed or reallocated,
+ * large ones get a block of their own which is returned when they are freed */
+struct _msym_arena {
+    msym_arena_lock_t lock;
+    size_t block;
+    msym_arena_block_t *blocks;
+    msym_arena_block_t *current;
+};
+
+void *allocatorMalloc(void *data, size_t size);
+void *allocatorRealloc(void *data, void *ptr, size_t size);
+void allocatorFree(void *data, void *ptr);
+void *arenaAllocate(msym_arena_t *arena, size_t size);
+void *arenaReallocate(msym_arena_t *arena, msym_allocation_t *a, size_t size);
+void arenaFree(msym_arena_t *arena, msym_allocation_t *a);
+size_t arenaAllocationSize(size_t size);
+
+static msym_allocator_t allocator = {.malloc = allocatorMalloc, .realloc = allocatorRealloc, .free = allocatorFree, .data = NULL};
+
+static MSYM_THREAD_LOCAL msym_arena_t *current_arena = NULL;
+
+void *allocatorMalloc(void *data, size_t size){
+    return malloc(size);
+}
+
+void *allocatorRealloc(void *data, void *ptr, size_t size){
+    return realloc(ptr, size);
+}
+
+void allocatorFree(void *data, void *ptr){
+    free(ptr);
+}
+
+/* Replaces malloc, realloc and free for all memory allocated by the library, NULL restores them.
+ * Memory is released with the allocator active when it is freed, so this must be called before any
+ * other function of the library, and not while other threads are using it */
+msym_error_t msymSetAllocator(const msym_allocator_t *a){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(NULL == a){
+        allocator.malloc = allocatorMalloc;
+        allocator.realloc = allocatorRealloc;
+        allocator.free = allocatorFree;
+        allocator.data = NULL;
+    } else if(NULL == a->malloc || NULL == a->realloc || NULL == a->free){
+        msymSetErrorDetails("Allocator is missing malloc, realloc or free");
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    } else {
+        allocator = *a;
+    }
+err:
+    return ret;
+}
+
+void *msymMalloc(size_t size){
+    msym_allocation_t *a = NULL;
+    if(size > SIZE_MAX - sizeof(*a)) return NULL;
+    if(NULL != current_arena) return arenaAllocate(current_arena, size);
+    if(NULL == (a = allocator.malloc(allocator.data, sizeof(*a) + size))) return NULL;
+    a->h.arena = NULL;
+    a->h.size = size;
+    a->h.large = 0;
+    return a + 1;
+}
+
+void *msymCalloc(size_t n, size_t size){
+    void *ptr = NULL;
+    if(size > 0 && n > SIZE_MAX / size) return NULL;
+    if(NULL != (ptr = msymMalloc(n*size))) memset(ptr, 0, n*size);
+    return ptr;
+}
+
+void *msymRealloc(void *ptr, size_t size){
+    msym_allocation_t *a = NULL, *r = NULL;
+    void *rptr = NULL;
+    if(NULL == ptr) return msymMalloc(size);
+    if(size > SIZE_MAX - sizeof(*a)) return NULL;
+    a = (msym_allocation_t *) ptr - 1;
+    if(NULL == a->h.arena){
+        if(NULL == (r = allocator.realloc(allocator.data, a, sizeof(*r) + size))) return NULL;
+        r->h.size = size;
+        return r + 1;
+    }
+    if(NULL != (rptr = arenaReallocate(a->h.arena, a, size))) return rptr;
+    if(NULL == (rptr = arenaAllocate(a->h.arena, size))) return NULL;
+    memcpy(rptr, ptr, a->h.size < size ? a->h.size : size);
+    arenaFree(a->h.arena, a);
+    return rptr;
+}
+
+void msymFree(void *ptr){
+    msym_allocation_t *a = NULL;
+    if(NULL == ptr) return;
+    a = (msym_allocation_t *) ptr - 1;
+    if(NULL == a->h.arena) allocator.free(allocator.data, a);
+    else arenaFree(a->h.arena, a);
+}
+
+/* Arena for the memory of one context, block is the size of the blocks small allocations are taken from */
+msym_arena_t *arenaCreate(size_t block){
+    msym_arena_t *arena = allocator.malloc(allocator.data, sizeof(*arena));
+    if(NULL == arena) return NULL;
+    arenaLockInit(&arena->lock);
+    arena->block = block > 0 ? block : ARENA_DEFAULT_BLOCK;
+    arena->blocks = NULL;
+    arena->current = NULL;
+    return arena;
+}
+
+void arenaDestroy(msym_arena_t *arena){
+    if(NULL == arena) return;
+    for(msym_arena_block_t *b = arena->blocks, *next = NULL;NULL != b;b = next){
+        next = b->b.next;
+        allocator.free(allocator.data, b);
+    }
+    arenaLockDestroy(&arena->lock);
+    allocator.free(allocator.data, arena);
+}
+
+/* Selects the arena used for allocations on the calling thread (NULL for none), returns the previous one */
+msym_arena_t *arenaSelect(msym_arena_t *arena){
+    msym_arena_t *previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+/* Space taken from a block by an allocation of size bytes including its header */
+size_t arenaAllocationSize(size_t size){
+    size_t align = sizeof(msym_allocation_t);
+    return sizeof(msym_allocation_t) + (size + align - 1) / align * align;
+}
+
+void *arenaAllocate(msym_arena_t *arena, size_t size){
+    msym_allocation_t *a = NULL;
+    msym_arena_block_t *b = NULL;
+    size_t need = arenaAllocationSize(size);
+    int large = need > arena->block / 4;
+    
+    arenaLock(&arena->lock);
+    if(large || NULL == arena->current || arena->current->b.size - arena->current->b.used < need){
+        size_t bsize = large ? need : arena->block;
+        if(NULL == (b = allocator.malloc(allocator.data, sizeof(*b) + bsize))) goto err;
+        b->b.size = bsize;
+        b->b.used = 0;
+        b->b.next = arena->blocks;
+        arena->blocks = b;
+        if(!large) arena->current = b;
+    } else {
+        b = arena->current;
+    }
+    
+    a = (msym_allocation_t *) ((char *) (b + 1) + b->b.used);
+    b->b.used += need;
+    a->h.arena = arena;
+    a->h.size = size;
+    a->h.large = large;
+    
+err:
+    arenaUnlock(&arena->lock);
+    return NULL == a ? NULL : a + 1;
+}
+
+/* Resizes a in place if it is the last allocation of the current block and still fits in it,
+ * or if it has a block of its own and is still large, returns NULL if it has to be moved */
+void *arenaReallocate(msym_arena_t *arena, msym_allocation_t *a, size_t size){
+    msym_allocation_t *r = NULL;
+    msym_arena_block_t *b = NULL;
+    size_t need = arenaAllocationSize(size), have = arenaAllocationSize(a->h.size);
+    int large = need > arena->block / 4;
+    
+    arenaLock(&arena->lock);
+    if(large != a->h.large) goto err;
+    if(large){
+        for(msym_arena_block_t **p = &arena->blocks;NULL != *p;p = &(*p)->b.next){
+            if((msym_allocation_t *) (*p + 1) != a) continue;
+            if(NULL == (b = allocator.realloc(allocator.data, *p, sizeof(*b) + need))) goto err;
+            b->b.size = need;
+            b->b.used = need;
+            *p = b;
+            r = (msym_allocation_t *) (b + 1);
+            break;
+        }
+    } else if(NULL != (b = arena->current) && (char *) a + have == (char *) (b + 1) + b->b.used && b->b.size - (b->b.used - have) >= need){
+        b->b.used = b->b.used - have + need;
+        r = a;
+    }
+    
+    if(NULL != r) r->h.size = size;
+    
+err:
+    arenaUnlock(&arena->lock);
+    return NULL == r ? NULL : r + 1;
+}
+
+void arenaFree(msym_arena_t *arena, msym_allocation_t *a){
+    arenaLock(&arena->lock);
+    if(a->h.large){
+        for(msym_arena_block_t **b = &arena->blocks;NULL != *b;b = &(*b)->b.next){
+            if((msym_allocation_t *) (*b + 1) == a){
+                msym_arena_block_t *f = *b;
+                *b = f->b.next;
+                allocator.free(allocator.data, f);
+                break;
+            }
+        }
+    } else {
+        msym_arena_block_t *b = arena->current;
+        size_t have = arenaAllocationSize(a->h.size);
+        if(NULL != b && (char *) a + have == (char *) (b + 1) + b->b.used) b->b.used -= have;
+    }
+    arenaUnlock(&arena->lock);
+}
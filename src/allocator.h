@@ -0,0 +1,27 @@
+//
+//  allocator.h
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#ifndef __MSYM__ALLOCATOR_h
+#define __MSYM__ALLOCATOR_h
+
+#include <stddef.h>
+#include "msym.h"
+
+typedef struct _msym_arena msym_arena_t;
+
+/* All memory of the library is allocated and freed with these, they use the arena selected on the calling
+ * thread if any, and the allocator set with msymSetAllocator otherwise. Memory can be freed on any thread */
+void *msymMalloc(size_t size);
+void *msymCalloc(size_t n, size_t size);
+void *msymRealloc(void *ptr, size_t size);
+void msymFree(void *ptr);
+
+msym_arena_t *arenaCreate(size_t block);
+void arenaDestroy(msym_arena_t *arena);
+msym_arena_t *arenaSelect(msym_arena_t *arena);
+
+#endif /* defined(__MSYM__ALLOCATOR_h) */
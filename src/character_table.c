@@ -14,7 +14,10 @@
 
 #include "character_table.h"
 #include "point_group.h"
+#include "point_group_cache.h"
+#include "linalg.h"
 
+#include "allocator.h"
 #include "debug.h"
 
 #ifndef M_PI
@@ -30,7 +33,16 @@ typedef struct _msym_representation {
     char name[8];
 } msym_representation_t;
 
+/* Internal layout of a character table allocation, the public struct is first so the
+ * table can be freed as usual, followed by the data that its pointers refer to */
+typedef struct _msym_character_table_block {
+    msym_character_table_t ct;
+    msym_character_table_cache_entry_t *entry;
+} msym_character_table_block_t;
+
 msym_error_t verifyCharacterTable(msym_character_table_t *ct);
+msym_error_t allocateCharacterTable(int d, msym_character_table_t **ct);
+msym_error_t buildCharacterTable(msym_point_group_type_t type, int n, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_character_table_t **oct);
 
 msym_error_t setRepresentationName(msym_representation_t *rep);
 msym_error_t representationCharacter(int n, msym_symmetry_operation_t *sop, msym_representation_t *rep, double *c);
@@ -73,26 +85,181 @@ void decomposeRepresentation(msym_character_table_t *ct, double rspan[ct->d], do
 }
 
 
+/* Same as decomposeRepresentation for l representations at once, as a single product
+ * with the class weighted character matrix w[k][j] = classc[j]*table[k][j]/order */
+msym_error_t decomposeRepresentations(msym_character_table_t *ct, int l, double rspan[l][ct->d], double dspan[l][ct->d]){
+    msym_error_t ret = MSYM_SUCCESS;
+    int order = 0, d = ct->d;
+    double (*ctable)[d] = ct->table;
+    double (*w)[d] = msymMalloc(sizeof(double[d][d]));
+    
+    if(NULL == w){
+        msymSetErrorDetails("Could not allocate memory for character table of dimension %d",d);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    for(int k = 0;k < d;k++) order += ct->classc[k];
+    
+    for(int k = 0;k < d;k++){
+        for(int j = 0;j < d;j++) w[k][j] = ct->classc[j]*ctable[k][j]/order;
+    }
+    
+    mmtlmul(l, d, rspan, d, w, dspan);
+    
+err:
+    msymFree(w);
+    return ret;
+}
+
 void directProduct(int l, double irrep1[l], double irrep2[l], double pspan[l]){
     for(int i = 0;i < l;i++) pspan[i] = irrep1[i]*irrep2[i];
 }
 
-msym_error_t generateCharacterTable(msym_point_group_type_t type, int n, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_character_table_t **oct){
+msym_error_t allocateCharacterTable(int d, msym_character_table_t **oct){
     msym_error_t ret = MSYM_SUCCESS;
-    int d = sops[sopsl-1].cla + 1; //max cla
-    int linear = n == 0 && ((MSYM_POINT_GROUP_TYPE_Dnh == type && sopsl == 4) || (MSYM_POINT_GROUP_TYPE_Cnv == type && sopsl == 2));
+    msym_character_table_block_t *block = msymCalloc(1, sizeof(msym_character_table_block_t) + sizeof(double[d][d]) + sizeof(msym_symmetry_species_t[d]) + sizeof(msym_symmetry_operation_t*[d]) + sizeof(int[d]));
     
-    msym_character_table_t *ct = calloc(1, sizeof(msym_character_table_t) + sizeof(int[d]) + sizeof(msym_symmetry_species_t[d]) + sizeof(msym_symmetry_operation_t*[d]) + sizeof(double[d][d]));
+    if(NULL == block){
+        msymSetErrorDetails("Could not allocate memory for character table of dimension %d",d);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
     
+    msym_character_table_t *ct = &block->ct;
     
-    ct->table = (double (*)[d])(ct + 1);
+    ct->table = (double (*)[d])(block + 1);
     ct->s = (msym_symmetry_species_t*)((double (*)[d])ct->table + d);
     ct->sops = (msym_symmetry_operation_t **)(ct->s + d);
     ct->classc = (int *)(ct->sops + d);
-    
     ct->d = d;
+    
+    *oct = ct;
+    
+err:
+    return ret;
+}
+
+/* Copy the characters, species and class sizes of a table, the class representatives
+ * are taken from sops (which need the same class indices) or set to NULL if sopsl is 0 */
+msym_error_t copyCharacterTable(msym_character_table_t *src, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_character_table_t **dst){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_character_table_t *ct = NULL;
+    int d = src->d;
+    
+    if(MSYM_SUCCESS != (ret = allocateCharacterTable(d, &ct))) goto err;
+    
+    memcpy(ct->table, src->table, sizeof(double[d][d]));
+    memcpy(ct->s, src->s, sizeof(msym_symmetry_species_t[d]));
+    memcpy(ct->classc, src->classc, sizeof(int[d]));
+    ((msym_character_table_block_t *) ct)->entry = ((msym_character_table_block_t *) src)->entry;
+    
+    for(int i = 0;i < sopsl;i++){
+        int c = sops[i].cla;
+        if(c < 0 || c >= d){
+            msymSetErrorDetails("Conjugacy class exceeds character table size %d >= %d",c,d);
+            ret = MSYM_INVALID_CHARACTER_TABLE;
+            goto err;
+        }
+        if(NULL == ct->sops[c]) ct->sops[c] = &sops[i];
+    }
+    
+    *dst = ct;
+    return ret;
+    
+err:
+    msymFree(ct);
+    return ret;
+}
 
-    msym_representation_t *rep = calloc(ct->d, sizeof(msym_representation_t));;
+/* dp[i][j] is the decomposition of the direct product of irreducible representations i and j */
+msym_error_t generateDirectProducts(msym_character_table_t *ct, double **odp){
+    msym_error_t ret = MSYM_SUCCESS;
+    int d = ct->d;
+    double (*ctable)[d] = ct->table;
+    double (*dp)[d][d] = msymMalloc(sizeof(double[d][d][d]));
+    double *pspan = msymMalloc(sizeof(double[d]));
+    
+    if(NULL == dp || NULL == pspan){
+        msymSetErrorDetails("Could not allocate memory for direct product table of dimension %d",d);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    for(int i = 0;i < d;i++){
+        for(int j = 0;j <= i;j++){
+            directProduct(d, ctable[i], ctable[j], pspan);
+            decomposeRepresentation(ct, pspan, dp[i][j]);
+            memcpy(dp[j][i], dp[i][j], sizeof(double[d]));
+        }
+    }
+    
+    msymFree(pspan);
+    *odp = (double *) dp;
+    return ret;
+err:
+    msymFree(pspan);
+    msymFree(dp);
+    return ret;
+}
+
+/* Shared read-only direct product table of a generated character table, see generateDirectProducts */
+msym_error_t getDirectProducts(msym_character_table_t *ct, double **dp){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_character_table_cache_entry_t *entry = ((msym_character_table_block_t *) ct)->entry;
+    if(NULL == entry){
+        msymSetErrorDetails("Character table has no direct product table");
+        ret = MSYM_INVALID_CHARACTER_TABLE;
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = findCachedDirectProducts(entry, dp))) goto err;
+    
+err:
+    return ret;
+}
+
+/* Character tables only depend on type, n and the canonical class ordering of the operations,
+ * so they are built once and copied with class representatives from sops */
+msym_error_t generateCharacterTable(msym_point_group_type_t type, int n, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_character_table_t **oct){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_character_table_t *ct = NULL, *cct = NULL;
+    msym_character_table_cache_entry_t *entry = NULL;
+    int d = sops[sopsl-1].cla + 1;
+    
+    if(MSYM_SUCCESS != (ret = findCachedCharacterTable(type, n, sopsl, &entry, &cct))) goto err;
+    
+    if(NULL == cct){
+        if(MSYM_SUCCESS != (ret = buildCharacterTable(type, n, sopsl, sops, &ct))) goto err;
+        if(MSYM_SUCCESS != (ret = cacheCharacterTable(type, n, sopsl, ct, &entry))) goto err;
+        ((msym_character_table_block_t *) ct)->entry = entry;
+    } else if(cct->d != d){
+        msymSetErrorDetails("Cached character table dimension %d does not match number of classes %d",cct->d,d);
+        ret = MSYM_INVALID_CHARACTER_TABLE;
+        goto err;
+    } else {
+        if(MSYM_SUCCESS != (ret = copyCharacterTable(cct, sopsl, sops, &ct))) goto err;
+        ((msym_character_table_block_t *) ct)->entry = entry;
+    }
+    
+    *oct = ct;
+    return ret;
+err:
+    msymFree(ct);
+    return ret;
+}
+
+msym_error_t buildCharacterTable(msym_point_group_type_t type, int n, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_character_table_t **oct){
+    msym_error_t ret = MSYM_SUCCESS;
+    int d = sops[sopsl-1].cla + 1; //max cla
+    int linear = n == 0 && ((MSYM_POINT_GROUP_TYPE_Dnh == type && sopsl == 4) || (MSYM_POINT_GROUP_TYPE_Cnv == type && sopsl == 2));
+    
+    msym_character_table_t *ct = NULL;
+    msym_representation_t *rep = NULL;
+    
+    if(MSYM_SUCCESS != (ret = allocateCharacterTable(d, &ct))) return ret;
+    
+    rep = msymCalloc(ct->d, sizeof(msym_representation_t));
     double (*table)[ct->d] = (double (*)[ct->d]) ct->table;
     
     
@@ -174,11 +341,11 @@ msym_error_t generateCharacterTable(msym_point_group_type_t type, int n, int sop
     
     *oct = ct;
     
-    free(rep);
+    msymFree(rep);
     return ret;
 err:
-    free(rep);
-    free(ct);
+    msymFree(rep);
+    msymFree(ct);
     return ret;
 }
 
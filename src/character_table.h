@@ -16,10 +16,18 @@
 
 void decomposeRepresentation(msym_character_table_t *ct, double rspan[ct->d], double dspan[ct->d]);
 
+msym_error_t decomposeRepresentations(msym_character_table_t *ct, int l, double rspan[l][ct->d], double dspan[l][ct->d]);
+
 void directProduct(int l, double irrep1[l], double irrep2[l], double pspan[l]);
 
 msym_error_t generateCharacterTable(msym_point_group_type_t type, int n, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_character_table_t **ct);
 
+msym_error_t copyCharacterTable(msym_character_table_t *src, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_character_table_t **dst);
+
+msym_error_t generateDirectProducts(msym_character_table_t *ct, double **dp);
+
+msym_error_t getDirectProducts(msym_character_table_t *ct, double **dp);
+
 
 
 #endif /* defined(__MSYM__CHARACTER_TABLE_h) */
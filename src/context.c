@@ -9,6 +9,8 @@
 //
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 
@@ -19,8 +21,53 @@
 #include "geometry.h"
 #include "linalg.h"
 #include "subspace.h"
+#include "point_group_cache.h"
+#include "allocator.h"
 #include "debug.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#define ctxReferenceAdd(r, v) (InterlockedExchangeAdd((r), (v)) + (v))
+#else
+#define ctxReferenceAdd(r, v) __sync_add_and_fetch((r), (v))
+#endif
+
+#define CTX_SNAPSHOT_VERSION 1
+#define CTX_SNAPSHOT_BYTE_ORDER 0x01020304
+
+typedef struct _msym_context_stream {
+    unsigned char *buf;         // written to, NULL when only measuring
+    const unsigned char *data;  // read from
+    size_t l;
+    size_t off;
+} msym_context_stream_t;
+
+msym_context ctxCreate();
+msym_error_t ctxCopy(msym_context ctx, msym_context clone);
+msym_error_t ctxCopyElements(msym_context ctx, msym_context clone);
+msym_error_t ctxCopyPointGroup(msym_context ctx, msym_context clone);
+msym_error_t ctxCopyEquivalenceSets(msym_context ctx, msym_context clone);
+msym_error_t ctxCopySubrepresentationSpaces(msym_context ctx, msym_context clone);
+void ctxWriteData(msym_context_stream_t *s, size_t size, const void *data);
+void ctxWriteInt(msym_context_stream_t *s, int v);
+void ctxWriteSize(msym_context_stream_t *s, size_t v);
+void ctxWriteElement(msym_context_stream_t *s, msym_element_t *e);
+void ctxWritePermutation(msym_context_stream_t *s, msym_permutation_t *perm);
+void ctxWriteContext(msym_context ctx, msym_context_stream_t *s);
+msym_error_t ctxReadData(msym_context_stream_t *s, size_t size, void *data);
+msym_error_t ctxReadInt(msym_context_stream_t *s, int min, int max, int *v);
+msym_error_t ctxReadLength(msym_context_stream_t *s, int *l);
+msym_error_t ctxReadSize(msym_context_stream_t *s, size_t *v);
+msym_error_t ctxReadElement(msym_context_stream_t *s, msym_element_t *e);
+msym_error_t ctxReadPermutation(msym_context_stream_t *s, msym_permutation_t *perm);
+msym_error_t ctxCheckPointGroupType(msym_point_group_type_t type, int n, int order);
+msym_error_t ctxReadContext(msym_context ctx, msym_context_stream_t *s);
+msym_error_t ctxReadPointGroup(msym_context ctx, msym_context_stream_t *s);
+msym_error_t ctxReadEquivalenceSets(msym_context ctx, msym_context_stream_t *s);
+msym_error_t ctxReadSubrepresentationSpaces(msym_context ctx, msym_context_stream_t *s);
+
+const char ctx_snapshot_magic[8] = "MSYMCTX";
+
 const msym_thresholds_t default_thresholds = {
     .zero = DEFAULT_ZERO_THRESHOLD,
     .geometry = DEFAULT_GEOMETRY_THRESHOLD,
@@ -42,7 +89,13 @@ struct _msym_context {
     msym_subrepresentation_space_t *srs;
     msym_basis_function_t **srsbf;
     int *srs_span;
+    volatile long **srs_refs;           // reference count of the SALC coefficients of each species, shared with clones
     unsigned long int flags;
+    int threads;
+    msym_precision_t precision;
+    size_t memory_budget;
+    size_t srs_predicted;
+    size_t srs_peak;
     int elementsl;
     int basisl;
     int esl;
@@ -55,8 +108,13 @@ struct _msym_context {
     msym_geometry_t geometry;
     double eigval[3];
     double eigvec[3][3];
+    char err_details[MSYM_ERROR_DETAILS_MAX_LENGTH];
+    char err_details_ext[MSYM_ERROR_DETAILS_MAX_LENGTH];
+    msym_arena_t *arena;                // all memory of the context if created with msymCreateContextWithArena
+    size_t arena_block;
     struct _external_data {
         msym_equivalence_set_t **eesmap;
+        int *eesimap;                       // index of each element in its equivalence set
         msym_element_t *set_elements_ptr;
         msym_element_t *elements;
         msym_equivalence_set_t *es;
@@ -68,8 +126,30 @@ struct _msym_context {
  ***********************/
 
 msym_context msymCreateContext(){
-    msym_context ctx = malloc(sizeof(struct _msym_context));
-    msym_thresholds_t *threshols = malloc(sizeof(msym_thresholds_t));
+    arenaSelect(NULL);
+    return ctxCreate();
+}
+
+/* A context whose memory is taken from blocks of block bytes (0 for a default size), everything is returned
+ * at once when it is released. Memory freed before that is only reused if it was a large allocation */
+msym_context msymCreateContextWithArena(size_t block){
+    msym_context ctx = NULL;
+    msym_arena_t *arena = arenaCreate(block);
+    if(NULL == arena) {msymSetErrorDetails("Arena memory allocation failed"); return NULL;}
+    arenaSelect(arena);
+    if(NULL == (ctx = ctxCreate())){
+        arenaSelect(NULL);
+        arenaDestroy(arena);
+        return NULL;
+    }
+    ctx->arena = arena;
+    ctx->arena_block = block;
+    return ctx;
+}
+
+msym_context ctxCreate(){
+    msym_context ctx = msymMalloc(sizeof(struct _msym_context));
+    msym_thresholds_t *threshols = msymMalloc(sizeof(msym_thresholds_t));
     
     //Don't generally handle allocation errors...
     if(ctx == NULL) {msymSetErrorDetails("Context memory allocation failed"); goto err;}
@@ -85,8 +165,8 @@ msym_context msymCreateContext(){
     return ctx;
     
     err :
-    free(ctx);
-    free(threshols);
+    msymFree(ctx);
+    msymFree(threshols);
     return NULL;
 }
 
@@ -97,6 +177,7 @@ const msym_thresholds_t *msymGetDefaultThresholds(){
 msym_error_t msymSetThresholds(msym_context ctx, const msym_thresholds_t *thresholds){
     msym_error_t ret = MSYM_SUCCESS;
     if(NULL == ctx) {ret = MSYM_INVALID_CONTEXT;goto err;}
+    ctxSelectArena(ctx);
     if(NULL != thresholds &&
        thresholds->angle < 1.0 && !signbit(thresholds->angle) &&
        thresholds->equivalence < 1.0 && !signbit(thresholds->equivalence) &&
@@ -107,30 +188,128 @@ msym_error_t msymSetThresholds(msym_context ctx, const msym_thresholds_t *thresh
        !signbit(thresholds->permutation)){
         if(ctx->thresholds != thresholds) memcpy(ctx->thresholds, thresholds, sizeof(msym_thresholds_t));
     } else {
+        msymSetErrorDetails("Invalid thresholds, angle, equivalence and geometry must be in [0,1) and the others non-negative");
         ret = MSYM_INVALID_THRESHOLD;
         goto err;
     }
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetThresholds(msym_context ctx, const msym_thresholds_t **thresholds){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->thresholds == NULL) ret = MSYM_INVALID_THRESHOLD;
+    ctxSelectArena(ctx);
+    if(ctx->thresholds == NULL) {
+        msymSetErrorDetails("Found no thresholds");
+        ret = MSYM_INVALID_THRESHOLD;
+    }
     *thresholds = ctx->thresholds;
 err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* Details of the last error from a function called with this context, cleared when read.
+ * Unlike msymGetErrorDetails these are not affected by other contexts used concurrently */
+const char *msymGetContextErrorDetails(msym_context ctx){
+    if(ctx == NULL) return msymGetErrorDetails();
+    snprintf(ctx->err_details_ext, sizeof(ctx->err_details_ext), "%s", ctx->err_details);
+    ctx->err_details[0] = '\0';
+    return ctx->err_details_ext;
+}
+
+/* Number of threads used for SALC generation, 0 (the default) uses one per processor. Each block being
+ * generated has scratch memory of its own, so with a memory budget (msymSetMemoryBudget) fewer are used */
+msym_error_t msymSetThreads(msym_context ctx, int threads){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    if(threads < 0){
+        msymSetErrorDetails("Invalid number of threads %d", threads);
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    ctx->threads = threads;
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+msym_error_t msymGetThreads(msym_context ctx, int *threads){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    *threads = ctx->threads;
+    return ret;
+}
+
+/* Precision of the projection and orthogonalization in SALC generation, in single precision the subspaces
+ * are refined in double precision, and generated in double precision when they cannot be. Changing it
+ * removes any SALCs already generated */
+msym_error_t msymSetPrecision(msym_context ctx, msym_precision_t precision){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    if(precision != MSYM_PRECISION_DOUBLE && precision != MSYM_PRECISION_SINGLE){
+        msymSetErrorDetails("Invalid precision %d", precision);
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    if(ctx->precision != precision) ctxDestroySubrepresentationSpaces(ctx);
+    ctx->precision = precision;
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+msym_error_t msymGetPrecision(msym_context ctx, msym_precision_t *precision){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    *precision = ctx->precision;
+    return ret;
+}
+
+/* Memory budget in bytes for SALC generation, 0 for no limit */
+msym_error_t msymSetMemoryBudget(msym_context ctx, size_t bytes){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    ctx->memory_budget = bytes;
+    return ret;
+}
+
+msym_error_t msymGetMemoryBudget(msym_context ctx, size_t *bytes){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    *bytes = ctx->memory_budget;
+    return ret;
+}
+
+/* Predicted and measured peak memory of the last SALC generation */
+msym_error_t msymGetSubrepresentationSpacesMemory(msym_context ctx, size_t *predicted, size_t *peak){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    *predicted = ctx->srs_predicted;
+    *peak = ctx->srs_peak;
     return ret;
 }
 
 msym_error_t msymSetElements(msym_context ctx, int length, msym_element_t *elements){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
     /* Allow manual setting of point group before elements */
     if(NULL != ctx->es) ctxDestroyPointGroup(ctx);
-    return ctxSetElements(ctx, length, elements);
+    if(MSYM_SUCCESS != (ret = ctxSetElements(ctx, length, elements))) goto err;
+    return ret;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -138,33 +317,47 @@ msym_error_t msymGetElements(msym_context ctx, int *length, msym_element_t **ele
     msym_error_t ret = MSYM_SUCCESS;
     msym_element_t *relements = NULL;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->elements == NULL || ctx->ext.elements == NULL) {ret = MSYM_INVALID_ELEMENTS;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->elements == NULL || ctx->ext.elements == NULL) {
+        msymSetErrorDetails("Found no elements");
+        ret = MSYM_INVALID_ELEMENTS;
+        goto err;
+    }
     
     *elements = ctx->ext.elements;
     *length = ctx->elementsl;
     return ret;
 err:
-    free(relements);
+    msymFree(relements);
     *elements = NULL;
     *length = 0;
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetEquivalenceSets(msym_context ctx, int *length, const msym_equivalence_set_t **es){
     msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
     
-    if(ctx->ext.es == NULL){ret = MSYM_INVALID_EQUIVALENCE_SET;goto err;}
+    if(ctx->ext.es == NULL){
+        msymSetErrorDetails("Found no equivalence sets");
+        ret = MSYM_INVALID_EQUIVALENCE_SET;
+        goto err;
+    }
     
     *es = ctx->ext.es;
     *length = ctx->esl;
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetBasisFunctions(msym_context ctx, int *length, msym_basis_function_t **basis){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
     if(ctx->basis == NULL) {
         msymSetErrorDetails("Found no basis functions");
         ret = MSYM_INVALID_BASIS_FUNCTIONS;
@@ -174,15 +367,21 @@ msym_error_t msymGetBasisFunctions(msym_context ctx, int *length, msym_basis_fun
     *length = ctx->basisl;
     *basis = ctx->basis;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymSetBasisFunctions(msym_context ctx, int length, msym_basis_function_t *basis){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->elements == NULL) {ret = MSYM_INVALID_ELEMENTS;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->elements == NULL) {
+        msymSetErrorDetails("Elements must be set before basis functions");
+        ret = MSYM_INVALID_ELEMENTS;
+        goto err;
+    }
     ctxDestroyBasisFunctions(ctx);
-    ctx->basis = malloc(sizeof(msym_basis_function_t[length]));
+    ctx->basis = msymMalloc(sizeof(msym_basis_function_t[length]));
     memcpy(ctx->basis, basis, sizeof(msym_basis_function_t[length]));
     for(int i = 0;i < length;i++){
         msym_basis_function_t *bf = &ctx->basis[i];
@@ -213,7 +412,7 @@ msym_error_t msymSetBasisFunctions(msym_context ctx, int length, msym_basis_func
     ctx->basisl = length;
     
     if(NULL != ctx->pg && isLinearPointGroup(ctx->pg)){
-        free(ctx->pg->ct);
+        msymFree(ctx->pg->ct);
         ctx->pg->ct = NULL;
         if(MSYM_SUCCESS != (ret = msymFindSymmetry(ctx))) goto err; // This will only do eq set building and linear reduction
     }
@@ -221,30 +420,43 @@ msym_error_t msymSetBasisFunctions(msym_context ctx, int length, msym_basis_func
     return ret;
 
 err:
-    free(ctx->basis);
+    msymFree(ctx->basis);
     ctx->basisl = 0;
     ctx->basis = NULL;
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetPointGroupName(msym_context ctx, int l, char buf[l]){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->pg == NULL) {ret = MSYM_INVALID_POINT_GROUP;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->pg == NULL) {
+        msymSetErrorDetails("Found no point group");
+        ret = MSYM_INVALID_POINT_GROUP;
+        goto err;
+    }
     snprintf(buf, l, "%s",ctx->pg->name);
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetPointGroupType(msym_context ctx, msym_point_group_type_t *t, int *n){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->pg == NULL) {ret = MSYM_INVALID_POINT_GROUP;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->pg == NULL) {
+        msymSetErrorDetails("Found no point group");
+        ret = MSYM_INVALID_POINT_GROUP;
+        goto err;
+    }
     
     *t = ctx->pg->type;
     *n = ctx->pg->n;
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -255,8 +467,14 @@ msym_error_t msymGetSubgroups(msym_context ctx, int *sgl, const msym_subgroup_t
     int gsgl = 0;
     
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->pg == NULL) {ret = MSYM_INVALID_POINT_GROUP;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->pg == NULL) {
+        msymSetErrorDetails("Found no point group");
+        ret = MSYM_INVALID_POINT_GROUP;
+        goto err;
+    }
     if(ctx->pg->perm == NULL && !(isLinearPointGroup(ctx->pg) && !isLinearSubgroup(ctx->pg))) {
+        msymSetErrorDetails("Found no permutations of the symmetry operations");
         ret = MSYM_INVALID_PERMUTATION;
         goto err;
     }
@@ -266,11 +484,24 @@ msym_error_t msymGetSubgroups(msym_context ctx, int *sgl, const msym_subgroup_t
         if(MSYM_SUCCESS != (ret = findPermutationSubgroups(ctx->pg->order, ctx->pg->perm, sgmax, ctx->pg->sops, &gsgl, &gsg))) goto err;
         
         if(isLinearSubgroup(ctx->pg)){
-            gsg = realloc(gsg, (gsgl+1)*sizeof(*gsg));
-            memset(&gsg[gsgl], 0, sizeof(*gsg));
+            // generators point into the subgroup array so it is moved rather than reallocated
+            msym_subgroup_t *lsg = msymCalloc(gsgl+1, sizeof(*lsg));
+            if(NULL == lsg){
+                ret = MSYM_MEMORY_ERROR;
+                msymSetErrorDetails("Could not allocate memory for linear subgroups");
+                goto err;
+            }
+            memcpy(lsg, gsg, gsgl*sizeof(*gsg));
+            for(int i = 0;i < gsgl;i++){
+                for(int j = 0;j < 2;j++){
+                    if(NULL != gsg[i].generators[j]) lsg[i].generators[j] = gsg[i].generators[j] - gsg + lsg;
+                }
+            }
+            msymFree(gsg);
+            gsg = lsg;
             gsg[gsgl].n = ctx->pg->n;
             gsg[gsgl].order = ctx->pg->order;
-            gsg[gsgl].sops = calloc(gsg[gsgl].order, sizeof(*gsg[gsgl].sops));
+            gsg[gsgl].sops = msymCalloc(gsg[gsgl].order, sizeof(*gsg[gsgl].sops));
             for(int i = 0;i < ctx->pg->order;i++){
                 gsg[gsgl].sops[i] = &ctx->pg->sops[i];
             }
@@ -291,9 +522,14 @@ msym_error_t msymGetSubgroups(msym_context ctx, int *sgl, const msym_subgroup_t
     
 err:
     for(int i = 0;NULL != gsg && i < gsgl;i++){
-        free(gsg[i].sops);
+        msymFree(gsg[i].sops);
+    }
+    msymFree(gsg);
+    if(ctx->sg == gsg){
+        ctx->sg = NULL;
+        ctx->sgl = 0;
     }
-    free(gsg);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
     
     
@@ -302,28 +538,58 @@ err:
 
 msym_error_t msymGetSubrepresentationSpaces(msym_context ctx, int *l, const msym_subrepresentation_space_t **srs){
     msym_error_t ret = MSYM_SUCCESS;
+    msym_subrepresentation_space_t *csrs = NULL;
+    int *span = NULL, srsl = 0;
     if(NULL == ctx) {ret = MSYM_INVALID_CONTEXT;goto err;}
-    if(NULL == ctx->srs){
+    ctxSelectArena(ctx);
+    if(MSYM_SUCCESS != ctxGetSubrepresentationSpaces(ctx, &srsl, &csrs, &span)){
         if(MSYM_SUCCESS != (ret = msymGenerateSubrepresentationSpaces(ctx))) goto err;
-        if(NULL == ctx->srs){
+        if(MSYM_SUCCESS != ctxGetSubrepresentationSpaces(ctx, &srsl, &csrs, &span)){
             msymSetErrorDetails("Found no subrepresentation spaces");
             ret = MSYM_INVALID_BASIS_FUNCTIONS;
             goto err;
         }
     }
     
-    *srs = ctx->srs;
-    *l = ctx->srsl;
+    *srs = csrs;
+    *l = srsl;
+    
+    return ret;
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+msym_error_t msymGetSubrepresentationSpace(msym_context ctx, int species, const msym_subrepresentation_space_t **srs){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_subrepresentation_space_t *csrs = NULL;
+    if(NULL == ctx) {ret = MSYM_INVALID_CONTEXT;goto err;}
+    ctxSelectArena(ctx);
+    if(MSYM_SUCCESS != ctxGetSubrepresentationSpace(ctx, species, &csrs)){
+        if(MSYM_SUCCESS != (ret = msymGenerateSubrepresentationSpace(ctx, species))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxGetSubrepresentationSpace(ctx, species, &csrs))){
+            msymSetErrorDetails("Found no subrepresentation space for symmetry species %d",species);
+            goto err;
+        }
+    }
+    
+    *srs = csrs;
     
     return ret;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetCharacterTable(msym_context ctx, const msym_character_table_t **ct){
     msym_error_t ret = MSYM_SUCCESS;
     if(NULL == ctx) {ret = MSYM_INVALID_CONTEXT;goto err;}
-    if(NULL == ctx->pg){ret = MSYM_INVALID_POINT_GROUP;goto err;}
+    ctxSelectArena(ctx);
+    if(NULL == ctx->pg) {
+        msymSetErrorDetails("Found no point group");
+        ret = MSYM_INVALID_POINT_GROUP;
+        goto err;
+    }
     if(NULL == ctx->pg->ct){
         msym_point_group_t *pg = ctx->pg;
         if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
@@ -331,6 +597,7 @@ msym_error_t msymGetCharacterTable(msym_context ctx, const msym_character_table_
     *ct = ctx->pg->ct;
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
     
 }
@@ -338,52 +605,87 @@ err:
 msym_error_t msymGetCenterOfMass(msym_context ctx, double v[3]){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->elements == NULL) {ret = MSYM_INVALID_ELEMENTS;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->elements == NULL) {
+        msymSetErrorDetails("Found no elements");
+        ret = MSYM_INVALID_ELEMENTS;
+        goto err;
+    }
     vcopy(ctx->cm, v);
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymSetCenterOfMass(msym_context ctx, double cm[3]){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
+    ctxSelectArena(ctx);
     vcopy(cm,ctx->cm);
     if(MSYM_SUCCESS != (ret = ctxUpdateExternalElementCoordinates(ctx))) goto err;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetGeometry(msym_context ctx, msym_geometry_t *geometry){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->elements == NULL) {ret = MSYM_INVALID_ELEMENTS;goto err;}
-    if(ctx->geometry == MSYM_GEOMETRY_UNKNOWN) {ret = MSYM_INVALID_GEOMETRY;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->elements == NULL) {
+        msymSetErrorDetails("Found no elements");
+        ret = MSYM_INVALID_ELEMENTS;
+        goto err;
+    }
+    if(ctx->geometry == MSYM_GEOMETRY_UNKNOWN) {
+        msymSetErrorDetails("Geometry has not been determined");
+        ret = MSYM_INVALID_GEOMETRY;
+        goto err;
+    }
     *geometry = ctx->geometry;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetPrincipalMoments(msym_context ctx, double eigval[3]){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->elements == NULL) {ret = MSYM_INVALID_ELEMENTS;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->elements == NULL) {
+        msymSetErrorDetails("Found no elements");
+        ret = MSYM_INVALID_ELEMENTS;
+        goto err;
+    }
     vcopy(ctx->eigval, eigval);
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 msym_error_t msymGetPrincipalAxes(msym_context ctx, double eigvec[3][3]){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->elements == NULL) {ret = MSYM_INVALID_ELEMENTS;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->elements == NULL) {
+        msymSetErrorDetails("Found no elements");
+        ret = MSYM_INVALID_ELEMENTS;
+        goto err;
+    }
     mcopy(ctx->eigvec, eigvec);
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetRadius(msym_context ctx, double *radius){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->elements == NULL) {ret = MSYM_INVALID_ELEMENTS;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->elements == NULL) {
+        msymSetErrorDetails("Found no elements");
+        ret = MSYM_INVALID_ELEMENTS;
+        goto err;
+    }
     double r = 0.0;
     for(int i = 0;i < ctx->elementsl;i++){
         double abs = vabs(ctx->elements[i].v);
@@ -392,6 +694,7 @@ msym_error_t msymGetRadius(msym_context ctx, double *radius){
     *radius = r;
 
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -399,25 +702,115 @@ msym_error_t msymGetSymmetryOperations(msym_context ctx, int *sopsl, const msym_
     msym_error_t ret = MSYM_SUCCESS;
     msym_symmetry_operation_t *rsops = NULL;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    if(ctx->pg == NULL || ctx->pg->sops == NULL) {ret = MSYM_INVALID_POINT_GROUP;goto err;}
+    ctxSelectArena(ctx);
+    if(ctx->pg == NULL || ctx->pg->sops == NULL) {
+        msymSetErrorDetails("Found no point group");
+        ret = MSYM_INVALID_POINT_GROUP;
+        goto err;
+    }
     
     *sops = ctx->pg->sops;
     *sopsl = ctx->pg->order;
     return ret;
 err:
-    free(rsops);
+    msymFree(rsops);
     *sops = NULL;
     *sopsl = 0;
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* A new context with the same settings, elements, basis functions, point group, subgroups, equivalence sets
+ * and SALCs as ctx. The SALC coefficients are shared by reference count and the rest is copied, so the clone
+ * is independent of ctx, and several clones of a context can be made concurrently as long as ctx itself
+ * is not changed at the same time. A clone of a context with an arena gets an arena of its own and a copy
+ * of the SALC coefficients, since they are returned with the arena they were allocated from. Returns NULL on error */
+msym_context msymCloneContext(msym_context ctx){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_context clone = NULL;
+    if(ctx == NULL) {msymSetErrorDetails("Cannot clone a NULL context"); return NULL;}
+    clone = NULL == ctx->arena ? msymCreateContext() : msymCreateContextWithArena(ctx->arena_block);
+    if(NULL == clone) {ret = MSYM_MEMORY_ERROR; goto err;}
+    if(MSYM_SUCCESS != (ret = ctxCopy(ctx, clone))){
+        msymReleaseContext(clone);
+        goto err;
+    }
+    return clone;
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return NULL;
+}
+
+/* Writes a snapshot of ctx (settings, elements, basis functions, point group, subgroups, equivalence sets,
+ * permutations and SALCs) to buf, and its size to *size. With buf NULL only the size is returned.
+ * The snapshot contains no pointers, but is in native byte order and is rejected by msymLoadContext
+ * on machines with a different one. Element and basis function ids are not saved */
+msym_error_t msymSaveContext(msym_context ctx, size_t l, void *buf, size_t *size){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_context_stream_t s = {.buf = NULL, .data = NULL, .l = 0, .off = 0};
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    
+    ctxWriteContext(ctx, &s);
+    
+    if(NULL != buf){
+        if(l < s.off){
+            msymSetErrorDetails("Buffer of %lu bytes too small for context snapshot of %lu bytes",(unsigned long) l,(unsigned long) s.off);
+            ret = MSYM_INVALID_INPUT;
+            goto err;
+        }
+        s.buf = buf;
+        s.l = l;
+        s.off = 0;
+        ctxWriteContext(ctx, &s);
+    }
+    
+    if(NULL != size) *size = s.off;
+    
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* Replaces the contents of ctx with a snapshot from msymSaveContext without redoing any symmetry analysis,
+ * buf can be read only (e.g. a mapped file) and is not used after the call. Elements passed to
+ * msymSetElements before the snapshot was saved are no longer recognized, use msymGetElements */
+msym_error_t msymLoadContext(msym_context ctx, size_t l, const void *buf){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_context_stream_t s = {.buf = NULL, .data = buf, .l = l, .off = 0};
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
+    ctxSelectArena(ctx);
+    if(NULL == buf){
+        msymSetErrorDetails("No context snapshot");
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    
+    ctxDestroyElements(ctx);
+    ctxDestroyPointGroup(ctx);
+    
+    if(MSYM_SUCCESS != (ret = ctxReadContext(ctx, &s))) goto err;
+    
+    return ret;
+err:
+    ctxDestroyElements(ctx);
+    ctxDestroyPointGroup(ctx);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymReleaseContext(msym_context ctx){
     msym_error_t ret = MSYM_SUCCESS;
+    msym_arena_t *arena = NULL;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; return ret;}
-    free(ctx->thresholds);
+    ctxSelectArena(ctx);
+    arena = ctx->arena;
+    msymFree(ctx->thresholds);
     ctxDestroyElements(ctx);
     ctxDestroyPointGroup(ctx);
-    free(ctx);
+    msymFree(ctx);
+    arenaSelect(NULL);
+    arenaDestroy(arena);
 //err:
     return ret;
 }
@@ -429,6 +822,17 @@ msym_error_t msymReleaseContext(msym_context ctx){
  * Private API
  ***********************/
 
+/* Allocations on the calling thread use the arena of ctx until another context is used */
+void ctxSelectArena(msym_context ctx){
+    arenaSelect(NULL == ctx ? NULL : ctx->arena);
+}
+
+/* Keeps the details of the error on the calling thread with the context */
+void ctxSaveErrorDetails(msym_context ctx, msym_error_t ret){
+    if(ctx == NULL || MSYM_SUCCESS == ret) return;
+    msymCopyErrorDetails(sizeof(ctx->err_details), ctx->err_details);
+}
+
 
 msym_error_t ctxSetElements(msym_context ctx, int length, msym_element_t elements[length]){
     msym_error_t ret = MSYM_SUCCESS;
@@ -439,8 +843,8 @@ msym_error_t ctxSetElements(msym_context ctx, int length, msym_element_t element
     
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &thresholds))) goto err;
     
-    ctx->elements = malloc(sizeof(msym_element_t[length]));
-    ctx->pelements = malloc(sizeof(msym_element_t *[length]));
+    ctx->elements = msymMalloc(sizeof(msym_element_t[length]));
+    ctx->pelements = msymMalloc(sizeof(msym_element_t *[length]));
     memcpy(ctx->elements, elements, sizeof(msym_element_t[length]));
     ctx->elementsl = length;
     
@@ -459,7 +863,7 @@ msym_error_t ctxSetElements(msym_context ctx, int length, msym_element_t element
     
     if(MSYM_SUCCESS != (ret = findGeometry(length, ctx->pelements, zero, thresholds, &ctx->geometry, ctx->eigval, ctx->eigvec))) goto err;
     
-    ctx->ext.elements = malloc(sizeof(msym_element_t[length]));
+    ctx->ext.elements = msymMalloc(sizeof(msym_element_t[length]));
     memcpy(ctx->ext.elements, ctx->elements, sizeof(msym_element_t[length]));
     
     ctx->ext.set_elements_ptr = elements;
@@ -467,9 +871,9 @@ msym_error_t ctxSetElements(msym_context ctx, int length, msym_element_t element
     return ret;
 err:
     
-    free(ctx->elements);
-    free(ctx->pelements);
-    free(ctx->ext.elements);
+    msymFree(ctx->elements);
+    msymFree(ctx->pelements);
+    msymFree(ctx->ext.elements);
     ctx->ext.elements = NULL;
     ctx->elements = NULL;
     ctx->pelements = NULL;
@@ -642,10 +1046,18 @@ msym_error_t ctxSetEquivalenceSets(msym_context ctx, int esl, msym_equivalence_s
         }
     }
     
-    ctx->ext.eesmap = calloc(ctx->elementsl, sizeof(msym_equivalence_set_t *));
+    ctx->ext.eesmap = msymCalloc(ctx->elementsl, sizeof(msym_equivalence_set_t *));
+    ctx->ext.eesimap = msymCalloc(ctx->elementsl, sizeof(int));
+    if(NULL == ctx->ext.eesmap || NULL == ctx->ext.eesimap){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for element equivalence set map");
+        goto err;
+    }
     for(int i = 0;i < esl;i++){
         for(int j = 0;j < ctx->ext.es[i].length;j++){
-            ctx->ext.eesmap[ctx->ext.es[i].elements[j] - ctx->ext.elements] = &ctx->ext.es[i];
+            int ei = (int)(ctx->ext.es[i].elements[j] - ctx->ext.elements);
+            ctx->ext.eesmap[ei] = &ctx->ext.es[i];
+            ctx->ext.eesimap[ei] = j;
         }
     }
     for(int i = 0; i < ctx->elementsl;i++){
@@ -659,10 +1071,12 @@ msym_error_t ctxSetEquivalenceSets(msym_context ctx, int esl, msym_equivalence_s
     ctx->esl = esl;
     return ret;
 err:
-    free(ctx->ext.es);
-    free(ctx->ext.eesmap);
+    msymFree(ctx->ext.es);
+    msymFree(ctx->ext.eesmap);
+    msymFree(ctx->ext.eesimap);
     ctx->ext.es = NULL;
     ctx->ext.eesmap = NULL;
+    ctx->ext.eesimap = NULL;
     return ret;
 }
 
@@ -679,6 +1093,7 @@ err:
 msym_error_t msymGetEquivalenceSetByElement(msym_context ctx, msym_element_t *element, const msym_equivalence_set_t **es){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
+    ctxSelectArena(ctx);
     if(ctx->es == NULL) {ret = MSYM_INVALID_EQUIVALENCE_SET;goto err;}
     
     if(element >= ctx->ext.set_elements_ptr && element < ctx->ext.set_elements_ptr + ctx->elementsl){
@@ -690,12 +1105,14 @@ msym_error_t msymGetEquivalenceSetByElement(msym_context ctx, msym_element_t *el
     }
     
     msym_equivalence_set_t **eesmap = NULL;
+    int *eesimap = NULL;
     
-    if(MSYM_SUCCESS != (ret = ctxGetExternalElementEquivalenceSetMap(ctx, &eesmap))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxGetExternalElementEquivalenceSetMap(ctx, &eesmap, &eesimap))) goto err;
     
     *es = eesmap[element - ctx->ext.elements];
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
     
 }
@@ -712,11 +1129,12 @@ err:
     return ret;
 }
 
-msym_error_t ctxGetExternalElementEquivalenceSetMap(msym_context ctx, msym_equivalence_set_t ***eesmap){
+msym_error_t ctxGetExternalElementEquivalenceSetMap(msym_context ctx, msym_equivalence_set_t ***eesmap, int **eesimap){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
-    if(ctx->ext.eesmap == NULL) {ret = MSYM_INVALID_EQUIVALENCE_SET;goto err;}
+    if(ctx->ext.eesmap == NULL || ctx->ext.eesimap == NULL) {ret = MSYM_INVALID_EQUIVALENCE_SET;goto err;}
     *eesmap = ctx->ext.eesmap;
+    *eesimap = ctx->ext.eesimap;
 err:
     return ret;
 }
@@ -742,10 +1160,14 @@ err:
     return ret;
 }
 
+/* Subrepresentation spaces are generated lazily per irreducible representation, only succeeds if all have been generated */
 msym_error_t ctxGetSubrepresentationSpaces(msym_context ctx, int *srsl, msym_subrepresentation_space_t **srs, int **span){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
     if(ctx->srs == NULL) {ret = MSYM_INVALID_SUBSPACE; goto err;}
+    for(int k = 0;k < ctx->srsl;k++){
+        if(NULL == ctx->srs[k].salc && ctx->srs_span[k] > 0) {ret = MSYM_INVALID_SUBSPACE; goto err;}
+    }
     *srsl = ctx->srsl;
     *srs = ctx->srs;
     *span = ctx->srs_span;
@@ -753,6 +1175,36 @@ err:
     return ret;
 }
 
+msym_error_t ctxGetSubrepresentationSpace(msym_context ctx, int species, msym_subrepresentation_space_t **srs){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
+    if(ctx->srs == NULL || species < 0 || species >= ctx->srsl) {ret = MSYM_INVALID_SUBSPACE; goto err;}
+    if(NULL == ctx->srs[species].salc && ctx->srs_span[species] > 0) {ret = MSYM_INVALID_SUBSPACE; goto err;}
+    *srs = &ctx->srs[species];
+err:
+    return ret;
+}
+
+msym_error_t ctxGetPartialSubrepresentationSpaces(msym_context ctx, int *srsl, msym_subrepresentation_space_t **srs, msym_basis_function_t ***srsbf, int **span){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
+    *srsl = ctx->srsl;
+    *srs = ctx->srs;
+    *srsbf = ctx->srsbf;
+    *span = ctx->srs_span;
+err:
+    return ret;
+}
+
+msym_error_t ctxSetSubrepresentationSpacesMemory(msym_context ctx, size_t predicted, size_t peak){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
+    ctx->srs_predicted = predicted;
+    ctx->srs_peak = peak;
+err:
+    return ret;
+}
+
 msym_error_t ctxSetSubrepresentationSpaces(msym_context ctx, int srsl, msym_subrepresentation_space_t *srs, msym_basis_function_t **srsbf, int *span){
     msym_error_t ret = MSYM_SUCCESS;
     if(MSYM_SUCCESS != (ret = ctxDestroySubrepresentationSpaces(ctx))) goto err;
@@ -785,21 +1237,978 @@ err:
 }
 
 
+/* Creates the reference counts of the SALC coefficients generated in ctx, so clones can share them */
+msym_error_t ctxReferenceSubrepresentationSpaces(msym_context ctx){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
+    if(ctx->srs == NULL) goto err;
+    if(ctx->srs_refs == NULL && NULL == (ctx->srs_refs = msymCalloc(ctx->srsl, sizeof(*ctx->srs_refs)))){
+        msymSetErrorDetails("Could not allocate memory for SALC reference counts");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    for(int k = 0;k < ctx->srsl;k++){
+        long *r = NULL;
+        if(NULL == ctx->srs[k].salc || NULL != ctx->srs_refs[k]) continue;
+        if(NULL == (r = msymMalloc(sizeof(*r)))){
+            msymSetErrorDetails("Could not allocate memory for SALC reference count");
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        *r = 1;
+        ctx->srs_refs[k] = r;
+    }
+err:
+    return ret;
+}
+
+msym_error_t ctxCopy(msym_context ctx, msym_context clone){
+    msym_error_t ret = MSYM_SUCCESS;
+    
+    memcpy(clone->thresholds, ctx->thresholds, sizeof(msym_thresholds_t));
+    clone->flags = ctx->flags;
+    clone->threads = ctx->threads;
+    clone->precision = ctx->precision;
+    clone->memory_budget = ctx->memory_budget;
+    
+    if(MSYM_SUCCESS != (ret = ctxCopyElements(ctx, clone))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxCopyPointGroup(ctx, clone))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxCopyEquivalenceSets(ctx, clone))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxCopySubrepresentationSpaces(ctx, clone))) goto err;
+    
+err:
+    return ret;
+}
+
+/* Copies elements, geometry and basis functions, the basis functions refer to the elements of the clone */
+msym_error_t ctxCopyElements(msym_context ctx, msym_context clone){
+    msym_error_t ret = MSYM_SUCCESS;
+    int l = ctx->elementsl;
+    
+    vcopy(ctx->cm, clone->cm);
+    vcopy(ctx->eigval, clone->eigval);
+    mcopy(ctx->eigvec, clone->eigvec);
+    clone->geometry = ctx->geometry;
+    
+    if(NULL == ctx->elements) goto err;
+    
+    clone->elements = msymMalloc(sizeof(msym_element_t[l]));
+    clone->pelements = msymMalloc(sizeof(msym_element_t *[l]));
+    clone->ext.elements = msymMalloc(sizeof(msym_element_t[l]));
+    
+    if(NULL == clone->elements || NULL == clone->pelements || NULL == clone->ext.elements){
+        msymSetErrorDetails("Could not allocate memory for %d elements",l);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    memcpy(clone->elements, ctx->elements, sizeof(msym_element_t[l]));
+    memcpy(clone->ext.elements, ctx->ext.elements, sizeof(msym_element_t[l]));
+    for(int i = 0;i < l;i++){
+        clone->pelements[i] = ctx->pelements[i] - ctx->elements + clone->elements;
+    }
+    clone->elementsl = l;
+    clone->ext.set_elements_ptr = ctx->ext.set_elements_ptr;
+    
+    if(NULL == ctx->basis) goto err;
+    
+    if(NULL == (clone->basis = msymMalloc(sizeof(msym_basis_function_t[ctx->basisl])))){
+        msymSetErrorDetails("Could not allocate memory for %d basis functions",ctx->basisl);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    memcpy(clone->basis, ctx->basis, sizeof(msym_basis_function_t[ctx->basisl]));
+    for(int i = 0;i < ctx->basisl;i++){
+        clone->basis[i].element = ctx->basis[i].element - ctx->ext.elements + clone->ext.elements;
+    }
+    clone->basisl = ctx->basisl;
+    
+err:
+    return ret;
+}
+
+/* Copies the point group and subgroups, the character table is copied from the cache */
+msym_error_t ctxCopyPointGroup(msym_context ctx, msym_context clone){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t *spg = ctx->pg, *pg = NULL;
+    msym_subgroup_t *sg = NULL;
+    
+    if(NULL == spg) goto err;
+    
+    if(NULL == (pg = msymMalloc(sizeof(*pg)))){
+        msymSetErrorDetails("Could not allocate memory for point group");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    memcpy(pg, spg, sizeof(*pg));
+    pg->sops = NULL;
+    pg->perm = NULL;
+    pg->ct = NULL;
+    clone->pg = pg;
+    
+    if(NULL != spg->perm){
+        if(MSYM_SUCCESS != (ret = copyPointGroupOperations(spg->order, spg->sops, spg->perm, &pg->sops, &pg->perm))) goto err;
+    } else {
+        if(NULL == (pg->sops = msymMalloc(sizeof(msym_symmetry_operation_t[spg->order])))){
+            msymSetErrorDetails("Could not allocate memory for %d symmetry operations",spg->order);
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        memcpy(pg->sops, spg->sops, sizeof(msym_symmetry_operation_t[spg->order]));
+    }
+    
+    if(NULL != spg->primary) pg->primary = spg->primary - spg->sops + pg->sops;
+    
+    if(NULL != spg->ct){
+        if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
+    }
+    
+    if(NULL == ctx->sg) goto err;
+    
+    if(NULL == (sg = msymCalloc(ctx->sgl, sizeof(*sg)))){
+        msymSetErrorDetails("Could not allocate memory for %d subgroups",ctx->sgl);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    clone->sg = sg;
+    clone->sgl = ctx->sgl;
+    
+    for(int i = 0;i < ctx->sgl;i++){
+        msym_subgroup_t *ssg = &ctx->sg[i];
+        sg[i] = *ssg;
+        if(NULL == (sg[i].sops = msymMalloc(sizeof(msym_symmetry_operation_t *[ssg->order])))){
+            msymSetErrorDetails("Could not allocate memory for subgroup symmetry operations");
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        for(int j = 0;j < ssg->order;j++){
+            sg[i].sops[j] = ssg->sops[j] - spg->sops + pg->sops;
+        }
+        if(NULL != ssg->primary) sg[i].primary = ssg->primary - spg->sops + pg->sops;
+        for(int j = 0;j < 2;j++){
+            if(NULL != ssg->generators[j]) sg[i].generators[j] = ssg->generators[j] - ctx->sg + sg;
+        }
+    }
+    
+err:
+    return ret;
+}
+
+/* Copies equivalence sets, element maps and permutations, the sets refer to the elements of the clone */
+msym_error_t ctxCopyEquivalenceSets(msym_context ctx, msym_context clone){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_permutation_t **perm = NULL, *bperm = NULL;
+    int esl = ctx->esl, order = ctx->es_perml;
+    
+    if(NULL == ctx->es) goto err;
+    
+    if(MSYM_SUCCESS != (ret = copyEquivalenceSets(esl, ctx->es, &clone->es))) goto err;
+    clone->esl = esl;
+    for(int i = 0;i < esl;i++){
+        for(int j = 0;j < clone->es[i].length;j++){
+            clone->es[i].elements[j] = clone->es[i].elements[j] - ctx->elements + clone->elements;
+        }
+    }
+    
+    if(NULL != ctx->ext.es){
+        if(MSYM_SUCCESS != (ret = copyEquivalenceSets(esl, ctx->ext.es, &clone->ext.es))) goto err;
+        for(int i = 0;i < esl;i++){
+            for(int j = 0;j < clone->ext.es[i].length;j++){
+                clone->ext.es[i].elements[j] = clone->ext.es[i].elements[j] - ctx->ext.elements + clone->ext.elements;
+            }
+        }
+    }
+    
+    if(NULL != ctx->ext.eesmap && NULL != ctx->ext.eesimap){
+        clone->ext.eesmap = msymMalloc(sizeof(msym_equivalence_set_t *[ctx->elementsl]));
+        clone->ext.eesimap = msymMalloc(sizeof(int[ctx->elementsl]));
+        if(NULL == clone->ext.eesmap || NULL == clone->ext.eesimap){
+            ret = MSYM_MEMORY_ERROR;
+            msymSetErrorDetails("Could not allocate memory for element equivalence set map");
+            goto err;
+        }
+        for(int i = 0;i < ctx->elementsl;i++){
+            clone->ext.eesmap[i] = ctx->ext.eesmap[i] - ctx->ext.es + clone->ext.es;
+        }
+        memcpy(clone->ext.eesimap, ctx->ext.eesimap, sizeof(int[ctx->elementsl]));
+    }
+    
+    if(NULL == ctx->es_perm) goto err;
+    
+    if(NULL == (perm = msymCalloc(1, esl*sizeof(msym_permutation_t*) + esl*order*sizeof(msym_permutation_t)))){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for equivalence set permutations");
+        goto err;
+    }
+    
+    clone->es_perm = perm;
+    clone->es_perml = order;
+    bperm = (msym_permutation_t*)(perm + esl);
+    
+    for(int i = 0;i < esl;i++){
+        perm[i] = bperm + i*order;
+        for(int j = 0;j < order;j++){
+            msym_permutation_t *sp = &ctx->es_perm[i][j], *p = &perm[i][j];
+            p->p = msymMalloc(sizeof(int[sp->p_length]));
+            p->c = msymMalloc(sizeof(msym_permutation_cycle_t[sp->c_length]));
+            if(NULL == p->p || NULL == p->c){
+                ret = MSYM_MEMORY_ERROR;
+                msymSetErrorDetails("Could not allocate memory for permutation of length %d",sp->p_length);
+                goto err;
+            }
+            p->p_length = sp->p_length;
+            p->c_length = sp->c_length;
+            memcpy(p->p, sp->p, sizeof(int[sp->p_length]));
+            memcpy(p->c, sp->c, sizeof(msym_permutation_cycle_t[sp->c_length]));
+        }
+    }
+    
+err:
+    return ret;
+}
+
+/* SALCs refer to the basis functions of the clone, the coefficients are shared by reference count,
+ * and copied for any species generated without one */
+msym_error_t ctxCopySubrepresentationSpaces(msym_context ctx, msym_context clone){
+    msym_error_t ret = MSYM_SUCCESS;
+    int srsl = ctx->srsl, basisl = ctx->basisl;
+    
+    if(NULL == ctx->srs) goto err;
+    
+    clone->srs_refs = msymCalloc(srsl, sizeof(*clone->srs_refs));
+    clone->srsbf = msymMalloc(sizeof(msym_basis_function_t *[basisl]));
+    clone->srs_span = msymMalloc(sizeof(int[srsl]));
+    clone->srs = msymCalloc(srsl, sizeof(msym_subrepresentation_space_t));
+    
+    if(NULL == clone->srs_refs || NULL == clone->srsbf || NULL == clone->srs_span || NULL == clone->srs){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for subrepresentation spaces");
+        goto err;
+    }
+    
+    clone->srsl = srsl;
+    memcpy(clone->srs_span, ctx->srs_span, sizeof(int[srsl]));
+    for(int i = 0;i < basisl;i++){
+        clone->srsbf[i] = NULL == ctx->srsbf[i] ? NULL : ctx->srsbf[i] - ctx->basis + clone->basis;
+    }
+    
+    for(int k = 0;k < srsl;k++){
+        msym_subrepresentation_space_t *ssrs = &ctx->srs[k], *srs = &clone->srs[k];
+        msym_salc_t *salc = NULL;
+        srs->s = ssrs->s;
+        if(NULL == ssrs->salc) continue;
+        
+        if(NULL == (salc = msymMalloc(sizeof(msym_salc_t[ssrs->salcl])))){
+            ret = MSYM_MEMORY_ERROR;
+            msymSetErrorDetails("Could not allocate memory for %d SALCs",ssrs->salcl);
+            goto err;
+        }
+        
+        memcpy(salc, ssrs->salc, sizeof(msym_salc_t[ssrs->salcl]));
+        for(int j = 0;j < ssrs->salcl;j++){
+            salc[j].f = ssrs->salc[j].f - ctx->srsbf + clone->srsbf;
+        }
+        
+        if(NULL == ctx->arena && NULL != ctx->srs_refs && NULL != ctx->srs_refs[k]){
+            ctxReferenceAdd(ctx->srs_refs[k], 1);
+            clone->srs_refs[k] = ctx->srs_refs[k];
+        } else {
+            for(int j = 0;j < ssrs->salcl;j++){
+                int pfl = salc[j].d*salc[j].fl;
+                if(NULL == (salc[j].pf = msymMalloc(sizeof(double[pfl])))){
+                    for(int i = j+1;i < ssrs->salcl;i++) salc[i].pf = NULL;
+                    srs->salc = salc;
+                    srs->salcl = ssrs->salcl;
+                    ret = MSYM_MEMORY_ERROR;
+                    msymSetErrorDetails("Could not allocate memory for SALC");
+                    goto err;
+                }
+                memcpy(salc[j].pf, ssrs->salc[j].pf, sizeof(double[pfl]));
+            }
+        }
+        
+        srs->salc = salc;
+        srs->salcl = ssrs->salcl;
+    }
+    
+    clone->srs_predicted = ctx->srs_predicted;
+    clone->srs_peak = ctx->srs_peak;
+    
+err:
+    return ret;
+}
+
+/* Snapshots are a header followed by the context in a fixed order, every count is stored before the data it
+ * describes and pointers are stored as indices, so they can be read from any address (e.g. a mapped file) */
+void ctxWriteData(msym_context_stream_t *s, size_t size, const void *data){
+    if(NULL != s->buf && s->off + size <= s->l) memcpy(s->buf + s->off, data, size);
+    s->off += size;
+}
+
+void ctxWriteInt(msym_context_stream_t *s, int v){
+    int32_t i = v;
+    ctxWriteData(s, sizeof(i), &i);
+}
+
+void ctxWriteSize(msym_context_stream_t *s, size_t v){
+    uint64_t u = v;
+    ctxWriteData(s, sizeof(u), &u);
+}
+
+msym_error_t ctxReadData(msym_context_stream_t *s, size_t size, void *data){
+    msym_error_t ret = MSYM_SUCCESS;
+    if(size > s->l - s->off){
+        msymSetErrorDetails("Context snapshot truncated at %lu bytes",(unsigned long) s->l);
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    memcpy(data, s->data + s->off, size);
+    s->off += size;
+err:
+    return ret;
+}
+
+/* Reads an integer in [min, max], counts are limited by the remaining size to avoid allocating for corrupt data */
+msym_error_t ctxReadInt(msym_context_stream_t *s, int min, int max, int *v){
+    msym_error_t ret = MSYM_SUCCESS;
+    int32_t i = 0;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(i), &i))) goto err;
+    if(i < min || i > max){
+        msymSetErrorDetails("Invalid value %d in context snapshot at offset %lu, expected [%d, %d]",(int) i,(unsigned long) (s->off - sizeof(i)),min,max);
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    *v = i;
+err:
+    return ret;
+}
+
+msym_error_t ctxReadLength(msym_context_stream_t *s, int *l){
+    size_t r = s->l - s->off;
+    return ctxReadInt(s, 0, r > INT_MAX ? INT_MAX : (int) r, l);
+}
+
+msym_error_t ctxReadSize(msym_context_stream_t *s, size_t *v){
+    msym_error_t ret = MSYM_SUCCESS;
+    uint64_t u = 0;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(u), &u))) goto err;
+    *v = (size_t) u;
+err:
+    return ret;
+}
+
+void ctxWriteElement(msym_context_stream_t *s, msym_element_t *e){
+    ctxWriteData(s, sizeof(double), &e->m);
+    ctxWriteData(s, sizeof(double[3]), e->v);
+    ctxWriteInt(s, e->n);
+    ctxWriteData(s, sizeof(e->name), e->name);
+}
+
+msym_error_t ctxReadElement(msym_context_stream_t *s, msym_element_t *e){
+    msym_error_t ret = MSYM_SUCCESS;
+    memset(e, 0, sizeof(*e));
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(double), &e->m))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(double[3]), e->v))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 1, INT_MAX, &e->n))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(e->name), e->name))) goto err;
+    e->name[sizeof(e->name) - 1] = '\0';
+    /* complementElementData always sets the mass and name of elements in a context */
+    if(!(e->m > 0.0) || '\0' == e->name[0]){
+        msymSetErrorDetails("Element in context snapshot has no mass or name");
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+err:
+    return ret;
+}
+
+void ctxWritePermutation(msym_context_stream_t *s, msym_permutation_t *perm){
+    ctxWriteInt(s, perm->p_length);
+    for(int i = 0;i < perm->p_length;i++) ctxWriteInt(s, perm->p[i]);
+    ctxWriteInt(s, perm->c_length);
+    for(int i = 0;i < perm->c_length;i++){
+        ctxWriteInt(s, perm->c[i].l);
+        ctxWriteInt(s, perm->c[i].s);
+    }
+}
+
+msym_error_t ctxReadPermutation(msym_context_stream_t *s, msym_permutation_t *perm){
+    msym_error_t ret = MSYM_SUCCESS;
+    int pl = 0, cl = 0;
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &pl))) goto err;
+    if(pl > 0 && NULL == (perm->p = msymMalloc(sizeof(int[pl])))) {ret = MSYM_MEMORY_ERROR; goto err;}
+    perm->p_length = pl;
+    for(int i = 0;i < pl;i++){
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, pl - 1, &perm->p[i]))) goto err;
+    }
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &cl))) goto err;
+    if(cl > 0 && NULL == (perm->c = msymMalloc(sizeof(msym_permutation_cycle_t[cl])))) {ret = MSYM_MEMORY_ERROR; goto err;}
+    perm->c_length = cl;
+    for(int i = 0;i < cl;i++){
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, pl, &perm->c[i].l))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, pl - 1, &perm->c[i].s))) goto err;
+    }
+err:
+    if(MSYM_MEMORY_ERROR == ret) msymSetErrorDetails("Could not allocate memory for permutation of length %d",pl);
+    return ret;
+}
+
+/* The type, n and order of a point group or subgroup need to be those it is generated with,
+ * except for linear groups (n = 0) which are represented by a group of a multiple of that order */
+msym_error_t ctxCheckPointGroupType(msym_point_group_type_t type, int n, int order){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t pg = {.n = 0, .order = 0};
+    if(n > order || MSYM_SUCCESS != pointGroupFromType(type, n, &pg) || pg.n != n || pg.order <= 0 || (0 == n ? order % pg.order : order != pg.order)){
+        msymSetErrorDetails("Invalid point group type %d with n = %d and order %d in context snapshot",type,n,order);
+        ret = MSYM_INVALID_INPUT;
+    }
+    return ret;
+}
+
+void ctxWriteContext(msym_context ctx, msym_context_stream_t *s){
+    msym_thresholds_t *t = ctx->thresholds;
+    msym_point_group_t *pg = ctx->pg;
+    double thresholds[7] = {t->zero, t->geometry, t->angle, t->equivalence, t->eigfact, t->permutation, t->orthogonalization};
+    size_t start = s->off;
+    
+    ctxWriteData(s, sizeof(ctx_snapshot_magic), ctx_snapshot_magic);
+    ctxWriteInt(s, CTX_SNAPSHOT_VERSION);
+    ctxWriteInt(s, CTX_SNAPSHOT_BYTE_ORDER);
+    ctxWriteSize(s, 0); // size, filled in last
+    
+    ctxWriteData(s, sizeof(thresholds), thresholds);
+    ctxWriteInt(s, ctx->threads);
+    ctxWriteInt(s, ctx->precision);
+    ctxWriteSize(s, ctx->memory_budget);
+    ctxWriteData(s, sizeof(ctx->cm), ctx->cm);
+    ctxWriteInt(s, ctx->geometry);
+    ctxWriteData(s, sizeof(ctx->eigval), ctx->eigval);
+    ctxWriteData(s, sizeof(ctx->eigvec), ctx->eigvec);
+    
+    ctxWriteInt(s, NULL == ctx->elements ? 0 : ctx->elementsl);
+    for(int i = 0;NULL != ctx->elements && i < ctx->elementsl;i++) ctxWriteElement(s, &ctx->elements[i]);
+    for(int i = 0;NULL != ctx->elements && i < ctx->elementsl;i++) ctxWriteElement(s, &ctx->ext.elements[i]);
+    for(int i = 0;NULL != ctx->elements && i < ctx->elementsl;i++) ctxWriteInt(s, (int) (ctx->pelements[i] - ctx->elements));
+    
+    ctxWriteInt(s, NULL == ctx->basis ? 0 : ctx->basisl);
+    for(int i = 0;NULL != ctx->basis && i < ctx->basisl;i++){
+        msym_basis_function_t *bf = &ctx->basis[i];
+        ctxWriteInt(s, bf->type);
+        ctxWriteInt(s, (int) (bf->element - ctx->ext.elements));
+        ctxWriteInt(s, bf->f.rsh.n);
+        ctxWriteInt(s, bf->f.rsh.l);
+        ctxWriteInt(s, bf->f.rsh.m);
+        ctxWriteData(s, sizeof(bf->name), bf->name);
+    }
+    
+    ctxWriteInt(s, NULL != pg);
+    if(NULL != pg){
+        ctxWriteInt(s, pg->type);
+        ctxWriteInt(s, pg->n);
+        ctxWriteInt(s, pg->order);
+        ctxWriteInt(s, NULL == pg->primary ? -1 : (int) (pg->primary - pg->sops));
+        for(int i = 0;i < pg->order;i++){
+            msym_symmetry_operation_t *sop = &pg->sops[i];
+            ctxWriteInt(s, sop->type);
+            ctxWriteInt(s, sop->order);
+            ctxWriteInt(s, sop->power);
+            ctxWriteInt(s, sop->orientation);
+            ctxWriteData(s, sizeof(sop->v), sop->v);
+            ctxWriteInt(s, sop->cla);
+        }
+        ctxWriteInt(s, NULL != pg->perm);
+        for(int i = 0;NULL != pg->perm && i < pg->order;i++) ctxWritePermutation(s, &pg->perm[i]);
+        ctxWriteData(s, sizeof(pg->transform), pg->transform);
+        ctxWriteData(s, sizeof(pg->name), pg->name);
+        ctxWriteInt(s, NULL != pg->ct);
+        
+        ctxWriteInt(s, NULL != ctx->sg);
+        ctxWriteInt(s, NULL == ctx->sg ? 0 : ctx->sgl);
+        for(int i = 0;NULL != ctx->sg && i < ctx->sgl;i++){
+            msym_subgroup_t *sg = &ctx->sg[i];
+            ctxWriteInt(s, sg->type);
+            ctxWriteInt(s, sg->n);
+            ctxWriteInt(s, sg->order);
+            ctxWriteInt(s, NULL == sg->primary ? -1 : (int) (sg->primary - pg->sops));
+            for(int j = 0;j < sg->order;j++) ctxWriteInt(s, (int) (sg->sops[j] - pg->sops));
+            for(int j = 0;j < 2;j++) ctxWriteInt(s, NULL == sg->generators[j] ? -1 : (int) (sg->generators[j] - ctx->sg));
+            ctxWriteData(s, sizeof(sg->name), sg->name);
+        }
+    }
+    
+    ctxWriteInt(s, NULL == ctx->es ? 0 : ctx->esl);
+    if(NULL != ctx->es){
+        int el = 0;
+        for(int i = 0;i < ctx->esl;i++) el += ctx->es[i].length;
+        ctxWriteInt(s, el);
+        for(int i = 0;i < ctx->esl;i++){
+            ctxWriteInt(s, ctx->es[i].length);
+            ctxWriteData(s, sizeof(double), &ctx->es[i].err);
+            for(int j = 0;j < ctx->es[i].length;j++) ctxWriteInt(s, (int) (ctx->es[i].elements[j] - ctx->elements));
+        }
+        ctxWriteInt(s, NULL == ctx->es_perm ? 0 : ctx->es_perml);
+        for(int i = 0;NULL != ctx->es_perm && i < ctx->esl;i++){
+            for(int j = 0;j < ctx->es_perml;j++) ctxWritePermutation(s, &ctx->es_perm[i][j]);
+        }
+    }
+    
+    ctxWriteInt(s, NULL == ctx->srs ? 0 : ctx->srsl);
+    if(NULL != ctx->srs){
+        for(int k = 0;k < ctx->srsl;k++) ctxWriteInt(s, ctx->srs_span[k]);
+        for(int i = 0;i < ctx->basisl;i++) ctxWriteInt(s, NULL == ctx->srsbf[i] ? -1 : (int) (ctx->srsbf[i] - ctx->basis));
+        for(int k = 0;k < ctx->srsl;k++){
+            msym_subrepresentation_space_t *srs = &ctx->srs[k];
+            ctxWriteInt(s, srs->s);
+            ctxWriteInt(s, NULL == srs->salc ? 0 : srs->salcl);
+            for(int j = 0;NULL != srs->salc && j < srs->salcl;j++){
+                msym_salc_t *salc = &srs->salc[j];
+                ctxWriteInt(s, salc->d);
+                ctxWriteInt(s, salc->fl);
+                ctxWriteInt(s, (int) (salc->f - ctx->srsbf));
+                ctxWriteData(s, sizeof(double[salc->d*salc->fl]), salc->pf);
+            }
+        }
+        ctxWriteSize(s, ctx->srs_predicted);
+        ctxWriteSize(s, ctx->srs_peak);
+    }
+    
+    if(NULL != s->buf){
+        uint64_t size = s->off - start;
+        memcpy(s->buf + start + sizeof(ctx_snapshot_magic) + 2*sizeof(int32_t), &size, sizeof(size));
+    }
+}
+
+msym_error_t ctxReadContext(msym_context ctx, msym_context_stream_t *s){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_thresholds_t t;
+    double thresholds[7];
+    char magic[sizeof(ctx_snapshot_magic)];
+    int version = 0, order = 0, l = 0, precision = 0, geometry = 0;
+    size_t size = 0;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(magic), magic))) goto err;
+    if(0 != memcmp(magic, ctx_snapshot_magic, sizeof(magic))){
+        msymSetErrorDetails("Not a context snapshot");
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, INT_MIN, INT_MAX, &version))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, INT_MIN, INT_MAX, &order))) goto err;
+    if(version != CTX_SNAPSHOT_VERSION || order != CTX_SNAPSHOT_BYTE_ORDER){
+        msymSetErrorDetails("Unsupported context snapshot version %d (byte order %x), expected version %d (byte order %x)",version,order,CTX_SNAPSHOT_VERSION,CTX_SNAPSHOT_BYTE_ORDER);
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    if(MSYM_SUCCESS != (ret = ctxReadSize(s, &size))) goto err;
+    if(size > s->l){
+        msymSetErrorDetails("Context snapshot of %lu bytes truncated at %lu bytes",(unsigned long) size,(unsigned long) s->l);
+        ret = MSYM_INVALID_INPUT;
+        goto err;
+    }
+    s->l = size;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(thresholds), thresholds))) goto err;
+    t.zero = thresholds[0];
+    t.geometry = thresholds[1];
+    t.angle = thresholds[2];
+    t.equivalence = thresholds[3];
+    t.eigfact = thresholds[4];
+    t.permutation = thresholds[5];
+    t.orthogonalization = thresholds[6];
+    if(MSYM_SUCCESS != (ret = msymSetThresholds(ctx, &t))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, INT_MAX, &ctx->threads))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, MSYM_PRECISION_DOUBLE, MSYM_PRECISION_SINGLE, &precision))) goto err;
+    ctx->precision = precision;
+    if(MSYM_SUCCESS != (ret = ctxReadSize(s, &ctx->memory_budget))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(ctx->cm), ctx->cm))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, MSYM_GEOMETRY_UNKNOWN, MSYM_GEOMETRY_ASSYMETRIC, &geometry))) goto err;
+    ctx->geometry = geometry;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(ctx->eigval), ctx->eigval))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(ctx->eigvec), ctx->eigvec))) goto err;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &l))) goto err;
+    if(l > 0){
+        ctx->elements = msymMalloc(sizeof(msym_element_t[l]));
+        ctx->pelements = msymMalloc(sizeof(msym_element_t *[l]));
+        ctx->ext.elements = msymMalloc(sizeof(msym_element_t[l]));
+        if(NULL == ctx->elements || NULL == ctx->pelements || NULL == ctx->ext.elements){
+            msymSetErrorDetails("Could not allocate memory for %d elements",l);
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        ctx->elementsl = l;
+        for(int i = 0;i < l;i++){
+            if(MSYM_SUCCESS != (ret = ctxReadElement(s, &ctx->elements[i]))) goto err;
+        }
+        for(int i = 0;i < l;i++){
+            if(MSYM_SUCCESS != (ret = ctxReadElement(s, &ctx->ext.elements[i]))) goto err;
+        }
+        for(int i = 0;i < l;i++){
+            int e = 0;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, l - 1, &e))) goto err;
+            ctx->pelements[i] = &ctx->elements[e];
+        }
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &l))) goto err;
+    if(l > 0){
+        if(NULL == (ctx->basis = msymCalloc(l, sizeof(msym_basis_function_t)))){
+            msymSetErrorDetails("Could not allocate memory for %d basis functions",l);
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        ctx->basisl = l;
+        for(int i = 0;i < l;i++){
+            msym_basis_function_t *bf = &ctx->basis[i];
+            int type = 0, e = 0, n = 0, bl = 0, bm = 0;
+            char name[sizeof(bf->name)];
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC, MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC, &type))) goto err;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, ctx->elementsl - 1, &e))) goto err;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 1, INT_MAX, &n))) goto err;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, n, &bl))) goto err;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, -bl, bl, &bm))) goto err;
+            if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(name), name))) goto err;
+            name[sizeof(name) - 1] = '\0';
+            bf->type = type;
+            bf->element = &ctx->ext.elements[e];
+            /* same rules as msymSetBasisFunctions, which also names the function from its quantum numbers */
+            if(MSYM_SUCCESS != (ret = basisFunctionFromQuantumNumbers(n, bl, bm, bf))) goto err;
+            if(0 != strncmp(name, bf->name, sizeof(name))){
+                msymSetErrorDetails("Basis function %d in context snapshot is named %s but has the quantum numbers of %s",i,name,bf->name);
+                ret = MSYM_INVALID_INPUT;
+                goto err;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxReadPointGroup(ctx, s))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadEquivalenceSets(ctx, s))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadSubrepresentationSpaces(ctx, s))) goto err;
+    
+err:
+    return ret;
+}
+
+msym_error_t ctxReadPointGroup(msym_context ctx, msym_context_stream_t *s){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t *pg = NULL;
+    msym_subgroup_t *sg = NULL;
+    int present = 0, type = 0, primary = 0, ct = 0, sgl = 0;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, 1, &present))) goto err;
+    if(!present) goto err;
+    
+    if(NULL == (pg = msymCalloc(1, sizeof(*pg)))){
+        msymSetErrorDetails("Could not allocate memory for point group");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, MSYM_POINT_GROUP_TYPE_Kh, MSYM_POINT_GROUP_TYPE_Ih, &type))) goto err;
+    pg->type = type;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, INT_MAX, &pg->n))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &pg->order))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxCheckPointGroupType(pg->type, pg->n, pg->order))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, -1, pg->order - 1, &primary))) goto err;
+    
+    if(NULL == (pg->sops = msymCalloc(pg->order, sizeof(msym_symmetry_operation_t)))){
+        msymSetErrorDetails("Could not allocate memory for %d symmetry operations",pg->order);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    pg->primary = primary < 0 ? NULL : &pg->sops[primary];
+    
+    for(int i = 0;i < pg->order;i++){
+        msym_symmetry_operation_t *sop = &pg->sops[i];
+        int stype = 0, orientation = 0, rotation = 0, pmax = 1;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, MSYM_SYMMETRY_OPERATION_TYPE_IDENTITY, MSYM_SYMMETRY_OPERATION_TYPE_INVERSION, &stype))) goto err;
+        /* rotations are at most of the order of the group (0 for the infinite axis of linear groups),
+         * and improper ones of odd order have powers up to twice it, the other operations have order 0, 1 or 2 */
+        rotation = MSYM_SYMMETRY_OPERATION_TYPE_PROPER_ROTATION == stype || MSYM_SYMMETRY_OPERATION_TYPE_IMPROPER_ROTATION == stype;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, rotation ? pg->order : 2, &sop->order))) goto err;
+        if(MSYM_SYMMETRY_OPERATION_TYPE_PROPER_ROTATION == stype && sop->order > 0) pmax = sop->order - 1;
+        else if(MSYM_SYMMETRY_OPERATION_TYPE_IMPROPER_ROTATION == stype) pmax = 2*sop->order - 1;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, pmax, &sop->power))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, MSYM_SYMMETRY_OPERATION_ORIENTATION_NONE, MSYM_SYMMETRY_OPERATION_ORIENTATION_DIHEDRAL, &orientation))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(sop->v), sop->v))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, pg->order - 1, &sop->cla))) goto err;
+        sop->type = stype;
+        sop->orientation = orientation;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, 1, &present))) goto err;
+    if(present){
+        if(NULL == (pg->perm = msymCalloc(pg->order, sizeof(msym_permutation_t)))){
+            msymSetErrorDetails("Could not allocate memory for %d permutations",pg->order);
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        for(int i = 0;i < pg->order;i++){
+            if(MSYM_SUCCESS != (ret = ctxReadPermutation(s, &pg->perm[i]))) goto err;
+            if(pg->perm[i].p_length != pg->order){
+                msymSetErrorDetails("Permutation of symmetry operation %d in context snapshot has length %d, expected %d",i,pg->perm[i].p_length,pg->order);
+                ret = MSYM_INVALID_INPUT;
+                goto err;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(pg->transform), pg->transform))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(pg->name), pg->name))) goto err;
+    pg->name[sizeof(pg->name) - 1] = '\0';
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, 1, &ct))) goto err;
+    if(ct && pg->order > 0){
+        if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxSetPointGroup(ctx, pg))) goto err;
+    pg = NULL;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, 1, &present))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &sgl))) goto err;
+    if(!present) goto err;
+    
+    if(NULL == (sg = msymCalloc(sgl, sizeof(*sg)))){
+        msymSetErrorDetails("Could not allocate memory for %d subgroups",sgl);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxSetSubgroups(ctx, sgl, sg))) goto err;
+    
+    for(int i = 0;i < sgl;i++){
+        msym_point_group_t *cpg = ctx->pg;
+        int g = 0;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, MSYM_POINT_GROUP_TYPE_Kh, MSYM_POINT_GROUP_TYPE_Ih, &type))) goto err;
+        sg[i].type = type;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, INT_MAX, &sg[i].n))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 1, cpg->order, &sg[i].order))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxCheckPointGroupType(sg[i].type, sg[i].n, sg[i].order))) goto err;
+        if(cpg->order % sg[i].order != 0){
+            msymSetErrorDetails("Subgroup %d in context snapshot has order %d which does not divide the order of the point group (%d)",i,sg[i].order,cpg->order);
+            ret = MSYM_INVALID_INPUT;
+            goto err;
+        }
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, -1, cpg->order - 1, &primary))) goto err;
+        sg[i].primary = primary < 0 ? NULL : &cpg->sops[primary];
+        if(NULL == (sg[i].sops = msymMalloc(sizeof(msym_symmetry_operation_t *[sg[i].order])))){
+            msymSetErrorDetails("Could not allocate memory for subgroup symmetry operations");
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        for(int j = 0;j < sg[i].order;j++){
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, cpg->order - 1, &g))) goto err;
+            sg[i].sops[j] = &cpg->sops[g];
+        }
+        for(int j = 0;j < 2;j++){
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, -1, sgl - 1, &g))) goto err;
+            sg[i].generators[j] = g < 0 ? NULL : &sg[g];
+        }
+        if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(sg[i].name), sg[i].name))) goto err;
+        sg[i].name[sizeof(sg[i].name) - 1] = '\0';
+    }
+    
+err:
+    freePointGroup(pg);
+    return ret;
+}
+
+msym_error_t ctxReadEquivalenceSets(msym_context ctx, msym_context_stream_t *s){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_equivalence_set_t *es = NULL;
+    msym_permutation_t **perm = NULL, *bperm = NULL;
+    int esl = 0, el = 0, order = 0, e = 0;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &esl))) goto err;
+    if(0 == esl) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, ctx->elementsl, &el))) goto err;
+    
+    if(NULL == (es = msymMalloc(sizeof(msym_equivalence_set_t[esl]) + sizeof(msym_element_t *[el])))){
+        msymSetErrorDetails("Could not allocate memory for %d equivalence sets",esl);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    msym_element_t **ep = (msym_element_t **) &es[esl];
+    for(int i = 0;i < esl;i++){
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, el, &es[i].length))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(double), &es[i].err))) goto err;
+        es[i].elements = ep;
+        el -= es[i].length;
+        if(el < 0){
+            msymSetErrorDetails("Equivalence sets in context snapshot contain more elements than stored");
+            ret = MSYM_INVALID_INPUT;
+            goto err;
+        }
+        for(int j = 0;j < es[i].length;j++){
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, ctx->elementsl - 1, &e))) goto err;
+            *ep++ = &ctx->elements[e];
+        }
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxSetEquivalenceSets(ctx, esl, es))) goto err;
+    es = NULL;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &order))) goto err;
+    if(0 == order) goto err;
+    
+    if(NULL == (perm = msymCalloc(1, esl*sizeof(msym_permutation_t*) + esl*order*sizeof(msym_permutation_t)))){
+        msymSetErrorDetails("Could not allocate memory for equivalence set permutations");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    bperm = (msym_permutation_t*)(perm + esl);
+    for(int i = 0;i < esl;i++){
+        perm[i] = bperm + i*order;
+        for(int j = 0;j < order;j++){
+            if(MSYM_SUCCESS != (ret = ctxReadPermutation(s, &perm[i][j]))) goto err;
+            if(perm[i][j].p_length != ctx->es[i].length){
+                msymSetErrorDetails("Permutation of equivalence set %d in context snapshot has length %d, expected %d",i,perm[i][j].p_length,ctx->es[i].length);
+                ret = MSYM_INVALID_INPUT;
+                goto err;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxSetEquivalenceSetPermutations(ctx, esl, order, perm))) goto err;
+    perm = NULL;
+    
+err:
+    if(NULL != perm){
+        for(int i = 0;i < esl*order;i++) freePermutationData(&bperm[i]);
+        msymFree(perm);
+    }
+    msymFree(es);
+    return ret;
+}
+
+msym_error_t ctxReadSubrepresentationSpaces(msym_context ctx, msym_context_stream_t *s){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_subrepresentation_space_t *srs = NULL;
+    msym_basis_function_t **srsbf = NULL;
+    int *span = NULL, *seen = NULL;
+    int srsl = 0, basisl = ctx->basisl, b = 0;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadLength(s, &srsl))) goto err;
+    if(0 == srsl) goto err;
+    
+    if(NULL == ctx->pg || NULL == ctx->pg->ct || srsl != ctx->pg->ct->d){
+        msymSetErrorDetails("Subrepresentation spaces in context snapshot do not match character table");
+        ret = MSYM_INVALID_SUBSPACE;
+        goto err;
+    }
+    
+    if(NULL == ctx->ext.eesmap){
+        msymSetErrorDetails("Subrepresentation spaces in context snapshot without equivalence sets");
+        ret = MSYM_INVALID_SUBSPACE;
+        goto err;
+    }
+    
+    srs = msymCalloc(srsl, sizeof(msym_subrepresentation_space_t));
+    srsbf = msymCalloc(basisl, sizeof(msym_basis_function_t *));
+    span = msymCalloc(srsl, sizeof(int));
+    seen = msymCalloc(basisl, sizeof(int));
+    
+    if(NULL == srs || NULL == srsbf || NULL == span || NULL == seen){
+        msymSetErrorDetails("Could not allocate memory for subrepresentation spaces");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    for(int k = 0;k < srsl;k++){
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, basisl, &span[k]))) goto err;
+    }
+    
+    /* the basis functions ordered by equivalence set and shell, each one exactly once */
+    for(int i = 0;i < basisl;i++){
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, basisl - 1, &b))) goto err;
+        if(seen[b]++){
+            msymSetErrorDetails("Basis function %d occurs more than once in subrepresentation spaces of context snapshot",b);
+            ret = MSYM_INVALID_SUBSPACE;
+            goto err;
+        }
+        srsbf[i] = &ctx->basis[b];
+    }
+    
+    for(int k = 0;k < srsl;k++){
+        int salcl = 0;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, k, k, &srs[k].s))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, basisl, &salcl))) goto err;
+        if(0 == salcl) continue;
+        if(NULL == (srs[k].salc = msymCalloc(salcl, sizeof(msym_salc_t)))){
+            msymSetErrorDetails("Could not allocate memory for %d SALCs",salcl);
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        srs[k].salcl = salcl;
+        for(int j = 0;j < salcl;j++){
+            msym_salc_t *salc = &srs[k].salc[j];
+            int f = 0;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 1, ctx->pg->ct->s[srs[k].s].d, &salc->d))) goto err;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 1, basisl, &salc->fl))) goto err;
+            if(MSYM_SUCCESS != (ret = ctxReadInt(s, 0, basisl - salc->fl, &f))) goto err;
+            salc->f = &srsbf[f];
+            /* a SALC is made of all functions of one shell (n, l) on an equivalence set */
+            msym_basis_function_t *bf = salc->f[0];
+            msym_equivalence_set_t *e = ctx->ext.eesmap[bf->element - ctx->ext.elements];
+            int valid = (size_t) salc->fl == (size_t) e->length*(2*(size_t) bf->f.rsh.l + 1);
+            for(int i = 1;valid && i < salc->fl;i++){
+                msym_basis_function_t *fi = salc->f[i];
+                valid = e == ctx->ext.eesmap[fi->element - ctx->ext.elements] && bf->f.rsh.n == fi->f.rsh.n && bf->f.rsh.l == fi->f.rsh.l;
+            }
+            if(!valid){
+                msymSetErrorDetails("SALC %d of subrepresentation space %d in context snapshot does not span one shell of an equivalence set",j,k);
+                ret = MSYM_INVALID_SUBSPACE;
+                goto err;
+            }
+            if(NULL == (salc->pf = msymMalloc(sizeof(double[salc->d*salc->fl])))){
+                msymSetErrorDetails("Could not allocate memory for SALC");
+                ret = MSYM_MEMORY_ERROR;
+                goto err;
+            }
+            if(MSYM_SUCCESS != (ret = ctxReadData(s, sizeof(double[salc->d*salc->fl]), salc->pf))) goto err;
+        }
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxSetSubrepresentationSpaces(ctx, srsl, srs, srsbf, span))) goto err;
+    srs = NULL;
+    srsbf = NULL;
+    span = NULL;
+    
+    if(MSYM_SUCCESS != (ret = ctxReadSize(s, &ctx->srs_predicted))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReadSize(s, &ctx->srs_peak))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReferenceSubrepresentationSpaces(ctx))) goto err;
+    
+err:
+    freeSubrepresentationSpaces(srsl, srs);
+    msymFree(srsbf);
+    msymFree(span);
+    msymFree(seen);
+    return ret;
+}
+
 msym_error_t ctxDestroyElements(msym_context ctx){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
     ctxDestroyEquivalcenceSets(ctx);
     ctxDestroySubrepresentationSpaces(ctx);
     ctxDestroyBasisFunctions(ctx);
-    free(ctx->elements);
-    free(ctx->pelements);
-    free(ctx->ext.eesmap);
-    free(ctx->ext.elements);
+    msymFree(ctx->elements);
+    msymFree(ctx->pelements);
+    msymFree(ctx->ext.eesmap);
+    msymFree(ctx->ext.eesimap);
+    msymFree(ctx->ext.elements);
     
     ctx->ext.set_elements_ptr = NULL;
     ctx->elements = NULL;
     ctx->pelements = NULL;
     ctx->ext.eesmap = NULL;
+    ctx->ext.eesimap = NULL;
     ctx->ext.elements = NULL;
     ctx->elementsl = 0;
     ctx->geometry = MSYM_GEOMETRY_UNKNOWN;
@@ -814,10 +2223,12 @@ msym_error_t ctxDestroyEquivalcenceSets(msym_context ctx){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
     ctxDestroyEquivalcenceSetPermutations(ctx);
-    free(ctx->ext.eesmap);
-    free(ctx->es);
-    free(ctx->ext.es);
+    msymFree(ctx->ext.eesmap);
+    msymFree(ctx->ext.eesimap);
+    msymFree(ctx->es);
+    msymFree(ctx->ext.es);
     ctx->ext.eesmap = NULL;
+    ctx->ext.eesimap = NULL;
     ctx->ext.es = NULL;
     ctx->es = NULL;
     ctx->esl = 0;
@@ -833,7 +2244,7 @@ msym_error_t ctxDestroyEquivalcenceSetPermutations(msym_context ctx){
             freePermutationData(&ctx->es_perm[i][j]);
         }
     }
-    free(ctx->es_perm);
+    msymFree(ctx->es_perm);
     ctx->es_perm = NULL;
     ctx->es_perml = 0;
 err:
@@ -846,15 +2257,7 @@ msym_error_t ctxDestroyPointGroup(msym_context ctx){
     if(ctx->pg == NULL) goto err;
     ctxDestroyEquivalcenceSets(ctx);
     ctxDestroySubgroups(ctx);
-    for(int i = 0;i < ctx->pg->order && ctx->pg->perm != NULL;i++){
-        freePermutationData(&ctx->pg->perm[i]);
-    }
-   
-    free(ctx->pg->perm);
-    free(ctx->pg->ct);
-    free(ctx->pg->sops);
-    free(ctx->pg);
-    
+    freePointGroup(ctx->pg);
     ctx->pg = NULL;
 err:
     return ret;
@@ -863,9 +2266,9 @@ err:
 msym_error_t ctxDestroySubgroups(msym_context ctx){
     msym_error_t ret = MSYM_SUCCESS;
     for(int i = 0;i < ctx->sgl;i++){
-        free(ctx->sg[i].sops);
+        msymFree(ctx->sg[i].sops);
     }
-    free(ctx->sg);
+    msymFree(ctx->sg);
     ctx->sg = NULL;
     ctx->sgl = 0;
 //err:
@@ -876,7 +2279,7 @@ msym_error_t ctxDestroyBasisFunctions(msym_context ctx){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
     ctxDestroySubrepresentationSpaces(ctx);
-    free(ctx->basis);
+    msymFree(ctx->basis);
     ctx->basis = NULL;
     ctx->basisl = 0;
 err:
@@ -886,13 +2289,22 @@ err:
 msym_error_t ctxDestroySubrepresentationSpaces(msym_context ctx){
     msym_error_t ret = MSYM_SUCCESS;
     if(ctx == NULL) {ret = MSYM_INVALID_CONTEXT; goto err;}
+    for(int k = 0;k < ctx->srsl && NULL != ctx->srs && NULL != ctx->srs_refs;k++){
+        if(NULL == ctx->srs_refs[k]) continue;
+        if(0 == ctxReferenceAdd(ctx->srs_refs[k], -1)) msymFree((long *) ctx->srs_refs[k]);
+        else for(int j = 0;j < ctx->srs[k].salcl;j++) ctx->srs[k].salc[j].pf = NULL; // still used by another context
+    }
     freeSubrepresentationSpaces(ctx->srsl, ctx->srs);
-    free(ctx->srsbf);
-    free(ctx->srs_span);
+    msymFree(ctx->srs_refs);
+    msymFree(ctx->srsbf);
+    msymFree(ctx->srs_span);
     ctx->srs = NULL;
+    ctx->srs_refs = NULL;
     ctx->srsbf = NULL;
     ctx->srs_span = NULL;
     ctx->srsl = 0;
+    ctx->srs_predicted = 0;
+    ctx->srs_peak = 0;
 err:
     return ret;
 }
@@ -25,6 +25,8 @@
 #define DEFAULT_ORTHOGONALIZATION_THRESHOLD 1.0e-2
 
 
+void ctxSelectArena(msym_context ctx);
+void ctxSaveErrorDetails(msym_context ctx, msym_error_t ret);
 msym_error_t ctxGetThresholds(msym_context ctx, msym_thresholds_t **thresholds);
 msym_error_t ctxSetElements(msym_context ctx, int length, msym_element_t *elements);
 msym_error_t ctxGetElements(msym_context, int *l, msym_element_t **elements);
@@ -41,11 +43,15 @@ msym_error_t ctxGetSubgroups(msym_context ctx, int *sgl, msym_subgroup_t **sg);
 msym_error_t ctxSetEquivalenceSets(msym_context ctx, int esl, msym_equivalence_set_t *es);
 msym_error_t ctxGetEquivalenceSets(msym_context ctx, int *esl, msym_equivalence_set_t **es);
 msym_error_t ctxGetExternalEquivalenceSets(msym_context ctx, int *esl, msym_equivalence_set_t **es);
-msym_error_t ctxGetExternalElementEquivalenceSetMap(msym_context ctx, msym_equivalence_set_t ***eesmap);
+msym_error_t ctxGetExternalElementEquivalenceSetMap(msym_context ctx, msym_equivalence_set_t ***eesmap, int **eesimap);
 msym_error_t ctxSetEquivalenceSetPermutations(msym_context ctx, int r, int c, msym_permutation_t **perm);
 msym_error_t ctxGetEquivalenceSetPermutations(msym_context ctx, int *r, int *c, msym_permutation_t ***perm);
 msym_error_t ctxGetBasisFunctions(msym_context ctx, int *l, msym_basis_function_t **basis);
 msym_error_t ctxGetSubrepresentationSpaces(msym_context ctx, int *srsl, msym_subrepresentation_space_t **srs, int **span);
+msym_error_t ctxGetSubrepresentationSpace(msym_context ctx, int species, msym_subrepresentation_space_t **srs);
+msym_error_t ctxGetPartialSubrepresentationSpaces(msym_context ctx, int *srsl, msym_subrepresentation_space_t **srs, msym_basis_function_t ***srsbf, int **span);
+msym_error_t ctxSetSubrepresentationSpacesMemory(msym_context ctx, size_t predicted, size_t peak);
+msym_error_t ctxReferenceSubrepresentationSpaces(msym_context ctx);
 msym_error_t ctxSetSubrepresentationSpaces(msym_context ctx, int srsl, msym_subrepresentation_space_t *srs, msym_basis_function_t **srsbf, int *span);
 msym_error_t ctxUpdateGeometry(msym_context ctx);
 msym_error_t ctxGetGeometry(msym_context ctx, msym_geometry_t *g, double eigval[3], double eigvec[3][3]);
@@ -0,0 +1,278 @@
+//
+//  dense.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdlib.h>
+
+#include "dense.h"
+#include "allocator.h"
+
+#ifdef MSYM_USE_BLAS
+
+void dgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k, const double *alpha, const double *a, const int *lda, const double *b, const int *ldb, const double *beta, double *c, const int *ldc);
+double ddot_(const int *n, const double *x, const int *incx, const double *y, const int *incy);
+void daxpy_(const int *n, const double *a, const double *x, const int *incx, double *y, const int *incy);
+void sgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k, const float *alpha, const float *a, const int *lda, const float *b, const int *ldb, const float *beta, float *c, const int *ldc);
+void saxpy_(const int *n, const float *a, const float *x, const int *incx, float *y, const int *incy);
+
+/* Row major C = A*op(B) is column major C^T = op(B)^T*A^T */
+void denseGemm(int transb, int m, int n, int k, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc){
+    double one = 1.0;
+    if(m <= 0 || n <= 0) return;
+    dgemm_(transb ? "T" : "N", "N", &n, &m, &k, &one, B, &ldb, A, &lda, &beta, C, &ldc);
+}
+
+double denseDot(int n, const double *x, const double *y){
+    int inc = 1;
+    return ddot_(&n, x, &inc, y, &inc);
+}
+
+void denseAxpy(int n, double a, const double *x, double *y){
+    int inc = 1;
+    daxpy_(&n, &a, x, &inc, y, &inc);
+}
+
+void denseGemmf(int transb, int m, int n, int k, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc){
+    float one = 1.0f;
+    if(m <= 0 || n <= 0) return;
+    sgemm_(transb ? "T" : "N", "N", &n, &m, &k, &one, B, &ldb, A, &lda, &beta, C, &ldc);
+}
+
+/* sdot returns float differently depending on the fortran compiler */
+float denseDotf(int n, const float *x, const float *y){
+    float p[8] = {0}, d = 0;
+    int i = 0;
+    for(;i + 8 <= n;i += 8){
+        for(int j = 0;j < 8;j++) p[j] += x[i+j]*y[i+j];
+    }
+    for(;i < n;i++) d += x[i]*y[i];
+    for(int j = 0;j < 8;j++) d += p[j];
+    return d;
+}
+
+void denseAxpyf(int n, float a, const float *x, float *y){
+    int inc = 1;
+    saxpy_(&n, &a, x, &inc, y, &inc);
+}
+
+#else
+
+#define DENSE_MR 8
+#define DENSE_NR 4
+#define DENSE_KC 256
+#define DENSE_NC 256
+#define DENSE_SMALL 32768
+#define DENSE_NRF 8     // twice as many single precision elements in a vector register
+
+void denseGemmNaive(int transb, int m, int n, int k, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc);
+void densePackB(int transb, int kc, int nc, const double *B, int ldb, double *Bp);
+void denseMicroKernel(int mr, int nr, int kc, int first, double beta, const double *A, int lda, const double *Bp, double *C, int ldc);
+void denseGemmNaivef(int transb, int m, int n, int k, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+void densePackBf(int transb, int kc, int nc, const float *B, int ldb, float *Bp);
+void denseMicroKernelf(int mr, int nr, int kc, int first, float beta, const float *A, int lda, const float *Bp, float *C, int ldc);
+
+void denseGemmNaive(int transb, int m, int n, int k, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc){
+    for(int r = 0;r < m;r++){
+        for(int c = 0;c < n;c++){
+            double s = beta == 0.0 ? 0.0 : beta*C[r*ldc + c];
+            if(transb){
+                for(int i = 0;i < k;i++) s += A[r*lda + i]*B[c*ldb + i];
+            } else {
+                for(int i = 0;i < k;i++) s += A[r*lda + i]*B[i*ldb + c];
+            }
+            C[r*ldc + c] = s;
+        }
+    }
+}
+
+/* Pack a kc x nc block of op(B) into panels of DENSE_NR columns, padded with zeros */
+void densePackB(int transb, int kc, int nc, const double *B, int ldb, double *Bp){
+    for(int j = 0;j < nc;j += DENSE_NR){
+        int nr = nc - j < DENSE_NR ? nc - j : DENSE_NR;
+        for(int i = 0;i < kc;i++, Bp += DENSE_NR){
+            int c = 0;
+            if(transb){
+                for(;c < nr;c++) Bp[c] = B[(j + c)*ldb + i];
+            } else {
+                for(;c < nr;c++) Bp[c] = B[i*ldb + j + c];
+            }
+            for(;c < DENSE_NR;c++) Bp[c] = 0.0;
+        }
+    }
+}
+
+/* Accumulates over k in order into a register tile, so each element of C is summed in the
+ * same order as the naive loops, the fixed DENSE_NR inner loop is left for the compiler to vectorize */
+void denseMicroKernel(int mr, int nr, int kc, int first, double beta, const double *A, int lda, const double *Bp, double *C, int ldc){
+    double acc[DENSE_MR][DENSE_NR];
+
+    for(int r = 0;r < mr;r++){
+        for(int c = 0;c < nr;c++){
+            if(!first) acc[r][c] = C[r*ldc + c];
+            else acc[r][c] = beta == 0.0 ? 0.0 : beta*C[r*ldc + c];
+        }
+        for(int c = nr;c < DENSE_NR;c++) acc[r][c] = 0.0;
+    }
+
+    if(mr == DENSE_MR){
+        for(int i = 0;i < kc;i++, Bp += DENSE_NR){
+            for(int r = 0;r < DENSE_MR;r++){
+                double a = A[r*lda + i];
+                for(int c = 0;c < DENSE_NR;c++) acc[r][c] += a*Bp[c];
+            }
+        }
+    } else {
+        for(int i = 0;i < kc;i++, Bp += DENSE_NR){
+            for(int r = 0;r < mr;r++){
+                double a = A[r*lda + i];
+                for(int c = 0;c < DENSE_NR;c++) acc[r][c] += a*Bp[c];
+            }
+        }
+    }
+
+    for(int r = 0;r < mr;r++){
+        for(int c = 0;c < nr;c++) C[r*ldc + c] = acc[r][c];
+    }
+}
+
+void denseGemm(int transb, int m, int n, int k, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc){
+    double *Bp = NULL;
+    int kb = k < DENSE_KC ? k : DENSE_KC, nb = n < DENSE_NC ? (n + DENSE_NR - 1)/DENSE_NR*DENSE_NR : DENSE_NC;
+
+    if(m <= 0 || n <= 0) return;
+
+    if(k <= 0 || (double) m*n*k < DENSE_SMALL || NULL == (Bp = msymMalloc(sizeof(double[kb][nb])))){
+        denseGemmNaive(transb, m, n, k, A, lda, B, ldb, beta, C, ldc);
+        return;
+    }
+
+    for(int jc = 0;jc < n;jc += DENSE_NC){
+        int nc = n - jc < DENSE_NC ? n - jc : DENSE_NC;
+        for(int pc = 0;pc < k;pc += DENSE_KC){
+            int kc = k - pc < DENSE_KC ? k - pc : DENSE_KC;
+            const double *Bb = transb ? &B[jc*ldb + pc] : &B[pc*ldb + jc];
+            densePackB(transb, kc, nc, Bb, ldb, Bp);
+            for(int ir = 0;ir < m;ir += DENSE_MR){
+                int mr = m - ir < DENSE_MR ? m - ir : DENSE_MR;
+                for(int jr = 0;jr < nc;jr += DENSE_NR){
+                    int nr = nc - jr < DENSE_NR ? nc - jr : DENSE_NR;
+                    denseMicroKernel(mr, nr, kc, pc == 0, beta, &A[ir*lda + pc], lda, &Bp[jr*kc], &C[ir*ldc + jc + jr], ldc);
+                }
+            }
+        }
+    }
+
+    msymFree(Bp);
+}
+
+double denseDot(int n, const double *x, const double *y){
+    double d = 0;
+    for(int i = 0; i < n; i++) d += x[i]*y[i];
+    return d;
+}
+
+void denseAxpy(int n, double a, const double *x, double *y){
+    for(int i = 0; i < n; i++) y[i] += a*x[i];
+}
+
+void denseGemmNaivef(int transb, int m, int n, int k, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc){
+    for(int r = 0;r < m;r++){
+        for(int c = 0;c < n;c++){
+            float s = beta == 0.0f ? 0.0f : beta*C[r*ldc + c];
+            if(transb){
+                for(int i = 0;i < k;i++) s += A[r*lda + i]*B[c*ldb + i];
+            } else {
+                for(int i = 0;i < k;i++) s += A[r*lda + i]*B[i*ldb + c];
+            }
+            C[r*ldc + c] = s;
+        }
+    }
+}
+
+void densePackBf(int transb, int kc, int nc, const float *B, int ldb, float *Bp){
+    for(int j = 0;j < nc;j += DENSE_NRF){
+        int nr = nc - j < DENSE_NRF ? nc - j : DENSE_NRF;
+        for(int i = 0;i < kc;i++, Bp += DENSE_NRF){
+            int c = 0;
+            if(transb){
+                for(;c < nr;c++) Bp[c] = B[(j + c)*ldb + i];
+            } else {
+                for(;c < nr;c++) Bp[c] = B[i*ldb + j + c];
+            }
+            for(;c < DENSE_NRF;c++) Bp[c] = 0.0f;
+        }
+    }
+}
+
+void denseMicroKernelf(int mr, int nr, int kc, int first, float beta, const float *A, int lda, const float *Bp, float *C, int ldc){
+    float acc[DENSE_MR][DENSE_NRF];
+
+    for(int r = 0;r < mr;r++){
+        for(int c = 0;c < nr;c++){
+            if(!first) acc[r][c] = C[r*ldc + c];
+            else acc[r][c] = beta == 0.0f ? 0.0f : beta*C[r*ldc + c];
+        }
+        for(int c = nr;c < DENSE_NRF;c++) acc[r][c] = 0.0f;
+    }
+
+    for(int i = 0;i < kc;i++, Bp += DENSE_NRF){
+        for(int r = 0;r < mr;r++){
+            float a = A[r*lda + i];
+            for(int c = 0;c < DENSE_NRF;c++) acc[r][c] += a*Bp[c];
+        }
+    }
+
+    for(int r = 0;r < mr;r++){
+        for(int c = 0;c < nr;c++) C[r*ldc + c] = acc[r][c];
+    }
+}
+
+void denseGemmf(int transb, int m, int n, int k, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc){
+    float *Bp = NULL;
+    int kb = k < DENSE_KC ? k : DENSE_KC, nb = n < DENSE_NC ? (n + DENSE_NRF - 1)/DENSE_NRF*DENSE_NRF : DENSE_NC;
+
+    if(m <= 0 || n <= 0) return;
+
+    if(k <= 0 || (double) m*n*k < DENSE_SMALL || NULL == (Bp = msymMalloc(sizeof(float[kb][nb])))){
+        denseGemmNaivef(transb, m, n, k, A, lda, B, ldb, beta, C, ldc);
+        return;
+    }
+
+    for(int jc = 0;jc < n;jc += DENSE_NC){
+        int nc = n - jc < DENSE_NC ? n - jc : DENSE_NC;
+        for(int pc = 0;pc < k;pc += DENSE_KC){
+            int kc = k - pc < DENSE_KC ? k - pc : DENSE_KC;
+            const float *Bb = transb ? &B[jc*ldb + pc] : &B[pc*ldb + jc];
+            densePackBf(transb, kc, nc, Bb, ldb, Bp);
+            for(int ir = 0;ir < m;ir += DENSE_MR){
+                int mr = m - ir < DENSE_MR ? m - ir : DENSE_MR;
+                for(int jr = 0;jr < nc;jr += DENSE_NRF){
+                    int nr = nc - jr < DENSE_NRF ? nc - jr : DENSE_NRF;
+                    denseMicroKernelf(mr, nr, kc, pc == 0, beta, &A[ir*lda + pc], lda, &Bp[jr*kc], &C[ir*ldc + jc + jr], ldc);
+                }
+            }
+        }
+    }
+
+    msymFree(Bp);
+}
+
+float denseDotf(int n, const float *x, const float *y){
+    float p[8] = {0}, d = 0;
+    int i = 0;
+    for(;i + 8 <= n;i += 8){
+        for(int j = 0;j < 8;j++) p[j] += x[i+j]*y[i+j];
+    }
+    for(;i < n;i++) d += x[i]*y[i];
+    for(int j = 0;j < 8;j++) d += p[j];
+    return d;
+}
+
+void denseAxpyf(int n, float a, const float *x, float *y){
+    for(int i = 0; i < n; i++) y[i] += a*x[i];
+}
+
+#endif
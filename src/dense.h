@@ -0,0 +1,27 @@
+//
+//  dense.h
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#ifndef __MSYM__DENSE_h
+#define __MSYM__DENSE_h
+
+/* Dense kernels used by linalg for large matrices, row major with leading dimensions.
+ * Built with MSYM_USE_BLAS these call the system BLAS, otherwise a cache blocked implementation
+ * that sums each element in the same order as the naive loops */
+
+#define DENSE_NOTRANS 0
+#define DENSE_TRANS 1
+
+void denseGemm(int transb, int m, int n, int k, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc);
+double denseDot(int n, const double *x, const double *y);
+void denseAxpy(int n, double a, const double *x, double *y);
+
+/* Single precision versions, sums are accumulated in single precision */
+void denseGemmf(int transb, int m, int n, int k, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+float denseDotf(int n, const float *x, const float *y);
+void denseAxpyf(int n, float a, const float *x, float *y);
+
+#endif /* defined(__MSYM__DENSE_h) */
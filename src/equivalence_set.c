@@ -17,12 +17,14 @@
 #include "context.h"
 #include "elements.h"
 
+#include "allocator.h"
 #include "debug.h"
 
 #define SQR(x) ((x)*(x))
 
 msym_error_t partitionEquivalenceSets(int length, msym_element_t *elements[length], msym_element_t *pelements[length], msym_geometry_t g, int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds);
 msym_error_t partitionPointGroupEquivalenceSets(msym_point_group_t *pg, int length, msym_element_t *elements[length], msym_element_t *pelements[length], int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds);
+msym_error_t partitionEquivalenceSetInvariants(msym_equivalence_set_invariants_t *inv, int length, msym_element_t *elements[length], msym_element_t *pelements[length], int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds);
 
 
 
@@ -31,7 +33,7 @@ msym_error_t copyEquivalenceSets(int length, msym_equivalence_set_t es[length],
     int el = 0;
     
     for(int i = 0;i < length;i++) el += es[i].length;
-    msym_equivalence_set_t *nes = malloc(sizeof(msym_equivalence_set_t[length]) + sizeof(msym_element_t *[el]));
+    msym_equivalence_set_t *nes = msymMalloc(sizeof(msym_equivalence_set_t[length]) + sizeof(msym_element_t *[el]));
     msym_element_t **ep = (msym_element_t **) &es[length];
     msym_element_t **nep = (msym_element_t **) &nes[length];
     memcpy(nes, es, sizeof(msym_equivalence_set_t[length]) + sizeof(msym_element_t *[el]));
@@ -44,8 +46,8 @@ msym_error_t copyEquivalenceSets(int length, msym_equivalence_set_t es[length],
 //TODO: Use a preallocated pointer array instead of multiple mallocs
 msym_error_t generateEquivalenceSet(msym_point_group_t *pg, int length, msym_element_t elements[length], double cm[3], int *glength, msym_element_t **gelements, int *esl, msym_equivalence_set_t **es,msym_thresholds_t *thresholds){
     msym_error_t ret = MSYM_SUCCESS;
-    msym_element_t *ge = calloc(length,sizeof(msym_element_t[pg->order]));
-    msym_equivalence_set_t *ges = calloc(length,sizeof(msym_equivalence_set_t));
+    msym_element_t *ge = msymCalloc(length,sizeof(msym_element_t[pg->order]));
+    msym_equivalence_set_t *ges = msymCalloc(length,sizeof(msym_equivalence_set_t));
     int gel = 0;
     int gesl = 0;
     
@@ -67,7 +69,7 @@ msym_error_t generateEquivalenceSet(msym_point_group_t *pg, int length, msym_ele
         }
         if(f == gel){
             aes = &ges[gesl++];
-            aes->elements = calloc(pg->order,sizeof(msym_element_t*));
+            aes->elements = msymCalloc(pg->order,sizeof(msym_element_t*));
             aes->length = 0;
         } else {
             continue;
@@ -96,12 +98,12 @@ msym_error_t generateEquivalenceSet(msym_point_group_t *pg, int length, msym_ele
             goto err;
         }
         
-        aes->elements = realloc(aes->elements,sizeof(msym_element_t*[aes->length]));
+        aes->elements = msymRealloc(aes->elements,sizeof(msym_element_t*[aes->length]));
     }
     
     msym_element_t *geo = ge;
-    ge = realloc(ge,sizeof(msym_element_t[gel]));
-    ges = realloc(ges,sizeof(msym_equivalence_set_t[gesl]) + sizeof(msym_element_t *[gel]));
+    ge = msymRealloc(ge,sizeof(msym_element_t[gel]));
+    ges = msymRealloc(ges,sizeof(msym_equivalence_set_t[gesl]) + sizeof(msym_element_t *[gel]));
     
     msym_element_t **ep = (msym_element_t **) &ges[gesl];
     for(int i = 0;i < gesl;i++){
@@ -110,7 +112,7 @@ msym_error_t generateEquivalenceSet(msym_point_group_t *pg, int length, msym_ele
             *ep = ges[i].elements[j] - geo + ge;
             ep++;
         }
-        free(ges[i].elements);
+        msymFree(ges[i].elements);
         ges[i].elements = tep;
     }
 
@@ -121,9 +123,9 @@ msym_error_t generateEquivalenceSet(msym_point_group_t *pg, int length, msym_ele
     return ret;
     
 err:
-    free(ge);
-    for(int i = 0; i < gesl;i++) free(ges[i].elements);
-    free(ges);
+    msymFree(ge);
+    for(int i = 0; i < gesl;i++) msymFree(ges[i].elements);
+    msymFree(ges);
     return ret;
 }
 
@@ -132,20 +134,20 @@ msym_error_t splitPointGroupEquivalenceSets(msym_point_group_t *pg, int esl, msy
     int length = 0, gesl = 0;
     for(int i = 0;i < esl;i++) length += es[i].length;
     msym_equivalence_set_t *ges = NULL;
-    msym_element_t **pelements = calloc(length,sizeof(msym_element_t*));
+    msym_element_t **pelements = msymCalloc(length,sizeof(msym_element_t*));
     msym_element_t **ep = (msym_element_t **) &es[esl];
     
     for(int i = 0; i < esl;i++){
         msym_equivalence_set_t *pes = NULL;
         int pesl = 0;
         if(MSYM_SUCCESS != (ret = partitionPointGroupEquivalenceSets(pg, es[i].length, es[i].elements, es[i].elements - ep + pelements, &pesl, &pes, thresholds))) goto err;
-        ges = realloc(ges, sizeof(msym_equivalence_set_t[gesl+pesl]));
+        ges = msymRealloc(ges, sizeof(msym_equivalence_set_t[gesl+pesl]));
         memcpy(&ges[gesl], pes, sizeof(msym_equivalence_set_t[pesl]));
-        free(pes);
+        msymFree(pes);
         gesl += pesl;
     }
     
-    ges = realloc(ges, sizeof(msym_equivalence_set_t[gesl]) + sizeof(msym_element_t *[length]));
+    ges = msymRealloc(ges, sizeof(msym_equivalence_set_t[gesl]) + sizeof(msym_element_t *[length]));
     ep = (msym_element_t **) &ges[gesl];
     memcpy(ep, pelements, sizeof(msym_element_t *[length]));
     
@@ -157,22 +159,22 @@ msym_error_t splitPointGroupEquivalenceSets(msym_point_group_t *pg, int esl, msy
     *sesl = gesl;
     *ses = ges;
     
-    free(pelements);
+    msymFree(pelements);
     return ret;
 err:
-    free(ges);
-    free(pelements);
+    msymFree(ges);
+    msymFree(pelements);
     return ret;
 }
 
 msym_error_t findPointGroupEquivalenceSets(msym_point_group_t *pg, int length, msym_element_t *elements[length], int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds){
     msym_error_t ret = MSYM_SUCCESS;
     msym_equivalence_set_t *ges = NULL;
-    msym_element_t **pelements = calloc(length,sizeof(msym_element_t*));
+    msym_element_t **pelements = msymCalloc(length,sizeof(msym_element_t*));
     int gesl = 0;
     if(MSYM_SUCCESS != (ret = partitionPointGroupEquivalenceSets(pg, length, elements, pelements, &gesl, &ges, thresholds))) goto err;
     
-    ges = realloc(ges,sizeof(msym_equivalence_set_t[gesl]) + sizeof(msym_element_t *[length]));
+    ges = msymRealloc(ges,sizeof(msym_equivalence_set_t[gesl]) + sizeof(msym_element_t *[length]));
     msym_element_t **ep = (msym_element_t **) &ges[gesl];
     msym_element_t **epo = ep;
     memcpy(ep, pelements, sizeof(msym_element_t *[length]));
@@ -189,19 +191,19 @@ msym_error_t findPointGroupEquivalenceSets(msym_point_group_t *pg, int length, m
     *es = ges;
     *esl = gesl;
     
-    free(pelements);
+    msymFree(pelements);
     return ret;
 err:
-    free(ges);
-    free(pelements);
+    msymFree(ges);
+    msymFree(pelements);
     return ret;
 
 }
 
 msym_error_t partitionPointGroupEquivalenceSets(msym_point_group_t *pg, int length, msym_element_t *elements[length], msym_element_t *pelements[length], int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds){
     msym_error_t ret = MSYM_SUCCESS;
-    msym_equivalence_set_t *ges = calloc(length,sizeof(msym_equivalence_set_t));
-    int *eqi = malloc(sizeof(int[length]));
+    msym_equivalence_set_t *ges = msymCalloc(length,sizeof(msym_equivalence_set_t));
+    int *eqi = msymMalloc(sizeof(int[length]));
     memset(eqi,-1,sizeof(int[length]));
     int gesl = 0, pelementsl = 0;
     for(int i = 0;i < length;i++){
@@ -257,22 +259,34 @@ msym_error_t partitionPointGroupEquivalenceSets(msym_point_group_t *pg, int leng
     *es = ges;
     *esl = gesl;
     
-    free(eqi);
+    msymFree(eqi);
     return ret;
 err:
-    free(eqi);
-    free(ges);
+    msymFree(eqi);
+    msymFree(ges);
     return ret;
 
 }
 
 msym_error_t findEquivalenceSets(int length, msym_element_t *elements[length], msym_geometry_t g, int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds) {
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_equivalence_set_invariants_t inv = {.length = 0, .e = NULL};
+    
+    if(MSYM_SUCCESS != (ret = findEquivalenceSetInvariants(length, elements, g, &inv))) goto err;
+    if(MSYM_SUCCESS != (ret = findEquivalenceSetsFromInvariants(&inv, length, elements, g, esl, es, thresholds))) goto err;
+    
+err:
+    freeEquivalenceSetInvariants(&inv);
+    return ret;
+}
+
+msym_error_t findEquivalenceSetsFromInvariants(msym_equivalence_set_invariants_t *inv, int length, msym_element_t *elements[length], msym_geometry_t g, int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds) {
     msym_error_t ret = MSYM_SUCCESS;
     int sesl = 0;
     msym_equivalence_set_t *ses = NULL;
-    msym_element_t **pelements = calloc(length,sizeof(msym_element_t *));
+    msym_element_t **pelements = msymCalloc(length,sizeof(msym_element_t *));
     
-    if(MSYM_SUCCESS != (ret = partitionEquivalenceSets(length, elements,pelements,g,&sesl,&ses,thresholds))) goto err;
+    if(MSYM_SUCCESS != (ret = partitionEquivalenceSetInvariants(inv, length, elements,pelements,&sesl,&ses,thresholds))) goto err;
     
     if(sesl > 1){
         for(int i = 0; i < sesl;i++){
@@ -283,16 +297,16 @@ msym_error_t findEquivalenceSets(int length, msym_element_t *elements[length], m
             if(rsesl > 1){
                 ses[i].elements = rses[0].elements;
                 ses[i].length = rses[0].length;
-                ses = realloc(ses, sizeof(msym_equivalence_set_t[sesl+rsesl-1]));
+                ses = msymRealloc(ses, sizeof(msym_equivalence_set_t[sesl+rsesl-1]));
                 memcpy(&ses[sesl], &rses[1], sizeof(msym_equivalence_set_t[rsesl-1]));
                 sesl += rsesl-1;
                 i--;
             }
-            free(rses);
+            msymFree(rses);
         }
     }
 
-    ses = realloc(ses, sizeof(msym_equivalence_set_t[sesl]) + sizeof(msym_element_t *[length]));
+    ses = msymRealloc(ses, sizeof(msym_equivalence_set_t[sesl]) + sizeof(msym_element_t *[length]));
     msym_element_t **ep = (msym_element_t **) &ses[sesl];
     
     for(int i = 0;i < sesl;i++){
@@ -303,30 +317,40 @@ msym_error_t findEquivalenceSets(int length, msym_element_t *elements[length], m
     
     *esl = sesl;
     *es = ses;
-    free(pelements);
+    msymFree(pelements);
     return ret;
 err:
-    free(pelements);
-    free(ses);
+    msymFree(pelements);
+    msymFree(ses);
     return ret;
     
 }
 
 
 msym_error_t partitionEquivalenceSets(int length, msym_element_t *elements[length], msym_element_t *pelements[length], msym_geometry_t g, int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds) {
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_equivalence_set_invariants_t inv = {.length = 0, .e = NULL};
     
-    int ns = 0, gd = geometryDegenerate(g);
-    double *e = calloc(length,sizeof(double));
-    double *s = calloc(length,sizeof(double));
+    if(MSYM_SUCCESS != (ret = findEquivalenceSetInvariants(length, elements, g, &inv))) goto err;
+    if(MSYM_SUCCESS != (ret = partitionEquivalenceSetInvariants(&inv, length, elements, pelements, esl, es, thresholds))) goto err;
     
-    int *sp = calloc(length,sizeof(int)); //set partition
-    int *ss  = calloc(length,sizeof(int)); //set size
+err:
+    freeEquivalenceSetInvariants(&inv);
+    return ret;
+}
+
+/* The invariants only depend on the geometry (degenerate or not) and the element positions,
+ * so they can be shared between partitions with different thresholds */
+msym_error_t findEquivalenceSetInvariants(int length, msym_element_t *elements[length], msym_geometry_t g, msym_equivalence_set_invariants_t *inv) {
+    int gd = geometryDegenerate(g);
+    double *e = msymCalloc(length,sizeof(double[4]));
+    double *s = e + length, *evabs = s + length, *epabs = evabs + length;
     
-    double (*ev)[3] = calloc(length,sizeof(double[3]));
-    double (*ep)[3] = calloc(length,sizeof(double[3]));
+    double (*ev)[3] = msymCalloc(length,sizeof(double[3]));
+    double (*ep)[3] = msymCalloc(length,sizeof(double[3]));
     
-    double (*vec)[3] = calloc(length, sizeof(double[3]));
-    double *m = calloc(length, sizeof(double));
+    double (*vec)[3] = msymCalloc(length, sizeof(double[3]));
+    double *m = msymCalloc(length, sizeof(double));
     
     for(int i = 0;i < length;i++){
         vcopy(elements[i]->v, vec[i]);
@@ -386,28 +410,65 @@ msym_error_t partitionEquivalenceSets(int length, msym_element_t *elements[lengt
         
         e[i] += dii;
         s[i] += SQR(dii);
+        evabs[i] = vabs(ev[i]);
+        epabs[i] = vabs(ep[i]);
     }
+    
+    msymFree(m);
+    msymFree(vec);
+    msymFree(ev);
+    msymFree(ep);
+    
+    inv->length = length;
+    inv->e = e;
+    inv->s = s;
+    inv->ev = evabs;
+    inv->ep = epabs;
+    
+    return MSYM_SUCCESS;
+}
+
+void freeEquivalenceSetInvariants(msym_equivalence_set_invariants_t *inv){
+    msymFree(inv->e);
+    memset(inv, 0, sizeof(*inv));
+}
+
+msym_error_t partitionEquivalenceSetInvariants(msym_equivalence_set_invariants_t *inv, int length, msym_element_t *elements[length], msym_element_t *pelements[length], int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds) {
+    msym_error_t ret = MSYM_SUCCESS;
+    int ns = 0;
+    double *e = inv->e, *s = inv->s, *ev = inv->ev, *ep = inv->ep;
+    int *sp = NULL, *ss = NULL;
+    double *serr = NULL;
+    
+    if(inv->length != length){
+        msymSetErrorDetails("Number of equivalence set invariants (%d) does not match number of elements (%d)",inv->length,length);
+        ret = MSYM_INVALID_EQUIVALENCE_SET;
+        goto err;
+    }
+    
+    sp = msymMalloc(sizeof(int[length])); //set partition
+    ss = msymCalloc(length,sizeof(int)); //set size
+    serr = msymCalloc(length,sizeof(double)); //error when adding element to set
+    
+    for(int i = 0; i < length; i++) sp[i] = -1;
+    
     for(int i = 0; i < length; i++){
-        if(e[i] >= 0.0){
-            sp[i] = i;
-            for(int j = i+1; j < length;j++){
-                if(e[j] >= 0.0){
-                    double vabsevi = vabs(ev[i]), vabsevj = vabs(ev[j]), vabsepi = vabs(ep[i]), vabsepj = vabs(ep[j]);
-                    double eep = 0.0, eev = fabs((vabsevi)-(vabsevj))/((vabsevi)+(vabsevj)), ee = fabs((e[i])-(e[j]))/((e[i])+(e[j])), es = fabs((s[i])-(s[j]))/((s[i])+(s[j]));
-                    
-                    if(!(vabsepi < thresholds->zero && vabsepj < thresholds->zero)){
-                        eep = fabs((vabsepi)-(vabsepj))/((vabsepi)+(vabsepj));
-                    }
-                    
-                    double max = fmax(eev,fmax(eep,fmax(ee, es)));
-                    
-                    if(max < thresholds->equivalence && elements[i]->n == elements[j]->n){
-                        e[j] = max > 0.0 ? -max : -1.0;
-                        sp[j] = i;
-                    }
-                }
+        if(sp[i] >= 0) continue;
+        sp[i] = i;
+        for(int j = i+1; j < length;j++){
+            if(sp[j] >= 0) continue;
+            double eep = 0.0, eev = fabs(ev[i]-ev[j])/(ev[i]+ev[j]), ee = fabs(e[i]-e[j])/(e[i]+e[j]), es = fabs(s[i]-s[j])/(s[i]+s[j]);
+            
+            if(!(ep[i] < thresholds->zero && ep[j] < thresholds->zero)){
+                eep = fabs(ep[i]-ep[j])/(ep[i]+ep[j]);
+            }
+            
+            double max = fmax(eev,fmax(eep,fmax(ee, es)));
+            
+            if(max < thresholds->equivalence && elements[i]->n == elements[j]->n){
+                serr[j] = max;
+                sp[j] = i;
             }
-            e[i] = -1.0;
         }
     }
     
@@ -417,12 +478,12 @@ msym_error_t partitionEquivalenceSets(int length, msym_element_t *elements[lengt
         ss[j]++;
     }
 
-    msym_equivalence_set_t *eqs = calloc(ns,sizeof(msym_equivalence_set_t));
+    msym_equivalence_set_t *eqs = msymCalloc(ns,sizeof(msym_equivalence_set_t));
     msym_element_t **lelements = elements;
     msym_element_t **pe = pelements;
     
     if(elements == pelements){
-        lelements = malloc(sizeof(msym_element_t *[length]));
+        lelements = msymMalloc(sizeof(msym_element_t *[length]));
         memcpy(lelements, elements, sizeof(msym_element_t *[length]));
     }
     
@@ -433,8 +494,7 @@ msym_error_t partitionEquivalenceSets(int length, msym_element_t *elements[lengt
             eqs[ni].length = ss[i];
             for(int j = 0; j < length;j++){
                 if(sp[j] == i){
-                    double err = (e[j] > -1.0) ? fabs(e[j]) : 0.0;
-                    eqs[ni].err = fmax(eqs[ni].err,err);
+                    eqs[ni].err = fmax(eqs[ni].err,serr[j]);
                     eqs[ni].elements[ei++] = lelements[j];
                 }
             }
@@ -444,17 +504,13 @@ msym_error_t partitionEquivalenceSets(int length, msym_element_t *elements[lengt
     }
 
     if(elements == pelements){
-        free(lelements);
+        msymFree(lelements);
     }
-    free(m);
-    free(vec);
-    free(s);
-    free(e);
-    free(sp);
-    free(ss);
-    free(ev);
-    free(ep);
     *es = eqs;
     *esl = ns;
-    return MSYM_SUCCESS;
+err:
+    msymFree(sp);
+    msymFree(ss);
+    msymFree(serr);
+    return ret;
 }
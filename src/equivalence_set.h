@@ -15,8 +15,19 @@
 #include "msym.h"
 #include "point_group.h"
 
+typedef struct _msym_equivalence_set_invariants {
+    int length;
+    double *e;      // Sum of weighted distances
+    double *s;      // Sum of squared weighted distances
+    double *ev;     // Length of weighted distance vector sum
+    double *ep;     // Length of weighted plane projection sum
+} msym_equivalence_set_invariants_t;
+
 msym_error_t copyEquivalenceSets(int length, msym_equivalence_set_t es[length], msym_equivalence_set_t **ces);
 msym_error_t findEquivalenceSets(int length, msym_element_t *elements[length], msym_geometry_t g, int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds);
+msym_error_t findEquivalenceSetInvariants(int length, msym_element_t *elements[length], msym_geometry_t g, msym_equivalence_set_invariants_t *inv);
+msym_error_t findEquivalenceSetsFromInvariants(msym_equivalence_set_invariants_t *inv, int length, msym_element_t *elements[length], msym_geometry_t g, int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds);
+void freeEquivalenceSetInvariants(msym_equivalence_set_invariants_t *inv);
 msym_error_t findPointGroupEquivalenceSets(msym_point_group_t *pg, int length, msym_element_t *elements[length], int *esl, msym_equivalence_set_t **es, msym_thresholds_t *thresholds);
 msym_error_t splitPointGroupEquivalenceSets(msym_point_group_t *pg, int esl, msym_equivalence_set_t es[esl], int *sesl, msym_equivalence_set_t **ses, msym_thresholds_t *thresholds);
 msym_error_t generateEquivalenceSet(msym_point_group_t *pg, int length, msym_element_t elements[length], double cm[3], int *glength, msym_element_t **gelements, int *esl, msym_equivalence_set_t **es,msym_thresholds_t *thresholds);
@@ -20,7 +20,6 @@
 #define SQR(x) ((x)*(x))
 
 void inertialTensor(int length, msym_element_t *elements[length], double cm[3], double e[3], double v[3][3], msym_thresholds_t *thresholds);
-msym_geometry_t eigenvaluesToGeometry(double e[3], msym_thresholds_t *thresholds);
 
 msym_error_t findGeometry(int length, msym_element_t *elements[length], double cm[3], msym_thresholds_t *thresholds, msym_geometry_t *g, double e[3], double v[3][3]){
     inertialTensor(length, elements, cm, e, v, thresholds);
@@ -16,6 +16,7 @@
 
 msym_error_t findGeometry(int length, msym_element_t *elements[length], double cm[3], msym_thresholds_t *thresholds, msym_geometry_t *g, double e[3], double v[3][3]);
 msym_error_t findCenterOfMass(int length, msym_element_t *elements[length], double v[3]);
+msym_geometry_t eigenvaluesToGeometry(double e[3], msym_thresholds_t *thresholds);
 int geometryDegenerate(msym_geometry_t g);
 void printGeometry(msym_geometry_t g);
 
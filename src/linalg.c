@@ -15,7 +15,9 @@
 #include <string.h>
 #include <math.h>
 #include "linalg.h"
+#include "dense.h"
 
+#include "allocator.h"
 #include "debug.h"
 
 #ifndef M_PI
@@ -399,33 +401,18 @@ void mmmul(const double A[3][3], const double B[3][3], double C[3][3]){
 
 void mmtlmul(int rla, int cla, const double A[rla][cla], int rlb, const double B[rlb][cla], double C[rla][rlb]){
     if(A == C || B == C){
-        double (*T)[rlb] = malloc(sizeof(double[cla][rlb]));
+        double (*T)[rlb] = msymMalloc(sizeof(double[cla][rlb]));
         mltranspose(rlb, cla, B, T);
         mmlmul(rla,cla,A,rlb,T,C);
-        free(T);
+        msymFree(T);
     } else {
-        for(int r=0; r < rla; r++){
-            for(int c=0; c < rlb; c++){
-                C[r][c] = 0.0;
-                for(int k=0; k < cla; k++){
-                    C[r][c]+=A[r][k]*B[c][k]; //Possibly thrashing cashe, but better than repeated mallocs if reasonably small
-                }
-            }
-        }
+        denseGemm(DENSE_TRANS, rla, rlb, cla, (const double *) A, cla, (const double *) B, cla, 0.0, (double *) C, rlb);
     }
 }
 
 
 void mmlsymmul(int dim, const double m1[dim][dim], const double m2[dim][dim], double mr[dim][dim]){
-    for(int r=0; r < dim; r++){
-        for(int c=0; c < dim; c++){
-            for(int k=0; k < dim; k++)
-            {
-                mr[r][c]+=m1[r][k]*m2[c][k];
-                
-            }
-        }
-    }
+    denseGemm(DENSE_TRANS, dim, dim, dim, (const double *) m1, dim, (const double *) m2, dim, 1.0, (double *) mr, dim);
 }
 
 
@@ -433,24 +420,16 @@ void mmlmul(int rla, int cla, double const A[rla][cla], int clb, const double B[
     
     double (*T)[clb];
     if(A == C || B == C){
-        T = malloc(sizeof(double[rla][clb]));
+        T = msymMalloc(sizeof(double[rla][clb]));
     } else {
         T = C;
     }
     
-    for(int r=0; r < rla; r++){
-        for(int c=0; c < clb; c++){
-            T[r][c] = 0.0;
-            for(int k=0; k < cla; k++)
-            {
-                T[r][c]+=A[r][k]*B[k][c];
-                
-            }
-        }
-    }
+    denseGemm(DENSE_NOTRANS, rla, clb, cla, (const double *) A, cla, (const double *) B, clb, 0.0, (double *) T, clb);
+    
     if(A == C || B == C){
         memcpy(C, T, sizeof(double[rla][clb]));
-        free(T);
+        msymFree(T);
     }
 }
 
@@ -499,7 +478,7 @@ void kron2(int ar, int ac, const double A[ar][ac], int br, int bc, const double
 
 /* Graam-Schmidt */
 int mgsold(int l, const double M[l][l], double O[l][l], int n, double t){
-    double *tmp = malloc(sizeof(double[l]));
+    double *tmp = msymMalloc(sizeof(double[l]));
     for(int i = 0; i < l;i++){
         if(vlabs(l,M[i]) < t){
             continue;
@@ -516,7 +495,7 @@ int mgsold(int l, const double M[l][l], double O[l][l], int n, double t){
             n += !(vlabs(l, O[n]) < t);
         }
     }
-    free(tmp);
+    msymFree(tmp);
     return n;
 }
 
@@ -524,37 +503,197 @@ int mgs(int l, const double m[l][l], double o[l][l], int n, double t){
     return mgs2(l,l,m,o,n,t);
 }
 
-#ifdef LIBMSYM_DEBUG
-#define MGS_ADD 1
-#else
-#define MGS_ADD 0
-#endif
-
-/* Graam-Schmidt */
+/* Graam-Schmidt, rows are orthogonalized in panels of MGS_PANEL using mgs2panel */
 int mgs2(int l, int lm, const double m[l][l], double o[l][l], int n, double t){
     
     int nm = n + lm + MGS_ADD;
     double ts = l/(1.0 + l);
-    for(int i = 0; i < l && n < nm;i++){
-        if(vlabs(l, m[i]) < t){
-            continue;
+    double (*w)[l] = msymMalloc(sizeof(double[3*MGS_PANEL][l]));
+    
+    if(NULL == w){
+        for(int i = 0; i < l && n < nm;i++){
+            n = mgs2add(l, m[i], o, n, &t, ts);
         }
+        return n;
+    }
+    
+    for(int i = 0; i < l && n < nm;){
+        double wn[MGS_PANEL], tc = mgs2candidate(t, ts);
+        int b = 0;
+        for(;i < l && b < MGS_PANEL;i++){
+            if((wn[b] = vlabs(l, m[i])) < tc) continue;
+            memcpy(w[b], m[i], sizeof(double[l]));
+            b++;
+        }
+        n = mgs2panel(l, b, w, wn, &w[MGS_PANEL], o, n, nm, &t, ts);
+    }
+    
+    msymFree(w);
+    return n;
+}
+
+/* Lower bound of the threshold during one panel, rows with a smaller norm can never be added */
+double mgs2candidate(double t, double ts){
+    for(int i = 0;i < MGS_PANEL;i++) t *= ts;
+    return t;
+}
+
+/* Orthogonalize a panel of b rows w against the n vectors in o using matrix products, then add the rows
+ * in order as mgs2add, wn holds the norms of w before orthogonalization. Rows that lost more than half
+ * of their norm are orthogonalized a second time, rows that are already too small can never be added
+ * and are dropped. w, wn and the scratch space c (2*MGS_PANEL rows) are overwritten */
+int mgs2panel(int l, int b, double w[b][l], double wn[b], double c[2*MGS_PANEL][l], double o[l][l], int n, int nm, double *t, double ts){
+    int n0 = n;
+    
+    if(n > 0 && n < l && b > 0){
+        double tc = mgs2candidate(*t, ts), *cn = c[0], (*rw)[l] = &c[MGS_PANEL];
+        int k = 0, q = 0, ri[MGS_PANEL];
+        
+        denseGemm(DENSE_TRANS, b, n, l, (const double *) w, l, (const double *) o, l, 0.0, cn, n);
+        for(int i = 0;i < b*n;i++) cn[i] = -cn[i];
+        denseGemm(DENSE_NOTRANS, b, l, n, cn, n, (const double *) o, l, 1.0, (double *) w, l);
+        
+        for(int r = 0;r < b;r++){
+            double a = vlabs(l, w[r]);
+            if(wn[r] < tc || a < tc) continue;
+            if(k != r) memcpy(w[k], w[r], sizeof(double[l]));
+            if(2*a < wn[r]){
+                memcpy(rw[q], w[k], sizeof(double[l]));
+                ri[q++] = k;
+            }
+            wn[k++] = wn[r];
+        }
+        b = k;
+        
+        if(q > 0){
+            denseGemm(DENSE_TRANS, q, n, l, (const double *) rw, l, (const double *) o, l, 0.0, cn, n);
+            for(int i = 0;i < q*n;i++) cn[i] = -cn[i];
+            denseGemm(DENSE_NOTRANS, q, l, n, cn, n, (const double *) o, l, 1.0, (double *) rw, l);
+            for(int i = 0;i < q;i++) memcpy(w[ri[i]], rw[i], sizeof(double[l]));
+        }
+    }
+    
+    for(int r = 0;r < b && n < nm && n < l;r++){
+        if(wn[r] < *t) continue;
         if(n == 0){
-            vlnorm2(l, m[i], o[n]);
+            vlnorm2(l, w[r], o[n]);
             n++;
-        } else if (n < l) {
-            double c = vldot(l,m[i],o[0]);
-            for(int k = 0;k < l;k++) o[n][k] = m[i][k] - c*o[0][k];
-            for(int j = 1; j < n;j++){
-                c = vldot(l,o[n],o[j]);
-                for(int k = 0;k < l;k++) o[n][k] -= c*o[j][k];
-            }
-            if(vlabs(l, o[n]) >= t){
-                t *= ts;
-                vlnorm(l, o[n]);
-                n++;
-                
+            continue;
+        }
+        memcpy(o[n], w[r], sizeof(double[l]));
+        for(int j = n0; j < n;j++){
+            double d = denseDot(l,o[n],o[j]);
+            denseAxpy(l, -d, o[j], o[n]);
+        }
+        if(vlabs(l, o[n]) >= *t){
+            *t *= ts;
+            vlnorm(l, o[n]);
+            n++;
+        }
+    }
+    return n;
+}
+
+/* One Graam-Schmidt step of mgs2, orthogonalize v against the n vectors in o and add it if
+ * it is not linearly dependent, the threshold is scaled by ts for each vector added */
+int mgs2add(int l, const double v[l], double o[l][l], int n, double *t, double ts){
+    if(vlabs(l, v) < *t){
+        return n;
+    }
+    if(n == 0){
+        vlnorm2(l, v, o[n]);
+        n++;
+    } else if (n < l) {
+        double c = denseDot(l,v,o[0]);
+        memcpy(o[n], v, sizeof(double[l]));
+        denseAxpy(l, -c, o[0], o[n]);
+        for(int j = 1; j < n;j++){
+            c = denseDot(l,o[n],o[j]);
+            denseAxpy(l, -c, o[j], o[n]);
+        }
+        if(vlabs(l, o[n]) >= *t){
+            *t *= ts;
+            vlnorm(l, o[n]);
+            n++;
+        }
+    }
+    return n;
+}
+
+
+float vlabsf(int l, const float v[l]){
+    return sqrtf(denseDotf(l, v, v));
+}
+
+/* Single precision mgs2, used for approximate subspaces that are refined in double precision */
+int mgs2f(int l, int lm, const float m[l][l], float o[l][l], int n, double t){
+    
+    int nm = n + lm + MGS_ADD;
+    double ts = l/(1.0 + l);
+    float (*w)[l] = msymMalloc(sizeof(float[3*MGS_PANEL][l]));
+    
+    if(NULL == w) return -1;
+    
+    for(int i = 0; i < l && n < nm;){
+        double wn[MGS_PANEL], tc = mgs2candidate(t, ts);
+        int b = 0;
+        for(;i < l && b < MGS_PANEL;i++){
+            if((wn[b] = vlabsf(l, m[i])) < tc) continue;
+            memcpy(w[b], m[i], sizeof(float[l]));
+            b++;
+        }
+        n = mgs2panelf(l, b, w, wn, &w[MGS_PANEL], o, n, nm, &t, ts);
+    }
+    
+    msymFree(w);
+    return n;
+}
+
+/* Single precision mgs2panel */
+int mgs2panelf(int l, int b, float w[b][l], double wn[b], float c[2*MGS_PANEL][l], float o[l][l], int n, int nm, double *t, double ts){
+    int n0 = n;
+    
+    if(n > 0 && n < l && b > 0){
+        double tc = mgs2candidate(*t, ts);
+        float *cn = c[0], (*rw)[l] = &c[MGS_PANEL];
+        int k = 0, q = 0, ri[MGS_PANEL];
+        
+        denseGemmf(DENSE_TRANS, b, n, l, (const float *) w, l, (const float *) o, l, 0.0f, cn, n);
+        for(int i = 0;i < b*n;i++) cn[i] = -cn[i];
+        denseGemmf(DENSE_NOTRANS, b, l, n, cn, n, (const float *) o, l, 1.0f, (float *) w, l);
+        
+        for(int r = 0;r < b;r++){
+            double a = vlabsf(l, w[r]);
+            if(wn[r] < tc || a < tc) continue;
+            if(k != r) memcpy(w[k], w[r], sizeof(float[l]));
+            if(2*a < wn[r]){
+                memcpy(rw[q], w[k], sizeof(float[l]));
+                ri[q++] = k;
             }
+            wn[k++] = wn[r];
+        }
+        b = k;
+        
+        if(q > 0){
+            denseGemmf(DENSE_TRANS, q, n, l, (const float *) rw, l, (const float *) o, l, 0.0f, cn, n);
+            for(int i = 0;i < q*n;i++) cn[i] = -cn[i];
+            denseGemmf(DENSE_NOTRANS, q, l, n, cn, n, (const float *) o, l, 1.0f, (float *) rw, l);
+            for(int i = 0;i < q;i++) memcpy(w[ri[i]], rw[i], sizeof(float[l]));
+        }
+    }
+    
+    for(int r = 0;r < b && n < nm && n < l;r++){
+        if(wn[r] < *t) continue;
+        memcpy(o[n], w[r], sizeof(float[l]));
+        for(int j = n0; j < n;j++){
+            float d = denseDotf(l,o[n],o[j]);
+            denseAxpyf(l, -d, o[j], o[n]);
+        }
+        float a = vlabsf(l, o[n]);
+        if(n == 0 || a >= *t){
+            if(n > 0) *t *= ts;
+            for(int i = 0;i < l;i++) o[n][i] /= a;
+            n++;
         }
     }
     return n;
@@ -11,6 +11,14 @@
 #ifndef __MSYM_LINALG_h
 #define __MSYM_LINALG_h
 
+#ifdef LIBMSYM_DEBUG
+#define MGS_ADD 1
+#else
+#define MGS_ADD 0
+#endif
+
+#define MGS_PANEL 16
+
 void mleye(int l, double E[l][l]);
 int vzero(const double v[3], double t);
 int vparallel(const double v1[3], const double v2[3], double t);
@@ -68,6 +76,12 @@ void malign(const double v[3], const double axis[3], double m[3][3]);
 int ipow(int b, int e);
 int mgs(int l, const double M[l][l], double O[l][l], int n, double t);
 int mgs2(int l, int lm, const double m[l][l], double o[l][l], int n, double t);
+int mgs2add(int l, const double v[l], double o[l][l], int n, double *t, double ts);
+int mgs2panel(int l, int b, double w[b][l], double wn[b], double c[2*MGS_PANEL][l], double o[l][l], int n, int nm, double *t, double ts);
+double mgs2candidate(double t, double ts);
+int mgs2f(int l, int lm, const float m[l][l], float o[l][l], int n, double t);
+int mgs2panelf(int l, int b, float w[b][l], double wn[b], float c[2*MGS_PANEL][l], float o[l][l], int n, int nm, double *t, double ts);
+float vlabsf(int l, const float v[l]);
 void kron(int al, const double A[al][al], int bl, const double B[bl][bl], int cl, double C[cl][cl]);
 void kron2(int ar, int ac, const double A[ar][ac], int br, int bc, const double B[br][bc], double C[ar*br][ac*bc]);
 void mlFilterSmall(int l, double A[l][l]);
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "msym.h"
 #include "context.h"
 #include "symmetry.h"
@@ -19,9 +20,15 @@
 #include "symmetrize.h"
 #include "linalg.h"
 #include "subspace.h"
+#include "geometry.h"
 
+#include "allocator.h"
 #include "debug.h"
 
+msym_error_t generateContextSubrepresentationSpaces(msym_context ctx, int species);
+msym_error_t symmetrizeContextMatrix(msym_context ctx, int l, double m[l][l], int bl, double *blocks, double (*sm)[l]);
+msym_error_t findPointGroupPermutations(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, msym_thresholds_t *t);
+
 msym_error_t msymFindSymmetry(msym_context ctx){
     msym_error_t ret = MSYM_SUCCESS;
     int elementsl = 0, esl = 0;
@@ -35,6 +42,7 @@ msym_error_t msymFindSymmetry(msym_context ctx){
     int sesl = 0;
     msym_point_group_t *fpg = NULL;
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetElements(ctx, &elementsl, &elements))) goto err;
     
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
@@ -49,7 +57,7 @@ msym_error_t msymFindSymmetry(msym_context ctx){
         if(MSYM_SUCCESS != (ret = findPointGroup(sopsl, sops, t, &fpg))) goto err;
         pg = fpg;
         if(MSYM_SUCCESS != (ret = ctxSetPointGroup(ctx, pg))) {
-            free(pg);
+            msymFree(pg);
             goto err;
         }
     }
@@ -68,15 +76,272 @@ msym_error_t msymFindSymmetry(msym_context ctx){
     
     if(MSYM_SUCCESS != (ret = ctxGetEquivalenceSets(ctx, &esl, &es))) goto err; //This is only for printing, since permutation may regenerate sets
     
-    free(sops);
+    msymFree(sops);
     return ret;
     
 err:
-    free(ses);
-    free(sops);
+    msymFree(ses);
+    msymFree(sops);
     if(des == NULL) {
         ctxDestroyEquivalcenceSets(ctx);
     }
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* Checks that the point group permutes the elements of its equivalence sets,
+ * so a level only reports a point group that msymFindSymmetry would also accept */
+msym_error_t findPointGroupPermutations(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, msym_thresholds_t *t){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_equivalence_set_t *ses = NULL;
+    msym_permutation_t perm, *aperm = NULL;
+    msym_axial_operation_t *aops = NULL;
+    double (**esv)[3] = NULL;
+    int sesl = 0, m = 0, axial = 0;
+    
+    if(MSYM_SUCCESS != (ret = splitPointGroupEquivalenceSets(pg, esl, es, &sesl, &ses, t))) goto err;
+    
+    aops = msymMalloc(sizeof(msym_axial_operation_t[pg->order]));
+    aperm = msymMalloc(sizeof(msym_permutation_t[pg->order]));
+    axial = findAxialSymmetryOperations(pg->order, pg->sops, pg->transform, t, &m, aops);
+    
+    if(NULL == (esv = msymMalloc(sizeof(double (*[pg->order])[3])))){
+        msymSetErrorDetails("Could not allocate memory for equivalence set coordinates");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    for(int i = 0;i < sesl;i++){
+        if(ses[i].length > pg->order){
+            msymSetErrorDetails("Equivalence set has more elements (%d) than the order of the point group %s (%d)",ses[i].length,pg->name,pg->order);
+            ret = MSYM_INVALID_EQUIVALENCE_SET;
+            goto err;
+        }
+        
+        for(int j = 0;j < ses[i].length;j++){
+            esv[j] = &ses[i].elements[j]->v;
+        }
+        
+        if(axial){
+            if(MSYM_SUCCESS != (ret = findAxialPermutations(pg->order, pg->sops, m, aops, ses[i].length, esv, t, aperm))) goto err;
+            for(int j = 0;j < pg->order;j++) freePermutationData(&aperm[j]);
+        } else for(int j = 0;j < pg->order;j++){
+            if(MSYM_SUCCESS != (ret = findPermutation(&pg->sops[j], ses[i].length, esv, t, &perm))) goto err;
+            freePermutationData(&perm);
+        }
+    }
+    
+err:
+    msymFree(aops);
+    msymFree(aperm);
+    msymFree(esv);
+    msymFree(ses);
+    return ret;
+}
+
+/* Cheap low symmetry detection for screening.
+ * Only asymmetric tops are triaged, since these can at most have D2h symmetry with all operations
+ * along the principal axes. If all elements are inequivalent only the molecular plane (if any) remains,
+ * otherwise the principal axis operations are tested directly. Everything else (including
+ * D2, C2v, C2h and D2h) falls through to msymFindSymmetry. The context is only modified
+ * when the full symmetry detection is used.
+ */
+msym_error_t msymTriageSymmetry(msym_context ctx, msym_point_group_type_t *type, int *n, msym_triage_stage_t *stage){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_element_t **pelements = NULL;
+    msym_thresholds_t *t = NULL;
+    msym_equivalence_set_t *es = NULL;
+    msym_point_group_t *pg = NULL;
+    msym_symmetry_operation_t sops[7];
+    msym_geometry_t g = MSYM_GEOMETRY_UNKNOWN;
+    double eigval[3], eigvec[3][3];
+    int pelementsl = 0, esl = 0, sopsl = 0;
+    
+    ctxSelectArena(ctx);
+    *stage = MSYM_TRIAGE_STAGE_NONE;
+    
+    if(MSYM_SUCCESS != (ret = ctxGetElementPtrs(ctx, &pelementsl, &pelements))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxGetGeometry(ctx, &g, eigval, eigvec))) goto err;
+    
+    if(MSYM_GEOMETRY_ASSYMETRIC == g || MSYM_GEOMETRY_PLANAR_IRREGULAR == g){
+        if(MSYM_SUCCESS != (ret = findEquivalenceSets(pelementsl, pelements, g, &esl, &es, t))) goto err;
+        if(esl == pelementsl){
+            *type = MSYM_GEOMETRY_PLANAR_IRREGULAR == g ? MSYM_POINT_GROUP_TYPE_Cs : MSYM_POINT_GROUP_TYPE_Cn;
+            *n = 1;
+            *stage = MSYM_TRIAGE_STAGE_EQUIVALENCE_SETS;
+        } else {
+            if(MSYM_SUCCESS != (ret = findPrincipalAxesSymmetryOperations(esl, es, eigvec, t, &sopsl, sops))) goto err;
+            if(sopsl == 0){
+                *type = MSYM_POINT_GROUP_TYPE_Cn;
+                *n = 1;
+                *stage = MSYM_TRIAGE_STAGE_PRINCIPAL_AXES;
+            } else if(sopsl == 1){
+                switch(sops[0].type){
+                    case PROPER_ROTATION : *type = MSYM_POINT_GROUP_TYPE_Cn; *n = 2; break;
+                    case REFLECTION      : *type = MSYM_POINT_GROUP_TYPE_Cs; *n = 1; break;
+                    default              : *type = MSYM_POINT_GROUP_TYPE_Ci; *n = 1; break;
+                }
+                *stage = MSYM_TRIAGE_STAGE_PRINCIPAL_AXES;
+            }
+        }
+    }
+    
+    if(MSYM_TRIAGE_STAGE_NONE == *stage){
+        if(MSYM_SUCCESS != (ret = msymFindSymmetry(ctx))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
+        *type = pg->type;
+        *n = pg->n;
+        *stage = MSYM_TRIAGE_STAGE_FULL;
+    }
+    
+err:
+    msymFree(es);
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* Find the point group at several threshold levels.
+ * The equivalence set invariants (the expensive O(n^2) part of the partitioning) are
+ * computed once per geometry class and shared between all levels, and levels that
+ * only differ in equivalence threshold and yield the same partitioning reuse the
+ * point group of the previous level unless an equivalence set is spherical.
+ * When the partitioning is unchanged and the point group found has exactly the same
+ * operations as the previous one, the permutation check (most of the time spent at
+ * each level) is also reused as long as the permutation threshold is the same.
+ * Levels where no point group is found have their error set and don't stop the sweep.
+ * The context itself is not modified.
+ */
+msym_error_t msymFindSymmetryHierarchy(msym_context ctx, int l, const msym_thresholds_t *thresholds, msym_symmetry_level_t *levels){
+    msym_error_t ret = MSYM_SUCCESS, pperm = MSYM_SUCCESS;
+    msym_element_t **pelements = NULL;
+    msym_equivalence_set_invariants_t inv[2] = {{.length = 0, .e = NULL}, {.length = 0, .e = NULL}};
+    msym_equivalence_set_t *es = NULL, *pes = NULL;
+    msym_symmetry_operation_t *sops = NULL;
+    msym_point_group_t *pg = NULL, *ppg = NULL;
+    msym_geometry_t g = MSYM_GEOMETRY_UNKNOWN;
+    double eigval[3], eigvec[3][3];
+    int pelementsl = 0, esl = 0, pesl = 0, sopsl = 0;
+    
+    ctxSelectArena(ctx);
+    if(NULL == thresholds || NULL == levels || l < 0){
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Invalid threshold levels");
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxGetElementPtrs(ctx, &pelementsl, &pelements))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxGetGeometry(ctx, &g, eigval, eigvec))) goto err;
+    
+    for(int i = 0;i < l;i++){
+        msym_thresholds_t t = thresholds[i];
+        msym_symmetry_level_t *level = &levels[i];
+        msym_error_t lret = MSYM_SUCCESS;
+        int reuse = 0, partitioned = 0, spherical = 0, gd;
+        
+        if(!(t.angle < 1.0 && !signbit(t.angle) &&
+             t.equivalence < 1.0 && !signbit(t.equivalence) &&
+             t.geometry < 1.0 && !signbit(t.geometry) &&
+             !signbit(t.eigfact) &&
+             !signbit(t.orthogonalization) &&
+             !signbit(t.zero) &&
+             !signbit(t.permutation))){
+            ret = MSYM_INVALID_THRESHOLD;
+            msymSetErrorDetails("Invalid thresholds at level %d",i);
+            goto err;
+        }
+        
+        g = eigenvaluesToGeometry(eigval, &t);
+        gd = geometryDegenerate(g);
+        
+        if(NULL == inv[gd].e){
+            if(MSYM_SUCCESS != (ret = findEquivalenceSetInvariants(pelementsl, pelements, g, &inv[gd]))) goto err;
+        }
+        
+        lret = findEquivalenceSetsFromInvariants(&inv[gd], pelementsl, pelements, g, &esl, &es, &t);
+        
+        if(MSYM_SUCCESS == lret && NULL != pes && esl == pesl){
+            partitioned = 1;
+            for(int j = 0;partitioned && j < esl;j++){
+                partitioned = es[j].length == pes[j].length && 0 == memcmp(es[j].elements, pes[j].elements, sizeof(msym_element_t *[es[j].length]));
+            }
+        }
+        
+        /* Symmetry operation detection only depends on the equivalence threshold for spherical equivalence sets,
+         * so if the partitioning is unchanged and there are none the previous point group still holds */
+        if(partitioned){
+            msym_thresholds_t pt = thresholds[i-1];
+            pt.equivalence = t.equivalence;
+            reuse = 0 == memcmp(&pt, &t, sizeof(t));
+            if(reuse && thresholds[i-1].equivalence != t.equivalence){
+                if(MSYM_SUCCESS != (ret = findSphericalEquivalenceSets(esl, es, &t, &spherical))) goto err;
+                reuse = !spherical;
+            }
+        }
+        
+        if(MSYM_SUCCESS != lret){
+            esl = 0;
+        } else if(reuse){
+            *level = levels[i-1];
+            lret = level->error;
+        } else {
+            if(MSYM_SUCCESS == (lret = findSymmetryOperations(esl, es, &t, &sopsl, &sops)) &&
+               MSYM_SUCCESS == (lret = findPointGroup(sopsl, sops, &t, &pg))){
+                // Same sets, same operations and same threshold give the same permutations
+                if(partitioned && NULL != ppg && ppg->order == pg->order &&
+                   thresholds[i-1].permutation == t.permutation &&
+                   identicalSymmetryOperations(pg->order, pg->sops, ppg->sops)){
+                    lret = pperm;
+                } else {
+                    lret = findPointGroupPermutations(pg, esl, es, &t);
+                }
+                if(MSYM_SUCCESS == lret){
+                    level->type = pg->type;
+                    level->n = pg->n;
+                    snprintf(level->name, sizeof(level->name), "%s", pg->name);
+                }
+                pperm = lret;
+                freePointGroup(ppg);
+                ppg = pg;
+                pg = NULL;
+            } else {
+                freePointGroup(ppg);
+                ppg = NULL;
+            }
+            freePointGroup(pg);
+            msymFree(sops);
+            pg = NULL;
+            sops = NULL;
+        }
+        
+        // A level without a point group is recorded and the sweep continues, the tight levels usually fail
+        if(MSYM_MEMORY_ERROR == lret) {ret = lret; goto err;}
+        if(MSYM_SUCCESS != lret){
+            level->type = MSYM_POINT_GROUP_TYPE_Kh;
+            level->n = 0;
+            level->name[0] = '\0';
+        }
+        level->error = lret;
+        
+        level->max_error = 0.0;
+        for(int j = 0;j < esl;j++) level->max_error = fmax(level->max_error, es[j].err);
+        
+        msymFree(pes);
+        pes = es;
+        pesl = esl;
+        es = NULL;
+        esl = 0;
+    }
+    
+err:
+    freeEquivalenceSetInvariants(&inv[0]);
+    freeEquivalenceSetInvariants(&inv[1]);
+    freePointGroup(pg);
+    freePointGroup(ppg);
+    msymFree(sops);
+    msymFree(es);
+    msymFree(pes);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -85,6 +350,7 @@ msym_error_t msymSetPointGroupByName(msym_context ctx, const char *name){
     msym_point_group_t *pg = NULL, *ppg = NULL;
     msym_thresholds_t *t = NULL;
     
+    ctxSelectArena(ctx);
     
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     
@@ -99,7 +365,8 @@ msym_error_t msymSetPointGroupByName(msym_context ctx, const char *name){
     return ret;
     
 err:
-    free(pg);
+    msymFree(pg);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -108,6 +375,7 @@ msym_error_t msymSetPointGroupByType(msym_context ctx, msym_point_group_type_t t
     msym_point_group_t *pg = NULL, *ppg = NULL;
     msym_thresholds_t *t = NULL;
     
+    ctxSelectArena(ctx);
     
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     
@@ -122,7 +390,8 @@ msym_error_t msymSetPointGroupByType(msym_context ctx, msym_point_group_type_t t
     return ret;
     
 err:
-    free(pg);
+    msymFree(pg);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -136,6 +405,7 @@ msym_error_t msymGenerateElements(msym_context ctx, int length, msym_element_t e
     double err = 0.0;
     double cm[3];
     
+    ctxSelectArena(ctx);
     int glength = 0, plength = 0, esl = 0;
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     if(MSYM_SUCCESS != (ret = msymGetCenterOfMass(ctx, cm))) goto err;
@@ -160,12 +430,13 @@ msym_error_t msymGenerateElements(msym_context ctx, int length, msym_element_t e
     if(MSYM_SUCCESS != (ret = msymFindEquivalenceSetPermutations(ctx))) goto err;
     if(MSYM_SUCCESS != (ret = msymSymmetrizeElements(ctx, &err))) goto err;
     if(MSYM_SUCCESS != (ret = msymSetCenterOfMass(ctx, cm))) goto err;
-    free(gelements);
+    msymFree(gelements);
     return ret;
     
 err:
-    free(gelements);
-    free(es);
+    msymFree(gelements);
+    msymFree(es);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -181,6 +452,7 @@ msym_error_t msymFindEquivalenceSets(msym_context ctx){
     int esl = 0;
     msym_equivalence_set_t *es;
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetElementPtrs(ctx, &pelementsl, &pelements))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) {
@@ -191,6 +463,7 @@ msym_error_t msymFindEquivalenceSets(msym_context ctx){
     }
     if(MSYM_SUCCESS != (ret = ctxSetEquivalenceSets(ctx, esl, es))) goto err;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -203,6 +476,7 @@ msym_error_t msymAlignAxes(msym_context ctx){
     int elementsl = 0;
     double zero[3] = {0,0,0};
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetElements(ctx, &elementsl, &elements))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
     
@@ -221,6 +495,7 @@ msym_error_t msymAlignAxes(msym_context ctx){
     if(MSYM_SUCCESS != (ret = ctxUpdateExternalElementCoordinates(ctx))) goto err;
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -228,6 +503,7 @@ msym_error_t msymGetAlignmentAxes(msym_context ctx, double primary[3], double se
     msym_error_t ret = MSYM_SUCCESS;
     msym_point_group_t *pg;
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
     
     double m[3][3], x[3] = {1,0,0}, z[3] = {0,0,1};
@@ -236,6 +512,7 @@ msym_error_t msymGetAlignmentAxes(msym_context ctx, double primary[3], double se
     mvmul(x, m, secondary);
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 
 }
@@ -245,11 +522,13 @@ msym_error_t msymGetAlignmentTransform(msym_context ctx, double transform[3][3])
     msym_error_t ret = MSYM_SUCCESS;
     msym_point_group_t *pg;
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
     
     mcopy(pg->transform, transform);
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
     
 }
@@ -263,6 +542,7 @@ msym_error_t msymSetAlignmentTransform(msym_context ctx, double transform[3][3])
     int elementsl = 0, esl = 0;
     double m[3][3];
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetElements(ctx, &elementsl, &elements))){
         elements = NULL;
@@ -295,6 +575,7 @@ msym_error_t msymSetAlignmentTransform(msym_context ctx, double transform[3][3])
     for(int i = 0; i < pg->order;i++) mvmul(pg->sops[i].v, m, pg->sops[i].v);
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -308,6 +589,7 @@ msym_error_t msymSetAlignmentAxes(msym_context ctx, double primary[3], double se
     int elementsl = 0, esl = 0;
     double x[3] = {1,0,0}, z[3] = {0,0,1}, m[3][3], p[3], s[3];
     
+    ctxSelectArena(ctx);
     vnorm2(primary, p);
     vnorm2(secondary,s);
     
@@ -356,6 +638,7 @@ msym_error_t msymSetAlignmentAxes(msym_context ctx, double primary[3], double se
     
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -366,6 +649,7 @@ msym_error_t msymSelectSubgroup(msym_context ctx, const msym_subgroup_t *sg){
     msym_thresholds_t *t = NULL;
     int sgl = 0;
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetSubgroups(ctx, &sgl, &sgs))) goto err;
     if(sg < sgs || sg >= sgs + sgl){
         msymSetErrorDetails("Subgroup not available in current context");
@@ -379,6 +663,7 @@ msym_error_t msymSelectSubgroup(msym_context ctx, const msym_subgroup_t *sg){
     if(MSYM_SUCCESS != (ret = msymFindEquivalenceSetPermutations(ctx))) goto err;
 
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -389,6 +674,7 @@ msym_error_t msymSymmetrizeElements(msym_context ctx, double *oerr){
     msym_equivalence_set_t *es = NULL;
     msym_element_t *elements = NULL;
     
+    ctxSelectArena(ctx);
     msym_permutation_t **perm = NULL;
     msym_thresholds_t *t = NULL;
     double error = 0.0;
@@ -417,6 +703,7 @@ msym_error_t msymSymmetrizeElements(msym_context ctx, double *oerr){
     
     *oerr = error;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -429,8 +716,10 @@ msym_error_t msymApplyTranslation(msym_context ctx, msym_element_t *ext, double
     msym_equivalence_set_t **eesmap = NULL;
     msym_permutation_t **perm;
     msym_thresholds_t *t = NULL;
+    int *eesimap = NULL;
     int perml = 0, esl = 0, eesl = 0, eelementsl = 0, sopsl = 0;
     
+    ctxSelectArena(ctx);
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetExternalElements(ctx, &eelementsl, &eelements))) goto err;
@@ -440,7 +729,7 @@ msym_error_t msymApplyTranslation(msym_context ctx, msym_element_t *ext, double
         if(MSYM_SUCCESS != (ret = ctxGetEquivalenceSets(ctx, &esl, &es))) goto err;
     }
     if(MSYM_SUCCESS != (ret = ctxGetExternalEquivalenceSets(ctx, &eesl, &ees))) goto err;
-    if(MSYM_SUCCESS != (ret = ctxGetExternalElementEquivalenceSetMap(ctx, &eesmap))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxGetExternalElementEquivalenceSetMap(ctx, &eesmap, &eesimap))) goto err;
     
     if(MSYM_SUCCESS != (ret = ctxGetEquivalenceSetPermutations(ctx, &perml, &sopsl, &perm))) goto err;
     if(sopsl != pg->order || perml != esl) {
@@ -459,12 +748,9 @@ msym_error_t msymApplyTranslation(msym_context ctx, msym_element_t *ext, double
     
     int fesi = (int)(eesmap[esmi] - ees);
     msym_equivalence_set_t *fes = eesmap[esmi];
-    int fi = 0;
-    for(fi = 0;fi < fes->length;fi++){
-        if(fes->elements[fi] == ext) break;
-    }
+    int fi = eesimap[esmi];
     
-    if(fi >= fes->length){
+    if(fi >= fes->length || fes->elements[fi] != ext){
         msymSetErrorDetails("Could not find index of element %s in equivalence set %d", ext->name, fesi);
         ret = MSYM_INVALID_ELEMENTS;
         goto err;
@@ -476,10 +762,40 @@ msym_error_t msymApplyTranslation(msym_context ctx, msym_element_t *ext, double
     
     return ret;
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGenerateSubrepresentationSpaces(msym_context ctx){
+    ctxSelectArena(ctx);
+    return generateContextSubrepresentationSpaces(ctx, -1);
+}
+
+msym_error_t msymGenerateSubrepresentationSpace(msym_context ctx, int species){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t *pg = NULL;
+    
+    ctxSelectArena(ctx);
+    if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
+    if(pg->ct == NULL){
+        if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
+    }
+    
+    if(species < 0 || species >= pg->ct->d){
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Symmetry species %d out of range [0, %d)",species,pg->ct->d);
+        goto err;
+    }
+    
+    return generateContextSubrepresentationSpaces(ctx, species);
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* Generates SALCs for species, or all irreducible representations if species < 0, adding them to the
+ * subrepresentation spaces already in the context */
+msym_error_t generateContextSubrepresentationSpaces(msym_context ctx, int species){
     msym_error_t ret = MSYM_SUCCESS;
     
     msym_point_group_t *pg = NULL;
@@ -488,13 +804,15 @@ msym_error_t msymGenerateSubrepresentationSpaces(msym_context ctx){
     msym_equivalence_set_t **eesmap = NULL;
     msym_permutation_t **perm = NULL;
     msym_thresholds_t *t = NULL;
-    msym_subrepresentation_space_t *srs = NULL;
+    msym_subrepresentation_space_t *srs = NULL, *csrs = NULL;
     msym_basis_function_t **srsbf = NULL;
     msym_element_t *elements = NULL;
     const msym_subgroup_t *sg = NULL;
-    int *span = NULL;
+    int *span = NULL, *eesimap = NULL;
+    size_t budget = 0, predicted = 0, peak = 0;
     
-    int basisl = 0, esl = 0, perml = 0, sopsl = 0, srsl = 0, elementsl = 0, sgl = 0;
+    int basisl = 0, esl = 0, perml = 0, sopsl = 0, srsl = 0, elementsl = 0, sgl = 0, threads = 0;
+    msym_precision_t precision = MSYM_PRECISION_DOUBLE;
     
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetExternalElements(ctx, &elementsl, &elements))) goto err;
@@ -503,27 +821,43 @@ msym_error_t msymGenerateSubrepresentationSpaces(msym_context ctx){
         if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
     }
     if(MSYM_SUCCESS != (ret = ctxGetExternalEquivalenceSets(ctx, &esl, &es))) goto err;
-    if(MSYM_SUCCESS != (ret = ctxGetExternalElementEquivalenceSetMap(ctx, &eesmap))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxGetExternalElementEquivalenceSetMap(ctx, &eesmap, &eesimap))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetBasisFunctions(ctx, &basisl, &basis))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetEquivalenceSetPermutations(ctx, &perml, &sopsl, &perm))) goto err;
     if(sopsl != pg->order || perml != esl) {ret = MSYM_INVALID_PERMUTATION; goto err;}
     
     if(MSYM_SUCCESS != (ret = msymGetSubgroups(ctx, &sgl, &sg))) goto err;
     
-    if(MSYM_SUCCESS != (ret = generateSubrepresentationSpaces(pg, sgl, sg, esl, es, perm, basisl, basis, elements, eesmap, t, &srsl, &srs, &srsbf, &span))) goto err;
+    if(MSYM_SUCCESS != (ret = msymGetThreads(ctx, &threads))) goto err;
+    if(MSYM_SUCCESS != (ret = msymGetMemoryBudget(ctx, &budget))) goto err;
+    if(MSYM_SUCCESS != (ret = msymGetPrecision(ctx, &precision))) goto err;
+    
+    if(MSYM_SUCCESS != (ret = ctxGetPartialSubrepresentationSpaces(ctx, &srsl, &csrs, &srsbf, &span))) goto err;
     
-    if(MSYM_SUCCESS != (ret = ctxSetSubrepresentationSpaces(ctx,srsl,srs,srsbf,span))) goto err;
+    srs = csrs;
+    
+    // SALCs are added in place to subrepresentation spaces already in the context
+    if(MSYM_SUCCESS != (ret = generateSubrepresentationSpaces(pg, sgl, sg, esl, es, perm, basisl, basis, elements, eesmap, eesimap, t, threads, precision, species, budget, &predicted, &peak, &srsl, &srs, &srsbf, &span))) goto err;
+    
+    if(NULL == csrs && MSYM_SUCCESS != (ret = ctxSetSubrepresentationSpaces(ctx,srsl,srs,srsbf,span))){
+        freeSubrepresentationSpaces(srsl, srs);
+        msymFree(srsbf);
+        msymFree(span);
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxSetSubrepresentationSpacesMemory(ctx, predicted, peak))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxReferenceSubrepresentationSpaces(ctx))) goto err;
     
     return ret;
 err:
-    freeSubrepresentationSpaces(srsl, srs);
-    free(srs);
-    free(span);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
 msym_error_t msymGetSALCs(msym_context ctx, int l, double c[l][l], int species[l], msym_partner_function_t pf[l]){
     msym_error_t ret = MSYM_SUCCESS;
+    ctxSelectArena(ctx);
     
     
     msym_subrepresentation_space_t *srs = NULL;
@@ -580,6 +914,7 @@ msym_error_t msymGetSALCs(msym_context ctx, int l, double c[l][l], int species[l
     }
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
     
 }
@@ -592,6 +927,7 @@ msym_error_t msymSymmetrySpeciesComponents(msym_context ctx, int wfl, double *wf
     msym_basis_function_t *basis = NULL;
     int *span = NULL;
     
+    ctxSelectArena(ctx);
     int srsl = 0, basisl = 0;
     
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
@@ -621,10 +957,68 @@ msym_error_t msymSymmetrySpeciesComponents(msym_context ctx, int wfl, double *wf
     if(MSYM_SUCCESS != (ret = symmetrySpeciesComponents(pg, srsl, srs, basisl, basis, wf, s))) goto err;
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
     
 }
 
+/* Decompose l reducible representations given by their characters in each class
+ * (same class order as the character table) into irreducible representations */
+msym_error_t msymDecomposeRepresentations(msym_context ctx, int l, int d, double chars[l][d], double span[l][d]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t *pg = NULL;
+    
+    ctxSelectArena(ctx);
+    if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
+    if(pg->ct == NULL){
+        if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
+    }
+    
+    if(l < 0 || d != pg->ct->d) {
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Supplied representation size (%d) does not match character table (%d)",d,pg->ct->d);
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = decomposeRepresentations(pg->ct, l, chars, span))) goto err;
+    
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* Number of times each irreducible representation occurs, separably degenerate pairs count once */
+msym_error_t msymDecomposeRepresentationsInteger(msym_context ctx, int l, int d, double chars[l][d], int span[l][d]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t *pg = NULL;
+    double (*dspan)[d] = NULL;
+    
+    ctxSelectArena(ctx);
+    if(l < 0 || d <= 0) {
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Invalid number (%d) or size (%d) of representations",l,d);
+        goto err;
+    }
+    
+    if(NULL == (dspan = msymMalloc(sizeof(double[l+1][d])))){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for representation decomposition");
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = msymDecomposeRepresentations(ctx, l, d, chars, dspan))) goto err;
+    if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
+    
+    for(int i = 0;i < l;i++){
+        for(int k = 0;k < d;k++) span[i][k] = (int)round(dspan[i][k]/pg->ct->s[k].r);
+    }
+    
+err:
+    msymFree(dspan);
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
 msym_error_t msymSymmetrizeWavefunctions(msym_context ctx, int l, double c[l][l], int species[l], msym_partner_function_t pf[l]){
     msym_error_t ret = MSYM_SUCCESS;
     msym_point_group_t *pg = NULL;
@@ -632,6 +1026,7 @@ msym_error_t msymSymmetrizeWavefunctions(msym_context ctx, int l, double c[l][l]
     msym_basis_function_t *basis = NULL;
     int *span = NULL;
     
+    ctxSelectArena(ctx);
     int srsl = 0, basisl = 0;
     
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
@@ -656,25 +1051,127 @@ msym_error_t msymSymmetrizeWavefunctions(msym_context ctx, int l, double c[l][l]
     if(MSYM_SUCCESS != (ret = symmetrizeWavefunctions(pg, srsl, srs, span, basisl, basis, c , c, species, pf))) goto err;
     
 err:
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
+/* Symmetrizes batch sets of wfl wave functions (rows stride apart) in place, each set has to contain all partners
+ * of its degenerate wave functions, species and pf are optional */
+msym_error_t msymSymmetrizeWavefunctionsBatch(msym_context ctx, int batch, int wfl, int basisl, int stride, double c[batch][wfl][stride], int species[batch][wfl], msym_partner_function_t pf[batch][wfl]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t *pg = NULL;
+    msym_subrepresentation_space_t *srs = NULL;
+    msym_basis_function_t *basis = NULL;
+    int *span = NULL;
+    
+    ctxSelectArena(ctx);
+    int srsl = 0, cbasisl = 0, threads = 0;
+    
+    if(batch < 0 || wfl < 0 || wfl > basisl || stride < basisl){
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Invalid wavefunction batch (batch %d, wavefunctions %d, basis functions %d, stride %d)",batch,wfl,basisl,stride);
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
+    if(pg->ct == NULL){
+        if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxGetBasisFunctions(ctx, &cbasisl, &basis))) goto err;
+    
+    if(cbasisl != basisl) {
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Supplied number of basis functions (%d) does not match number of basis functions (%d)",basisl,cbasisl);
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxGetSubrepresentationSpaces(ctx, &srsl, &srs, &span))){
+        if(MSYM_SUCCESS != (ret = msymGenerateSubrepresentationSpaces(ctx))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxGetSubrepresentationSpaces(ctx, &srsl, &srs, &span))) goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = msymGetThreads(ctx, &threads))) goto err;
+    
+    if(MSYM_SUCCESS != (ret = symmetrizeWavefunctionBatch(pg, srsl, srs, span, basisl, basis, threads, batch, wfl, stride, c, species, pf))) goto err;
+    
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+msym_error_t symmetrizeContextMatrix(msym_context ctx, int l, double m[l][l], int bl, double *blocks, double (*sm)[l]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_t *pg = NULL;
+    msym_subrepresentation_space_t *srs = NULL;
+    msym_basis_function_t *basis = NULL;
+    int *span = NULL;
+    
+    int srsl = 0, basisl = 0, threads = 0;
+    
+    if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
+    if(pg->ct == NULL){
+        if(MSYM_SUCCESS != (ret = generateCharacterTable(pg->type, pg->n, pg->order, pg->sops, &pg->ct))) goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxGetBasisFunctions(ctx, &basisl, &basis))) goto err;
+    
+    if(basisl != l) {
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Supplied matrix size (%d) does not match number of basis functions (%d)",l,basisl);
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = ctxGetSubrepresentationSpaces(ctx, &srsl, &srs, &span))){
+        if(MSYM_SUCCESS != (ret = msymGenerateSubrepresentationSpaces(ctx))) goto err;
+        if(MSYM_SUCCESS != (ret = ctxGetSubrepresentationSpaces(ctx, &srsl, &srs, &span))) goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = msymGetThreads(ctx, &threads))) goto err;
+    
+    if(MSYM_SUCCESS != (ret = symmetrizeMatrix(pg, srsl, srs, basisl, basis, threads, m, bl, blocks, sm))) goto err;
+    
+err:
+    ctxSaveErrorDetails(ctx, ret);
+    return ret;
+}
+
+/* Replaces the symmetric matrix m (e.g. a Fock or density matrix in the basis functions) with its totally symmetric part */
+msym_error_t msymSymmetrizeMatrix(msym_context ctx, int l, double m[l][l]){
+    ctxSelectArena(ctx);
+    return symmetrizeContextMatrix(ctx, l, m, 0, NULL, m);
+}
+
+/* The blocks of the symmetric matrix m in the SALC basis (in the order of msymGetSALCs), one for each symmetry species
+ * with dimension*salcl rows stored one after the other, the coupling between species is not included */
+msym_error_t msymBlockDiagonalizeMatrix(msym_context ctx, int l, double m[l][l], int bl, double blocks[bl]){
+    ctxSelectArena(ctx);
+    if(NULL == blocks){
+        msymSetErrorDetails("No storage for matrix blocks");
+        ctxSaveErrorDetails(ctx, MSYM_INVALID_INPUT);
+        return MSYM_INVALID_INPUT;
+    }
+    return symmetrizeContextMatrix(ctx, l, m, bl, blocks, NULL);
+}
+
 msym_error_t msymFindEquivalenceSetPermutations(msym_context ctx) {
     msym_error_t ret = MSYM_SUCCESS;
+    ctxSelectArena(ctx);
     //We can't allocate this as a double[][] unless we typecast it every time, since the compiler doesn't have the indexing information in the context
     msym_permutation_t **perm = NULL;
     msym_permutation_t *bperm = NULL;
     msym_point_group_t *pg = NULL;
     msym_equivalence_set_t *es = NULL;
     msym_thresholds_t *t = NULL;
+    msym_axial_operation_t *aops = NULL;
     double (**esv)[3] = NULL;
-    int esl = 0;
+    int esl = 0, m = 0, axial = 0;
     
     if(MSYM_SUCCESS != (ret = ctxGetThresholds(ctx, &t))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetPointGroup(ctx, &pg))) goto err;
     if(MSYM_SUCCESS != (ret = ctxGetEquivalenceSets(ctx, &esl, &es))) goto err;
     
-    perm = (msym_permutation_t**)malloc(esl*sizeof(msym_permutation_t*) + esl*pg->order*sizeof(msym_permutation_t));
+    perm = (msym_permutation_t**)msymMalloc(esl*sizeof(msym_permutation_t*) + esl*pg->order*sizeof(msym_permutation_t));
     bperm = (msym_permutation_t*)(perm + esl);
     memset(bperm,0,esl*pg->order*sizeof(msym_permutation_t));
     
@@ -690,7 +1187,7 @@ msym_error_t msymFindEquivalenceSetPermutations(msym_context ctx) {
     }
     /*
     if(perm == NULL){
-        perm = (msym_permutation_t**)malloc(esl*sizeof(msym_permutation_t*) + esl*pg->sopsl*sizeof(msym_permutation_t));
+        perm = (msym_permutation_t**)msymMalloc(esl*sizeof(msym_permutation_t*) + esl*pg->sopsl*sizeof(msym_permutation_t));
         bperm = (msym_permutation_t*)(perm + esl);
         memset(bperm,0,esl*pg->sopsl*sizeof(msym_permutation_t));
         for(int i = 0; i < esl;i++){ //This really shouldn't happen
@@ -703,25 +1200,34 @@ msym_error_t msymFindEquivalenceSetPermutations(msym_context ctx) {
         }
     }*/
     
-    esv = malloc(sizeof(double (*[pg->order])[3]));
+    // Cyclic and dihedral groups compose most permutations from a few matched ones
+    aops = msymMalloc(sizeof(msym_axial_operation_t[pg->order]));
+    axial = findAxialSymmetryOperations(pg->order, pg->sops, pg->transform, t, &m, aops);
+    
+    esv = msymMalloc(sizeof(double (*[pg->order])[3]));
     for(int i = 0; i < esl;i++){
         for(int j = 0; j < es[i].length;j++){
             esv[j] = &es[i].elements[j]->v;
         }
         
-        for(int j = 0; j < pg->order;j++){
+        if(axial){
+            if(MSYM_SUCCESS != (ret = findAxialPermutations(pg->order, pg->sops, m, aops, es[i].length, esv, t, perm[i]))) goto err;
+        } else for(int j = 0; j < pg->order;j++){
             if(MSYM_SUCCESS != (ret = findPermutation(&pg->sops[j], es[i].length, esv, t, &perm[i][j]))) goto err;
         }
     }
         
     if(MSYM_SUCCESS != (ret = ctxSetEquivalenceSetPermutations(ctx, esl, pg->order, perm))) goto err;
     
-    free(esv);
+    msymFree(aops);
+    msymFree(esv);
     return ret;
     
 err:
-    free(esv);
-    free(perm);
+    msymFree(aops);
+    msymFree(esv);
+    msymFree(perm);
+    ctxSaveErrorDetails(ctx, ret);
     return ret;
 }
 
@@ -19,6 +19,8 @@ extern "C" {
     
 #include "msym_error.h"
     
+#include <stddef.h>
+    
     typedef struct _msym_context * msym_context;
 
     typedef enum _msym_geometry {
@@ -95,6 +97,26 @@ extern "C" {
     } msym_thresholds_t;
     
     
+    typedef enum _msym_precision {
+        MSYM_PRECISION_DOUBLE = 0,
+        MSYM_PRECISION_SINGLE = 1  // Single precision SALC generation refined in double precision
+    } msym_precision_t;
+    
+    typedef enum _msym_triage_stage {
+        MSYM_TRIAGE_STAGE_NONE = 0,
+        MSYM_TRIAGE_STAGE_EQUIVALENCE_SETS = 1, // All elements inequivalent (C1, or Cs if planar)
+        MSYM_TRIAGE_STAGE_PRINCIPAL_AXES = 2,   // At most one operation along the principal axes (C1, Cs, Ci or C2)
+        MSYM_TRIAGE_STAGE_FULL = 3              // Decided by full symmetry detection
+    } msym_triage_stage_t;
+    
+    typedef struct _msym_symmetry_level {
+        msym_point_group_type_t type;           // Point group type found at this level
+        int n;                                  // Order of principal axis
+        double max_error;                       // Maximum equivalence set error at this level
+        char name[8];                           // Point group name
+        msym_error_t error;                     // Why no point group was found at this level (name is then empty)
+    } msym_symmetry_level_t;
+    
     typedef struct _msym_element {
         void *id;                               // custom identifier
         double m;                               // Mass
@@ -160,14 +182,42 @@ extern "C" {
         msym_symmetry_species_t *s;
         void *table;  //double[d][d]
     } msym_character_table_t;
+    
+    typedef struct _msym_allocator {
+        void *(*malloc)(void *data, size_t size);
+        void *(*realloc)(void *data, void *ptr, size_t size);
+        void (*free)(void *data, void *ptr);
+        void *data;
+    } msym_allocator_t;
 
     
+    /* A context must not be used from more than one thread at a time, but independent contexts can be
+     * used concurrently from different threads. Error details are kept per thread (msymGetErrorDetails)
+     * and per context (msymGetContextErrorDetails) */
     msym_context MSYM_EXPORT msymCreateContext();
+    msym_context MSYM_EXPORT msymCreateContextWithArena(size_t block);
+    msym_context MSYM_EXPORT msymCloneContext(msym_context ctx);
     msym_error_t MSYM_EXPORT msymReleaseContext(msym_context ctx);
+    msym_error_t MSYM_EXPORT msymSaveContext(msym_context ctx, size_t l, void *buf, size_t *size);
+    msym_error_t MSYM_EXPORT msymLoadContext(msym_context ctx, size_t l, const void *buf);
+    const char MSYM_EXPORT *msymGetContextErrorDetails(msym_context ctx);
+    
+    /* Must be called before any other function, NULL restores malloc, realloc and free. Memory of a context
+     * created with msymCreateContextWithArena is taken from blocks of the given size (0 for default)
+     * and returned all at once by msymReleaseContext, memory shared between contexts (the point group
+     * cache) always uses the allocator */
+    msym_error_t MSYM_EXPORT msymSetAllocator(const msym_allocator_t *allocator);
     
     const msym_thresholds_t MSYM_EXPORT *msymGetDefaultThresholds();
     msym_error_t MSYM_EXPORT msymSetThresholds(msym_context ctx, const msym_thresholds_t *thresholds);
     msym_error_t MSYM_EXPORT msymGetThresholds(msym_context ctx, const msym_thresholds_t **thresholds);
+    msym_error_t MSYM_EXPORT msymSetThreads(msym_context ctx, int threads);
+    msym_error_t MSYM_EXPORT msymGetThreads(msym_context ctx, int *threads);
+    msym_error_t MSYM_EXPORT msymSetPrecision(msym_context ctx, msym_precision_t precision);
+    msym_error_t MSYM_EXPORT msymGetPrecision(msym_context ctx, msym_precision_t *precision);
+    msym_error_t MSYM_EXPORT msymSetMemoryBudget(msym_context ctx, size_t bytes);
+    msym_error_t MSYM_EXPORT msymGetMemoryBudget(msym_context ctx, size_t *bytes);
+    msym_error_t MSYM_EXPORT msymGetSubrepresentationSpacesMemory(msym_context ctx, size_t *predicted, size_t *peak);
     msym_error_t MSYM_EXPORT msymSetElements(msym_context ctx, int length, msym_element_t *elements);
     msym_error_t MSYM_EXPORT msymGetElements(msym_context ctx, int *length, msym_element_t **elements);
     msym_error_t MSYM_EXPORT msymSetBasisFunctions(msym_context ctx, int length, msym_basis_function_t *basis);
@@ -182,24 +232,38 @@ extern "C" {
     msym_error_t MSYM_EXPORT msymGetEquivalenceSets(msym_context ctx, int *l, const msym_equivalence_set_t **es);
     msym_error_t MSYM_EXPORT msymGetEquivalenceSetByElement(msym_context ctx, msym_element_t *element, const msym_equivalence_set_t **es);
     msym_error_t MSYM_EXPORT msymGetSubrepresentationSpaces(msym_context ctx, int *l, const msym_subrepresentation_space_t **srs);
+    msym_error_t MSYM_EXPORT msymGetSubrepresentationSpace(msym_context ctx, int species, const msym_subrepresentation_space_t **srs);
     msym_error_t MSYM_EXPORT msymGetCharacterTable(msym_context ctx, const msym_character_table_t **ct);
     
     msym_error_t MSYM_EXPORT msymFindEquivalenceSets(msym_context ctx);
     msym_error_t MSYM_EXPORT msymFindEquivalenceSetPermutations(msym_context ctx);
     msym_error_t MSYM_EXPORT msymFindSymmetry(msym_context ctx);
+    msym_error_t MSYM_EXPORT msymTriageSymmetry(msym_context ctx, msym_point_group_type_t *type, int *n, msym_triage_stage_t *stage);
+    msym_error_t MSYM_EXPORT msymFindSymmetryHierarchy(msym_context ctx, int l, const msym_thresholds_t *thresholds, msym_symmetry_level_t *levels);
     msym_error_t MSYM_EXPORT msymSymmetrizeElements(msym_context context, double *err);
     msym_error_t MSYM_EXPORT msymApplyTranslation(msym_context ctx, msym_element_t *element, double v[3]);
 #ifdef __cplusplus
     msym_error_t MSYM_EXPORT msymSymmetrizeWavefunctions(msym_context ctx, int l, void *c, int *species, msym_partner_function_t *pf);
+    msym_error_t MSYM_EXPORT msymSymmetrizeWavefunctionsBatch(msym_context ctx, int batch, int wfl, int basisl, int stride, void *c, int *species, msym_partner_function_t *pf);
+    msym_error_t MSYM_EXPORT msymSymmetrizeMatrix(msym_context ctx, int l, void *m);
+    msym_error_t MSYM_EXPORT msymBlockDiagonalizeMatrix(msym_context ctx, int l, void *m, int bl, double *blocks);
     msym_error_t MSYM_EXPORT msymGetSALCs(msym_context ctx, int l, void *c, int *species, msym_partner_function_t *pf);
+    msym_error_t MSYM_EXPORT msymDecomposeRepresentations(msym_context ctx, int l, int d, void *chars, void *span);
+    msym_error_t MSYM_EXPORT msymDecomposeRepresentationsInteger(msym_context ctx, int l, int d, void *chars, void *span);
     
 #else
     msym_error_t MSYM_EXPORT msymSymmetrizeWavefunctions(msym_context ctx, int l, double c[l][l], int species[l], msym_partner_function_t pf[l]);
+    msym_error_t MSYM_EXPORT msymSymmetrizeWavefunctionsBatch(msym_context ctx, int batch, int wfl, int basisl, int stride, double c[batch][wfl][stride], int species[batch][wfl], msym_partner_function_t pf[batch][wfl]);
+    msym_error_t MSYM_EXPORT msymSymmetrizeMatrix(msym_context ctx, int l, double m[l][l]);
+    msym_error_t MSYM_EXPORT msymBlockDiagonalizeMatrix(msym_context ctx, int l, double m[l][l], int bl, double blocks[bl]);
     msym_error_t MSYM_EXPORT msymGetSALCs(msym_context ctx, int l, double c[l][l], int species[l], msym_partner_function_t pf[l]);
+    msym_error_t MSYM_EXPORT msymDecomposeRepresentations(msym_context ctx, int l, int d, double chars[l][d], double span[l][d]);
+    msym_error_t MSYM_EXPORT msymDecomposeRepresentationsInteger(msym_context ctx, int l, int d, double chars[l][d], int span[l][d]);
 #endif
     msym_error_t MSYM_EXPORT msymSymmetrySpeciesComponents(msym_context ctx, int wfl, double *wf, int sl, double *s);
     msym_error_t MSYM_EXPORT msymGenerateElements(msym_context ctx, int length, msym_element_t *elements);
     msym_error_t MSYM_EXPORT msymGenerateSubrepresentationSpaces(msym_context ctx);
+    msym_error_t MSYM_EXPORT msymGenerateSubrepresentationSpace(msym_context ctx, int species);
     msym_error_t MSYM_EXPORT msymAlignAxes(msym_context ctx);
     
     msym_error_t MSYM_EXPORT msymGetCenterOfMass(msym_context ctx, double v[3]);
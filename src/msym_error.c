@@ -11,14 +11,14 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include "msym_error.h"
-
-
-#define MSYM_ERROR_DETAILS_MAX_LENGTH 1024
+#include "parallel.h"
 
 const char * invalid = "Invalid error code";
 
-char err_details[MSYM_ERROR_DETAILS_MAX_LENGTH];
-char err_details_ext[MSYM_ERROR_DETAILS_MAX_LENGTH];
+/* Details of the last error on the calling thread, functions taking a context also keep a copy
+ * in the context (msymGetContextErrorDetails) so concurrent contexts never see each others errors */
+MSYM_THREAD_LOCAL char err_details[MSYM_ERROR_DETAILS_MAX_LENGTH];
+MSYM_THREAD_LOCAL char err_details_ext[MSYM_ERROR_DETAILS_MAX_LENGTH];
 
 const struct _errordesc {
     msym_error_t code;
@@ -59,6 +59,10 @@ const char MSYM_EXPORT *msymGetErrorDetails(){
     return err_details_ext;
 }
 
+void msymCopyErrorDetails(size_t l, char *details){
+    if(l > 0) snprintf(details, l, "%s", err_details);
+}
+
 const char MSYM_EXPORT *msymErrorString(msym_error_t error){
     const char *ret = invalid;
     int length = sizeof(error_desc) / sizeof(error_desc[0]);
@@ -11,8 +11,11 @@
 #ifndef __MSYM__ERROR_H
 #define __MSYM__ERROR_H
 
+#include <stddef.h>
 #include "msym_EXPORTS.h" // automatically generated by cmake
 
+#define MSYM_ERROR_DETAILS_MAX_LENGTH 1024
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -45,6 +48,7 @@ extern "C" {
     const char *msymErrorString(msym_error_t error);
     void msymSetErrorDetails(const char *format, ...);
     const char *msymGetErrorDetails();
+    void msymCopyErrorDetails(size_t l, char *details);
     
     
 #ifdef __cplusplus
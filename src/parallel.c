@@ -0,0 +1,213 @@
+//
+//  parallel.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdlib.h>
+
+#include "parallel.h"
+#include "allocator.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK msym_parallel_lock_t;
+typedef HANDLE msym_thread_t;
+#define parallelLockInit(l) InitializeSRWLock(l)
+#define parallelLockDestroy(l)
+#define parallelLock(l) AcquireSRWLockExclusive(l)
+#define parallelUnlock(l) ReleaseSRWLockExclusive(l)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t msym_parallel_lock_t;
+typedef pthread_t msym_thread_t;
+#define parallelLockInit(l) pthread_mutex_init(l, NULL)
+#define parallelLockDestroy(l) pthread_mutex_destroy(l)
+#define parallelLock(l) pthread_mutex_lock(l)
+#define parallelUnlock(l) pthread_mutex_unlock(l)
+#endif
+
+/* Tasks are handed out in order, so when a task fails every task before it has been started,
+ * and the error returned is the same one a sequential loop would have stopped at.
+ * Error details are thread local so the ones of the failing task are handed back to the caller */
+typedef struct _msym_parallel {
+    msym_parallel_lock_t lock;
+    msym_parallel_task_t f;
+    void *data;
+    int tasks;
+    int next;
+    int failed;
+    msym_error_t ret;
+    char details[MSYM_ERROR_DETAILS_MAX_LENGTH];
+} msym_parallel_t;
+
+struct _msym_parallel_meter {
+    msym_parallel_lock_t lock;
+    size_t bytes;
+    size_t peak;
+};
+
+typedef struct _msym_parallel_worker {
+    msym_parallel_t *p;
+    int id;
+} msym_parallel_worker_t;
+
+int parallelProcessors(void);
+void parallelRun(msym_parallel_worker_t *w);
+
+#ifdef _WIN32
+DWORD WINAPI parallelThread(LPVOID arg);
+
+DWORD WINAPI parallelThread(LPVOID arg){
+    parallelRun(arg);
+    return 0;
+}
+
+int parallelProcessors(void){
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+}
+#else
+void *parallelThread(void *arg);
+
+void *parallelThread(void *arg){
+    parallelRun(arg);
+    return NULL;
+}
+
+int parallelProcessors(void){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+#endif
+
+int parallelWorkers(int threads, int tasks){
+    int n = threads > 0 ? threads : parallelProcessors();
+    if(n > tasks) n = tasks;
+    return n < 1 ? 1 : n;
+}
+
+void parallelRun(msym_parallel_worker_t *w){
+    msym_parallel_t *p = w->p;
+    for(;;){
+        msym_error_t ret = MSYM_SUCCESS;
+        int task;
+
+        parallelLock(&p->lock);
+        task = p->failed < 0 && p->next < p->tasks ? p->next++ : -1;
+        parallelUnlock(&p->lock);
+
+        if(task < 0) break;
+
+        if(MSYM_SUCCESS != (ret = p->f(p->data, task, w->id))){
+            parallelLock(&p->lock);
+            if(p->failed < 0 || task < p->failed){
+                p->failed = task;
+                p->ret = ret;
+                msymCopyErrorDetails(sizeof(p->details), p->details);
+            }
+            parallelUnlock(&p->lock);
+        }
+    }
+}
+
+msym_error_t parallelFor(int threads, int tasks, msym_parallel_task_t f, void *data){
+    msym_error_t ret = MSYM_SUCCESS;
+    int workers = parallelWorkers(threads, tasks), started = 1;
+
+    if(workers == 1){
+        for(int i = 0;i < tasks;i++){
+            if(MSYM_SUCCESS != (ret = f(data, i, 0))) break;
+        }
+        return ret;
+    }
+
+    msym_parallel_t p = {.f = f, .data = data, .tasks = tasks, .next = 0, .failed = -1, .ret = MSYM_SUCCESS, .details = ""};
+    msym_parallel_worker_t *w = msymMalloc(sizeof(msym_parallel_worker_t[workers]));
+    msym_thread_t *t = msymMalloc(sizeof(msym_thread_t[workers]));
+
+    if(NULL == w || NULL == t){
+        msymFree(w);
+        msymFree(t);
+        return parallelFor(1, tasks, f, data);
+    }
+
+    parallelLockInit(&p.lock);
+
+    for(int i = 0;i < workers;i++){
+        w[i].p = &p;
+        w[i].id = i;
+    }
+
+    // If a thread cannot be created the remaining tasks are run by the ones we have
+    for(;started < workers;started++){
+#ifdef _WIN32
+        if(NULL == (t[started] = CreateThread(NULL, 0, parallelThread, &w[started], 0, NULL))) break;
+#else
+        if(0 != pthread_create(&t[started], NULL, parallelThread, &w[started])) break;
+#endif
+    }
+
+    parallelRun(&w[0]);
+
+    for(int i = 1;i < started;i++){
+#ifdef _WIN32
+        WaitForSingleObject(t[i], INFINITE);
+        CloseHandle(t[i]);
+#else
+        pthread_join(t[i], NULL);
+#endif
+    }
+
+    parallelLockDestroy(&p.lock);
+
+    msymFree(w);
+    msymFree(t);
+
+    if(MSYM_SUCCESS != p.ret) msymSetErrorDetails("%s", p.details);
+
+    return p.ret;
+}
+
+msym_parallel_meter_t *parallelMeterCreate(void){
+    msym_parallel_meter_t *m = msymMalloc(sizeof(*m));
+    if(NULL == m) return NULL;
+    parallelLockInit(&m->lock);
+    m->bytes = 0;
+    m->peak = 0;
+    return m;
+}
+
+void parallelMeterDestroy(msym_parallel_meter_t *m){
+    if(NULL == m) return;
+    parallelLockDestroy(&m->lock);
+    msymFree(m);
+}
+
+/* A NULL meter measures nothing */
+void parallelMeterAdd(msym_parallel_meter_t *m, size_t bytes){
+    if(NULL == m) return;
+    parallelLock(&m->lock);
+    m->bytes += bytes;
+    if(m->bytes > m->peak) m->peak = m->bytes;
+    parallelUnlock(&m->lock);
+}
+
+void parallelMeterRemove(msym_parallel_meter_t *m, size_t bytes){
+    if(NULL == m) return;
+    parallelLock(&m->lock);
+    m->bytes -= bytes < m->bytes ? bytes : m->bytes;
+    parallelUnlock(&m->lock);
+}
+
+size_t parallelMeterPeak(msym_parallel_meter_t *m){
+    size_t peak = 0;
+    if(NULL == m) return peak;
+    parallelLock(&m->lock);
+    peak = m->peak;
+    parallelUnlock(&m->lock);
+    return peak;
+}
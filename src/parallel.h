@@ -0,0 +1,38 @@
+//
+//  parallel.h
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#ifndef __MSYM__PARALLEL_h
+#define __MSYM__PARALLEL_h
+
+#include <stddef.h>
+#include "msym.h"
+
+#if defined(_MSC_VER)
+#define MSYM_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define MSYM_THREAD_LOCAL __thread
+#else
+#define MSYM_THREAD_LOCAL
+#endif
+
+/* Called once for each task, worker is in [0, parallelWorkers(threads, tasks)) and can be used to index
+ * per thread scratch memory, the calling thread always acts as worker 0 */
+typedef msym_error_t (*msym_parallel_task_t)(void *data, int task, int worker);
+
+/* Bytes in use by all threads, and the most that has been in use at the same time */
+typedef struct _msym_parallel_meter msym_parallel_meter_t;
+
+int parallelWorkers(int threads, int tasks);
+msym_error_t parallelFor(int threads, int tasks, msym_parallel_task_t f, void *data);
+
+msym_parallel_meter_t *parallelMeterCreate(void);
+void parallelMeterDestroy(msym_parallel_meter_t *m);
+void parallelMeterAdd(msym_parallel_meter_t *m, size_t bytes);
+void parallelMeterRemove(msym_parallel_meter_t *m, size_t bytes);
+size_t parallelMeterPeak(msym_parallel_meter_t *m);
+
+#endif /* defined(__MSYM__PARALLEL_h) */
@@ -10,19 +10,27 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "msym.h"
 #include "permutation.h"
 #include "linalg.h"
 
+#include "allocator.h"
 #include "debug.h"
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338327950288419716939937510582
+#endif
+
 msym_error_t setPermutationCycles(msym_permutation_t *perm);
+int findAxialSymmetryOperationPermutations(int l, msym_symmetry_operation_t sops[l], msym_thresholds_t *t, msym_permutation_t *permutations);
+int axialOperationProduct(int m, int index[m][2][2], msym_axial_operation_t *a, msym_axial_operation_t *b);
 
 void freePermutationData(msym_permutation_t *perm){
     if(perm != NULL){
-        free(perm->c);
-        free(perm->p);
+        msymFree(perm->c);
+        msymFree(perm->p);
     }
 }
 
@@ -31,7 +39,7 @@ msym_error_t findPermutation(msym_symmetry_operation_t *sop, int l, double (*v[l
     double m[3][3];
     symmetryOperationMatrix(sop, m);
     
-    perm->p = malloc(sizeof(int[l]));
+    perm->p = msymMalloc(sizeof(int[l]));
     memset(perm->p, -1, sizeof(int[l])); //TODO: 2s complement
     perm->p_length = l;
     
@@ -58,7 +66,7 @@ msym_error_t findPermutation(msym_symmetry_operation_t *sop, int l, double (*v[l
     return ret;
     
 err:
-    free(perm->p);
+    msymFree(perm->p);
     return ret;
 }
 
@@ -73,10 +81,10 @@ typedef struct _perm_subgroup {
 
 msym_error_t findPermutationSubgroups(int l, msym_permutation_t perm[l], int sgmax, msym_symmetry_operation_t *sops, int *subgroupl, msym_subgroup_t **subgroup){
     msym_error_t ret = MSYM_SUCCESS;
-    perm_subgroup_t *group = calloc(l, sizeof(perm_subgroup_t));
+    perm_subgroup_t *group = msymCalloc(l, sizeof(perm_subgroup_t));
     
-    int *isops = malloc(sizeof(int[l]));
-    int *msops = malloc(sizeof(int[l]));
+    int *isops = msymMalloc(sizeof(int[l]));
+    int *msops = msymMalloc(sizeof(int[l]));
     int gl = 0, glm = 0;
     
     for(int i = 0;i < l;i++){
@@ -85,9 +93,9 @@ msym_error_t findPermutationSubgroups(int l, msym_permutation_t perm[l], int sgm
             glm = gl;
             memset(msops, 0, sizeof(int[l]));
             group[gl].sopsl = c->l;
-            group[gl].sops = realloc(group[gl].sops, sizeof(int[c->l]));
+            group[gl].sops = msymRealloc(group[gl].sops, sizeof(int[c->l]));
             memset(group[gl].sops,0,sizeof(int[c->l]));
-            //group[gl].sops = calloc(c->l, sizeof(int));
+            //group[gl].sops = msymCalloc(c->l, sizeof(int));
             group[gl].subgroup[0] = group[gl].subgroup[1] = -1;
             for(int next = c->s, j = 0;j < c->l;j++){
                 msops[next] = 1;
@@ -107,7 +115,7 @@ msym_error_t findPermutationSubgroups(int l, msym_permutation_t perm[l], int sgm
     }
     
     if(glm == gl){
-        free(group[gl].sops);
+        msymFree(group[gl].sops);
     }
         
     for(int i = 0;i < gl && gl < sgmax;i++){
@@ -161,9 +169,9 @@ msym_error_t findPermutationSubgroups(int l, msym_permutation_t perm[l], int sgm
                     }
                 }
                 if(f == gl){
-                    group = realloc(group, sizeof(perm_subgroup_t[gl+1]));
+                    group = msymRealloc(group, sizeof(perm_subgroup_t[gl+1]));
                     group[gl].sopsl = n;
-                    group[gl].sops = malloc(sizeof(int[n]));
+                    group[gl].sops = msymMalloc(sizeof(int[n]));
                     memcpy(group[gl].sops, isops, sizeof(int[n]));
                     group[gl].subgroup[0] = i;
                     group[gl].subgroup[1] = j;
@@ -173,9 +181,9 @@ msym_error_t findPermutationSubgroups(int l, msym_permutation_t perm[l], int sgm
         }
     }
 
-    msym_subgroup_t *mgroup = calloc(gl, sizeof(msym_subgroup_t));
+    msym_subgroup_t *mgroup = msymCalloc(gl, sizeof(msym_subgroup_t));
     for(int i = 0;i < gl;i++){
-        mgroup[i].sops = calloc(group[i].sopsl, sizeof(msym_symmetry_operation_t *));
+        mgroup[i].sops = msymCalloc(group[i].sopsl, sizeof(msym_symmetry_operation_t *));
         mgroup[i].order = group[i].sopsl;
         mgroup[i].generators[0] = group[i].subgroup[0] < 0 ? NULL : &mgroup[group[i].subgroup[0]];
         mgroup[i].generators[1] = group[i].subgroup[1] < 0 ? NULL : &mgroup[group[i].subgroup[1]];
@@ -190,11 +198,11 @@ msym_error_t findPermutationSubgroups(int l, msym_permutation_t perm[l], int sgm
     
 //err:
     for(int i = 0;i < gl;i++){
-        free(group[i].sops);
+        msymFree(group[i].sops);
     }
-    free(group);
-    free(isops);
-    free(msops);
+    msymFree(group);
+    msymFree(isops);
+    msymFree(msops);
     return ret;
 }
 
@@ -202,21 +210,23 @@ msym_error_t findSymmetryOperationPermutations(int l, msym_symmetry_operation_t
     
     msym_error_t ret = MSYM_SUCCESS;
     //Don't block allocate this, it's a pain to keep track of the pointers
-    msym_permutation_t *permutations = malloc(sizeof(msym_permutation_t[l]));
+    msym_permutation_t *permutations = msymMalloc(sizeof(msym_permutation_t[l]));
     
     for(int i = 0; i < l;i++){
-        permutations[i].p = malloc(sizeof(int[l]));
+        permutations[i].p = msymMalloc(sizeof(int[l]));
         memset(permutations[i].p, -1, sizeof(int[l]));
         permutations[i].p_length = l;
     }
     
-    double (*msops)[3][3] = malloc(sizeof(double[l][3][3]));
+    double (*msops)[3][3] = msymMalloc(sizeof(double[l][3][3]));
     
     for(int i = 0; i < l;i++){
         symmetryOperationMatrix(&sops[i], msops[i]);
     }
     
-    for(int i = 0; i < l;i++){
+    int axial = findAxialSymmetryOperationPermutations(l, sops, t, permutations);
+    
+    for(int i = 0; i < l && !axial;i++){
         if((sops[i].type == PROPER_ROTATION && sops[i].order == 0) || sops[i].type == IDENTITY){
             for(int j = 0;j < l;j++) permutations[i].p[j] = j;
         } else {
@@ -247,28 +257,197 @@ msym_error_t findSymmetryOperationPermutations(int l, msym_symmetry_operation_t
         if(MSYM_SUCCESS != (ret = setPermutationCycles(&permutations[i]))) goto err;
     }
     
-    free(msops);
+    msymFree(msops);
     *rperm = permutations;
     
     return ret;
     
 err:
-    free(msops);
+    msymFree(msops);
     for(int i = 0; i < l;i++){
-        free(permutations[i].p);
+        msymFree(permutations[i].p);
     }
-    free(permutations);
+    msymFree(permutations);
     *rperm = NULL;
     return ret;
     
 }
 
+/* Returns 1 and the (a, f, h) form of each operation if all operations are axial in the canonical frame, otherwise 0.
+ * Operations in the molecular frame are taken to the canonical frame by transform (if not NULL), and m is the number of rotation steps per turn */
+int findAxialSymmetryOperations(int l, msym_symmetry_operation_t sops[l], double transform[3][3], msym_thresholds_t *t, int *om, msym_axial_operation_t aops[l]){
+    int m = 0, found = 0;
+    int (*index)[2][2] = NULL;
+    
+    for(int i = 0;i < l;i++){
+        if(sops[i].type == PROPER_ROTATION && sops[i].order == 0) return 0;
+        if(sops[i].order > m) m = sops[i].order;
+    }
+    
+    m = 4*(m > 0 ? m : 1);
+    
+    index = msymMalloc(sizeof(int[m][2][2]));
+    memset(index, -1, sizeof(int[m][2][2]));
+    
+    for(int i = 0;i < l;i++){
+        msym_symmetry_operation_t sop = sops[i];
+        double sm[3][3], am[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+        if(NULL != transform) mvmul(sop.v, transform, sop.v);
+        symmetryOperationMatrix(&sop, sm);
+        int f = sm[0][0]*sm[1][1] - sm[0][1]*sm[1][0] < 0, h = sm[2][2] < 0;
+        double theta = atan2(sm[1][0], sm[0][0]);
+        int a = (int) lround(theta*m/(2*M_PI));
+        a = ((a % m) + m) % m;
+        
+        theta = 2*M_PI*a/m;
+        am[0][0] = cos(theta);
+        am[1][0] = sin(theta);
+        am[0][1] = f ? sin(theta) : -sin(theta);
+        am[1][1] = f ? -cos(theta) : cos(theta);
+        am[2][2] = h ? -1 : 1;
+        
+        if(!mequal(sm, am, t->permutation) || index[a][f][h] >= 0) goto err;
+        
+        aops[i].a = a;
+        aops[i].f = f;
+        aops[i].h = h;
+        index[a][f][h] = i;
+    }
+    
+    *om = m;
+    found = 1;
+    
+err:
+    msymFree(index);
+    return found;
+}
+
+/* Index of the operation a*b, or -1 if it is not in index */
+int axialOperationProduct(int m, int index[m][2][2], msym_axial_operation_t *a, msym_axial_operation_t *b){
+    return index[(a->a + (a->f ? m - b->a : b->a)) % m][a->f ^ b->f][a->h ^ b->h];
+}
+
+/* Returns 1 and fills the multiplication table if all operations are axial, otherwise 0 */
+int findAxialSymmetryOperationPermutations(int l, msym_symmetry_operation_t sops[l], msym_thresholds_t *t, msym_permutation_t *permutations){
+    int m = 0, found = 0;
+    int (*index)[2][2] = NULL;
+    msym_axial_operation_t *aops = msymMalloc(sizeof(msym_axial_operation_t[l]));
+    
+    if(!findAxialSymmetryOperations(l, sops, NULL, t, &m, aops)) goto err;
+    
+    index = msymMalloc(sizeof(int[m][2][2]));
+    memset(index, -1, sizeof(int[m][2][2]));
+    for(int i = 0;i < l;i++) index[aops[i].a][aops[i].f][aops[i].h] = i;
+    
+    for(int i = 0;i < l;i++){
+        for(int j = 0;j < l;j++){
+            int k = axialOperationProduct(m, index, &aops[i], &aops[j]);
+            if(k < 0) goto err;
+            permutations[i].p[j] = k;
+        }
+    }
+    
+    found = 1;
+    
+err:
+    msymFree(aops);
+    msymFree(index);
+    return found;
+}
+
+/* Permutations of v under axial operations (see findAxialSymmetryOperations).
+ * Only operations that can't be composed from those already found are matched against v (usually two or three),
+ * the rest of the group is generated from these and each composed permutation is checked against its operation.
+ * This is O(|G|*l) instead of the O(|G|*l^2) of matching every operation, which matters for high order axes */
+msym_error_t findAxialPermutations(int sopsl, msym_symmetry_operation_t sops[sopsl], int m, msym_axial_operation_t aops[sopsl], int l, double (*v[l])[3], msym_thresholds_t *t, msym_permutation_t perm[sopsl]){
+    msym_error_t ret = MSYM_SUCCESS;
+    int (*index)[2][2] = msymMalloc(sizeof(int[m][2][2]));
+    int *queue = msymMalloc(sizeof(int[sopsl]));
+    int *gen = msymMalloc(sizeof(int[sopsl]));
+    int ql = 0, gl = 0;
+    
+    memset(index, -1, sizeof(int[m][2][2]));
+    for(int i = 0;i < sopsl;i++){
+        index[aops[i].a][aops[i].f][aops[i].h] = i;
+        perm[i].p = NULL;
+        perm[i].c = NULL;
+    }
+    
+    for(int i = 0;i < sopsl;i++){
+        if(NULL != perm[i].p) continue;
+        if(MSYM_SUCCESS != (ret = findPermutation(&sops[i], l, v, t, &perm[i]))){
+            perm[i].p = NULL;
+            goto err;
+        }
+        gen[gl++] = i;
+        queue[ql++] = i;
+        
+        for(int q = 0;q < ql;q++){
+            for(int g = 0;g < gl;g++){
+                int k = axialOperationProduct(m, index, &aops[gen[g]], &aops[queue[q]]), *p, *pg, *pq, match = 1;
+                double mk[3][3];
+                if(k < 0){
+                    char buf[16];
+                    symmetryOperationName(&sops[gen[g]], sizeof(buf), buf);
+                    msymSetErrorDetails("Product with symmetry operation %s is not in the point group",buf);
+                    ret = MSYM_PERMUTATION_ERROR;
+                    goto err;
+                }
+                if(NULL != perm[k].p) continue;
+                
+                p = perm[k].p = msymMalloc(sizeof(int[l]));
+                pg = perm[gen[g]].p;
+                pq = perm[queue[q]].p;
+                perm[k].p_length = l;
+                symmetryOperationMatrix(&sops[k], mk);
+                for(int j = 0;j < l && match;j++){
+                    double r[3];
+                    p[j] = pg[pq[j]];
+                    mvmul(*v[j], mk, r);
+                    match = vequal(r, *v[p[j]], t->permutation);
+                }
+                
+                if(match){
+                    ret = setPermutationCycles(&perm[k]);
+                } else {
+                    msymFree(p);
+                    ret = findPermutation(&sops[k], l, v, t, &perm[k]);
+                }
+                
+                if(MSYM_SUCCESS != ret){
+                    perm[k].p = NULL;
+                    goto err;
+                }
+                
+                queue[ql++] = k;
+            }
+        }
+    }
+    
+    msymFree(index);
+    msymFree(queue);
+    msymFree(gen);
+    return ret;
+    
+err:
+    for(int i = 0;i < sopsl;i++){
+        msymFree(perm[i].p);
+        msymFree(perm[i].c);
+        perm[i].p = NULL;
+        perm[i].c = NULL;
+    }
+    msymFree(index);
+    msymFree(queue);
+    msymFree(gen);
+    return ret;
+}
+
 msym_error_t setPermutationCycles(msym_permutation_t *perm){
     msym_error_t ret = MSYM_SUCCESS;
     int l = perm->p_length;
-    int *icycle = malloc(sizeof(int[l]));
-    int *pcycle = malloc(sizeof(int[l]));
-    int *lcycle = malloc(sizeof(int[l]));
+    int *icycle = msymMalloc(sizeof(int[l]));
+    int *pcycle = msymMalloc(sizeof(int[l]));
+    int *lcycle = msymMalloc(sizeof(int[l]));
     
     int cl = 0;
     memset(icycle, -1,sizeof(int[l])); //TODO: 2s complement
@@ -294,7 +473,7 @@ msym_error_t setPermutationCycles(msym_permutation_t *perm){
         cl++;
     }
     perm->c_length = cl;
-    perm->c = malloc(sizeof(msym_permutation_cycle_t[cl]));
+    perm->c = msymMalloc(sizeof(msym_permutation_cycle_t[cl]));
     for(int c = 0; c < cl;c++){
         perm->c[c].l = lcycle[c];
         perm->c[c].s = pcycle[c];
@@ -302,9 +481,9 @@ msym_error_t setPermutationCycles(msym_permutation_t *perm){
     
     
 err:
-    free(icycle);
-    free(pcycle);
-    free(lcycle);
+    msymFree(icycle);
+    msymFree(pcycle);
+    msymFree(lcycle);
     return ret;
 }
 
@@ -42,6 +42,19 @@ typedef struct _msym_permutation_morphism {
 } msym_permutation_morphism_t;
 
 
+/* Cyclic and dihedral operations in the canonical frame (primary axis along z) can be written as
+ * Z^h * R(2*pi*a/m) * F^f, where R is a rotation about z, F a reflection y -> -y and Z a reflection z -> -z.
+ * Since F*R(b) = R(-b)*F and Z commutes with both, the product of two operations only needs
+ * integer arithmetic on (a, f, h), which lets us build the multiplication table and compose
+ * permutations without comparing matrices or vectors for every operation of high order axes */
+typedef struct _msym_axial_operation {
+    int a;  // power of rotation about z in units of 2*pi/m
+    int f;  // in-plane reflection y -> -y applied before rotation
+    int h;  // horizontal reflection z -> -z
+} msym_axial_operation_t;
+
+int findAxialSymmetryOperations(int l, msym_symmetry_operation_t sops[l], double transform[3][3], msym_thresholds_t *t, int *m, msym_axial_operation_t aops[l]);
+msym_error_t findAxialPermutations(int sopsl, msym_symmetry_operation_t sops[sopsl], int m, msym_axial_operation_t aops[sopsl], int l, double (*v[l])[3], msym_thresholds_t *t, msym_permutation_t perm[sopsl]);
 msym_error_t findSymmetryOperationPermutations(int l, msym_symmetry_operation_t sops[l], msym_thresholds_t *t, msym_permutation_t **ret);
 msym_error_t findPermutation(msym_symmetry_operation_t *sop, int l, double (*v[l])[3], msym_thresholds_t *t, msym_permutation_t *perm);
 void freePermutationData(msym_permutation_t *perm);
@@ -18,7 +18,9 @@
 #include "linalg.h"
 #include "point_group.h"
 #include "permutation.h"
+#include "point_group_cache.h"
 
+#include "allocator.h"
 #include "debug.h"
 
 #define PHI 1.618033988749894848204586834
@@ -30,9 +32,6 @@
 #define M_PI_2 (M_PI/2)
 #endif
 
-
-#define CLASSIFICATION_THRESHOLD 0.01
-
 msym_error_t determinePointGroup(int sopsl, msym_symmetry_operation_t *sops, msym_thresholds_t *thresholds, msym_point_group_t *pg);
 
 msym_error_t generatePointGroup(msym_point_group_type_t type, int n, msym_symmetry_operation_t *primary, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_thresholds_t *thresholds, msym_point_group_t **opg);
@@ -85,46 +84,37 @@ msym_error_t generateSymmetryOperationsUnknown(int n, int l, msym_symmetry_opera
 
 
 msym_error_t pointGroupFromName(const char *name, msym_point_group_t *pg);
-msym_error_t pointGroupFromType(msym_point_group_type_t type, int n, msym_point_group_t *pg);
 msym_error_t generatePointGroupFromStruct(msym_point_group_t *pg, double transform[3][3], msym_thresholds_t *thresholds);
-
-int classifySymmetryOperations(msym_point_group_t *pg);
-void sortSymmetryOperations(msym_point_group_t *pg, int classes);
+msym_error_t generateCanonicalPointGroupOperations(msym_point_group_t *pg, msym_thresholds_t *thresholds);
 
 msym_error_t generatePointGroupFromType(msym_point_group_type_t type, int n, double transform[3][3], msym_thresholds_t *thresholds, msym_point_group_t **opg){
     msym_error_t ret = MSYM_SUCCESS;
-    msym_point_group_t *pg = calloc(1,sizeof(msym_point_group_t));
+    msym_point_group_t *pg = msymCalloc(1,sizeof(msym_point_group_t));
     if(MSYM_SUCCESS != (ret = pointGroupFromType(type,n,pg))) goto err;
     if(MSYM_SUCCESS != (ret = generatePointGroupFromStruct(pg, transform, thresholds))) goto err;
     *opg = pg;
     return ret;
 err:
-    free(pg);
+    msymFree(pg);
     return ret;
 }
 
 msym_error_t generatePointGroupFromName(const char *name, double transform[3][3], msym_thresholds_t *thresholds, msym_point_group_t **opg){
     msym_error_t ret = MSYM_SUCCESS;
-    msym_point_group_t *pg = calloc(1,sizeof(msym_point_group_t));
+    msym_point_group_t *pg = msymCalloc(1,sizeof(msym_point_group_t));
     if(MSYM_SUCCESS != (ret = pointGroupFromName(name,pg))) goto err;
     if(MSYM_SUCCESS != (ret = generatePointGroupFromStruct(pg, transform, thresholds))) goto err;
     *opg = pg;
     return ret;
 err:
-    free(pg);
+    msymFree(pg);
     return ret;
 }
 
 msym_error_t generatePointGroupFromStruct(msym_point_group_t *pg, double transform[3][3], msym_thresholds_t *thresholds){
     msym_error_t ret = MSYM_SUCCESS;
 
-    if(MSYM_SUCCESS != (ret = generateSymmetryOperations(pg->type, pg->n, pg->order, &pg->sops))) goto err;
-    
-    if(isLinearPointGroup(pg)){
-        pg->perm = NULL;
-    } else {
-        if(MSYM_SUCCESS != (ret = findSymmetryOperationPermutations(pg->order,pg->sops, thresholds, &pg->perm))) goto err;
-    }
+    if(MSYM_SUCCESS != (ret = generateCanonicalPointGroupOperations(pg, thresholds))) goto err;
     
     memcpy(pg->transform, transform, sizeof(double[3][3]));
     
@@ -139,12 +129,48 @@ msym_error_t generatePointGroupFromStruct(msym_point_group_t *pg, double transfo
     return ret;
     
 err:
-    free(pg->sops);
+    msymFree(pg->sops);
     pg->sops = NULL;
     // Need to free findSymmetryOperationPermutations if there is ever a possibility of an error after that call
     return ret;
 }
 
+/* Operations and multiplication table in the canonical frame only depend on type and n,
+ * so they are generated once per process and copied from the point group cache */
+msym_error_t generateCanonicalPointGroupOperations(msym_point_group_t *pg, msym_thresholds_t *thresholds){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_symmetry_operation_t *sops = NULL;
+    msym_permutation_t *perm = NULL;
+    int found = 0;
+    
+    if(isLinearPointGroup(pg)){
+        if(MSYM_SUCCESS != (ret = generateSymmetryOperations(pg->type, pg->n, pg->order, &sops))) goto err;
+        pg->sops = sops;
+        pg->perm = NULL;
+        return ret;
+    }
+    
+    if(MSYM_SUCCESS != (ret = findCachedPointGroupOperations(pg->type, pg->n, pg->order, &found, &sops, &perm))) goto err;
+    
+    if(!found){
+        if(MSYM_SUCCESS != (ret = generateSymmetryOperations(pg->type, pg->n, pg->order, &sops))) goto err;
+        if(MSYM_SUCCESS != (ret = findSymmetryOperationPermutations(pg->order, sops, thresholds, &perm))) goto err;
+        if(MSYM_SUCCESS != (ret = cachePointGroupOperations(pg->type, pg->n, pg->order, sops, perm))) goto err;
+    }
+    
+    pg->sops = sops;
+    pg->perm = perm;
+    
+    return ret;
+err:
+    for(int i = 0;i < pg->order && NULL != perm;i++){
+        freePermutationData(&perm[i]);
+    }
+    msymFree(perm);
+    msymFree(sops);
+    return ret;
+}
+
 msym_error_t pointGroupFromType(msym_point_group_type_t type, int n, msym_point_group_t *pg){
     msym_error_t ret = MSYM_SUCCESS;
     pg->type = type;
@@ -329,7 +355,7 @@ err:
 
 msym_error_t generatePointGroup(msym_point_group_type_t type, int n, msym_symmetry_operation_t *primary, int sopsl, msym_symmetry_operation_t sops[sopsl], msym_thresholds_t *thresholds, msym_point_group_t **opg){
     msym_error_t ret = MSYM_SUCCESS;
-    msym_point_group_t *pg = calloc(1,sizeof(msym_point_group_t));
+    msym_point_group_t *pg = msymCalloc(1,sizeof(msym_point_group_t));
     pg->type = type;
     pg->n = n;
     if(MSYM_SUCCESS != (ret = getPointGroupName(type,n,sizeof(pg->name)/sizeof(char),pg->name))) goto err;
@@ -346,13 +372,7 @@ msym_error_t generatePointGroup(msym_point_group_type_t type, int n, msym_symmet
     
     if(MSYM_SUCCESS != (ret = transformAxes(type, n, primary, sopsl, sops, thresholds, pg->transform))) goto err;
     
-    if(MSYM_SUCCESS != (ret = generateSymmetryOperations(type, n, pg->order, &pg->sops))) goto err;
-    
-    if(isLinearPointGroup(pg)){
-        pg->perm = NULL;
-    } else {
-        if(MSYM_SUCCESS != (ret = findSymmetryOperationPermutations(pg->order,pg->sops, thresholds, &pg->perm))) goto err;
-    }
+    if(MSYM_SUCCESS != (ret = generateCanonicalPointGroupOperations(pg, thresholds))) goto err;
 
     double T[3][3];
     minv(pg->transform, T);
@@ -372,8 +392,8 @@ msym_error_t generatePointGroup(msym_point_group_type_t type, int n, msym_symmet
     return ret;
     
 err:
-    if(pg) free(pg->sops);
-    free(pg);
+    if(pg) msymFree(pg->sops);
+    msymFree(pg);
     return ret;
 }
 
@@ -422,7 +442,7 @@ msym_error_t findPointGroup(int sopsl, msym_symmetry_operation_t *sops, msym_thr
     
     if(tpg.order < sopsl){
         int length = 2*sopsl > 121 ? 2*sopsl : 121;
-        tsops = calloc(length, sizeof(msym_symmetry_operation_t));
+        tsops = msymCalloc(length, sizeof(msym_symmetry_operation_t));
         memcpy(tsops, sops, sizeof(msym_symmetry_operation_t[sopsl]));
         if(MSYM_SUCCESS != (ret = generateSymmetryOperationsImpliedRot(tsopsl, tsops, length, thresholds, &tsopsl))) goto err;
         tpg.primary = NULL;
@@ -446,7 +466,7 @@ msym_error_t findPointGroup(int sopsl, msym_symmetry_operation_t *sops, msym_thr
     }
     
 err:
-    free(tsops);
+    msymFree(tsops);
     return ret;
 
 }
@@ -867,6 +887,9 @@ msym_error_t reduceLinearPointGroup(msym_point_group_t *pg, int n, msym_threshol
     }
     
     
+    /* Permutations are found in the canonical frame where cyclic and dihedral groups don't need matrix comparisons */
+    if(MSYM_SUCCESS != (ret = findSymmetryOperationPermutations(order,sops, thresholds, &perm))) goto err;
+    
     double T[3][3];
     minv(pg->transform, T);
     
@@ -874,15 +897,11 @@ msym_error_t reduceLinearPointGroup(msym_point_group_t *pg, int n, msym_threshol
         mvmul(sops[i].v,T,sops[i].v);
     }
     
-    
-    
-    if(MSYM_SUCCESS != (ret = findSymmetryOperationPermutations(order,sops, thresholds, &perm))) goto err;
-    
     for(int i = 0;i < pg->order && pg->perm != NULL;i++){
         freePermutationData(&pg->perm[i]);
     }
     
-    free(pg->sops);
+    msymFree(pg->sops);
     
     
     pg->sops = sops;
@@ -892,7 +911,7 @@ msym_error_t reduceLinearPointGroup(msym_point_group_t *pg, int n, msym_threshol
     
     return ret;
 err:
-    free(sops);
+    msymFree(sops);
     return ret;
 
 }
@@ -901,11 +920,11 @@ err:
  * and move it to the group so we don't have to regenerate */
 msym_error_t pointGroupFromSubgroup(const msym_subgroup_t *sg, msym_thresholds_t *thresholds, msym_point_group_t **opg){
     msym_error_t ret = MSYM_SUCCESS;
-    *opg = calloc(1,sizeof(msym_point_group_t));
+    *opg = msymCalloc(1,sizeof(msym_point_group_t));
     msym_point_group_t *pg = *opg;
     pg->type = sg->type;
     pg->n = sg->n;
-    pg->sops = malloc(sizeof(msym_symmetry_operation_t[sg->order]));
+    pg->sops = msymMalloc(sizeof(msym_symmetry_operation_t[sg->order]));
     memcpy(pg->name,sg->name,sizeof(pg->name));
     
     if(MSYM_SUCCESS != (ret = getPointGroupOrder(pg->type, pg->n, &pg->order))) goto err;
@@ -926,17 +945,11 @@ msym_error_t pointGroupFromSubgroup(const msym_subgroup_t *sg, msym_thresholds_t
     
     /* Unfortunately we need to regenerate these as they need a specific
      * class ordering for orbital symmetrization */
-    free(pg->sops);
+    msymFree(pg->sops);
     pg->sops = NULL;
     pg->primary = NULL;
     
-    if(MSYM_SUCCESS != (ret = generateSymmetryOperations(pg->type, pg->n, pg->order, &pg->sops))) goto err;
-    
-    if(isLinearPointGroup(pg)){
-        pg->perm = NULL;
-    } else {
-        if(MSYM_SUCCESS != (ret = findSymmetryOperationPermutations(pg->order,pg->sops, thresholds, &pg->perm))) goto err;
-    }
+    if(MSYM_SUCCESS != (ret = generateCanonicalPointGroupOperations(pg, thresholds))) goto err;
     
     double T[3][3];
     minv(pg->transform, T);
@@ -957,8 +970,8 @@ msym_error_t pointGroupFromSubgroup(const msym_subgroup_t *sg, msym_thresholds_t
     return ret;
 err:
     *opg = NULL;
-    free(pg->sops);
-    free(pg);
+    msymFree(pg->sops);
+    msymFree(pg);
     return ret;
 }
 
@@ -1185,7 +1198,7 @@ err:
 
 msym_error_t generateSymmetryOperations(msym_point_group_type_t type, int n, int order, msym_symmetry_operation_t **osops){
     msym_error_t ret = MSYM_SUCCESS;
-    msym_symmetry_operation_t *sops = calloc(order, sizeof(msym_symmetry_operation_t));
+    msym_symmetry_operation_t *sops = msymCalloc(order, sizeof(msym_symmetry_operation_t));
     sops[0].cla = 0;
     sops[0].type = IDENTITY;
     sops[0].power = 1;
@@ -1243,7 +1256,7 @@ msym_error_t generateSymmetryOperations(msym_point_group_type_t type, int n, int
     *osops = sops;
     return ret;
 err:
-    free(sops);
+    msymFree(sops);
     return ret;
 
 }
@@ -2140,66 +2153,15 @@ err:
     return ret;
 }
 
-
-int classifySymmetryOperations(msym_point_group_t *pg){
-    int c = 1;
-    double (*mop)[3][3] = malloc(sizeof(double[pg->order][3][3]));
-    double (*imop)[3][3] = malloc(sizeof(double[pg->order][3][3]));
-    
-    //There may be a better way to do this
-    for(int i = 0; i < pg->order;i++){
-        if(pg->sops[i].type == IDENTITY){
-            pg->sops[i].cla = 0;
-        } else {
-            pg->sops[i].cla = -1;
-        }
-        msym_symmetry_operation_t isop;
-        invertSymmetryOperation(&(pg->sops[i]), &isop);
-        symmetryOperationMatrix(&(pg->sops[i]), mop[i]);
-        symmetryOperationMatrix(&isop, imop[i]);
-    }
-    
-    for(int i = 0; i < pg->order;i++){
-        if(pg->sops[i].cla < 0){
-            pg->sops[i].cla = c;
-            for(int j = 0; j < pg->order;j++){
-                double m[3][3];
-                mmmul(mop[i], imop[j], m);
-                mmmul(mop[j],m,m);
-                for(int k = 0; k < pg->order;k++){
-                    if(mequal(mop[k],m,CLASSIFICATION_THRESHOLD)){ //Don't need to be dynamic, this is done on generated point groups (always the same)
-                        pg->sops[k].cla = c;
-                    }
-                }
-            }
-            c++;
-        }
-    }
-    
-    free(mop);
-    free(imop);
-    
-    return c;
-    
-    
-}
-
-//cant be bothereed writing an efficient sorting alg for this
-void sortSymmetryOperations(msym_point_group_t *pg, int classes){
-    msym_symmetry_operation_t *tmp = malloc(pg->order*sizeof(msym_symmetry_operation_t));
-    int n = 0;
-    
-    for(int c = 0; c < classes;c++){
-        for(int i = 0; i < pg->order;i++){
-            if(pg->sops[i].cla == c){
-                copySymmetryOperation(&tmp[n], &pg->sops[i]);
-                n++;
-            }
-        }
+void freePointGroup(msym_point_group_t *pg){
+    if(NULL == pg) return;
+    for(int i = 0;i < pg->order && pg->perm != NULL;i++){
+        freePermutationData(&pg->perm[i]);
     }
-    memcpy(pg->sops, tmp,pg->order*sizeof(msym_symmetry_operation_t));
-
-    free(tmp);
+    msymFree(pg->perm);
+    msymFree(pg->ct);
+    msymFree(pg->sops);
+    msymFree(pg);
 }
 
 int numberOfSubgroups(msym_point_group_t *pg){
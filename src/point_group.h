@@ -37,8 +37,10 @@ msym_error_t findSubgroup(msym_subgroup_t *subgroup, msym_thresholds_t *threshol
 msym_error_t findCharacterTable(msym_point_group_t *pg);
 msym_error_t generatePointGroupFromName(const char *name, double transform[3][3], msym_thresholds_t *thresholds, msym_point_group_t **opg);
 msym_error_t generatePointGroupFromType(msym_point_group_type_t type, int n, double transform[3][3], msym_thresholds_t *thresholds, msym_point_group_t **opg);
+msym_error_t pointGroupFromType(msym_point_group_type_t type, int n, msym_point_group_t *pg);
 msym_error_t pointGroupFromSubgroup(const msym_subgroup_t *sg, msym_thresholds_t *thresholds, msym_point_group_t **opg);
 msym_error_t reduceLinearPointGroup(msym_point_group_t *pg, int n, msym_thresholds_t *thresholds);
 int numberOfSubgroups(msym_point_group_t *pg);
+void freePointGroup(msym_point_group_t *pg);
 
 #endif /* defined(__MSYM__POINT_GROUP_h) */
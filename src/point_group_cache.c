@@ -0,0 +1,460 @@
+//
+//  point_group_cache.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "point_group_cache.h"
+#include "character_table.h"
+#include "allocator.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK msym_cache_lock_t;
+#define CACHE_LOCK_INITIALIZER SRWLOCK_INIT
+#define cacheLock(l) AcquireSRWLockExclusive(l)
+#define cacheUnlock(l) ReleaseSRWLockExclusive(l)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t msym_cache_lock_t;
+#define CACHE_LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define cacheLock(l) pthread_mutex_lock(l)
+#define cacheUnlock(l) pthread_mutex_unlock(l)
+#endif
+
+/* Canonical frame operations (with class indices) and multiplication table of a point group.
+ * Entries are never modified or freed once inserted, so they can be read without holding the lock,
+ * callers always get their own copy since the operations are transformed in place */
+typedef struct _msym_point_group_cache_entry {
+    msym_point_group_type_t type;
+    int n;
+    int order;
+    msym_symmetry_operation_t *sops;
+    msym_permutation_t *perm;
+    struct _msym_point_group_cache_entry *next;
+} msym_point_group_cache_entry_t;
+
+/* Character table with class representatives set to NULL, the direct product table
+ * is only generated on request and is protected by the cache lock */
+struct _msym_character_table_cache_entry {
+    msym_point_group_type_t type;
+    int n;
+    int order;
+    msym_character_table_t *ct;
+    double *dp;
+    struct _msym_character_table_cache_entry *next;
+};
+
+#define SUBSPACE_CACHE_BUCKETS 256
+#define SUBSPACE_CACHE_BYTES (64*1024*1024)
+#define SUBSPACE_CACHE_THRESHOLD 1.0e-10
+
+/* Orthonormal subspace of an irreducible representation on an equivalence set. The representation matrices
+ * depend on the orientation of the molecule and are compared within SUBSPACE_CACHE_THRESHOLD, the key owns
+ * copies of the permutations (as p only), representation matrices and characters */
+typedef struct _msym_subspace_cache_entry {
+    unsigned long hash;
+    msym_subspace_key_t key;
+    int pd;
+    int *p;
+    int l;
+    double *ss;
+    struct _msym_subspace_cache_entry *next;
+} msym_subspace_cache_entry_t;
+
+#define RSH_CACHE_BYTES (16*1024*1024)
+#define RSH_CACHE_THRESHOLD 1.0e-10
+
+/* Real spherical harmonic representations of one l, identified by the l = 1 representations
+ * they were generated from, which are compared within RSH_CACHE_THRESHOLD */
+typedef struct _msym_rsh_cache_entry {
+    int sopsl;
+    int l;
+    double *r1;
+    double *r;
+    struct _msym_rsh_cache_entry *next;
+} msym_rsh_cache_entry_t;
+
+static msym_cache_lock_t cache_lock = CACHE_LOCK_INITIALIZER;
+static msym_point_group_cache_entry_t *cache = NULL;
+static msym_character_table_cache_entry_t *ct_cache = NULL;
+static msym_subspace_cache_entry_t *ss_cache[SUBSPACE_CACHE_BUCKETS];
+static size_t ss_cache_bytes = 0;
+static msym_rsh_cache_entry_t *rsh_cache = NULL;
+static size_t rsh_cache_bytes = 0;
+
+msym_character_table_cache_entry_t *lookupCharacterTableCacheEntry(msym_point_group_type_t type, int n, int order);
+unsigned long subspaceKeyHash(msym_subspace_key_t *key);
+int subspaceKeyEqual(msym_subspace_cache_entry_t *e, unsigned long hash, msym_subspace_key_t *key);
+msym_subspace_cache_entry_t *lookupSubspaceCacheEntry(unsigned long hash, msym_subspace_key_t *key);
+void freeSubspaceCacheEntry(msym_subspace_cache_entry_t *e);
+msym_rsh_cache_entry_t *lookupRSHCacheEntry(int sopsl, int l, double r1[sopsl][3][3]);
+
+static msym_point_group_cache_entry_t *lookupPointGroupCacheEntry(msym_point_group_type_t type, int n){
+    msym_point_group_cache_entry_t *e;
+    cacheLock(&cache_lock);
+    for(e = cache;e != NULL && !(e->type == type && e->n == n);e = e->next);
+    cacheUnlock(&cache_lock);
+    return e;
+}
+
+msym_error_t copyPointGroupOperations(int order, msym_symmetry_operation_t sops[order], msym_permutation_t perm[order], msym_symmetry_operation_t **osops, msym_permutation_t **operm){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_symmetry_operation_t *csops = msymMalloc(sizeof(msym_symmetry_operation_t[order]));
+    msym_permutation_t *cperm = msymCalloc(order, sizeof(msym_permutation_t));
+
+    if(NULL == csops || NULL == cperm){
+        msymSetErrorDetails("Could not allocate memory for %d symmetry operations",order);
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+
+    memcpy(csops, sops, sizeof(msym_symmetry_operation_t[order]));
+
+    for(int i = 0;i < order;i++){
+        cperm[i].p_length = perm[i].p_length;
+        cperm[i].c_length = perm[i].c_length;
+        cperm[i].p = msymMalloc(sizeof(int[perm[i].p_length]));
+        cperm[i].c = msymMalloc(sizeof(msym_permutation_cycle_t[perm[i].c_length]));
+        if(NULL == cperm[i].p || NULL == cperm[i].c){
+            msymSetErrorDetails("Could not allocate memory for permutation of length %d",perm[i].p_length);
+            ret = MSYM_MEMORY_ERROR;
+            goto err;
+        }
+        memcpy(cperm[i].p, perm[i].p, sizeof(int[perm[i].p_length]));
+        memcpy(cperm[i].c, perm[i].c, sizeof(msym_permutation_cycle_t[perm[i].c_length]));
+    }
+
+    *osops = csops;
+    *operm = cperm;
+
+    return ret;
+err:
+    for(int i = 0;i < order && NULL != cperm;i++){
+        freePermutationData(&cperm[i]);
+    }
+    msymFree(cperm);
+    msymFree(csops);
+    return ret;
+}
+
+msym_error_t findCachedPointGroupOperations(msym_point_group_type_t type, int n, int order, int *found, msym_symmetry_operation_t **sops, msym_permutation_t **perm){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_point_group_cache_entry_t *e = lookupPointGroupCacheEntry(type, n);
+    *found = 0;
+    if(NULL == e) goto err;
+    if(e->order != order){
+        msymSetErrorDetails("Cached point group order %d does not match requested order %d",e->order,order);
+        ret = MSYM_POINT_GROUP_ERROR;
+        goto err;
+    }
+    if(MSYM_SUCCESS != (ret = copyPointGroupOperations(e->order, e->sops, e->perm, sops, perm))) goto err;
+    *found = 1;
+err:
+    return ret;
+}
+
+msym_error_t cachePointGroupOperations(msym_point_group_type_t type, int n, int order, msym_symmetry_operation_t sops[order], msym_permutation_t perm[order]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_arena_t *arena = arenaSelect(NULL); // cache memory outlives any context
+    msym_point_group_cache_entry_t *e = msymCalloc(1, sizeof(msym_point_group_cache_entry_t)), *d = NULL;
+    if(NULL == e){
+        msymSetErrorDetails("Could not allocate memory for point group cache entry");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+
+    e->type = type;
+    e->n = n;
+    e->order = order;
+
+    if(MSYM_SUCCESS != (ret = copyPointGroupOperations(order, sops, perm, &e->sops, &e->perm))) goto err;
+
+    // Another thread may have generated the same group while we were busy, keep the first one
+    cacheLock(&cache_lock);
+    for(d = cache;d != NULL && !(d->type == type && d->n == n);d = d->next);
+    if(NULL == d){
+        e->next = cache;
+        cache = e;
+        e = NULL;
+    }
+    cacheUnlock(&cache_lock);
+
+err:
+    if(NULL != e){
+        for(int i = 0;i < e->order && NULL != e->perm;i++){
+            freePermutationData(&e->perm[i]);
+        }
+        msymFree(e->perm);
+        msymFree(e->sops);
+        msymFree(e);
+    }
+    arenaSelect(arena);
+    return ret;
+}
+
+msym_character_table_cache_entry_t *lookupCharacterTableCacheEntry(msym_point_group_type_t type, int n, int order){
+    msym_character_table_cache_entry_t *e;
+    cacheLock(&cache_lock);
+    for(e = ct_cache;e != NULL && !(e->type == type && e->n == n && e->order == order);e = e->next);
+    cacheUnlock(&cache_lock);
+    return e;
+}
+
+msym_error_t findCachedCharacterTable(msym_point_group_type_t type, int n, int order, msym_character_table_cache_entry_t **entry, msym_character_table_t **ct){
+    msym_character_table_cache_entry_t *e = lookupCharacterTableCacheEntry(type, n, order);
+    *entry = e;
+    *ct = NULL == e ? NULL : e->ct;
+    return MSYM_SUCCESS;
+}
+
+msym_error_t cacheCharacterTable(msym_point_group_type_t type, int n, int order, msym_character_table_t *ct, msym_character_table_cache_entry_t **entry){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_arena_t *arena = arenaSelect(NULL);
+    msym_character_table_cache_entry_t *e = msymCalloc(1, sizeof(msym_character_table_cache_entry_t)), *d = NULL;
+    if(NULL == e){
+        msymSetErrorDetails("Could not allocate memory for character table cache entry");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    e->type = type;
+    e->n = n;
+    e->order = order;
+    
+    if(MSYM_SUCCESS != (ret = copyCharacterTable(ct, 0, NULL, &e->ct))) goto err;
+    
+    cacheLock(&cache_lock);
+    for(d = ct_cache;d != NULL && !(d->type == type && d->n == n && d->order == order);d = d->next);
+    if(NULL == d){
+        e->next = ct_cache;
+        ct_cache = e;
+        d = e;
+        e = NULL;
+    }
+    cacheUnlock(&cache_lock);
+    
+    *entry = d;
+    
+err:
+    if(NULL != e){
+        msymFree(e->ct);
+        msymFree(e);
+    }
+    arenaSelect(arena);
+    return ret;
+}
+
+msym_error_t findCachedDirectProducts(msym_character_table_cache_entry_t *entry, double **dp){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_arena_t *arena = arenaSelect(NULL);
+    cacheLock(&cache_lock);
+    if(NULL == entry->dp) ret = generateDirectProducts(entry->ct, &entry->dp);
+    *dp = entry->dp;
+    cacheUnlock(&cache_lock);
+    arenaSelect(arena);
+    return ret;
+}
+
+/* FNV-1a of the discrete part of the key, the permutations are hashed as they are
+ * since the order of the elements in the equivalence set determines the layout of the subspace */
+unsigned long subspaceKeyHash(msym_subspace_key_t *key){
+    int pd = key->perm->p_length;
+    int h[] = {key->type, key->n, key->order, pd, key->ld, key->k, key->span, key->sgd[0], key->sgd[1], key->sgd[2], key->sgd[3], key->sgd[4]}, hl = sizeof(h)/sizeof(h[0]);
+    unsigned long hash = 2166136261UL;
+    for(int i = 0;i < hl;i++) hash = (hash ^ (unsigned long) h[i])*16777619UL;
+    for(int s = 0;s < key->order;s++){
+        for(int i = 0;i < pd;i++) hash = (hash ^ (unsigned long) key->perm[s].p[i])*16777619UL;
+    }
+    return hash;
+}
+
+int subspaceKeyEqual(msym_subspace_cache_entry_t *e, unsigned long hash, msym_subspace_key_t *key){
+    msym_subspace_key_t *ek = &e->key;
+    int pd = key->perm->p_length, lsl = key->order*key->ld*key->ld, sgcl = 5*key->order;
+    
+    if(e->hash != hash || e->pd != pd || ek->type != key->type || ek->n != key->n || ek->order != key->order || ek->ld != key->ld || ek->k != key->k || ek->span != key->span) return 0;
+    if(0 != memcmp(ek->sgd, key->sgd, sizeof(ek->sgd)) || ek->zero != key->zero || ek->orthogonalization != key->orthogonalization || ek->precision != key->precision) return 0;
+    
+    for(int s = 0;s < key->order;s++){
+        if(0 != memcmp(&e->p[s*pd], key->perm[s].p, sizeof(int[pd]))) return 0;
+    }
+    
+    for(int i = 0;i < lsl;i++){
+        if(fabs(ek->lrsops[i] - key->lrsops[i]) > SUBSPACE_CACHE_THRESHOLD) return 0;
+    }
+    
+    for(int i = 0;i < sgcl;i++){
+        if(fabs(ek->sgc[i] - key->sgc[i]) > SUBSPACE_CACHE_THRESHOLD) return 0;
+    }
+    
+    return 1;
+}
+
+msym_subspace_cache_entry_t *lookupSubspaceCacheEntry(unsigned long hash, msym_subspace_key_t *key){
+    msym_subspace_cache_entry_t *e;
+    for(e = ss_cache[hash % SUBSPACE_CACHE_BUCKETS];e != NULL && !subspaceKeyEqual(e, hash, key);e = e->next);
+    return e;
+}
+
+void freeSubspaceCacheEntry(msym_subspace_cache_entry_t *e){
+    if(NULL == e) return;
+    msymFree(e->p);
+    msymFree(e->key.lrsops);
+    msymFree(e->key.sgc);
+    msymFree(e->ss);
+    msymFree(e);
+}
+
+msym_error_t findCachedSubspace(msym_subspace_key_t *key, int *found, int l, double ss[l]){
+    unsigned long hash = subspaceKeyHash(key);
+    msym_subspace_cache_entry_t *e = NULL;
+    
+    cacheLock(&cache_lock);
+    e = lookupSubspaceCacheEntry(hash, key);
+    cacheUnlock(&cache_lock);
+    
+    *found = NULL != e && e->l == l;
+    if(*found) memcpy(ss, e->ss, sizeof(double[l]));
+    
+    return MSYM_SUCCESS;
+}
+
+/* The cache is limited to SUBSPACE_CACHE_BYTES, when full new subspaces are not added */
+msym_error_t cacheSubspace(msym_subspace_key_t *key, int l, double ss[l]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_arena_t *arena = arenaSelect(NULL);
+    unsigned long hash = subspaceKeyHash(key);
+    int pd = key->perm->p_length, order = key->order, ld = key->ld;
+    size_t bytes = sizeof(msym_subspace_cache_entry_t) + sizeof(int[order][pd]) + sizeof(double[order][ld][ld]) + sizeof(double[5][order]) + sizeof(double[l]);
+    msym_subspace_cache_entry_t *e = NULL;
+    
+    cacheLock(&cache_lock);
+    int full = ss_cache_bytes + bytes > SUBSPACE_CACHE_BYTES;
+    cacheUnlock(&cache_lock);
+    
+    if(full) goto err;
+    
+    if(NULL == (e = msymCalloc(1, sizeof(msym_subspace_cache_entry_t)))){
+        msymSetErrorDetails("Could not allocate memory for subspace cache entry");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    e->hash = hash;
+    e->key = *key;
+    e->key.perm = NULL;
+    e->pd = pd;
+    e->l = l;
+    e->p = msymMalloc(sizeof(int[order][pd]));
+    e->key.lrsops = msymMalloc(sizeof(double[order][ld][ld]));
+    e->key.sgc = msymMalloc(sizeof(double[5][order]));
+    e->ss = msymMalloc(sizeof(double[l]));
+    
+    if(NULL == e->p || NULL == e->key.lrsops || NULL == e->key.sgc || NULL == e->ss){
+        msymSetErrorDetails("Could not allocate memory for subspace cache entry");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    for(int s = 0;s < order;s++) memcpy(&e->p[s*pd], key->perm[s].p, sizeof(int[pd]));
+    memcpy(e->key.lrsops, key->lrsops, sizeof(double[order][ld][ld]));
+    memcpy(e->key.sgc, key->sgc, sizeof(double[5][order]));
+    memcpy(e->ss, ss, sizeof(double[l]));
+    
+    // Another thread may have generated the same subspace while we were busy, keep the first one
+    cacheLock(&cache_lock);
+    if(NULL == lookupSubspaceCacheEntry(hash, key) && ss_cache_bytes + bytes <= SUBSPACE_CACHE_BYTES){
+        e->next = ss_cache[hash % SUBSPACE_CACHE_BUCKETS];
+        ss_cache[hash % SUBSPACE_CACHE_BUCKETS] = e;
+        ss_cache_bytes += bytes;
+        e = NULL;
+    }
+    cacheUnlock(&cache_lock);
+    
+err:
+    freeSubspaceCacheEntry(e);
+    arenaSelect(arena);
+    return ret;
+}
+
+msym_rsh_cache_entry_t *lookupRSHCacheEntry(int sopsl, int l, double r1[sopsl][3][3]){
+    msym_rsh_cache_entry_t *e;
+    for(e = rsh_cache;e != NULL;e = e->next){
+        int equal = e->sopsl == sopsl && e->l == l;
+        double *er1 = e->r1, *kr1 = (double *) r1;
+        for(int i = 0;equal && i < 9*sopsl;i++) equal = fabs(er1[i] - kr1[i]) <= RSH_CACHE_THRESHOLD;
+        if(equal) break;
+    }
+    return e;
+}
+
+msym_error_t findCachedRSHRepresentations(int sopsl, int l, double r1[sopsl][3][3], int *found, double r[sopsl][2*l+1][2*l+1]){
+    msym_rsh_cache_entry_t *e = NULL;
+    
+    cacheLock(&cache_lock);
+    e = lookupRSHCacheEntry(sopsl, l, r1);
+    cacheUnlock(&cache_lock);
+    
+    *found = NULL != e;
+    if(*found) memcpy(r, e->r, sizeof(double[sopsl][2*l+1][2*l+1]));
+    
+    return MSYM_SUCCESS;
+}
+
+/* The cache is limited to RSH_CACHE_BYTES, when full new representations are not added */
+msym_error_t cacheRSHRepresentations(int sopsl, int l, double r1[sopsl][3][3], double r[sopsl][2*l+1][2*l+1]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_arena_t *arena = arenaSelect(NULL);
+    size_t bytes = sizeof(msym_rsh_cache_entry_t) + sizeof(double[sopsl][3][3]) + sizeof(double[sopsl][2*l+1][2*l+1]);
+    msym_rsh_cache_entry_t *e = NULL;
+    
+    cacheLock(&cache_lock);
+    int full = rsh_cache_bytes + bytes > RSH_CACHE_BYTES;
+    cacheUnlock(&cache_lock);
+    
+    if(full) goto err;
+    
+    if(NULL == (e = msymCalloc(1, sizeof(msym_rsh_cache_entry_t)))){
+        msymSetErrorDetails("Could not allocate memory for real spherical harmonic cache entry");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    e->sopsl = sopsl;
+    e->l = l;
+    e->r1 = msymMalloc(sizeof(double[sopsl][3][3]));
+    e->r = msymMalloc(sizeof(double[sopsl][2*l+1][2*l+1]));
+    
+    if(NULL == e->r1 || NULL == e->r){
+        msymSetErrorDetails("Could not allocate memory for real spherical harmonic cache entry");
+        ret = MSYM_MEMORY_ERROR;
+        goto err;
+    }
+    
+    memcpy(e->r1, r1, sizeof(double[sopsl][3][3]));
+    memcpy(e->r, r, sizeof(double[sopsl][2*l+1][2*l+1]));
+    
+    cacheLock(&cache_lock);
+    if(NULL == lookupRSHCacheEntry(sopsl, l, r1) && rsh_cache_bytes + bytes <= RSH_CACHE_BYTES){
+        e->next = rsh_cache;
+        rsh_cache = e;
+        rsh_cache_bytes += bytes;
+        e = NULL;
+    }
+    cacheUnlock(&cache_lock);
+    
+err:
+    if(NULL != e){
+        msymFree(e->r1);
+        msymFree(e->r);
+        msymFree(e);
+    }
+    arenaSelect(arena);
+    return ret;
+}
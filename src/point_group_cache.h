@@ -0,0 +1,47 @@
+//
+//  point_group_cache.h
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#ifndef __MSYM__POINT_GROUP_CACHE_h
+#define __MSYM__POINT_GROUP_CACHE_h
+
+#include "msym.h"
+#include "symop.h"
+#include "permutation.h"
+
+typedef struct _msym_character_table_cache_entry msym_character_table_cache_entry_t;
+
+/* Everything the orthonormal subspace of one irreducible representation on an equivalence set depends on,
+ * lrsops are the representation matrices of the basis functions (order x ld x ld) and sgc the splitting
+ * field characters (5 x order) of the irreducible representation */
+typedef struct _msym_subspace_key {
+    msym_point_group_type_t type;
+    int n;
+    int order;
+    int ld;
+    int k;
+    int span;
+    int sgd[5];
+    double zero;
+    double orthogonalization;
+    int precision;
+    msym_permutation_t *perm;
+    double *lrsops;
+    double *sgc;
+} msym_subspace_key_t;
+
+msym_error_t findCachedPointGroupOperations(msym_point_group_type_t type, int n, int order, int *found, msym_symmetry_operation_t **sops, msym_permutation_t **perm);
+msym_error_t cachePointGroupOperations(msym_point_group_type_t type, int n, int order, msym_symmetry_operation_t sops[order], msym_permutation_t perm[order]);
+msym_error_t copyPointGroupOperations(int order, msym_symmetry_operation_t sops[order], msym_permutation_t perm[order], msym_symmetry_operation_t **osops, msym_permutation_t **operm);
+msym_error_t findCachedCharacterTable(msym_point_group_type_t type, int n, int order, msym_character_table_cache_entry_t **entry, msym_character_table_t **ct);
+msym_error_t cacheCharacterTable(msym_point_group_type_t type, int n, int order, msym_character_table_t *ct, msym_character_table_cache_entry_t **entry);
+msym_error_t findCachedDirectProducts(msym_character_table_cache_entry_t *entry, double **dp);
+msym_error_t findCachedSubspace(msym_subspace_key_t *key, int *found, int l, double ss[l]);
+msym_error_t cacheSubspace(msym_subspace_key_t *key, int l, double ss[l]);
+msym_error_t findCachedRSHRepresentations(int sopsl, int l, double r1[sopsl][3][3], int *found, double r[sopsl][2*l+1][2*l+1]);
+msym_error_t cacheRSHRepresentations(int sopsl, int l, double r1[sopsl][3][3], double r[sopsl][2*l+1][2*l+1]);
+
+#endif /* defined(__MSYM__POINT_GROUP_CACHE_h) */
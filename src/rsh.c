@@ -21,6 +21,8 @@
 #include "rsh.h"
 #include "linalg.h"
 #include "symop.h"
+#include "point_group_cache.h"
+#include "allocator.h"
 
 #define SQR(x) ((x)*(x))
 
@@ -28,35 +30,56 @@
 #define M_SQRT2 1.41421356237309504880
 #endif
 
-void rshSymmetryOperationRepresentation(msym_symmetry_operation_t *sops, int index, int l, rsh_representations_t *lts);
+void rshSymmetryOperationRepresentation(msym_symmetry_operation_t *sops, int index, int l, double c[3][2*l+1][2*l+1], double p[4][2*l+1], rsh_representations_t *lrs);
 void rshCalculateUVWCoefficients(int l, int m1, int m2, double* u, double* v, double* w);
-void rshRotationRepresentation(int index, int l, rsh_representations_t *lrs);
-double rshRotationP(int index, int l, int i, int m1, int m2, rsh_representations_t *lrs);
-double rshRotationU(int index, int l, int m1, int m2, rsh_representations_t *lrs);
-double rshRotationV(int index, int l, int m1, int m2, rsh_representations_t *lrs);
-double rshRotationW(int index, int l, int m1, int m2, rsh_representations_t *lrs);
-
+void rshRotationCoefficients(int l, double c[3][2*l+1][2*l+1]);
+void rshRotationRepresentation(int index, int l, double c[3][2*l+1][2*l+1], double p[4][2*l+1], rsh_representations_t *lrs);
+void rshRotationP(int l, int i, int m1, double r1[3][3], double rl[2*l-1][2*l-1], double p[2*l+1]);
 
+/* Representations for l > 1 only depend on those of l = 1 and are taken from the cache when possible,
+ * the recurrence coefficients are calculated once for each l rather than for every operation */
 msym_error_t generateRSHRepresentations(int sopsl, msym_symmetry_operation_t sops[sopsl], int lmax, rsh_representations_t *lrs){
     msym_error_t ret = MSYM_SUCCESS;
+    int dmax = 2*lmax+1;
+    double (*c)[dmax][dmax] = NULL;
+    double (*p)[dmax] = NULL;
+    
     for(int l = 0;l <= lmax;l++){
         if(lrs[l].d != 2*l+1){
             ret = MSYM_INVALID_BASIS_FUNCTIONS;
             msymSetErrorDetails("Invalid dimension of real spherical harmonic (expected %d, got %d)",2*l+1, lrs[l].d);
             goto err;
         }
+    }
+    
+    if(NULL == (c = msymMalloc(sizeof(double[3][dmax][dmax]))) || NULL == (p = msymMalloc(sizeof(double[4][dmax])))){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for real spherical harmonic representations");
+        goto err;
+    }
+    
+    for(int l = 0;l <= lmax;l++){
+        int found = 0;
+        if(l > 1){
+            if(MSYM_SUCCESS != (ret = findCachedRSHRepresentations(sopsl, l, lrs[1].t, &found, lrs[l].t))) goto err;
+            if(found) continue;
+            rshRotationCoefficients(l, (double (*)[2*l+1][2*l+1]) c);
+        }
         for(int i = 0; i < sopsl;i++){
-            rshSymmetryOperationRepresentation(sops,i,l,lrs);
+            rshSymmetryOperationRepresentation(sops,i,l,(double (*)[2*l+1][2*l+1]) c,(double (*)[2*l+1]) p,lrs);
         }
+        if(l > 1 && MSYM_SUCCESS != (ret = cacheRSHRepresentations(sopsl, l, lrs[1].t, lrs[l].t))) goto err;
     }
     
 err:
+    msymFree(c);
+    msymFree(p);
     return ret;
 }
 
 
 
-void rshSymmetryOperationRepresentation(msym_symmetry_operation_t *sops, int index, int l, rsh_representations_t *lrs){
+void rshSymmetryOperationRepresentation(msym_symmetry_operation_t *sops, int index, int l, double c[3][2*l+1][2*l+1], double p[4][2*l+1], rsh_representations_t *lrs){
     if(0 == l){
         int d = lrs[0].d;
         double (*st)[d][d] = lrs[0].t;
@@ -95,80 +118,88 @@ void rshSymmetryOperationRepresentation(msym_symmetry_operation_t *sops, int ind
             case IMPROPER_ROTATION:
             case PROPER_ROTATION:
             default:
-                rshRotationRepresentation(index, l, lrs);
+                rshRotationRepresentation(index, l, c, p, lrs);
                 break;
                 
         }
     }
 }
 
-double rshRotationP(int index, int l, int i, int m1, int m2, rsh_representations_t *lrs){
-    int d1 = lrs[1].d, dl = lrs[l-1].d, ol = (dl - 1)/2;
-    double (*st1)[d1][d1] = lrs[1].t, (*stl)[dl][dl] = lrs[l-1].t;
-    double (*r1)[d1] = st1[index], (*rl)[dl] = stl[index];
-    double ret = 0;
+/* Row m1 of the P function of the recurrence for all m2 */
+void rshRotationP(int l, int i, int m1, double r1[3][3], double rl[2*l-1][2*l-1], double p[2*l+1]){
+    int d = 2*l+1, ol = l-1;
+    double *rm = rl[m1 + ol], s = r1[i + 1][1];
     
-    if (m2 == l) {
-        ret = r1[i + 1][2]*rl[m1 + ol][l - 1 + ol] - r1[i + 1][0]*rl[m1 + ol][1 - l + ol];
-    } else if (m2 == -l) {
-        ret = r1[i + 1][2]*rl[m1 + ol][1 - l + ol] + r1[i + 1][0]*rl[m1 + ol][l - 1 + ol];
-    } else {
-        ret = r1[i + 1][1]*rl[m1 + ol][m2 + ol];
+    for(int j = 1;j < d - 1;j++){
+        p[j] = s*rm[j - 1];
     }
     
-    return ret;
-}
-
-double rshRotationU(int index, int l, int m1, int m2, rsh_representations_t *lrs){
-    return rshRotationP(index, l, 0, m1, m2, lrs);
+    p[d - 1] = r1[i + 1][2]*rm[l - 1 + ol] - r1[i + 1][0]*rm[1 - l + ol];
+    p[0] = r1[i + 1][2]*rm[1 - l + ol] + r1[i + 1][0]*rm[l - 1 + ol];
 }
 
-double rshRotationV(int index, int l, int m1, int m2, rsh_representations_t *lrs){
-    double ret = 0;
-    if (m1 == 0) {
-        ret = rshRotationP(index, l, 1, 1, m2, lrs) + rshRotationP(index, l, -1, -1, m2, lrs);
-    } else if (m1 == 1){
-        ret = M_SQRT2*rshRotationP(index, l, 1, 0, m2, lrs);
-    } else if (m1 == -1){
-        ret = M_SQRT2*rshRotationP(index, l, -1, 0, m2, lrs);
-    } else if (m1 > 0){
-        ret = rshRotationP(index, l, 1, m1 - 1, m2, lrs) - rshRotationP(index,l, -1, -m1 + 1, m2, lrs);
-    } else {
-        ret = rshRotationP(index, l, 1, m1 + 1, m2, lrs) + rshRotationP(index,l, -1, -m1 - 1, m2, lrs);
-    }
+/* Calculates a row at a time as c[0]*U + c[1]*V + c[2]*W, where U and W are replaced by 1 when their
+ * coefficients are zero (rows m1 = +-l and m1 = 0, +-(l-1) respectively) since they are out of range */
+void rshRotationRepresentation(int index, int l, double c[3][2*l+1][2*l+1], double p[4][2*l+1], rsh_representations_t *lrs){
+    int d = lrs[l].d, dl = lrs[l-1].d;
+    double (*st)[d][d] = lrs[l].t, (*st1)[3][3] = lrs[1].t, (*stl)[dl][dl] = lrs[l-1].t;
+    double (*r)[d] = st[index], (*r1)[3] = st1[index], (*rl)[dl] = stl[index];
+    double *u = p[0], *v = p[1], *w = p[2], *t = p[3];
     
-    return ret;
-}
-
-double rshRotationW(int index, int l, int m1, int m2, rsh_representations_t *lrs){
-    double ret = 0;
-    if (m1 > 0) {
-        ret = rshRotationP(index, l, 1, m1 + 1, m2, lrs) + rshRotationP(index, l, -1, -m1 - 1, m2, lrs);
-    } else {
-        ret = rshRotationP(index, l, 1, m1 - 1, m2, lrs) - rshRotationP(index, l, -1, -m1 + 1, m2, lrs);
+    for (int m1 = -l; m1 <= l; m1++) {
+        int am1 = abs(m1);
+        double *cu = c[0][m1 + l], *cv = c[1][m1 + l], *cw = c[2][m1 + l], *rm = r[m1 + l];
+        
+        if(am1 < l){
+            rshRotationP(l, 0, m1, r1, rl, u);
+        } else {
+            for(int j = 0;j < d;j++) u[j] = 1;
+        }
+        
+        if (m1 == 0) {
+            rshRotationP(l, 1, 1, r1, rl, v);
+            rshRotationP(l, -1, -1, r1, rl, t);
+            for(int j = 0;j < d;j++) v[j] = v[j] + t[j];
+        } else if (m1 == 1){
+            rshRotationP(l, 1, 0, r1, rl, v);
+            for(int j = 0;j < d;j++) v[j] = M_SQRT2*v[j];
+        } else if (m1 == -1){
+            rshRotationP(l, -1, 0, r1, rl, v);
+            for(int j = 0;j < d;j++) v[j] = M_SQRT2*v[j];
+        } else if (m1 > 0){
+            rshRotationP(l, 1, m1 - 1, r1, rl, v);
+            rshRotationP(l, -1, -m1 + 1, r1, rl, t);
+            for(int j = 0;j < d;j++) v[j] = v[j] - t[j];
+        } else {
+            rshRotationP(l, 1, m1 + 1, r1, rl, v);
+            rshRotationP(l, -1, -m1 - 1, r1, rl, t);
+            for(int j = 0;j < d;j++) v[j] = v[j] + t[j];
+        }
+        
+        if(m1 != 0 && am1 < l - 1){
+            if (m1 > 0) {
+                rshRotationP(l, 1, m1 + 1, r1, rl, w);
+                rshRotationP(l, -1, -m1 - 1, r1, rl, t);
+                for(int j = 0;j < d;j++) w[j] = w[j] + t[j];
+            } else {
+                rshRotationP(l, 1, m1 - 1, r1, rl, w);
+                rshRotationP(l, -1, -m1 + 1, r1, rl, t);
+                for(int j = 0;j < d;j++) w[j] = w[j] - t[j];
+            }
+        } else {
+            for(int j = 0;j < d;j++) w[j] = 1;
+        }
+        
+        for(int j = 0;j < d;j++){
+            rm[j] = cu[j]*u[j] + cv[j]*v[j] + cw[j]*w[j];
+        }
     }
-    
-    return ret;
 }
 
-void rshRotationRepresentation(int index, int l, rsh_representations_t *lrs){
-    int d = lrs[l].d;
-    double (*st)[d][d] = lrs[l].t;
-    double (*r)[d] = st[index];
+void rshRotationCoefficients(int l, double c[3][2*l+1][2*l+1]){
     for (int m1 = -l; m1 <= l; m1++) {
         for (int m2 = -l; m2 <= l; m2++) {
-            double u, v, w;
-            rshCalculateUVWCoefficients(l, m1, m2, &u, &v, &w);
-            if(u != 0){
-                u *= rshRotationU(index, l, m1, m2, lrs);
-            }
-            if(v != 0){
-                v *= rshRotationV(index, l, m1, m2, lrs);
-            }
-            if(w != 0){
-                w *= rshRotationW(index, l, m1, m2, lrs);
-            }
-            r[m1 + l][m2 + l] = u + v + w;
+            rshCalculateUVWCoefficients(l, m1, m2, &c[0][m1 + l][m2 + l], &c[1][m1 + l][m2 + l], &c[2][m1 + l][m2 + l]);
         }
     }
 }
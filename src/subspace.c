@@ -12,20 +12,122 @@
 #include <math.h>
 #include <string.h>
 #include <float.h>
+#include <limits.h>
 
 #include "msym.h"
 #include "linalg.h"
+#include "dense.h"
 #include "subspace.h"
 #include "permutation.h"
 #include "rsh.h"
+#include "parallel.h"
+#include "point_group_cache.h"
 
+#include "allocator.h"
 #include "debug.h"
 
 #define SQR(x) ((x)*(x))
 
 #define PARTNER_THRESHOLD 1.0e-6
 
+/* Per thread memory for generating the subspaces of one irreducible representation */
+typedef struct _msym_subspace_scratch {
+    double *cmem;                   // max(order, dim)
+    double *pmem;                   // [5][dim][dim]
+    double *v;                      // [3*MGS_PANEL][dim] orthogonalization panel
+    msym_block_projection_t bp;
+} msym_subspace_scratch_t;
+
+typedef struct _msym_subspace_task {
+    msym_point_group_t *pg;
+    msym_permutation_t *perm;
+    int ld;
+    void *lrsops;                   // double[order][ld][ld]
+    int *span;
+    void *sgc;                      // double[d][5][order]
+    int (*sgd)[5];
+    msym_thresholds_t *thresholds;
+    msym_precision_t precision;
+    int *irrep;                     // irreducible representation of each task
+    int *oirl;                      // first row in ss of each irreducible representation
+    msym_subspace_scratch_t *scratch;
+    void *pss;
+    void *ss;
+} msym_subspace_task_t;
+
+/* SALCs generated from one equivalence set and angular momentum */
+typedef struct _msym_salc_block {
+    int i;
+    int l;
+    int *salcl;                     // number of SALCs per irreducible representation
+    msym_salc_t **salc;
+    size_t bytes;                   // memory allocated for the SALCs
+} msym_salc_block_t;
+
+typedef struct _msym_salc_scratch {
+    int projm;
+    double *pmem;                   // [7][projm][projm]
+    double *cmem;
+    double *mspan;
+    int *span;                      // span of the irreducible representations being generated
+    void *sspmem;                   // subspace pointers [d][5]
+    void *psspmem;                  // permutation subspace pointers [d]
+    int (*sgd)[5];
+    size_t bytes;                   // memory allocated for this scratch
+} msym_salc_scratch_t;
+
+typedef struct _msym_salc_task {
+    msym_point_group_t *pg;
+    int sgl;
+    const msym_subgroup_t *sg;
+    const msym_subgroup_t **rsg;
+    msym_equivalence_set_t *es;
+    msym_permutation_t **perm;
+    msym_thresholds_t *thresholds;
+    int threads;                    // threads for each block
+    msym_precision_t precision;
+    int *generate;                  // irreducible representations to generate SALCs for
+    int lmax;
+    int nmax;
+    int *esnmax;
+    rsh_representations_t *lts;
+    msym_basis_function_t **srsbf;
+    void *srsbfmap;
+    void *srsbfl;
+    void *lssp;
+    void *iespan;
+    void *ipspan;
+    void *ibspan;
+    void *pspan;
+    void *bspan;
+    void *dp;
+    void *sgc;
+    msym_salc_block_t *blocks;
+    msym_parallel_meter_t *meter;   // memory in use by the blocks being generated
+} msym_salc_task_t;
+
 msym_error_t projectLinearlyIndependent(int dim, int vdim, double v[vdim][dim], int udim, double u[udim][dim], msym_thresholds_t *thresholds, double cmem[dim], double mem[dim][dim], double o[dim][dim], int *oirl);
+int mgs2BlockProjectionSingle(msym_block_projection_t *bp, int lm, float o[bp->pd*bp->ld][bp->pd*bp->ld], int n, double t, float v[3*MGS_PANEL][bp->pd*bp->ld]);
+int projectLinearlyIndependentSingle(int dim, int vdim, float v[vdim][dim], int udim, float u[udim][dim], msym_thresholds_t *thresholds, float mem[dim][dim], float o[dim][dim], int oirl);
+msym_error_t generateIrrepSubspaceSingle(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int k, int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, msym_subspace_scratch_t *scratch, double (*(*pss)[5])[perm->p_length*ld], double ss[perm->p_length*ld][perm->p_length*ld]);
+msym_error_t allocateSubspaceScratch(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, msym_subspace_scratch_t *scratch);
+void freeSubspaceScratch(msym_subspace_scratch_t *scratch);
+msym_error_t generateIrrepSubspace(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int k, int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, msym_subspace_scratch_t *scratch, double (*(*pss)[5])[perm->p_length*ld], double ss[perm->p_length*ld][perm->p_length*ld]);
+msym_error_t generateSubspacesTask(void *data, int task, int worker);
+void subspaceCacheKey(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int k, int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, msym_precision_t precision, msym_subspace_key_t *key);
+size_t subspaceScratchBytes(int order, int pd, int ld);
+msym_error_t generateSubspaces(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, int threads, msym_precision_t precision, msym_parallel_meter_t *meter, double (*(*pss)[5])[perm->p_length*ld], double ss[perm->p_length*ld][perm->p_length*ld]);
+msym_error_t generateSALCBlock(msym_salc_task_t *t, msym_salc_block_t *b, msym_salc_scratch_t *w);
+msym_error_t generateSALCBlockTask(void *data, int task, int worker);
+void freeSALCBlock(int d, msym_salc_block_t *b);
+msym_error_t allocateSALCScratch(msym_point_group_t *pg, int lmax, int projm, msym_salc_scratch_t *w);
+void freeSALCScratch(msym_salc_scratch_t *w);
+size_t salcScratchBytes(msym_point_group_t *pg, int lmax, int projm);
+size_t salcBlockBytes(msym_point_group_t *pg, int lmax, int esd, int ld, int threads);
+void predictSubrepresentationSpacesMemory(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int lmax, int nmax, size_t *shared, size_t *lowmem);
+msym_error_t scheduleSALCBlocks(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int lmax, int threads, size_t shared, size_t budget, int *oworkers, int *othreads, size_t *opredicted);
+msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int sgl, const msym_subgroup_t sg[sgl], int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int *esimap, msym_thresholds_t *thresholds, size_t *opeak, int *osrsl, msym_subrepresentation_space_t **osrs, msym_basis_function_t ***osrsbf, int **ospan);
+msym_error_t mapSubrepresentationBasisFunctions(int esl, msym_equivalence_set_t *es, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int *esimap, int lmax, int nmax, int esnmax[esl], int srsbfl[esl][nmax+1][lmax+1], int srsbfmap[esl][nmax+1][lmax+1], msym_basis_function_t *srsbf[basisl]);
 
 
 
@@ -71,7 +173,7 @@ msym_error_t generateBasisRepresentations(int n, int sopsl, msym_symmetry_operat
     for(int l = 0;l <= lmax;l++){
         int d = 2*l+1;
         lrsh[l].d = d;
-        lrsh[l].t = malloc(sizeof(double[n][d][d]));
+        lrsh[l].t = msymMalloc(sizeof(double[n][d][d]));
     }
     
     if(MSYM_SUCCESS != (ret = generateRSHRepresentations(sopsl, sops, lmax, lrsh))) goto err;
@@ -79,7 +181,7 @@ msym_error_t generateBasisRepresentations(int n, int sopsl, msym_symmetry_operat
     return ret;
 err:
     for(int l = 0;l <= lmax;l++){
-        free(lrsh[l].t);
+        msymFree(lrsh[l].t);
         lrsh[l].t = NULL;
         lrsh[l].d = 0;
     }
@@ -114,6 +216,154 @@ msym_error_t generateProjectionOperator(int d, int sopsl, double c[sopsl], msym_
 }
 
 
+msym_error_t allocateBlockProjectionOperator(int sopsl, msym_permutation_t perm[sopsl], int ld, msym_block_projection_t *bp){
+    msym_error_t ret = MSYM_SUCCESS;
+    int pd = perm->p_length, bl = pd*(sopsl < pd ? sopsl : pd);
+    
+    bp->pd = pd;
+    bp->ld = ld;
+    bp->row = msymMalloc(sizeof(int[pd+1]));
+    bp->col = msymMalloc(sizeof(int[bl]));
+    bp->b = msymMalloc(sizeof(double[bl][ld][ld]));
+    bp->iperm = msymMalloc(sizeof(int[sopsl][pd]));
+    bp->slot = msymMalloc(sizeof(int[pd]));
+    
+    if(NULL == bp->row || NULL == bp->col || NULL == bp->b || NULL == bp->iperm || NULL == bp->slot){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for projection operator with %d blocks of size %d",bl,ld);
+        freeBlockProjectionOperator(bp);
+        return ret;
+    }
+    
+    int (*iperm)[pd] = (int (*)[pd]) bp->iperm;
+    for(int s = 0;s < sopsl;s++){
+        for(int i = 0;i < pd;i++) iperm[s][perm[s].p[i]] = i;
+    }
+    
+    for(int i = 0;i < pd;i++) bp->slot[i] = -1;
+    
+    return ret;
+}
+
+void freeBlockProjectionOperator(msym_block_projection_t *bp){
+    msymFree(bp->row);
+    msymFree(bp->col);
+    msymFree(bp->b);
+    msymFree(bp->iperm);
+    msymFree(bp->slot);
+    memset(bp, 0, sizeof(*bp));
+}
+
+/* Same operator as generateProjectionOperator, with identical accumulation order */
+msym_error_t generateBlockProjectionOperator(int d, int sopsl, double c[sopsl], int ld, double (*lsops)[ld][ld], msym_block_projection_t *bp){
+    msym_error_t ret = MSYM_SUCCESS;
+    
+    int pd = bp->pd, nb = 0;
+    int (*iperm)[pd] = (int (*)[pd]) bp->iperm;
+    double (*b)[ld][ld] = (double (*)[ld][ld]) bp->b;
+    double scale = ((double)d)/sopsl;
+    
+    for(int pr = 0;pr < pd;pr++){
+        bp->row[pr] = nb;
+        for(int s = 0;s < sopsl;s++){
+            if(c[s] == 0) continue;
+            int pi = iperm[s][pr];
+            if(bp->slot[pi] < 0){
+                bp->slot[pi] = nb;
+                bp->col[nb] = pi;
+                memset(b[nb], 0, sizeof(double[ld][ld]));
+                nb++;
+            }
+            double (*bb)[ld] = b[bp->slot[pi]];
+            for(int li = 0;li < ld;li++){
+                for(int lj = 0;lj < ld;lj++){
+                    bb[li][lj] += lsops[s][li][lj]*c[s];
+                }
+            }
+        }
+        for(int i = bp->row[pr];i < nb;i++) bp->slot[bp->col[i]] = -1;
+    }
+    
+    bp->row[pd] = nb;
+    
+    for(int i = 0;i < nb;i++) mlscale(scale, ld, b[i], b[i]);
+    
+    return ret;
+}
+
+/* Projects the rows of v in place, y is scratch */
+void applyBlockProjectionOperator(msym_block_projection_t *bp, int n, double v[n][bp->pd*bp->ld], double y[bp->pd*bp->ld]){
+    int pd = bp->pd, ld = bp->ld;
+    double (*b)[ld][ld] = (double (*)[ld][ld]) bp->b;
+    
+    for(int r = 0;r < n;r++){
+        for(int pr = 0;pr < pd;pr++){
+            for(int li = 0;li < ld;li++){
+                double p = 0.0;
+                for(int i = bp->row[pr];i < bp->row[pr+1];i++){
+                    double *vb = &v[r][bp->col[i]*ld];
+                    for(int j = 0;j < ld;j++) p += b[i][li][j]*vb[j];
+                }
+                y[pr*ld + li] = p;
+            }
+        }
+        memcpy(v[r], y, sizeof(double[pd*ld]));
+    }
+}
+
+/* mgs2 on the rows of a block projection operator, rows are expanded into panels of v before orthogonalization */
+int mgs2BlockProjection(msym_block_projection_t *bp, int lm, double o[bp->pd*bp->ld][bp->pd*bp->ld], int n, double t, double v[3*MGS_PANEL][bp->pd*bp->ld]){
+    int pd = bp->pd, ld = bp->ld, l = pd*ld, nm = n + lm + MGS_ADD;
+    double (*b)[ld][ld] = (double (*)[ld][ld]) bp->b;
+    double ts = l/(1.0 + l);
+    
+    for(int pr = 0, li = 0;pr < pd && n < nm;){
+        double wn[MGS_PANEL], tc = mgs2candidate(t, ts);
+        int w = 0;
+        while(pr < pd && w < MGS_PANEL){
+            memset(v[w], 0, sizeof(double[l]));
+            for(int i = bp->row[pr];i < bp->row[pr+1];i++){
+                memcpy(&v[w][bp->col[i]*ld], b[i][li], sizeof(double[ld]));
+            }
+            if((wn[w] = vlabs(l, v[w])) >= tc) w++;
+            if(++li == ld){
+                li = 0;
+                pr++;
+            }
+        }
+        n = mgs2panel(l, w, v, wn, &v[MGS_PANEL], o, n, nm, &t, ts);
+    }
+    
+    return n;
+}
+
+/* mgs2BlockProjection in single precision, the operator blocks are converted when rows are expanded */
+int mgs2BlockProjectionSingle(msym_block_projection_t *bp, int lm, float o[bp->pd*bp->ld][bp->pd*bp->ld], int n, double t, float v[3*MGS_PANEL][bp->pd*bp->ld]){
+    int pd = bp->pd, ld = bp->ld, l = pd*ld, nm = n + lm + MGS_ADD;
+    double (*b)[ld][ld] = (double (*)[ld][ld]) bp->b;
+    double ts = l/(1.0 + l);
+    
+    for(int pr = 0, li = 0;pr < pd && n < nm;){
+        double wn[MGS_PANEL], tc = mgs2candidate(t, ts);
+        int w = 0;
+        while(pr < pd && w < MGS_PANEL){
+            memset(v[w], 0, sizeof(float[l]));
+            for(int i = bp->row[pr];i < bp->row[pr+1];i++){
+                float *vb = &v[w][bp->col[i]*ld];
+                for(int j = 0;j < ld;j++) vb[j] = (float) b[i][li][j];
+            }
+            if((wn[w] = vlabsf(l, v[w])) >= tc) w++;
+            if(++li == ld){
+                li = 0;
+                pr++;
+            }
+        }
+        n = mgs2panelf(l, w, v, wn, &v[MGS_PANEL], o, n, nm, &t, ts);
+    }
+    
+    return n;
+}
+
 msym_error_t generatePermutationSubspaces(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int span[pg->ct->d], msym_thresholds_t *thresholds, double pmem[4][perm->p_length][perm->p_length], double (**pss)[pg->ct->d], double ss[perm->p_length][perm->p_length]){
     msym_error_t ret = MSYM_SUCCESS;
     
@@ -158,109 +408,357 @@ err:
     return ret;
 }
 
-msym_error_t generateSubspaces(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, double cmem[pg->order], double pmem[4][perm->p_length*ld][perm->p_length*ld], double (*(*pss)[5])[pg->ct->d], double ss[perm->p_length*ld][perm->p_length*ld]){
+msym_error_t generateIrrepSubspace(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int k, int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, msym_subspace_scratch_t *scratch, double (*(*pss)[5])[perm->p_length*ld], double ss[perm->p_length*ld][perm->p_length*ld]){
     msym_error_t ret = MSYM_SUCCESS;
     
-    int pd = perm->p_length, dim = pd*ld;
+    int pd = perm->p_length, dim = pd*ld, sopsl = pg->order;
     msym_character_table_t *ct = pg->ct;
     double (*ctable)[ct->d] = ct->table;
-    double (*proj)[dim] = pmem[0], (*sspg)[dim] = pmem[1], (*sssg)[dim] = pmem[2], (*mem)[dim] = pmem[3];
-    
+    double (*pmem)[dim][dim] = (double (*)[dim][dim]) scratch->pmem;
+    double (*proj)[dim] = pmem[0], (*sspg)[dim] = pmem[1], (*sssg)[dim] = pmem[2], (*mem)[dim] = pmem[3], (*o)[dim] = pmem[4];
+    double (*v)[dim] = (double (*)[dim]) scratch->v;
+    double *cmem = scratch->cmem;
+    msym_block_projection_t *bp = &scratch->bp;
     msym_symmetry_operation_t *sops = pg->sops;
-    int sopsl = pg->order;
     int icosahedral = MSYM_POINT_GROUP_TYPE_I == pg->type || MSYM_POINT_GROUP_TYPE_Ih == pg->type;
+    int irrepd = ct->s[k].d, pgvspan = irrepd*span[k], oirl = 0, nirl = 0;
     
-    memset(ss, 0, dim*sizeof(*ss));
-    memset(pss, 0, ct->d*sizeof(*pss));
+    for(int s = 0;s < sopsl;s++) cmem[s] = ctable[k][sops[s].cla];
     
-    for(int k = 0, oirl = 0, nirl = 0;k < ct->d;k++, oirl = nirl){
-        int irrepd = ct->s[k].d, pgvspan = irrepd*span[k];
-        
-        if(pgvspan == 0) continue;
-        
-        for(int s = 0;s < pg->order;s++) cmem[s] = ctable[k][sops[s].cla];
-        
-        if(MSYM_SUCCESS != (ret = generateProjectionOperator(irrepd,sopsl,cmem,perm,ld,lrsops,proj))) goto err;
+    if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(irrepd,sopsl,cmem,ld,lrsops,bp))) goto err;
+    
+    if(irrepd == 1){
+        nirl = mgs2BlockProjection(bp, pgvspan, o, oirl, thresholds->orthogonalization, v);
+        if(nirl - oirl != pgvspan){
+            debug_printTransform(dim, dim, o);
+            ret = MSYM_SUBSPACE_ERROR;
+            msymSetErrorDetails("Ortogonal subspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,pgvspan,ct->s[k].name);
+            goto err;
+        }
+        pss[k][0] = &ss[oirl];
+    } else if(!(icosahedral && irrepd == 5)){
         
-        if(irrepd == 1){
-            nirl = mgs2(dim, pgvspan, proj, ss, oirl, thresholds->orthogonalization);
-            if(nirl - oirl != pgvspan){
-                debug_printTransform(dim, dim, ss);
+        int pgnirl = mgs2BlockProjection(bp, pgvspan, sspg, 0, thresholds->orthogonalization, v);
+        for(int d = 0; d < irrepd;d++,oirl = nirl){
+            
+            if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(1,sopsl,sgc[k][d],ld,lrsops,bp))) goto err;
+            
+            int sgnirl = mgs2BlockProjection(bp, sgd[k][d], sssg, 0, thresholds->orthogonalization, v);
+            
+            if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, pgnirl, sspg, sgnirl, sssg, thresholds, cmem, mem, o, &nirl))) goto err;
+            
+            if(nirl - oirl != span[k]){
                 ret = MSYM_SUBSPACE_ERROR;
-                msymSetErrorDetails("Ortogonal subspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,pgvspan,ct->s[k].name);
+                msymSetErrorDetails("Ortogonal subsubspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,span[k],ct->s[k].name);
                 goto err;
             }
-            pss[k][0] = &ss[oirl];
-        } else if(!(icosahedral && irrepd == 5)){
+            pss[k][d] = &ss[oirl];
             
-            int pgnirl = mgs2(dim, pgvspan, proj, sspg, 0, thresholds->orthogonalization);
-            for(int d = 0; d < irrepd;d++,oirl = nirl){
-                
-                if(MSYM_SUCCESS != (ret = generateProjectionOperator(1,sopsl,sgc[k][d],perm,ld,lrsops,proj))) goto err;
-                
-                int sgnirl = mgs2(dim, sgd[k][d], proj, sssg, 0, thresholds->orthogonalization);
-                
-                if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, pgnirl, sspg, sgnirl, sssg, thresholds, cmem, mem, ss, &nirl))) goto err;
-                
+        }
+    } else {
+        int idim[] = {1,2,2}, sdim[] = {3,4}, ssd = 0;
+        int pgnirl = mgs2BlockProjection(bp, pgvspan, sspg, 0, thresholds->orthogonalization, v);
+        for(int d = 0; d < 3;d++,oirl = nirl){
+            if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(idim[d],sopsl,sgc[k][d],ld,lrsops,bp))) goto err;
+            
+            int sgnirl = mgs2BlockProjection(bp, sgd[k][d], sssg, 0, thresholds->orthogonalization, v);
+            
+            int id = idim[d];
+            if(id > 1){
+                int n = 0;
+                if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, pgnirl, sspg, sgnirl, sssg, thresholds, cmem, mem, sssg, &n))) goto err;
+                sgnirl = n;
+                for(int sd = 0; sd < id;sd++,oirl = nirl){
+                    int sid = sdim[sd];
+                    if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(1,sopsl,sgc[k][sid],ld,lrsops,bp))) goto err;
+                    
+                    // sspg and sssg are taken, use mem, and take proj as mem after
+                    int ignirl = mgs2BlockProjection(bp, sgd[k][sid], mem, 0, thresholds->orthogonalization, v);
+                    
+                    if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, sgnirl, sssg, ignirl, mem, thresholds, cmem, proj, o, &nirl))) goto err;
+                    
+                    if(nirl - oirl != span[k]){
+                        debug_printTransform(sgnirl, dim, sssg);
+                        ret = MSYM_SUBSPACE_ERROR;
+                        msymSetErrorDetails("Ortogonal icosahedral subsubspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,span[k],ct->s[k].name);
+                        goto err;
+                    }
+                    pss[k][ssd] = &ss[oirl];
+                    ssd++;
+                }
+            } else {
+                if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, pgnirl, sspg, sgnirl, sssg, thresholds, cmem, mem, o, &nirl))) goto err;
                 if(nirl - oirl != span[k]){
+                    debug_printTransform(dim, dim, o);
                     ret = MSYM_SUBSPACE_ERROR;
-                    msymSetErrorDetails("Ortogonal subsubspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,span[k],ct->s[k].name);
+                    msymSetErrorDetails("Ortogonal icosahedral subspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,span[k],ct->s[k].name);
                     goto err;
                 }
                 pss[k][d] = &ss[oirl];
                 
+                ssd++;
             }
-        } else {
-            int idim[] = {1,2,2}, sdim[] = {3,4}, ssd = 0;
-            int pgnirl = mgs2(dim, pgvspan, proj, sspg, 0, thresholds->orthogonalization);
-            for(int d = 0; d < 3;d++,oirl = nirl){
-                if(MSYM_SUCCESS != (ret = generateProjectionOperator(idim[d],sopsl,sgc[k][d],perm,ld,lrsops,proj))) goto err;
-                
-                int sgnirl = mgs2(dim, sgd[k][d], proj, sssg, 0, thresholds->orthogonalization);
-                
-                int id = idim[d];
-                if(id > 1){
-                    int n = 0;
-                    if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, pgnirl, sspg, sgnirl, sssg, thresholds, cmem, mem, sssg, &n))) goto err;
-                    sgnirl = n;
-                    for(int sd = 0; sd < id;sd++,oirl = nirl){
-                        int sid = sdim[sd];
-                        if(MSYM_SUCCESS != (ret = generateProjectionOperator(1,sopsl,sgc[k][sid],perm,ld,lrsops,proj))) goto err;
-                        
-                        // sspg, sssg and proj are taken, use mem, and take proj as mem after
-                        int ignirl = mgs2(dim, sgd[k][sid], proj, mem, 0, thresholds->orthogonalization);
-                        
-                        if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, sgnirl, sssg, ignirl, mem, thresholds, cmem, proj, ss, &nirl))) goto err;
-                        
-                        if(nirl - oirl != span[k]){
-                            debug_printTransform(sgnirl, dim, sssg);
-                            ret = MSYM_SUBSPACE_ERROR;
-                            msymSetErrorDetails("Ortogonal icosahedral subsubspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,span[k],ct->s[k].name);
-                            goto err;
-                        }
-                        pss[k][ssd] = &ss[oirl];
-                        ssd++;
-                    }
-                } else {
-                    if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, pgnirl, sspg, sgnirl, sssg, thresholds, cmem, mem, ss, &nirl))) goto err;
-                    if(nirl - oirl != span[k]){
-                        debug_printTransform(dim, dim, ss);
-                        ret = MSYM_SUBSPACE_ERROR;
-                        msymSetErrorDetails("Ortogonal icosahedral subspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,span[k],ct->s[k].name);
-                        goto err;
-                    }
-                    pss[k][d] = &ss[oirl];
-                    
-                    ssd++;
+        }
+    }
+    
+    memcpy(ss, o, nirl*sizeof(*o));
+    
+err:
+    return ret;
+}
+
+/* Same as generateIrrepSubspace with single precision projection and orthogonalization, the subspace is then
+ * refined in double precision directly into ss, each vector may only change by less than the
+ * orthogonalization threshold. Scratch is the same as for double precision, the float matrices use the
+ * first half of pmem and v */
+msym_error_t generateIrrepSubspaceSingle(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int k, int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, msym_subspace_scratch_t *scratch, double (*(*pss)[5])[perm->p_length*ld], double ss[perm->p_length*ld][perm->p_length*ld]){
+    msym_error_t ret = MSYM_SUCCESS;
+    
+    int pd = perm->p_length, dim = pd*ld, sopsl = pg->order;
+    msym_character_table_t *ct = pg->ct;
+    double (*ctable)[ct->d] = ct->table;
+    float (*pmem)[dim][dim] = (float (*)[dim][dim]) scratch->pmem;
+    float (*proj)[dim] = pmem[0], (*sspg)[dim] = pmem[1], (*sssg)[dim] = pmem[2], (*mem)[dim] = pmem[3], (*o)[dim] = pmem[4];
+    float (*v)[dim] = (float (*)[dim]) scratch->v;
+    double *cmem = scratch->cmem;
+    msym_block_projection_t *bp = &scratch->bp;
+    msym_symmetry_operation_t *sops = pg->sops;
+    int icosahedral = MSYM_POINT_GROUP_TYPE_I == pg->type || MSYM_POINT_GROUP_TYPE_Ih == pg->type;
+    int irrepd = ct->s[k].d, pgvspan = irrepd*span[k], oirl = 0, nirl = 0;
+    
+    for(int s = 0;s < sopsl;s++) cmem[s] = ctable[k][sops[s].cla];
+    
+    if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(irrepd,sopsl,cmem,ld,lrsops,bp))) goto err;
+    
+    if(irrepd == 1){
+        nirl = mgs2BlockProjectionSingle(bp, pgvspan, o, oirl, thresholds->orthogonalization, v);
+        if(nirl - oirl != pgvspan) goto span_err;
+        pss[k][0] = &ss[oirl];
+    } else if(!(icosahedral && irrepd == 5)){
+        int pgnirl = mgs2BlockProjectionSingle(bp, pgvspan, sspg, 0, thresholds->orthogonalization, v);
+        for(int d = 0; d < irrepd;d++,oirl = nirl){
+            if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(1,sopsl,sgc[k][d],ld,lrsops,bp))) goto err;
+            int sgnirl = mgs2BlockProjectionSingle(bp, sgd[k][d], sssg, 0, thresholds->orthogonalization, v);
+            nirl = projectLinearlyIndependentSingle(dim, pgnirl, sspg, sgnirl, sssg, thresholds, mem, o, nirl);
+            if(nirl - oirl != span[k]) goto span_err;
+            pss[k][d] = &ss[oirl];
+        }
+    } else {
+        int idim[] = {1,2,2}, sdim[] = {3,4}, ssd = 0;
+        int pgnirl = mgs2BlockProjectionSingle(bp, pgvspan, sspg, 0, thresholds->orthogonalization, v);
+        for(int d = 0; d < 3;d++,oirl = nirl){
+            if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(idim[d],sopsl,sgc[k][d],ld,lrsops,bp))) goto err;
+            int sgnirl = mgs2BlockProjectionSingle(bp, sgd[k][d], sssg, 0, thresholds->orthogonalization, v);
+            if(idim[d] > 1){
+                sgnirl = projectLinearlyIndependentSingle(dim, pgnirl, sspg, sgnirl, sssg, thresholds, mem, sssg, 0);
+                for(int sd = 0; sd < idim[d];sd++,oirl = nirl){
+                    if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(1,sopsl,sgc[k][sdim[sd]],ld,lrsops,bp))) goto err;
+                    int ignirl = mgs2BlockProjectionSingle(bp, sgd[k][sdim[sd]], mem, 0, thresholds->orthogonalization, v);
+                    nirl = projectLinearlyIndependentSingle(dim, sgnirl, sssg, ignirl, mem, thresholds, proj, o, nirl);
+                    if(nirl - oirl != span[k]) goto span_err;
+                    pss[k][ssd++] = &ss[oirl];
                 }
+            } else {
+                nirl = projectLinearlyIndependentSingle(dim, pgnirl, sspg, sgnirl, sssg, thresholds, mem, o, nirl);
+                if(nirl - oirl != span[k]) goto span_err;
+                pss[k][ssd++] = &ss[oirl];
             }
         }
     }
     
-    //for(int i = 0; i < dim;i++) vlnorm(dim, ss[i]);
+    /* Refine in double precision, the vectors of each component are projected again with the operators that
+     * generated them, these commute so the spans are the same as in double precision, and since the vectors
+     * are already orthogonal in single precision one Gram-Schmidt pass is enough */
+    double *y = scratch->v;
+    
+    for(int i = 0;i < nirl;i++){
+        for(int j = 0;j < dim;j++) ss[i][j] = o[i][j];
+    }
+    
+    if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(irrepd,sopsl,cmem,ld,lrsops,bp))) goto err;
+    applyBlockProjectionOperator(bp, nirl, ss, y);
+    
+    if(irrepd > 1 && !(icosahedral && irrepd == 5)){
+        for(int d = 0;d < irrepd;d++){
+            if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(1,sopsl,sgc[k][d],ld,lrsops,bp))) goto err;
+            applyBlockProjectionOperator(bp, span[k], pss[k][d], y);
+        }
+    } else if(irrepd > 1){
+        int idim[] = {1,2,2}, sdim[] = {3,4};
+        for(int d = 0, ssd = 0;d < 3;ssd += idim[d++]){
+            if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(idim[d],sopsl,sgc[k][d],ld,lrsops,bp))) goto err;
+            applyBlockProjectionOperator(bp, idim[d]*span[k], pss[k][ssd], y);
+            for(int sd = 0;idim[d] > 1 && sd < idim[d];sd++){
+                if(MSYM_SUCCESS != (ret = generateBlockProjectionOperator(1,sopsl,sgc[k][sdim[sd]],ld,lrsops,bp))) goto err;
+                applyBlockProjectionOperator(bp, span[k], pss[k][ssd + sd], y);
+            }
+        }
+    }
     
+    for(int i = 0;i < nirl;i++){
+        double a = 0.0;
+        for(int j = 0;j < i;j++) denseAxpy(dim, -denseDot(dim, ss[i], ss[j]), ss[j], ss[i]);
+        vlnorm(dim, ss[i]);
+        for(int j = 0;j < dim;j++) a += ss[i][j]*o[i][j];
+        if(fabs(1.0 - a) >= thresholds->orthogonalization){
+            ret = MSYM_SUBSPACE_ERROR;
+            msymSetErrorDetails("Single precision subspace vector %d in %s changed by %e during refinement",i,ct->s[k].name,fabs(1.0 - a));
+            goto err;
+        }
+    }
+    
+err:
+    return ret;
+span_err:
+    ret = MSYM_SUBSPACE_ERROR;
+    msymSetErrorDetails("Single precision subspace of dimension (%d) inconsistent with span (%d) in %s",nirl - oirl,irrepd == 1 ? pgvspan : span[k],ct->s[k].name);
+    return ret;
+}
+
+msym_error_t generateSubspacesTask(void *data, int task, int worker){
+    msym_subspace_task_t *t = data;
+    int k = t->irrep[task], ld = t->ld, dim = t->perm->p_length*ld;
+    double (*ss)[dim] = t->ss;
+    // the double precision subspace is generated if the single precision one cannot be refined
+    if(MSYM_PRECISION_SINGLE == t->precision && MSYM_SUCCESS == generateIrrepSubspaceSingle(t->pg, t->perm, ld, t->lrsops, k, t->span, t->sgc, t->sgd, t->thresholds, &t->scratch[worker], t->pss, &ss[t->oirl[k]])) return MSYM_SUCCESS;
+    return generateIrrepSubspace(t->pg, t->perm, ld, t->lrsops, k, t->span, t->sgc, t->sgd, t->thresholds, &t->scratch[worker], t->pss, &ss[t->oirl[k]]);
+}
+
+msym_error_t allocateSubspaceScratch(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, msym_subspace_scratch_t *scratch){
+    msym_error_t ret = MSYM_SUCCESS;
+    int dim = perm->p_length*ld;
+    
+    memset(scratch, 0, sizeof(*scratch));
+    
+    if(MSYM_SUCCESS != (ret = allocateBlockProjectionOperator(pg->order, perm, ld, &scratch->bp))) goto err;
+    
+    scratch->cmem = msymMalloc(sizeof(double[pg->order > dim ? pg->order : dim]));
+    scratch->pmem = msymMalloc(sizeof(double[5][dim][dim]));
+    scratch->v = msymMalloc(sizeof(double[3*MGS_PANEL][dim]));
+    
+    if(NULL == scratch->cmem || NULL == scratch->pmem || NULL == scratch->v){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for subspace generation of dimension %d",dim);
+        goto err;
+    }
+    
+    return ret;
 err:
+    freeSubspaceScratch(scratch);
+    return ret;
+}
+
+/* Memory allocated by allocateSubspaceScratch */
+size_t subspaceScratchBytes(int order, int pd, int ld){
+    size_t dim = ((size_t) pd)*ld, bl = ((size_t) pd)*(order < pd ? order : pd);
+    size_t d = (order > dim ? order : dim) + 5*dim*dim + 3*MGS_PANEL*dim + bl*ld*ld;
+    size_t i = pd + 1 + bl + ((size_t) order)*pd + pd;
+    return d*sizeof(double) + i*sizeof(int);
+}
+
+void freeSubspaceScratch(msym_subspace_scratch_t *scratch){
+    freeBlockProjectionOperator(&scratch->bp);
+    msymFree(scratch->cmem);
+    msymFree(scratch->pmem);
+    msymFree(scratch->v);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+void subspaceCacheKey(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int k, int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, msym_precision_t precision, msym_subspace_key_t *key){
+    memset(key, 0, sizeof(*key));
+    key->type = pg->type;
+    key->n = pg->n;
+    key->order = pg->order;
+    key->ld = ld;
+    key->k = k;
+    key->span = span[k];
+    memcpy(key->sgd, sgd[k], sizeof(key->sgd));
+    key->zero = thresholds->zero;
+    key->orthogonalization = thresholds->orthogonalization;
+    key->precision = precision;
+    key->perm = perm;
+    key->lrsops = (double *) lrsops;
+    key->sgc = (double *) sgc[k];
+}
+
+/* Irreducible representations are generated independently into their own part of ss, so the result
+ * does not depend on the number of threads, the scratch memory is added to meter while it is in use.
+ * Subspaces only depend on the point group, permutations and basis function representation,
+ * so they are taken from the subspace cache when an equivalence set with the same pattern has been seen */
+msym_error_t generateSubspaces(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int span[pg->ct->d], double (*sgc)[5][pg->order], int (*sgd)[5], msym_thresholds_t *thresholds, int threads, msym_precision_t precision, msym_parallel_meter_t *meter, double (*(*pss)[5])[perm->p_length*ld], double ss[perm->p_length*ld][perm->p_length*ld]){
+    msym_error_t ret = MSYM_SUCCESS;
     
+    int dim = perm->p_length*ld, tasks = 0, workers = 0;
+    msym_character_table_t *ct = pg->ct;
+    msym_subspace_scratch_t *scratch = NULL;
+    int *irrep = msymCalloc(ct->d, sizeof(*irrep));
+    int *oirl = msymCalloc(ct->d, sizeof(*oirl));
+    
+    if(NULL == irrep || NULL == oirl){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for subspace generation");
+        goto err;
+    }
+    
+    memset(ss, 0, dim*sizeof(*ss));
+    memset(pss, 0, ct->d*sizeof(*pss));
+    
+    for(int k = 0, o = 0;k < ct->d;k++){
+        msym_subspace_key_t key;
+        int pgvspan = ct->s[k].d*span[k], found = 0;
+        oirl[k] = o;
+        if(pgvspan == 0) continue;
+        if(o + pgvspan > dim){
+            ret = MSYM_SUBSPACE_ERROR;
+            msymSetErrorDetails("Subspace span (%d) exceeds dimension (%d)",o + pgvspan,dim);
+            goto err;
+        }
+        o += pgvspan;
+        
+        subspaceCacheKey(pg, perm, ld, lrsops, k, span, sgc, sgd, thresholds, precision, &key);
+        if(MSYM_SUCCESS != (ret = findCachedSubspace(&key, &found, pgvspan*dim, ss[oirl[k]]))) goto err;
+        if(found){
+            for(int d = 0;d < ct->s[k].d;d++) pss[k][d] = &ss[oirl[k] + d*span[k]];
+            continue;
+        }
+        
+        irrep[tasks++] = k;
+    }
+    
+    // Nothing left to generate when every irreducible representation was cached
+    workers = tasks > 0 ? parallelWorkers(threads, tasks) : 0;
+    
+    if(workers > 0 && NULL == (scratch = msymCalloc(workers, sizeof(*scratch)))){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for subspace generation");
+        goto err;
+    }
+    
+    for(int i = 0;i < workers;i++){
+        if(MSYM_SUCCESS != (ret = allocateSubspaceScratch(pg, perm, ld, &scratch[i]))) goto err;
+    }
+    
+    parallelMeterAdd(meter, workers*subspaceScratchBytes(pg->order, perm->p_length, ld));
+    
+    msym_subspace_task_t task = {.pg = pg, .perm = perm, .ld = ld, .lrsops = lrsops, .span = span, .sgc = sgc, .sgd = sgd, .thresholds = thresholds, .precision = precision, .irrep = irrep, .oirl = oirl, .scratch = scratch, .pss = pss, .ss = ss};
+    
+    if(MSYM_SUCCESS != (ret = parallelFor(workers, tasks, generateSubspacesTask, &task))) goto err;
+    
+    for(int i = 0;i < tasks;i++){
+        msym_subspace_key_t key;
+        int k = irrep[i];
+        subspaceCacheKey(pg, perm, ld, lrsops, k, span, sgc, sgd, thresholds, precision, &key);
+        if(MSYM_SUCCESS != (ret = cacheSubspace(&key, ct->s[k].d*span[k]*dim, ss[oirl[k]]))) goto err;
+    }
+    
+err:
+    for(int i = 0;i < workers && NULL != scratch;i++){
+        freeSubspaceScratch(&scratch[i]);
+    }
+    if(NULL != scratch) parallelMeterRemove(meter, workers*subspaceScratchBytes(pg->order, perm->p_length, ld));
+    msymFree(scratch);
+    msymFree(irrep);
+    msymFree(oirl);
     return ret;
 }
 
@@ -644,6 +1142,22 @@ msym_error_t projectLinearlyIndependent(int dim, int vdim, double v[vdim][dim],
     return ret;
 }
 
+/* projectLinearlyIndependent in single precision, returns the new number of vectors in o */
+int projectLinearlyIndependentSingle(int dim, int vdim, float v[vdim][dim], int udim, float u[udim][dim], msym_thresholds_t *thresholds, float mem[dim][dim], float o[dim][dim], int oirl){
+    memset(mem, 0, dim*sizeof(*mem));
+    for(int vd = 0; vd < vdim;vd++){
+        for(int ud = 0; ud < udim; ud++){
+            denseAxpyf(dim, denseDotf(dim, v[vd], u[ud]), u[ud], mem[vd]);
+        }
+    }
+    
+    int mdim = vdim > udim ? udim : vdim;
+    
+    int nirl = mgs2f(dim, mdim, mem, o, oirl, thresholds->orthogonalization/sqrt(dim));
+    
+    return nirl;
+}
+
 msym_error_t generateSplittingOperation(msym_point_group_t *pg, msym_permutation_t perm[pg->order], int ld, double (*lrsops)[ld][ld], int sgl, const msym_subgroup_t *sg, const msym_subgroup_t **rsg, double rsop[perm->p_length*ld][perm->p_length*ld], msym_symmetry_operation_t **osop){
     msym_error_t ret = MSYM_SUCCESS;
     
@@ -892,88 +1406,454 @@ err:
 
 
 
-msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, const msym_subgroup_t sg[sgl], int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, msym_thresholds_t *thresholds, int *osrsl, msym_subrepresentation_space_t **osrs, msym_basis_function_t ***osrsbf, int **ospan){
+/* SALCs of one equivalence set and angular momentum, collected per irreducible representation
+ * and merged in block order so the result does not depend on the number of threads */
+msym_error_t generateSALCBlock(msym_salc_task_t *t, msym_salc_block_t *b, msym_salc_scratch_t *w){
     msym_error_t ret = MSYM_SUCCESS;
+    
+    msym_point_group_t *pg = t->pg;
     msym_character_table_t *ct = pg->ct;
-    int lmax = -1, nmax = 0, eslmax = 0;
-    enum _msym_basis_type ftype = basis[0].type;
-    for(int i = 0;i < basisl;i++){
-        if(basis[i].type != ftype) {nmax = -1; break;}
-        lmax = basis[i].f.rsh.l > lmax ? basis[i].f.rsh.l : lmax;
-        nmax = basis[i].f.rsh.n > nmax ? basis[i].f.rsh.n : nmax;
-    }
+    int i = b->i, l = b->l, lmax = t->lmax, nmax = t->nmax, projm = w->projm;
+    int ld = t->lts[l].d, esd = t->es[i].length, dim = esd*ld, li = 0;
+    double (*lrsops)[ld][ld] = t->lts[l].t;
+    double (*pmem)[projm][projm] = (double (*)[projm][projm]) w->pmem;
+    double (*(*ssp)[5])[dim] = w->sspmem;
+    double (*ss)[dim] = (double (*)[dim]) pmem[4];
+    double (**pssp)[esd] = w->psspmem;
+    double (*pss)[esd] = (double (*)[esd]) pmem[3];
+    double (*split)[dim] = (double (*)[dim]) pmem[6];
+    double (*sdss)[dim] = (double (*)[dim]) pmem[1];
+    double (*dss)[dim] = (double (*)[dim]) pmem[2];
+    double (*pf)[dim] = (double (*)[dim]) pmem[5];
+    double (*mem)[dim] = (double (*)[dim]) pmem[0];
+    double *mspan = w->mspan;
+    double (*pspan)[ct->d] = t->pspan;
+    double (*bspan)[ct->d] = t->bspan;
+    double (*dp)[ct->d][ct->d] = t->dp;
+    double (*sgc)[5][pg->order] = t->sgc;
+    double (*(*lssp)[ct->d])[2*lmax+1] = t->lssp;
+    int (*iespan)[lmax+1][ct->d] = t->iespan;
+    int (*ipspan)[ct->d] = t->ipspan;
+    int (*ibspan)[ct->d] = t->ibspan;
+    int (*srsbfmap)[nmax+1][lmax+1] = t->srsbfmap;
+    int (*srsbfl)[nmax+1][lmax+1] = t->srsbfl;
+    msym_permutation_t **perm = t->perm;
+    msym_symmetry_operation_t *splitop = NULL;
+    int nn = 0;
+    
+    for(int n = l+1; n <= t->esnmax[i];n++) nn += srsbfl[i][n][l] > 0;
     
-    for(int i = 0;i < esl;i++){
-        eslmax = es[i].length > eslmax ? es[i].length : eslmax;
+    for(int k = 0;k < ct->d;k++){
+        int cap = t->generate[k] ? iespan[i][l][k]*nn : 0;
+        b->salcl[k] = 0;
+        w->span[k] = t->generate[k] ? iespan[i][l][k] : 0;
+        if(cap == 0) continue;
+        if(NULL == (b->salc[k] = msymCalloc(cap, sizeof(msym_salc_t)))){
+            ret = MSYM_MEMORY_ERROR;
+            msymSetErrorDetails("Could not allocate memory for %d SALCs",cap);
+            goto err;
+        }
+        b->bytes += cap*sizeof(msym_salc_t);
+        parallelMeterAdd(t->meter, cap*sizeof(msym_salc_t));
     }
     
-    if(lmax < 0 || nmax < 1){
-        if(nmax == -1) msymSetErrorDetails("Basis functions are not of the same type");
-        else msymSetErrorDetails("Invalid sperical harmonics quantum numbers");
-        ret = MSYM_INVALID_BASIS_FUNCTIONS;
-        return ret;
-    } else if (ftype != MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC){
-        msymSetErrorDetails("Basis function type not supported");
-        ret = MSYM_INVALID_BASIS_FUNCTIONS;
-        return ret;
+    clean_debug_printf("e decomposed %d\n", ct->d);
+    for(int prk = 0;prk < ct->d;prk++){
+        if(prk < ct->d - 1) clean_debug_printf("%d%s + ", iespan[i][l][prk], ct->s[prk].name);
+        else clean_debug_printf("%d%s\n", iespan[i][l][prk], ct->s[prk].name);
     }
     
-    int projm = (2*lmax+1)*eslmax;
+    decomposeSubRepresentation(pg, t->rsg, sgc, iespan[i][l], w->sgd);
+    if(MSYM_SUCCESS != (ret = generateSplittingOperation(pg, perm[i], ld, lrsops, t->sgl, t->sg, t->rsg, split, &splitop))) goto err;
+    if(MSYM_SUCCESS != (ret = generateSubspaces(pg, perm[i], ld, lrsops, w->span, sgc, w->sgd, t->thresholds, t->threads, t->precision, t->meter, ssp, ss))) goto err;
+    if(MSYM_SUCCESS != (ret = generatePermutationSubspaces(pg, perm[i], ipspan[i], t->thresholds, (double (*)[esd][esd]) pmem[0], pssp, pss))) goto err;
     
-    double (*pmem)[projm][projm] = calloc(7, sizeof(*pmem));        // Memory for calculating projection operatorsle
+    for(int pk = 0;pk < ct->d;pk++){
+        int pvspan = ipspan[i][pk]*ct->s[pk].d;
+        if(pvspan == 0) continue;
+        for(int lk = 0;lk < ct->d;lk++){
+            int lvspan = ibspan[l][lk]*ct->s[lk].d, vspan = pvspan*lvspan;
+            if(lvspan == 0) continue;
+            
+            kron2(pvspan, esd, pssp[pk], lvspan, ld, lssp[l][lk], dss);
+            
+            vlscale(pspan[i][pk]*bspan[l][lk], ct->d, dp[pk][lk], mspan);
+            
+            for(int dk = 0; dk < ct->d; dk++){
+                int sspan =  (int) round(mspan[dk]/ct->s[dk].r);
+                if(sspan == 0 || !t->generate[dk]) continue;
+                
+                int sd = ct->s[dk].d;
+                
+                int sdvi[5] = {-1,-1,-1,-1,-1};
+                
+                for(int d = 0, oirl = 0, nirl = 0; d < sd;d++, oirl = nirl){
+                    if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, vspan, dss, iespan[i][l][dk], ssp[dk][d], t->thresholds, w->cmem, mem, sdss, &nirl))) goto err;
+                    
+                    int sdvl = nirl - oirl;
+                    sdvi[d] = oirl;
+                    
+                    if(sdvl != sspan){
+                        debug_printTransform(vspan, dim, dss);
+                        ret = MSYM_SUBSPACE_ERROR;
+                        msymSetErrorDetails("Linear projection subspace of dimension (%d) inconsistent with span (%d) in %s component %d",sdvl,sspan,ct->s[dk].name,d);
+                        goto err;
+                    }
+                }
+                
+                if(MSYM_SUCCESS != (ret = determinePartnerFunctions(pg, ct->s[dk].r, perm[i], ld, lrsops, dim, sd, sspan, sdss, sdvi, split, splitop, mem, &li, pf))) goto err;
+                
+                for(int si = 0, pfi = 0; si < sspan;si++){
+                    for(int n = l+1; n <= t->esnmax[i];n++){
+                        if(srsbfl[i][n][l] == 0) continue;
+                        if(b->salcl[dk] >= iespan[i][l][dk]*nn){
+                            ret = MSYM_SUBSPACE_ERROR;
+                            msymSetErrorDetails("Exceeded calculated number of SALCs %d >= %d",b->salcl[dk],iespan[i][l][dk]*nn);
+                            goto err;
+                        }
+                        
+                        msym_salc_t *salc = &b->salc[dk][b->salcl[dk]];
+                        salc->d = sd;
+                        // Add basis function and permutation irrep here
+                        double (*salcpf)[dim] = msymCalloc(salc->d,sizeof(*salcpf));
+                        memcpy(salcpf, pf[pfi], sd*sizeof(*salcpf));
+                        
+                        salc->pf = (double*) salcpf;
+                        salc->fl = dim;
+                        salc->f = &t->srsbf[srsbfmap[i][n][l]];
+                        
+                        b->salcl[dk]++;
+                        b->bytes += salc->d*sizeof(*salcpf);
+                        parallelMeterAdd(t->meter, salc->d*sizeof(*salcpf));
+                    }
+                    
+                    pfi += sd;
+                }
+            }
+        }
+    }
+    
+err:
+    return ret;
+}
+
+/* Scratch is sized to the block and freed when it is done, so only the blocks being generated use memory */
+msym_error_t generateSALCBlockTask(void *data, int task, int worker){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_salc_task_t *t = data;
+    msym_salc_block_t *b = &t->blocks[task];
+    msym_salc_scratch_t w;
+    
+    if(MSYM_SUCCESS != (ret = allocateSALCScratch(t->pg, t->lmax, t->es[b->i].length*t->lts[b->l].d, &w))) goto err;
+    
+    parallelMeterAdd(t->meter, w.bytes);
+    
+    ret = generateSALCBlock(t, b, &w);
+    
+    parallelMeterRemove(t->meter, w.bytes);
+    freeSALCScratch(&w);
+err:
+    return ret;
+}
+
+void freeSALCBlock(int d, msym_salc_block_t *b){
+    for(int k = 0;k < d && NULL != b->salc;k++){
+        for(int s = 0;NULL != b->salcl && s < b->salcl[k];s++){
+            msymFree(b->salc[k][s].pf);
+        }
+        msymFree(b->salc[k]);
+    }
+    msymFree(b->salc);
+    msymFree(b->salcl);
+    b->salc = NULL;
+    b->salcl = NULL;
+}
+
+/* Memory allocated by allocateSALCScratch */
+size_t salcScratchBytes(msym_point_group_t *pg, int lmax, int projm){
+    size_t d = pg->ct->d;
+    return sizeof(double)*(7*((size_t) projm)*projm + ((size_t) pg->order)*(2*lmax+1) + d) + d*(sizeof(int) + sizeof(double *[5]) + sizeof(double *) + sizeof(int[5]));
+}
+
+/* Memory used while generating the SALCs of one equivalence set of length esd and angular momentum with ld functions,
+ * when its irreducible representations are generated by threads */
+size_t salcBlockBytes(msym_point_group_t *pg, int lmax, int esd, int ld, int threads){
+    return salcScratchBytes(pg, lmax, esd*ld) + parallelWorkers(threads, pg->ct->d)*subspaceScratchBytes(pg->order, esd, ld);
+}
+
+/* Orders the basis functions in srsbf by equivalence set, n, l, element and m, the functions of each
+ * (n,l) in an equivalence set start at srsbfmap and there are srsbfl of them, which is either none or
+ * 2l+1 for every element in the set */
+msym_error_t mapSubrepresentationBasisFunctions(int esl, msym_equivalence_set_t *es, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int *esimap, int lmax, int nmax, int esnmax[esl], int srsbfl[esl][nmax+1][lmax+1], int srsbfmap[esl][nmax+1][lmax+1], msym_basis_function_t *srsbf[basisl]){
+    msym_error_t ret = MSYM_SUCCESS;
+    int srsbfi = 0;
+    
+    memset(srsbfl, 0, esl*sizeof(*srsbfl));
+    memset(srsbf, 0, basisl*sizeof(*srsbf));
+    
+    for(int o = 0;o < basisl;o++){
+        msym_basis_function_t *bf = &basis[o];
+        int ei = (int)(bf->element - elements), esi = esimap[ei];
+        msym_equivalence_set_t *e = esmap[ei];
+        if(esi >= e->length || e->elements[esi] != bf->element){
+            ret = MSYM_INVALID_BASIS_FUNCTIONS;
+            msymSetErrorDetails("Basis function does not map to any equivalence set");
+            goto err;
+        }
+        if(bf->f.rsh.n < 0 || bf->f.rsh.m < -bf->f.rsh.l || bf->f.rsh.m > bf->f.rsh.l){
+            ret = MSYM_INVALID_BASIS_FUNCTIONS;
+            msymSetErrorDetails("Invalid sperical harmonics quantum numbers n = %d, l = %d, m = %d for basis function %s",bf->f.rsh.n,bf->f.rsh.l,bf->f.rsh.m,bf->name);
+            goto err;
+        }
+        if(bf->f.rsh.n > esnmax[e - es]) esnmax[e - es] = bf->f.rsh.n;
+        srsbfl[e - es][bf->f.rsh.n][bf->f.rsh.l]++;
+    }
+    
+    for(int i = 0;i < esl;i++){
+        for(int n = 0;n <= nmax;n++){
+            for(int l = 0;l <= lmax;l++){
+                int bfl = srsbfl[i][n][l];
+                srsbfmap[i][n][l] = srsbfi;
+                if(bfl != 0 && bfl != es[i].length*(2*l+1)){
+                    ret = MSYM_INVALID_BASIS_FUNCTIONS;
+                    msymSetErrorDetails("Found %d basis functions where n = %d and l = %d in equivalence set %d, expected %d (%d for each element)",bfl,n,l,i,es[i].length*(2*l+1),2*l+1);
+                    goto err;
+                }
+                srsbfi += bfl;
+            }
+        }
+    }
     
-    if(NULL == pmem){
+    for(int o = 0;o < basisl;o++){
+        msym_basis_function_t *bf = &basis[o];
+        int ei = (int)(bf->element - elements), esi = esimap[ei], i = (int)(esmap[ei] - es), l = bf->f.rsh.l;
+        int bfi = srsbfmap[i][bf->f.rsh.n][l] + esi*(2*l+1) + bf->f.rsh.m + l;
+        if(NULL != srsbf[bfi]){
+            ret = MSYM_INVALID_BASIS_FUNCTIONS;
+            msymSetErrorDetails("Found basis function %s but function where m = %d is already defined on element %d of equivalence set %d",bf->name,bf->f.rsh.m,esi,i);
+            goto err;
+        }
+        srsbf[bfi] = bf;
+    }
+    
+err:
+    return ret;
+}
+
+/* Predicted peak memory of the SALC engines, for generateSubrepresentationSpaces the memory shared by all
+ * blocks (see salcBlockBytes for each block), and for generateSubrepresentationSpacesLowMem in total */
+void predictSubrepresentationSpacesMemory(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int lmax, int nmax, size_t *shared, size_t *lowmem){
+    size_t d = pg->ct->d, order = pg->order, ll = 2*lmax+1, output = 0, common = 0, lts = 0;
+    
+    /* each basis function is a partner function row of length (2l+1)*(equivalence set length) */
+    for(int o = 0;o < basisl;o++){
+        output += sizeof(double)*(2*basis[o].f.rsh.l+1)*esmap[basis[o].element - elements]->length;
+    }
+    
+    for(int l = 0;l <= lmax;l++){
+        lts += sizeof(double)*(order + 1)*(2*l+1)*(2*l+1);
+    }
+    
+    size_t projl = ll*order, ddim = (projl+1)/2 < (size_t) basisl ? (projl+1)/2 : (size_t) basisl;
+    
+    common = output + lts + basisl*(sizeof(msym_salc_t) + sizeof(msym_basis_function_t *)) + esl*2*(nmax+1)*(lmax+1)*sizeof(int);
+    
+    *shared = common + sizeof(double)*2*ll*ll + basisl*sizeof(msym_salc_t) + esl*(lmax+1)*(sizeof(msym_salc_block_t) + d*(sizeof(int[2]) + sizeof(msym_salc_t *)));
+    *lowmem = common + sizeof(double)*(4*projl*projl + 2*order*order + 2*basisl*projl + 5*ddim*ddim) + sizeof(int[5])*ddim;
+}
+
+/* Generating blocks of the largest (equivalence set, l) first the workers blocks generated at the same time use at most
+ * the memory of the workers largest blocks, threads for the irreducible representations within a block are
+ * reduced before blocks are generated one at a time, and it fails only if the largest block does not fit alone */
+msym_error_t scheduleSALCBlocks(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int lmax, int threads, size_t shared, size_t budget, int *oworkers, int *othreads, size_t *opredicted){
+    msym_error_t ret = MSYM_SUCCESS;
+    int (*les)[lmax+1] = msymCalloc(esl, sizeof(*les));
+    size_t *need = msymCalloc(esl*(lmax+1), sizeof(*need));
+    int blocksl = 0, workers = 0, inner = 0, threadsl = parallelWorkers(threads, INT_MAX);
+    size_t predicted = 0;
+    
+    if(NULL == les || NULL == need){
         ret = MSYM_MEMORY_ERROR;
-        msymSetErrorDetails("Could not allocate %ld bytes of memory for SALC generation", 7*sizeof(*pmem));
+        msymSetErrorDetails("Could not allocate memory for SALC block scheduling");
+        goto err;
+    }
+    
+    for(int o = 0;o < basisl;o++){
+        les[esmap[basis[o].element - elements] - es][basis[o].f.rsh.l] = 1;
+    }
+    
+    for(int i = 0;i < esl;i++){
+        for(int l = 0;l <= lmax;l++) blocksl += les[i][l];
+    }
+    
+    workers = parallelWorkers(threadsl, blocksl);
+    inner = threadsl/workers;
+    
+    for(;;){
+        blocksl = 0;
+        for(int i = 0;i < esl;i++){
+            for(int l = 0;l <= lmax;l++){
+                if(!les[i][l]) continue;
+                size_t n = salcBlockBytes(pg, lmax, es[i].length, 2*l+1, inner);
+                int b = blocksl++;
+                for(;b > 0 && need[b-1] < n;b--) need[b] = need[b-1];
+                need[b] = n;
+            }
+        }
+        
+        predicted = shared;
+        for(int b = 0;b < workers && b < blocksl;b++) predicted += need[b];
+        
+        if(0 == budget || predicted <= budget) break;
+        if(inner > 1) inner--;
+        else if(workers > 1) workers--;
+        else {
+            ret = MSYM_MEMORY_ERROR;
+            msymSetErrorDetails("Predicted memory for SALC generation (%lu bytes shared and %lu bytes for the largest block) exceeds budget (%lu bytes)",(unsigned long) shared,(unsigned long) (blocksl > 0 ? need[0] : 0),(unsigned long) budget);
+            goto err;
+        }
+    }
+    
+    *oworkers = workers;
+    *othreads = inner;
+    *opredicted = predicted;
+    
+err:
+    msymFree(les);
+    msymFree(need);
+    return ret;
+}
+
+msym_error_t allocateSALCScratch(msym_point_group_t *pg, int lmax, int projm, msym_salc_scratch_t *w){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_character_table_t *ct = pg->ct;
+    
+    memset(w, 0, sizeof(*w));
+    
+    w->projm = projm;
+    w->pmem = msymCalloc(7, sizeof(double[projm][projm]));
+    w->cmem = msymCalloc(pg->order*(2*lmax+1), sizeof(double));    // Don't change this to elsmax*(2*lmax+1) needed for sops
+    w->mspan = msymCalloc(ct->d, sizeof(double));
+    w->span = msymCalloc(ct->d, sizeof(*w->span));
+    w->sspmem = msymCalloc(ct->d, sizeof(double *[5]));
+    w->psspmem = msymCalloc(ct->d, sizeof(double *));
+    w->sgd = msymCalloc(ct->d, sizeof(*w->sgd));
+    if(NULL == w->pmem || NULL == w->cmem || NULL == w->mspan || NULL == w->span || NULL == w->sspmem || NULL == w->psspmem || NULL == w->sgd){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate %ld bytes of memory for SALC generation", 7*sizeof(double[projm][projm]));
+        goto err;
+    }
+    w->bytes = salcScratchBytes(pg, lmax, projm);
+    
+    return ret;
+err:
+    freeSALCScratch(w);
+    return ret;
+}
+
+void freeSALCScratch(msym_salc_scratch_t *w){
+    msymFree(w->pmem);
+    msymFree(w->cmem);
+    msymFree(w->mspan);
+    msymFree(w->span);
+    msymFree(w->sspmem);
+    msymFree(w->psspmem);
+    msymFree(w->sgd);
+}
+
+/* Spans are calculated from characters alone, SALCs are only generated for species (or all if species < 0)
+ * and only for the irreducible representations that are not already in *osrs. If *osrs is NULL the
+ * subrepresentation spaces are allocated, otherwise *osrs, *osrsbf and *ospan are updated in place.
+ * Blocks of (equivalence set, l) are generated with scratch that is freed when each is done, with a memory budget
+ * (0 for none) the number generated at the same time is limited to what fits (see scheduleSALCBlocks), and if not
+ * even the largest block fits alone the low memory engine is used. The predicted and measured peak memory is returned */
+msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, const msym_subgroup_t sg[sgl], int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int *esimap, msym_thresholds_t *thresholds, int threads, msym_precision_t precision, int species, size_t budget, size_t *opredicted, size_t *opeak, int *osrsl, msym_subrepresentation_space_t **osrs, msym_basis_function_t ***osrsbf, int **ospan){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_character_table_t *ct = pg->ct;
+    int lmax = -1, nmax = 0;
+    enum _msym_basis_type ftype = basis[0].type;
+    for(int i = 0;i < basisl;i++){
+        if(basis[i].type != ftype) {nmax = -1; break;}
+        lmax = basis[i].f.rsh.l > lmax ? basis[i].f.rsh.l : lmax;
+        nmax = basis[i].f.rsh.n > nmax ? basis[i].f.rsh.n : nmax;
+    }
+    
+    if(lmax < 0 || nmax < 1){
+        if(nmax == -1) msymSetErrorDetails("Basis functions are not of the same type");
+        else msymSetErrorDetails("Invalid sperical harmonics quantum numbers");
+        ret = MSYM_INVALID_BASIS_FUNCTIONS;
+        return ret;
+    } else if (ftype != MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC){
+        msymSetErrorDetails("Basis function type not supported");
+        ret = MSYM_INVALID_BASIS_FUNCTIONS;
         return ret;
     }
     
-    double (*bspan)[ct->d] = calloc(lmax+1, sizeof(*bspan));        // span of individual basis functions
-    double (*pspan)[ct->d] = calloc(esl, sizeof(*pspan));               // span of permutation operators
+    size_t shared = 0, lowmem = 0, predicted = 0;
+    int workers = 0, inner = 0;
     
-    double *rspan = calloc(ct->d, sizeof(*rspan));                  // total direct product symmetrized basis
-    double *dspan = calloc(ct->d, sizeof(*dspan));                  // decoposed total span of symmetrized basis (double)
+    predictSubrepresentationSpacesMemory(pg, esl, es, basisl, basis, elements, esmap, lmax, nmax, &shared, &lowmem);
     
-    double (*sdssmem)[projm] = pmem[1];
-    double (*dssmem)[projm] = pmem[2];
-    double (*pssmem)[pg->order] = pmem[3];
-    double (*ssmem)[projm] = pmem[4];
-    double (*pfmem)[projm] = pmem[5];
-    double (*splitmem)[projm] = pmem[6];
-    double *cmem = calloc(pg->order*(2*lmax+1), sizeof(*cmem));    // Don't change this to elsmax*(2*lmax+1) needed for sops
-    double (*(*sspmem)[5])[pg->order*(lmax+1)] = calloc(ct->d, sizeof(*sspmem));
+    if(MSYM_SUCCESS != (ret = scheduleSALCBlocks(pg, esl, es, basisl, basis, elements, esmap, lmax, threads, shared, budget, &workers, &inner, &predicted))){
+        if(MSYM_MEMORY_ERROR == ret && lowmem <= budget && species < 0 && NULL == *osrs){
+            *opredicted = lowmem;
+            return generateSubrepresentationSpacesLowMem(pg, sgl, sg, esl, es, perm, basisl, basis, elements, esmap, esimap, thresholds, opeak, osrsl, osrs, osrsbf, ospan);
+        }
+        return ret;
+    }
     
-    double (**psspmem)[pg->order] = calloc(ct->d, sizeof(*psspmem));
-    double (*(*lssp)[ct->d])[2*lmax+1] = calloc(lmax+1, sizeof(*lssp));
+    int projm = 2*lmax+1;
     
-    double *mspan = calloc(ct->d, sizeof(double));                  // span decomposition memory
-    double (*sgc)[5][pg->order] = calloc(ct->d,sizeof(*sgc));
+    double (*pmem)[projm][projm] = msymCalloc(2, sizeof(*pmem));        // Memory for calculating projection operators of the basis functions
+    msym_parallel_meter_t *meter = parallelMeterCreate();
     
-    const msym_subgroup_t **rsg = calloc(ct->d, sizeof(*rsg));
+    if(NULL == pmem || NULL == meter){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate %ld bytes of memory for SALC generation", 2*sizeof(*pmem));
+        msymFree(pmem);
+        parallelMeterDestroy(meter);
+        return ret;
+    }
+    
+    double (*bspan)[ct->d] = msymCalloc(lmax+1, sizeof(*bspan));        // span of individual basis functions
+    double (*pspan)[ct->d] = msymCalloc(esl, sizeof(*pspan));               // span of permutation operators
+    
+    double *dspan = msymCalloc(ct->d, sizeof(*dspan));                  // decoposed total span of symmetrized basis (double)
+    
+    double (*(*lssp)[ct->d])[2*lmax+1] = msymCalloc(lmax+1, sizeof(*lssp));
     
-    int (*sgd)[5] = calloc(ct->d,sizeof(*sgd));
-    int *ispan = calloc(ct->d, sizeof(*ispan));                               // decoposed total span of symmetrized basis (int)
-    int (*iespan)[lmax+1][ct->d] = calloc(esl, sizeof(*iespan));
-    int (*ipspan)[ct->d] = calloc(esl, sizeof(*ipspan));               // span of permutation operators
-    int (*ibspan)[ct->d] = calloc(lmax+1, sizeof(*ibspan));
-    int *isalc = calloc(ct->d, sizeof(*isalc));                               // number of added salcs to irrep
-    int *esnmax = calloc(esl, sizeof(*esnmax));                                     // max n in eqset
+    double *mspan = msymCalloc(ct->d, sizeof(double));                  // span decomposition memory
+    double (*sgc)[5][pg->order] = msymCalloc(ct->d,sizeof(*sgc));
     
-    msym_basis_function_t *(*esbfmap)[pg->order][nmax+1][lmax+1][2*lmax+1] = calloc(esl,sizeof(*esbfmap));
+    const msym_subgroup_t **rsg = msymCalloc(ct->d, sizeof(*rsg));
     
+    int (*sgd)[5] = msymCalloc(ct->d,sizeof(*sgd));
+    int *ispan = msymCalloc(ct->d, sizeof(*ispan));                               // decoposed total span of symmetrized basis (int)
+    int (*iespan)[lmax+1][ct->d] = msymCalloc(esl, sizeof(*iespan));
+    int (*ipspan)[ct->d] = msymCalloc(esl, sizeof(*ipspan));               // span of permutation operators
+    int (*ibspan)[ct->d] = msymCalloc(lmax+1, sizeof(*ibspan));
+    int *isalc = msymCalloc(ct->d, sizeof(*isalc));                               // number of added salcs to irrep
+    int *generate = msymCalloc(ct->d, sizeof(*generate));                         // irreps to generate salcs for
+    int *esnmax = msymCalloc(esl, sizeof(*esnmax));                                     // max n in eqset
     
-    msym_basis_function_t *(*srsbf) = calloc(basisl, sizeof(*srsbf));
+    msym_basis_function_t *(*srsbf) = msymCalloc(basisl, sizeof(*srsbf));
     
-    int (*srsbfmap)[nmax+1][lmax+1] = calloc(esl,sizeof(*srsbfmap));
+    int (*srsbfmap)[nmax+1][lmax+1] = msymCalloc(esl,sizeof(*srsbfmap));   // offset of (n,l) functions of each ES in srsbf
+    int (*srsbfl)[nmax+1][lmax+1] = msymCalloc(esl,sizeof(*srsbfl));       // number of (n,l) functions of each ES
     
-    rsh_representations_t *lts = calloc(lmax+1,sizeof(*lts)); // transformation matrices for rsh basis functions
+    rsh_representations_t *lts = msymCalloc(lmax+1,sizeof(*lts)); // transformation matrices for rsh basis functions
     
-    int (*les)[lmax+1] = calloc(esl, sizeof(*les));                      // number of l-type basis functions in each ES
+    int (*les)[lmax+1] = msymCalloc(esl, sizeof(*les));                      // number of l-type basis functions in each ES
     
     msym_basis_function_t dbf = {.type = ftype};
     double (*ctable)[ct->d] = ct->table;
+    double (*dp)[ct->d][ct->d] = NULL;
     
-    msym_subrepresentation_space_t *srs = calloc(ct->d, sizeof(*srs));
+    msym_subrepresentation_space_t *srs = *osrs;
+    msym_basis_function_t **salcbf = NULL;
+    
+    msym_salc_block_t *blocks = NULL;
+    int blocksl = 0;
     
     /* determine number of l-type basis functions in each ES */
     for(int o = 0;o < basisl;o++){
@@ -981,6 +1861,7 @@ msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, co
     }
     
     if(MSYM_SUCCESS != (ret = generateBasisRepresentations(pg->order+1, pg->order, pg->sops, lmax, lts))) goto err;
+    if(MSYM_SUCCESS != (ret = getDirectProducts(ct, (double **) &dp))) goto err;
     
     
     for(int k = 0; k < ct->d;k++){
@@ -990,54 +1871,7 @@ msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, co
         }
     }
     
-    for(int o = 0;o < basisl;o++){
-        msym_basis_function_t *bf = &basis[o];
-        int ei = (int)(bf->element - elements), esi = 0;
-        msym_equivalence_set_t *e = esmap[ei];
-        for(esi = 0;esi < e->length && e->elements[esi] != bf->element;esi++){}; //could improve perf with a map here
-        if(esi >= e->length){
-            ret = MSYM_INVALID_BASIS_FUNCTIONS;
-            msymSetErrorDetails("Basis function does not map to any equivalence set");
-            goto err;
-        }
-        if(bf->f.rsh.n > esnmax[e - es]) esnmax[e - es] = bf->f.rsh.n;
-        esbfmap[e - es][esi][bf->f.rsh.n][bf->f.rsh.l][bf->f.rsh.m+bf->f.rsh.l] = bf;
-    }
-    
-    int srsbfi = 0;
-    
-    for(int i = 0;i < esl;i++){
-        for(int n = 0;n <= nmax;n++){
-            for(int l = 0;l <= lmax;l++){
-                srsbfmap[i][n][l] = srsbfi;
-                for(int e = 0;e < es[i].length;e++){
-                    msym_basis_function_t *lbf = esbfmap[i][e][n][l][0];
-                    for(int m = -l;m <= l;m++){
-                        msym_basis_function_t *bf = esbfmap[i][e][n][l][m+l];
-                        if((NULL == bf && NULL != lbf) || (NULL == lbf && NULL != bf)) {
-                            lbf = NULL == lbf ? bf : lbf;
-                            ret = MSYM_INVALID_BASIS_FUNCTIONS;
-                            msymSetErrorDetails("Found basis function %s but function where m = %d is missing on element %d of equivalence set %d",lbf->name,m,e,i);
-                            goto err;
-                        }
-                        if(NULL != bf){
-                            lbf = bf;
-                            srsbf[srsbfi] = bf;
-                            srsbfi++;
-                        }
-                    }
-                }
-                //when this is moved to a separate function it can be used and availability check (replace esbfmap)
-                //if(srsbfmap[i][n][l] == srsbfi) srsbfmap[i][n][l] = -1;
-            }
-        }
-    }
-    
-    if(srsbfi != basisl){
-        ret = MSYM_SUBSPACE_ERROR;
-        msymSetErrorDetails("Unexpected number of basis functions in subrepresentation map (expected %d, got %d)",basisl, srsbfi);
-        goto err;
-    }
+    if(MSYM_SUCCESS != (ret = mapSubrepresentationBasisFunctions(esl, es, basisl, basis, elements, esmap, esimap, lmax, nmax, esnmax, srsbfl, srsbfmap, srsbf))) goto err;
     
     /* calculate span of irreducible representations for basis functions and permutations */
     for(int s = 0; s < pg->order;s++){
@@ -1120,27 +1954,19 @@ msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, co
             memset(dspan, 0, sizeof(double[ct->d]));
             for(int k = 0;k < ct->d;k++){
                 for(int j = 0;j < ct->d && round(pspan[i][k]) > 0;j++){
-                    directProduct(ct->d, ctable[k], ctable[j], mspan);
-                    vlscale(pspan[i][k]*bspan[l][j], ct->d, mspan, mspan);
+                    vlscale(pspan[i][k]*bspan[l][j], ct->d, dp[k][j], mspan);
                     vladd(ct->d, mspan, dspan, dspan);
                 }
             }
             
-            decomposeRepresentation(ct, dspan, mspan);
             for(int k = 0;k < ct->d;k++){
-                iespan[i][l][k] = (int)round(mspan[k]/ct->s[k].r);
+                iespan[i][l][k] = (int)round(dspan[k]/ct->s[k].r);
                 ispan[k] += les[i][l]*iespan[i][l][k];
             }
         }
         for(int k = 0;k < ct->d;k++) ipspan[i][k] = (int)round(pspan[i][k]);
     }
 
-    for(int k = 0;k < ct->d;k++){
-        srs[k].s = k;
-        srs[k].salcl = ispan[k];
-        srs[k].salc = calloc(srs[k].salcl, sizeof(msym_salc_t));
-    }
-    
     clean_debug_printf("decomposed %d\n", ct->d);
     for(int prk = 0;prk < ct->d;prk++){
         if(prk < ct->d - 1) clean_debug_printf("%d%s + ", ispan[prk], ct->s[prk].name);
@@ -1159,187 +1985,202 @@ msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, co
         goto err;
     }
     
+    if(NULL == srs){
+        if(NULL == (srs = msymCalloc(ct->d, sizeof(*srs)))){
+            ret = MSYM_MEMORY_ERROR;
+            msymSetErrorDetails("Could not allocate memory for subrepresentation spaces");
+            goto err;
+        }
+        for(int k = 0;k < ct->d;k++) srs[k].s = k;
+        salcbf = srsbf;
+    } else if(*osrsl != ct->d || 0 != memcmp(*ospan, ispan, ct->d*sizeof(*ispan)) || 0 != memcmp(*osrsbf, srsbf, basisl*sizeof(*srsbf))){
+        ret = MSYM_SUBSPACE_ERROR;
+        msymSetErrorDetails("Subrepresentation spaces are inconsistent with basis functions");
+        goto err;
+    } else {
+        salcbf = *osrsbf;
+    }
+    
+    for(int k = 0;k < ct->d;k++){
+        if((species >= 0 && species != k) || NULL != srs[k].salc || ispan[k] == 0) continue;
+        if(NULL == (srs[k].salc = msymCalloc(ispan[k], sizeof(msym_salc_t)))){
+            ret = MSYM_MEMORY_ERROR;
+            msymSetErrorDetails("Could not allocate memory for %d SALCs",ispan[k]);
+            goto err;
+        }
+        generate[k] = 1;
+    }
     
+    /* only blocks with SALCs in the requested irreducible representations need to be generated */
     for(int i = 0;i < esl;i++){
         for(int l = 0;l <= lmax;l++){
-
-            if(les[i][l] == 0) continue;
-            
-            
-            int ld = lts[l].d, esd = es[i].length, dim = esd*ld, li = 0;
-            double (*lrsops)[ld][ld] = lts[l].t;
-            double (*(*ssp)[5])[dim] = sspmem;
-            double (*ss)[dim] = ssmem;
-            double (**pssp)[esd] = psspmem;
-            double (*pss)[esd] = pssmem;
-            double (*split)[dim] = splitmem;
-            msym_symmetry_operation_t *splitop = NULL;
-            
-            clean_debug_printf("e decomposed %d\n", ct->d);
-            for(int prk = 0;prk < ct->d;prk++){
-                if(prk < ct->d - 1) clean_debug_printf("%d%s + ", iespan[i][l][prk], ct->s[prk].name);
-                else clean_debug_printf("%d%s\n", iespan[i][l][prk], ct->s[prk].name);
+            int g = 0;
+            for(int k = 0;k < ct->d && les[i][l] != 0;k++) g |= generate[k] && iespan[i][l][k] > 0;
+            if(g) blocksl++;
+        }
+    }
+    
+    /* blocks are divided between the workers, if there are fewer blocks than threads the remaining threads
+     * are used for the irreducible representations within each block */
+    blocks = msymCalloc(blocksl, sizeof(*blocks));
+    
+    if(NULL == blocks){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for %d SALC blocks",blocksl);
+        goto err;
+    }
+    
+    for(int i = 0, b = 0;i < esl;i++){
+        for(int l = 0;l <= lmax;l++){
+            int g = 0;
+            for(int k = 0;k < ct->d && les[i][l] != 0;k++) g |= generate[k] && iespan[i][l][k] > 0;
+            if(!g) continue;
+            blocks[b].i = i;
+            blocks[b].l = l;
+            blocks[b].salcl = msymCalloc(ct->d, sizeof(*blocks[b].salcl));
+            blocks[b].salc = msymCalloc(ct->d, sizeof(*blocks[b].salc));
+            if(NULL == blocks[b].salcl || NULL == blocks[b].salc){
+                ret = MSYM_MEMORY_ERROR;
+                msymSetErrorDetails("Could not allocate memory for SALC block");
+                goto err;
             }
-            
-            decomposeSubRepresentation(pg, rsg, sgc, iespan[i][l], sgd);
-            if(MSYM_SUCCESS != (ret = generateSplittingOperation(pg, perm[i], ld, lrsops, sgl, sg, rsg, split, &splitop))) goto err;
-            if(MSYM_SUCCESS != (ret = generateSubspaces(pg, perm[i], ld, lrsops, iespan[i][l], sgc, sgd, thresholds, cmem, pmem, ssp, ss))) goto err;
-            // Must be done after generateSubspaces since memory overlaps with pss for icosahedral groups
-            if(MSYM_SUCCESS != (ret = generatePermutationSubspaces(pg, perm[i], ipspan[i], thresholds, pmem, pssp, pss))) goto err;
-            
-            for(int pk = 0;pk < ct->d;pk++){
-                int pvspan = ipspan[i][pk]*ct->s[pk].d;
-                if(pvspan == 0) continue;
-                for(int lk = 0;lk < ct->d;lk++){
-                    int lvspan = ibspan[l][lk]*ct->s[lk].d, vspan = pvspan*lvspan;
-                    if(lvspan == 0) continue;
-                    
-                    double (*dss)[dim] = dssmem;
-                    
-                    kron2(pvspan, esd, pssp[pk], lvspan, ld, lssp[l][lk], dss);
-                    
-                    directProduct(ct->d, ctable[pk], ctable[lk], rspan);
-                    vlscale(pspan[i][pk]*bspan[l][lk], ct->d, rspan, rspan);
-                    decomposeRepresentation(ct, rspan, mspan);
-        
-                    for(int dk = 0; dk < ct->d; dk++){
-                        int sspan =  (int) round(mspan[dk]/ct->s[dk].r);
-                        if(sspan == 0) continue;
-                        
-                        double (*sdss)[dim] = sdssmem;
-                        
-                        int sd = ct->s[dk].d;
-                        
-                        int sdvi[5] = {-1,-1,-1,-1,-1};
-                        
-                        for(int d = 0, oirl = 0, nirl = 0; d < sd;d++, oirl = nirl){
-                            if(MSYM_SUCCESS != (ret = projectLinearlyIndependent(dim, vspan, dss, iespan[i][l][dk], ssp[dk][d], thresholds, cmem, pmem[0], sdss, &nirl))) goto err;
-                            
-                            int sdvl = nirl - oirl;
-                            sdvi[d] = oirl;
-                            
-                            if(sdvl != sspan){
-                                debug_printTransform(vspan, dim, dss);
-                                ret = MSYM_SUBSPACE_ERROR;
-                                msymSetErrorDetails("Linear projection subspace of dimension (%d) inconsistent with span (%d) in %s component %d",sdvl,sspan,ct->s[dk].name,d);
-                                goto err;
-                            }
-                            
-                            
-                        }
-                        
-                        double (*pf)[dim] = pfmem;
-                        
-                        if(MSYM_SUCCESS != (ret = determinePartnerFunctions(pg, ct->s[dk].r, perm[i], ld, lrsops, dim, sd, sspan, sdss, sdvi, split, splitop, pmem[0], &li, pf))) goto err;
-                        
-                        for(int si = 0, pfi = 0; si < sspan;si++){
-                            for(int n = l+1; n <= esnmax[i];n++){
-                                if(esbfmap[i][0][n][l][0] == NULL) continue;
-                                if(isalc[dk] >= ispan[dk]){
-                                    ret = MSYM_SUBSPACE_ERROR;
-                                    msymSetErrorDetails("Exceeded calculated number of SALCs %d >= %d",isalc[dk],ispan[dk]);
-                                    goto err;
-                                }
-
-                                msym_salc_t *salc = &srs[dk].salc[isalc[dk]];
-                                salc->d = sd;
-                                // Add basis function and permutation irrep here
-                                double (*salcpf)[dim] = calloc(salc->d,sizeof(*salcpf));
-                                memcpy(salcpf, pf[pfi], sd*sizeof(*salcpf));
-                                
-                                salc->pf = (double*) salcpf;
-                                salc->fl = dim;
-                                salc->f = &srsbf[srsbfmap[i][n][l]];
-                                
-                                isalc[dk]++;
-                            }
-                            
-                            pfi += sd;
-                        }
-                    }
-                }
+            b++;
+        }
+    }
+    
+    /* memory shared by all blocks, measured from the allocations */
+    parallelMeterAdd(meter, 2*sizeof(*pmem) + esl*(sizeof(*srsbfl) + sizeof(*srsbfmap) + sizeof(*iespan)) + basisl*sizeof(*srsbf) + blocksl*(sizeof(*blocks) + ct->d*(sizeof(int) + sizeof(msym_salc_t *))));
+    for(int l = 0;l <= lmax;l++) parallelMeterAdd(meter, sizeof(double[pg->order + 1][lts[l].d][lts[l].d]));
+    for(int k = 0;k < ct->d;k++) parallelMeterAdd(meter, generate[k]*ispan[k]*sizeof(msym_salc_t));
+    
+    msym_salc_task_t task = {
+        .pg = pg, .sgl = sgl, .sg = sg, .rsg = rsg, .es = es, .perm = perm, .thresholds = thresholds,
+        .threads = inner, .precision = precision, .generate = generate, .lmax = lmax, .nmax = nmax, .esnmax = esnmax, .lts = lts, .srsbf = salcbf,
+        .srsbfmap = srsbfmap, .srsbfl = srsbfl, .lssp = lssp, .iespan = iespan, .ipspan = ipspan, .ibspan = ibspan,
+        .pspan = pspan, .bspan = bspan, .dp = dp, .sgc = sgc, .blocks = blocks, .meter = meter
+    };
+    
+    if(MSYM_SUCCESS != (ret = parallelFor(workers, blocksl, generateSALCBlockTask, &task))) goto err;
+    
+    for(int b = 0;b < blocksl;b++){
+        for(int k = 0;k < ct->d;k++){
+            int bsalcl = blocks[b].salcl[k];
+            if(bsalcl == 0) continue;
+            if(isalc[k] + bsalcl > ispan[k]){
+                ret = MSYM_SUBSPACE_ERROR;
+                msymSetErrorDetails("Exceeded calculated number of SALCs %d >= %d",isalc[k] + bsalcl,ispan[k]);
+                goto err;
             }
+            memcpy(&srs[k].salc[isalc[k]], blocks[b].salc[k], bsalcl*sizeof(msym_salc_t));
+            isalc[k] += bsalcl;
+            srs[k].salcl = isalc[k];
+            blocks[b].salcl[k] = 0;
+        }
+    }
+    
+    for(int k = 0;k < ct->d;k++){
+        if(generate[k] && isalc[k] != ispan[k]){
+            ret = MSYM_SUBSPACE_ERROR;
+            msymSetErrorDetails("Unexpected number of SALCs in %s (expected %d, got %d)",ct->s[k].name,ispan[k],isalc[k]);
+            goto err;
         }
     }
     
     debug_printSubspace(ct,ct->d,srs);
-    *ospan = ispan;
-    *osrsl = ct->d;
-    *osrs = srs;
-    *osrsbf = srsbf;
+    
+    *opredicted = predicted;
+    *opeak = parallelMeterPeak(meter);
+    
+    if(NULL == *osrs){
+        *ospan = ispan;
+        *osrsl = ct->d;
+        *osrs = srs;
+        *osrsbf = srsbf;
+    } else {
+        msymFree(ispan);
+        msymFree(srsbf);
+    }
     
 
-    free(pmem);
-    free(bspan);
-    free(pspan);
-    free(rspan);
-    free(dspan);
-    free(mspan);
-    free(cmem);
-    free(iespan);
-    free(ipspan);
-    free(ibspan);
-    free(sspmem);
-    free(psspmem);
-    free(lssp);
-    free(rsg);
-    free(sgc);
-    free(sgd);
-    free(isalc);
-    free(esnmax);
-    free(esbfmap);
+    for(int b = 0;b < blocksl && NULL != blocks;b++){
+        freeSALCBlock(ct->d, &blocks[b]);
+    }
+    msymFree(blocks);
+    msymFree(pmem);
+    parallelMeterDestroy(meter);
+    msymFree(bspan);
+    msymFree(pspan);
+    msymFree(dspan);
+    msymFree(mspan);
+    msymFree(iespan);
+    msymFree(ipspan);
+    msymFree(ibspan);
+    msymFree(lssp);
+    msymFree(rsg);
+    msymFree(sgc);
+    msymFree(sgd);
+    msymFree(isalc);
+    msymFree(generate);
+    msymFree(esnmax);
+    msymFree(srsbfl);
     for(int l = 0;l <= lmax;l++){
-        free(lts[l].t);
+        msymFree(lts[l].t);
     }
-    free(lts);
-    free(les);
-    free(srsbfmap);
+    msymFree(lts);
+    msymFree(les);
+    msymFree(srsbfmap);
     
     return ret;
     
 err:
     
-    free(pmem);
-    free(bspan);
-    free(pspan);
-    free(rspan);
-    free(dspan);
-    free(mspan);
-    free(cmem);
-    free(iespan);
-    free(ipspan);
-    free(ibspan);
-    free(sspmem);
-    free(psspmem);
-    free(lssp);
-    free(rsg);
-    free(sgc);
-    free(sgd);
-    free(ispan);
-    free(isalc);
-    free(esnmax);
-    free(esbfmap);
+    for(int b = 0;b < blocksl && NULL != blocks;b++){
+        freeSALCBlock(ct->d, &blocks[b]);
+    }
+    msymFree(blocks);
+    msymFree(pmem);
+    parallelMeterDestroy(meter);
+    msymFree(bspan);
+    msymFree(pspan);
+    msymFree(dspan);
+    msymFree(mspan);
+    msymFree(iespan);
+    msymFree(ipspan);
+    msymFree(ibspan);
+    msymFree(lssp);
+    msymFree(rsg);
+    msymFree(sgc);
+    msymFree(sgd);
+    msymFree(ispan);
+    msymFree(isalc);
+    msymFree(esnmax);
+    msymFree(srsbfl);
     for(int l = 0;l <= lmax;l++){
-        free(lts[l].t);
+        msymFree(lts[l].t);
     }
-    free(lts);
-    free(les);
-    free(srsbfmap);
-    for(int k = 0;k < ct->d;k++){
+    msymFree(lts);
+    msymFree(les);
+    msymFree(srsbfmap);
+    for(int k = 0;k < ct->d && NULL != srs;k++){
+        if(!generate[k]) continue;
         for(int i = 0;i < srs[k].salcl;i++){
-            free(srs[k].salc[i].pf);
+            msymFree(srs[k].salc[i].pf);
         }
-        free(srs[k].salc);
+        msymFree(srs[k].salc);
+        srs[k].salc = NULL;
+        srs[k].salcl = 0;
     }
-    free(srs);
-    free(srsbf);
+    msymFree(generate);
+    if(srs != *osrs) msymFree(srs);
+    msymFree(srsbf);
     
     return ret;
 }
 
 
 
-msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int sgl, const msym_subgroup_t sg[sgl], int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, msym_thresholds_t *thresholds, int *osrsl, msym_subrepresentation_space_t **osrs, msym_basis_function_t ***osrsbf, int **ospan){
+/* Uses memory proportional to the order of the point group rather than to the largest equivalence set */
+msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int sgl, const msym_subgroup_t sg[sgl], int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int *esimap, msym_thresholds_t *thresholds, size_t *opeak, int *osrsl, msym_subrepresentation_space_t **osrs, msym_basis_function_t ***osrsbf, int **ospan){
     msym_error_t ret = MSYM_SUCCESS;
     msym_character_table_t *ct = pg->ct;
     int lmax = -1, nmax = 0;
@@ -1363,49 +2204,47 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
     
     int projm = (2*lmax+1)*pg->order;
     
-    double (*bspan)[ct->d] = calloc(lmax+1, sizeof(*bspan));        // span of individual basis functions
-    double (*pspan)[ct->d] = calloc(esl, sizeof(*pspan));               // span of permutation operators
+    double (*bspan)[ct->d] = msymCalloc(lmax+1, sizeof(*bspan));        // span of individual basis functions
+    double (*pspan)[ct->d] = msymCalloc(esl, sizeof(*pspan));               // span of permutation operators
     
-    double (*lspan)[ct->d] = calloc(esl, sizeof(*lspan));           // total span of basis function on each ES
-    double *rspan = calloc(ct->d, sizeof(*rspan));                  // total direct product symmetrized basis
-    double *dspan = calloc(ct->d, sizeof(*dspan));                  // decoposed total span of symmetrized basis (double)
+    double (*lspan)[ct->d] = msymCalloc(esl, sizeof(*lspan));           // total span of basis function on each ES
+    double *dspan = msymCalloc(ct->d, sizeof(*dspan));                  // decoposed total span of symmetrized basis (double)
     
-    double *mspan = calloc(ct->d, sizeof(double));                  // span decomposition memory
-    double (*mproj)[projm] = calloc(projm, sizeof(*mproj));         // projection operator memory
-    double (*mscal)[projm] = calloc(projm, sizeof(*mscal));         // projection scaling memory
-    double (*mpih)[projm] = calloc(projm, sizeof(*mpih));           // icosahedral projection memory
-    double (*mperm)[pg->order] = calloc(pg->order, sizeof(*mperm)); // permutation memory
-    double (*morth)[pg->order] = calloc(pg->order, sizeof(*morth)); // permutation orthoginalization memory
-    double (*mbasis)[projm] = calloc(basisl, sizeof(*mbasis));      // basis function coefficients
-    double (*mdec)[projm] = calloc(basisl, sizeof(*mdec));          // directo product decomposition memory
-    double (*sgc)[5][pg->order] = calloc(ct->d,sizeof(*sgc));
+    double *mspan = msymCalloc(ct->d, sizeof(double));                  // span decomposition memory
+    double (*mproj)[projm] = msymCalloc(projm, sizeof(*mproj));         // projection operator memory
+    double (*mscal)[projm] = msymCalloc(projm, sizeof(*mscal));         // projection scaling memory
+    double (*mpih)[projm] = msymCalloc(projm, sizeof(*mpih));           // icosahedral projection memory
+    double (*mperm)[pg->order] = msymCalloc(pg->order, sizeof(*mperm)); // permutation memory
+    double (*morth)[pg->order] = msymCalloc(pg->order, sizeof(*morth)); // permutation orthoginalization memory
+    double (*mbasis)[projm] = msymCalloc(basisl, sizeof(*mbasis));      // basis function coefficients
+    double (*mdec)[projm] = msymCalloc(basisl, sizeof(*mdec));          // directo product decomposition memory
+    double (*sgc)[5][pg->order] = msymCalloc(ct->d,sizeof(*sgc));
     
-    const msym_subgroup_t **rsg = calloc(ct->d, sizeof(*rsg));
+    const msym_subgroup_t **rsg = msymCalloc(ct->d, sizeof(*rsg));
     
     double *mdcomp = NULL;
     double *mdproj = NULL;
     int *mdfound = NULL;
     
-    int (*sgd)[5] = calloc(ct->d,sizeof(*sgd));
-    int *ispan = calloc(ct->d, sizeof(int));                               // decoposed total span of symmetrized basis (int)
-    int *isalc = calloc(ct->d, sizeof(int));                               // number of added salcs to irrep
-    int *esnmax = calloc(esl, sizeof(int));                                     // max n in eqset
-    
-    msym_basis_function_t *(*esbfmap)[pg->order][nmax+1][lmax+1][2*lmax+1] = calloc(esl,sizeof(*esbfmap));
+    int (*sgd)[5] = msymCalloc(ct->d,sizeof(*sgd));
+    int *ispan = msymCalloc(ct->d, sizeof(int));                               // decoposed total span of symmetrized basis (int)
+    int *isalc = msymCalloc(ct->d, sizeof(int));                               // number of added salcs to irrep
+    int *esnmax = msymCalloc(esl, sizeof(int));                                     // max n in eqset
     
+    msym_basis_function_t *(*srsbf) = msymCalloc(basisl, sizeof(*srsbf));
     
-    msym_basis_function_t *(*srsbf) = calloc(basisl, sizeof(*srsbf));
+    int (*srsbfmap)[nmax+1][lmax+1] = msymCalloc(esl,sizeof(*srsbfmap));   // offset of (n,l) functions of each ES in srsbf
+    int (*srsbfl)[nmax+1][lmax+1] = msymCalloc(esl,sizeof(*srsbfl));       // number of (n,l) functions of each ES
     
-    int (*srsbfmap)[nmax+1][lmax+1] = calloc(esl,sizeof(*srsbfmap));
+    rsh_representations_t *lts = msymCalloc(lmax+1,sizeof(*lts)); // transformation matrices for rsh basis functions
     
-    rsh_representations_t *lts = calloc(lmax+1,sizeof(*lts)); // transformation matrices for rsh basis functions
-    
-    int (*les)[lmax+1] = calloc(esl, sizeof(*les));                      // number of l-type basis functions in each ES
+    int (*les)[lmax+1] = msymCalloc(esl, sizeof(*les));                      // number of l-type basis functions in each ES
     
     msym_basis_function_t dbf = {.type = ftype};
     double (*ctable)[ct->d] = ct->table;
+    double (*dp)[ct->d][ct->d] = NULL;
     
-    msym_subrepresentation_space_t *srs = calloc(ct->d, sizeof(*srs));
+    msym_subrepresentation_space_t *srs = msymCalloc(ct->d, sizeof(*srs));
     
     /* determine number of l-type basis functions in each ES */
     for(int o = 0;o < basisl;o++){
@@ -1413,6 +2252,7 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
     }
     
     if(MSYM_SUCCESS != (ret = generateBasisRepresentations(pg->order+1, pg->order, pg->sops, lmax, lts))) goto err;
+    if(MSYM_SUCCESS != (ret = getDirectProducts(ct, (double **) &dp))) goto err;
     
     
     for(int k = 0; k < ct->d;k++){
@@ -1423,54 +2263,7 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
     }
     
     
-    for(int o = 0;o < basisl;o++){
-        msym_basis_function_t *bf = &basis[o];
-        int ei = (int)(bf->element - elements), esi = 0;
-        msym_equivalence_set_t *e = esmap[ei];
-        for(esi = 0;esi < e->length && e->elements[esi] != bf->element;esi++){}; //could improve perf with a map here
-        if(esi >= e->length){
-            ret = MSYM_INVALID_BASIS_FUNCTIONS;
-            msymSetErrorDetails("Basis function does not map to any equivalence set");
-            goto err;
-        }
-        if(bf->f.rsh.n > esnmax[e - es]) esnmax[e - es] = bf->f.rsh.n;
-        esbfmap[e - es][esi][bf->f.rsh.n][bf->f.rsh.l][bf->f.rsh.m+bf->f.rsh.l] = bf;
-    }
-    
-    int srsbfi = 0;
-    
-    for(int i = 0;i < esl;i++){
-        for(int n = 0;n <= nmax;n++){
-            for(int l = 0;l <= lmax;l++){
-                srsbfmap[i][n][l] = srsbfi;
-                for(int e = 0;e < es[i].length;e++){
-                    msym_basis_function_t *lbf = esbfmap[i][e][n][l][0];
-                    for(int m = -l;m <= l;m++){
-                        msym_basis_function_t *bf = esbfmap[i][e][n][l][m+l];
-                        if((NULL == bf && NULL != lbf) || (NULL == lbf && NULL != bf)) {
-                            lbf = NULL == lbf ? bf : lbf;
-                            ret = MSYM_INVALID_BASIS_FUNCTIONS;
-                            msymSetErrorDetails("Found basis function %s but function where m = %d is missing on element %d of equivalence set %d",lbf->name,m,e,i);
-                            goto err;
-                        }
-                        if(NULL != bf){
-                            lbf = bf;
-                            srsbf[srsbfi] = bf;
-                            srsbfi++;
-                        }
-                    }
-                }
-                //when this is moved to a separate function it can be used and availability check (replace esbfmap)
-                //if(srsbfmap[i][n][l] == srsbfi) srsbfmap[i][n][l] = -1;
-            }
-        }
-    }
-    
-    if(srsbfi != basisl){
-        ret = MSYM_SUBSPACE_ERROR;
-        msymSetErrorDetails("Unexpected number of basis functions in subrepresentation map (expected %d, got %d)",basisl, srsbfi);
-        goto err;
-    }
+    if(MSYM_SUCCESS != (ret = mapSubrepresentationBasisFunctions(esl, es, basisl, basis, elements, esmap, esimap, lmax, nmax, esnmax, srsbfl, srsbfmap, srsbf))) goto err;
     
     /* calculate span of irreducible representations for basis functions and permutations */
     for(int s = 0; s < pg->order;s++){
@@ -1547,32 +2340,32 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
         }
     }
     
-    /* calculate direct product of irreducible representations spanned by basis functions and permutations on each ES (don't really need to do this) */
+    /* decomposed direct product of irreducible representations spanned by basis functions and permutations on each ES (don't really need to do this) */
     for(int i = 0;i < esl;i++){
         for(int k = 0;k < ct->d;k++){
             for(int j = 0;j < ct->d && round(pspan[i][k]) > 0;j++){
                 if(round(lspan[i][j]) == 0) continue;
-                directProduct(ct->d, ctable[k], ctable[j], mspan);
-                vlscale(pspan[i][k]*lspan[i][j], ct->d, mspan, mspan);
-                vladd(ct->d, mspan, rspan, rspan);
+                vlscale(pspan[i][k]*lspan[i][j], ct->d, dp[k][j], mspan);
+                vladd(ct->d, mspan, dspan, dspan);
             }
         }
     }
     
-    /* decompose direct product into irreducible representations */
-    decomposeRepresentation(ct, rspan, dspan);
     int ddim_max = 0;
     for(int k = 0;k < ct->d;k++){
         ispan[k] = (int)round(dspan[k]/ct->s[k].r);
         ddim_max = ddim_max > ispan[k] ? ddim_max : ispan[k];
         srs[k].s = k;
         srs[k].salcl = ispan[k];
-        srs[k].salc = calloc(srs[k].salcl, sizeof(msym_salc_t));
+        srs[k].salc = msymCalloc(srs[k].salcl, sizeof(msym_salc_t));
     }
     
-    mdcomp = malloc(sizeof(double[5][ddim_max][ddim_max]));
-    mdproj = malloc(sizeof(double[projm][projm]));
-    mdfound = malloc(sizeof(int[5][ddim_max]));
+    // multiplicity of a degenerate irrep in one equivalence set and angular momentum
+    if(ddim_max > (projm+1)/2) ddim_max = (projm+1)/2;
+    
+    mdcomp = msymMalloc(sizeof(double[5][ddim_max][ddim_max]));
+    mdproj = msymMalloc(sizeof(double[projm][projm]));
+    mdfound = msymMalloc(sizeof(int[5][ddim_max]));
     
     
     clean_debug_printf("decomposed %d\n", ct->d);
@@ -1631,9 +2424,7 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
                     kron2(vspan, d, &porth[oirl], lvspan, ld, &lst[pg->order][li], mbasis);
                     li += lvspan;
                     
-                    directProduct(ct->d, ctable[k], ctable[lk], rspan);
-                    vlscale(pspan[i][k]*bspan[l][lk], ct->d, rspan, rspan);
-                    decomposeRepresentation(ct, rspan, mspan);
+                    vlscale(pspan[i][k]*bspan[l][lk], ct->d, dp[k][lk], mspan);
                     
                     for(int dk = 0; dk < ct->d; dk++) mspan[dk] /= ct->s[dk].r;
                     
@@ -1770,7 +2561,7 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
                         }
                         for(int ir = 0;ir < svspan;ir += ct->s[sk].d){
                             for(int n = l+1; n <= esnmax[i];n++){
-                                if(esbfmap[i][0][n][l][0] == NULL) continue;
+                                if(srsbfl[i][n][l] == 0) continue;
                                 if(isalc[sk] >= ispan[sk]){
                                     ret = MSYM_SUBSPACE_ERROR;
                                     msymSetErrorDetails("Exceeded calculated number of SALCs %d >= %d",isalc[sk],ispan[sk]);
@@ -1780,7 +2571,7 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
                                 msym_salc_t *salc = &srs[sk].salc[isalc[sk]];
                                 salc->d = ct->s[sk].d;
                                 
-                                double (*pf)[dd] = calloc(salc->d,sizeof(double[dd]));
+                                double (*pf)[dd] = msymCalloc(salc->d,sizeof(double[dd]));
                                 
                                 for(int dim = 0; dim < salc->d;dim++){
                                     vlnorm2(dd, sbasis[si+dim+ir], pf[dim]);
@@ -1800,81 +2591,85 @@ msym_error_t generateSubrepresentationSpacesLowMem(msym_point_group_t *pg, int s
     }
     
     debug_printSubspace(ct,ct->d,srs);
+    
+    *opeak = sizeof(double)*(4*((size_t) projm)*projm + 2*((size_t) pg->order)*pg->order + 2*((size_t) basisl)*projm + 5*((size_t) ddim_max)*ddim_max) + sizeof(int[5])*ddim_max + esl*(sizeof(*srsbfl) + sizeof(*srsbfmap)) + basisl*(sizeof(*srsbf) + sizeof(msym_salc_t));
+    for(int l = 0;l <= lmax;l++) *opeak += sizeof(double[pg->order + 1][lts[l].d][lts[l].d]);
+    for(int k = 0;k < ct->d;k++){
+        for(int i = 0;i < srs[k].salcl;i++) *opeak += sizeof(double[srs[k].salc[i].d][srs[k].salc[i].fl]);
+    }
+    
     *ospan = ispan;
     *osrsl = ct->d;
     *osrs = srs;
     *osrsbf = srsbf;
     
-    free(bspan);
-    free(pspan);
-    free(lspan);
-    free(rspan);
-    free(dspan);
-    free(mspan);
-    free(mproj);
-    free(mscal);
-    free(mpih);
-    free(mperm);
-    free(morth);
-    free(mbasis);
-    free(mdec);
-    free(rsg);
-    free(sgc);
-    free(sgd);
-    free(mpih);
-    free(mdcomp);
-    free(mdproj);
-    free(mdfound);
-    free(isalc);
-    free(esnmax);
-    free(esbfmap);
+    msymFree(bspan);
+    msymFree(pspan);
+    msymFree(lspan);
+    msymFree(dspan);
+    msymFree(mspan);
+    msymFree(mproj);
+    msymFree(mscal);
+    msymFree(mpih);
+    msymFree(mperm);
+    msymFree(morth);
+    msymFree(mbasis);
+    msymFree(mdec);
+    msymFree(rsg);
+    msymFree(sgc);
+    msymFree(sgd);
+    msymFree(mdcomp);
+    msymFree(mdproj);
+    msymFree(mdfound);
+    msymFree(isalc);
+    msymFree(esnmax);
+    msymFree(srsbfl);
     for(int l = 0;l <= lmax;l++){
-        free(lts[l].t);
+        msymFree(lts[l].t);
     }
-    free(lts);
-    free(les);
-    free(srsbfmap);
+    msymFree(lts);
+    msymFree(les);
+    msymFree(srsbfmap);
     
     return ret;
     
 err:
-    free(bspan);
-    free(pspan);
-    free(lspan);
-    free(rspan);
-    free(dspan);
-    free(mspan);
-    free(mproj);
-    free(mscal);
-    free(mperm);
-    free(morth);
-    free(mbasis);
-    free(mdec);
-    free(rsg);
-    free(sgc);
-    free(sgd);
-    free(mpih);
-    free(mdcomp);
-    free(mdproj);
-    free(mdfound);
-    free(ispan);
-    free(isalc);
-    free(esnmax);
-    free(esbfmap);
+    msymFree(bspan);
+    msymFree(pspan);
+    msymFree(lspan);
+    msymFree(dspan);
+    msymFree(mspan);
+    msymFree(mproj);
+    msymFree(mscal);
+    msymFree(mperm);
+    msymFree(morth);
+    msymFree(mbasis);
+    msymFree(mdec);
+    msymFree(rsg);
+    msymFree(sgc);
+    msymFree(sgd);
+    msymFree(mpih);
+    msymFree(mdcomp);
+    msymFree(mdproj);
+    msymFree(mdfound);
+    msymFree(ispan);
+    msymFree(isalc);
+    msymFree(esnmax);
+    msymFree(srsbfl);
     for(int l = 0;l <= lmax;l++){
-        free(lts[l].t);
+        msymFree(lts[l].t);
     }
-    free(lts);
-    free(les);
-    free(srsbfmap);
+    msymFree(lts);
+    msymFree(les);
+    msymFree(srsbfmap);
     for(int k = 0;k < ct->d;k++){
         for(int i = 0;i < srs[k].salcl;i++){
-            free(srs[k].salc[i].pf);
+            msymFree(srs[k].salc[i].pf);
         }
-        free(srs[k].salc);
+        msymFree(srs[k].salc);
     }
-    free(srs);
-    free(srsbf);
+    msymFree(srs);
+    msymFree(srsbf);
     
     return ret;
 }
@@ -1882,11 +2677,11 @@ err:
 void freeSubrepresentationSpaces(int srsl, msym_subrepresentation_space_t *srs){
     for(int i = 0;i < srsl && NULL != srs;i++){
         for(int j = 0;j < srs[i].salcl;j++){
-            free(srs[i].salc[j].pf);
+            msymFree(srs[i].salc[j].pf);
         }
-        free(srs[i].salc);
+        msymFree(srs[i].salc);
     }
-    free(srs);
+    msymFree(srs);
 }
 
 
@@ -15,10 +15,31 @@
 #include "msym.h"
 #include "character_table.h"
 #include "point_group.h"
+#include "permutation.h"
+#include "linalg.h"
+
+/* Projection operator on the basis functions of an equivalence set, stored as rows of ld x ld
+ * blocks (one block row per element), since each symmetry operation only maps an element to one
+ * other there are at most min(order, number of elements) nonzero blocks per row */
+typedef struct _msym_block_projection {
+    int pd;             // number of elements
+    int ld;             // basis functions per element
+    int *row;           // start of block row in col and b (pd + 1)
+    int *col;           // element index of block
+    double *b;          // blocks of ld x ld
+    int *iperm;         // inverse permutations, element mapped onto row element by each operation
+    int *slot;          // block index of each column in the current row
+} msym_block_projection_t;
 
 void freeSubrepresentationSpaces(int srsl, msym_subrepresentation_space_t *srs);
-msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, const msym_subgroup_t sg[sgl], int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, msym_thresholds_t *thresholds, int *osrsl, msym_subrepresentation_space_t **osrs, msym_basis_function_t ***osrsbf, int **ospan);
+msym_error_t generateSubrepresentationSpaces(msym_point_group_t *pg, int sgl, const msym_subgroup_t sg[sgl], int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, int basisl, msym_basis_function_t basis[basisl], msym_element_t *elements, msym_equivalence_set_t **esmap, int *esimap, msym_thresholds_t *thresholds, int threads, msym_precision_t precision, int species, size_t budget, size_t *opredicted, size_t *opeak, int *osrsl, msym_subrepresentation_space_t **osrs, msym_basis_function_t ***osrsbf, int **ospan);
 msym_error_t symmetrySpeciesComponents(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int basisl, msym_basis_function_t *basis, double *wf, double *s);
+msym_error_t generateProjectionOperator(int d, int sopsl, double c[sopsl], msym_permutation_t perm[sopsl], int ld, double (*lsops)[ld][ld], double proj[perm->p_length*ld][perm->p_length*ld]);
+msym_error_t allocateBlockProjectionOperator(int sopsl, msym_permutation_t perm[sopsl], int ld, msym_block_projection_t *bp);
+void freeBlockProjectionOperator(msym_block_projection_t *bp);
+msym_error_t generateBlockProjectionOperator(int d, int sopsl, double c[sopsl], int ld, double (*lsops)[ld][ld], msym_block_projection_t *bp);
+void applyBlockProjectionOperator(msym_block_projection_t *bp, int n, double v[n][bp->pd*bp->ld], double y[bp->pd*bp->ld]);
+int mgs2BlockProjection(msym_block_projection_t *bp, int lm, double o[bp->pd*bp->ld][bp->pd*bp->ld], int n, double t, double v[3*MGS_PANEL][bp->pd*bp->ld]);
 
 #endif /* defined(__MSYM__SUBSPACE_h) */
 
@@ -15,10 +15,47 @@
 
 #include "symmetrize.h"
 #include "linalg.h"
+#include "parallel.h"
 
+#include "allocator.h"
 #include "debug.h"
 
 #define SQR(x) ((x)*(x))
+#define PARTNER_PRUNE_MARGIN 1.0e-10
+
+typedef struct _msym_symmetrize_wavefunction_batch {
+    msym_point_group_t *pg;
+    int srsl;
+    msym_subrepresentation_space_t *srs;
+    int *span;
+    msym_salc_matrix_t m;
+    int wfl;
+    int basisl;
+    int stride;
+    void *c;
+    void *species;
+    void *pf;
+} msym_symmetrize_wavefunction_batch_t;
+
+typedef struct _msym_symmetrize_matrix {
+    msym_point_group_t *pg;
+    msym_subrepresentation_space_t *srs;
+    msym_salc_matrix_t m;
+    int basisl;
+    int average;
+    double *a;
+    double *t;          // SALC rows times the matrix, then the symmetrized blocks times the SALC rows
+    double *blocks;
+    size_t *blocko;     // offset of the block of each species in blocks
+    int *colp;          // SALC matrix transposed
+    int *rowi;
+    double *cval;
+    double *sa;
+} msym_symmetrize_matrix_t;
+
+msym_error_t symmetrizeWavefunctionBatchTask(void *data, int task, int worker);
+msym_error_t symmetrizeMatrixBlockTask(void *data, int task, int worker);
+msym_error_t symmetrizeMatrixRowTask(void *data, int task, int worker);
 
 /* This is a projection into the fully symmetric space.
  * A little more computation than if we just recreate it from one atom,
@@ -30,7 +67,7 @@
 msym_error_t symmetrizeElements(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, msym_thresholds_t *thresholds, double *err){
     msym_error_t ret = MSYM_SUCCESS;
     double e = 0.0;
-    double (*v)[3] = malloc(sizeof(double[pg->order][3]));
+    double (*v)[3] = msymMalloc(sizeof(double[pg->order][3]));
     for(int i = 0; i < esl;i++){
         if(es[i].length > pg->order){
             ret = MSYM_SYMMETRIZATION_ERROR;
@@ -58,71 +95,70 @@ msym_error_t symmetrizeElements(msym_point_group_t *pg, int esl, msym_equivalenc
     
     *err = sqrt(fmax(e,0.0)); //should never be < 0, but it's a dumb way to die
 err:
-    free(v);
+    msymFree(v);
     return ret;
 }
 
-msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int *span, int basisl, msym_basis_function_t basis[basisl], double wf[basisl][basisl], double symwf[basisl][basisl], int specieso[basisl], msym_partner_function_t pfo[basisl]){
+/* The SALCs are used as a sparse (CSR) matrix with one row per SALC component, and since every wave function is
+ * matched with partners and symmetrized within its own symmetry species only the components in that species
+ * are kept (block diagonal), rather than the components of every wave function in every SALC.
+ * Any number of wave functions (wfl) can be symmetrized as long as all partners of degenerate ones are included,
+ * the rows of wf and symwf are stride apart and only the first basisl elements are used */
+msym_error_t symmetrizeWavefunctionMatrix(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int *span, msym_salc_matrix_t *m, int wfl, int basisl, int stride, double wf[wfl][stride], double symwf[wfl][stride], int specieso[wfl], msym_partner_function_t pfo[wfl]){
     msym_error_t ret = MSYM_SUCCESS;
     
-    if(srsl != pg->ct->d){
+    if(srsl != pg->ct->d || m->rowsl != basisl){
         ret = MSYM_SYMMETRIZATION_ERROR;
-        msymSetErrorDetails("Unexpected subspace length (expected %d got %d)",pg->ct->d, srsl);
+        msymSetErrorDetails("Unexpected subspace length (expected %d got %d) or number of SALC components (expected %d got %d)",pg->ct->d, srsl, basisl, m->rowsl);
         return ret;
     }
     
-    int *ispan = calloc(pg->ct->d,sizeof(*ispan));
-    int *species = (NULL == specieso ? malloc(sizeof(int[basisl])) : specieso);
+    int *ispan = msymCalloc(pg->ct->d,sizeof(*ispan));
+    int *species = (NULL == specieso ? msymMalloc(sizeof(int[wfl])) : specieso);
     
     
-    memset(species,0,sizeof(int[basisl]));
-    if(NULL != pfo) memset(pfo,0,sizeof(msym_partner_function_t[basisl]));
+    memset(species,0,sizeof(int[wfl]));
+    if(NULL != pfo) memset(pfo,0,sizeof(msym_partner_function_t[wfl]));
     
     int md = 1;
     //could deduce from pg type but can't be bothered
     for(int k = 0;k < pg->ct->d;k++) md = (md > pg->ct->s[k].d ? md : pg->ct->s[k].d);
-    int (*pf)[md] = calloc(basisl+1,sizeof(*pf));
+    int (*pf)[md] = msymCalloc(wfl+1,sizeof(*pf));
     
-    int psalcl = 0;
+    int *psalck = m->psalck, *salcr = m->salcr, *rowp = m->rowp, *col = m->col;
+    double *val = m->val;
     
-    int *psalck = calloc(pg->ct->d, sizeof(*psalck));
+    size_t *wfc = msymCalloc(wfl+1, sizeof(*wfc));                   // offset of the components of each wave function in psalc
+    int *bucket = msymMalloc(sizeof(int[wfl]));                      // wave functions ordered by species
+    int *bucketk = msymCalloc(pg->ct->d+1, sizeof(*bucketk));          // first wave function of each species in bucket
+    struct _fpf {int i; int j;} *assigned = msymCalloc(wfl, sizeof(*assigned));  // first function that claimed each one as partner j
+    double *wfn = msymCalloc(wfl, sizeof(*wfn));                     // norm of the SALC component magnitudes
+    int *claimed = msymCalloc(wfl, sizeof(*claimed));                // number of functions that have each one as a partner
+    double *psalc = NULL;
+    double (*bfd)[md] = msymCalloc(wfl+1, sizeof(*bfd));
+    double *dmpf = bfd[wfl];
     
-    for(int i = 0;i < srsl;i++){
-        psalck[i] = psalcl;
-        psalcl += srs[i].salcl;
+    if(NULL == ispan || NULL == species || NULL == pf || NULL == wfc || NULL == bucket || NULL == bucketk || NULL == assigned || NULL == wfn || NULL == claimed || NULL == bfd){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for symmetrization of wave functions");
+        goto err;
     }
-    /* This is a bit of overkill since we only need the sign of the component
-     * We could just as well have used a basis change, but the sign in degenerate
-     * representations can't be used for partner function determination,
-     * and this is a sparce matrix
-     */
-    double (*psalc)[basisl][psalcl] = calloc(md+1,sizeof(*psalc));
-    double (*bfd)[md] = calloc(basisl+1, sizeof(*bfd));
-    double *dmpf = bfd[basisl];
     
     /* Determine salc components, and build information vectors (e.g. indexing/offsets/irreps) */
-    for(int o = 0;o < basisl;o++){
+    for(int o = 0;o < wfl;o++){
         double mcomp = -1.0;
-        int psalci = 0;
-        for(int k = 0;k < srsl;k++){
+        for(int k = 0, psalci = 0;k < srsl;k++){
             double mabs = 0.0;
-            for(int s = 0;s < srs[k].salcl;s++){
-                msym_salc_t *salc = &srs[k].salc[s];
-                double (*space)[salc->fl] = (double (*)[salc->fl]) salc->pf;
-                double psalcabs = 0.0;
-                for(int d = 0;d < salc->d;d++){
+            for(int s = 0;s < srs[k].salcl;s++, psalci++){
+                for(int d = 0, r = salcr[psalci];d < srs[k].salc[s].d;d++, r++){
                     double c = 0.0;
-                    for(int j = 0; j < salc->fl;j++){
-                        c += wf[o][salc->f[j] - basis]*space[d][j];
+                    for(int i = rowp[r]; i < rowp[r+1];i++){
+                        c += wf[o][col[i]]*val[i];
                     }
                     double c2 = SQR(c);
-                    psalc[d][o][psalci] = c; //Won't thrash the cache too bad since d is small
-                    psalcabs += c2;
+                    mabs += c2;
                     bfd[o][d] += c2;
                 }
-                mabs += psalcabs;
-                psalc[md][o][psalci] = sqrt(psalcabs);
-                psalci++;
             }
             if(mabs > mcomp){
                 species[o] = k;
@@ -130,58 +166,98 @@ msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subr
             }
         }
         ispan[species[o]]++;
+        wfc[o+1] = wfc[o] + (pg->ct->s[species[o]].d+1)*srs[species[o]].salcl;
     }
     
     for(int k = 0;k < pg->ct->d;k++){
-        if(ispan[k] != span[k]*pg->ct->s[k].d){
+        if(wfl == m->rowsl && ispan[k] != span[k]*pg->ct->s[k].d){
             msymSetErrorDetails("Projected orbitals do not span the expected irredicible representations. Expected %d%s, got %d",span[k],pg->ct->s[k].name,ispan[k]);
             ret = MSYM_SYMMETRIZATION_ERROR;
             goto err;
+        } else if(ispan[k] > span[k]*pg->ct->s[k].d){
+            msymSetErrorDetails("Projected orbitals span more than the expected irredicible representations. Expected at most %d%s, got %d",span[k],pg->ct->s[k].name,ispan[k]);
+            ret = MSYM_SYMMETRIZATION_ERROR;
+            goto err;
         }
     }
     
-    /* Find parner functions */
-    for(int o = 0;o < basisl;o++){
-        int ko = species[o], dim = pg->ct->s[ko].d;
-        
-        struct _fpf {int i; int j;} fpf = {.i = 0, .j = 0};
+    /* Components of each wave function in the SALCs of its species (dimension x salcs) followed by their magnitudes,
+     * they are calculated again rather than kept for all species */
+    if(NULL == (psalc = msymMalloc(sizeof(double[wfc[wfl]])))){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for symmetrization of wave functions");
+        goto err;
+    }
+    
+    for(int o = 0;o < wfl;o++){
+        int k = species[o], dim = pg->ct->s[k].d, salcl = srs[k].salcl;
+        double (*opsalc)[salcl] = (double (*)[salcl]) &psalc[wfc[o]];
+        for(int s = 0;s < salcl;s++){
+            double psalcabs = 0.0;
+            for(int d = 0, r = salcr[psalck[k] + s];d < dim;d++, r++){
+                double c = 0.0;
+                for(int i = rowp[r]; i < rowp[r+1];i++){
+                    c += wf[o][col[i]]*val[i];
+                }
+                opsalc[d][s] = c;
+                psalcabs += SQR(c);
+            }
+            opsalc[dim][s] = sqrt(psalcabs);
+            wfn[o] += psalcabs;
+        }
+        wfn[o] = sqrt(wfn[o]);
+    }
+    
+    for(int k = 0;k < pg->ct->d;k++) bucketk[k+1] = bucketk[k] + ispan[k];
+    for(int k = 0, b = 0;k < pg->ct->d;k++){
+        for(int o = 0;o < wfl;o++){
+            if(species[o] == k) bucket[b++] = o;
+        }
+    }
+    
+    /* Find parner functions, only functions of the same species are compared and since the distances are only
+     * used to find ones closer than the current candidates, those that cannot be (by the difference in norm, or
+     * partway through the sum) are skipped, in the same order so the result does not change */
+    for(int o = 0;o < wfl;o++){
+        int ko = species[o], dim = pg->ct->s[ko].d, salcl = srs[ko].salcl;
+        double *omag = &psalc[wfc[o] + dim*salcl];
         
         for(int i = 1;i < md;i++){
             pf[o][i] = -1;
-            pf[basisl][i] = -1;
+            pf[wfl][i] = -1;
         };
         
         if(dim <= 1) continue;
         
         /* check if this functions has alredy been assigned partners */
-        for(int i = 0;i < o && !fpf.j;i++){
-            for(int j = 1;j < md;j++){
-                if(pf[i][j] == o){
-                    fpf.i = i;
-                    fpf.j = j;
-                    break;
-                }
-            }
-        }
-        
-        if(fpf.j){
-            for(int i = 1; i < fpf.j;i++){
-                pf[pf[fpf.i][i]][0]--;
+        if(assigned[o].j){
+            for(int i = 1; i < assigned[o].j;i++){
+                pf[pf[assigned[o].i][i]][0]--;
             }            
-            pf[o][0] -= fpf.j;
+            pf[o][0] -= assigned[o].j;
             continue;
         }
         
         for(int i = 0;i < md;i++){dmpf[i] = DBL_MAX;}
         
-        for(int po = 0; po < basisl;po++){
-            if(species[po] != ko || o == po || abs(pf[po][0]) == dim - 1) continue;
-            double c = 0, mc = 0;
+        for(int b = bucketk[ko]; b < bucketk[ko+1];b++){
+            int po = bucket[b];
+            if(o == po || abs(pf[po][0]) == dim - 1) continue;
+            double c = 0, mc = 0, bound = 0, *pomag = &psalc[wfc[po] + dim*salcl];
+            
+            for(int i = 1;i < dim;i++) bound = fmax(bound, dmpf[i]);
+            
+            int prune = bound < DBL_MAX;
+            double bound2 = prune ? SQR(bound)*(1 + PARTNER_PRUNE_MARGIN) + DBL_MIN : DBL_MAX;
+            if(prune && fabs(wfn[o] - wfn[po]) > bound*(1 + PARTNER_PRUNE_MARGIN) + PARTNER_PRUNE_MARGIN*(wfn[o] + wfn[po])) continue;
+            
             /* length of v1-v2 */
-            for(int i = 0;i < psalcl;i++){
-                double sub = psalc[md][o][i] - psalc[md][po][i];
+            int i;
+            for(i = 0;i < salcl && c <= bound2;i++){
+                double sub = omag[i] - pomag[i];
                 c += SQR(sub);
             }
+            if(i < salcl) continue;
             c = sqrt(c);
             
             /* find the <dim> smallest diffs */
@@ -196,17 +272,22 @@ msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subr
             if(mic > 0){
                 dmpf[mic] = c;
                 pf[o][mic] = po;
-                pf[basisl][mic] = po;
+                pf[wfl][mic] = po;
             }
         }
         
         for(int i = 1;i < dim;i++){
-            pf[o][0] += pf[basisl][i] > 0;
+            int po = pf[o][i];
+            pf[o][0] += pf[wfl][i] > 0;
+            if(po > o && !assigned[po].j){
+                assigned[po].i = o;
+                assigned[po].j = i;
+            }
         }
     }
     
     /* verify that we have partners for everything */
-    for(int o = 0;o < basisl;o++){
+    for(int o = 0;o < wfl;o++){
         int dim = pg->ct->s[species[o]].d;
         if(abs(pf[o][0])+1 != dim){
             for(int i = 0;i < md;i++) clean_debug_printf("%d = %d\n",i,pf[o][i]);
@@ -221,20 +302,32 @@ msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subr
                 ret = MSYM_SYMMETRIZATION_ERROR;
                 goto err;
             }
+            if(i > 0) claimed[pf[o][i]]++;
         }
     }
     
+    /* every function of a degenerate species needs to be the partner of exactly one function that
+     * symmetrizes it, if one is missing (e.g. an incomplete rectangular set) another one ends up shared */
+    for(int o = 0;o < wfl;o++){
+        int dim = pg->ct->s[species[o]].d;
+        if(dim > 1 && claimed[o] != (pf[o][0] < 0)){
+            msymSetErrorDetails("Wave function %d in %s is the partner of %d functions (expected %d), all partners of degenerate functions must be included", o, pg->ct->s[species[o]].name, claimed[o], pf[o][0] < 0);
+            ret = MSYM_SYMMETRIZATION_ERROR;
+            goto err;
+        }
+    }
     
-    memset(symwf,0,sizeof(double[basisl][basisl]));
     
-    for(int o = 0;o < basisl;o++){
+    for(int o = 0;o < wfl;o++) memset(symwf[o],0,sizeof(double[basisl]));
+    
+    for(int o = 0;o < wfl;o++){
         int k = species[o];
-        int dim = pg->ct->s[k].d;
+        int dim = pg->ct->s[k].d, salcl = srs[k].salcl;
         
         if(pf[o][0] < 0) continue;
             
         pf[o][0] = o;
-        for(int i = 0;i < dim;i++) pf[basisl][i] = -1;
+        for(int i = 0;i < dim;i++) pf[wfl][i] = -1;
 
         /* Get the unique dimensions for each partner function in which they have the largest component.
          * This is only needed when the symmetry is really broken but the degenerate functions can be averaged,
@@ -247,13 +340,13 @@ msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subr
                 if(c > cmax){
                     int found = 0;
                     for(int j = 0;j < i;j++){
-                        if(pf[basisl][j] == d){
+                        if(pf[wfl][j] == d){
                             found = 1;
                             break;
                         }
                     }
                     if(!found){
-                        pf[basisl][i] = d;
+                        pf[wfl][i] = d;
                         cmax = c;
                     }
                 }
@@ -261,34 +354,31 @@ msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subr
         }
         
         /*for(int i = 0;i < dim;i++){
-            clean_debug_printf("partner function %d has maximum component in dimension %d\n",i,pf[basisl][i]);
+            clean_debug_printf("partner function %d has maximum component in dimension %d\n",i,pf[wfl][i]);
         }*/
         
         /* calculate average component in each salc subspace and rotate onto the partner functions with largest component */
-        for(int s = 0;s < srs[k].salcl;s++){
+        for(int s = 0;s < salcl;s++){
             int psalci = psalck[k] + s, pfmin = 0;
             double avg = 0;
             
             
             for(int d = 0;d < dim;d++){
                 int wfi = pf[o][d];
-                avg += psalc[md][wfi][psalci];
-                if(pf[basisl][d] == 0) pfmin = wfi;
+                avg += psalc[wfc[wfi] + dim*salcl + s];
+                if(pf[wfl][d] == 0) pfmin = wfi;
             }
             
             avg /= dim;
             
             //printf("average component in salc %d(%s) for wf %d = %lf\n",psalci,pg->ct->s[k].name,o,avg);
             
-            msym_salc_t *salc = &srs[k].salc[s];
-            double (*space)[salc->fl] = (double (*)[salc->fl]) salc->pf;
-            
             for(int d = 0; d < dim;d++){
-                int wfi = pf[o][d], di = pf[basisl][d];
+                int wfi = pf[o][d], di = pf[wfl][d], r = salcr[psalci] + di;
                 /* use the sign of the projection onto the largest component */
-                double c = copysign(avg,psalc[di][wfi][psalci]);
-                for(int j = 0; j < salc->fl;j++){
-                    symwf[wfi][salc->f[j] - basis] += c*space[di][j];
+                double c = copysign(avg,psalc[wfc[wfi] + di*salcl + s]);
+                for(int i = rowp[r]; i < rowp[r+1];i++){
+                    symwf[wfi][col[i]] += c*val[i];
                 }
                 if(NULL != pfo){
                     pfo[wfi].d = di;
@@ -300,19 +390,294 @@ msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subr
     
 err:
     
-    if(species != specieso) free(species);
-    free(ispan);
-    free(pf);
-    free(psalc);
-    free(bfd);
-    free(psalck);
+    if(species != specieso) msymFree(species);
+    msymFree(ispan);
+    msymFree(pf);
+    msymFree(psalc);
+    msymFree(bfd);
+    msymFree(wfc);
+    msymFree(bucket);
+    msymFree(bucketk);
+    msymFree(assigned);
+    msymFree(wfn);
+    msymFree(claimed);
+
+    return ret;
+}
+
+msym_error_t generateSALCMatrix(int srsl, msym_subrepresentation_space_t *srs, int basisl, msym_basis_function_t basis[basisl], msym_salc_matrix_t *m){
+    msym_error_t ret = MSYM_SUCCESS;
+    int nnz = 0;
+    
+    memset(m, 0, sizeof(*m));
+    
+    for(int k = 0;k < srsl;k++){
+        for(int s = 0;s < srs[k].salcl;s++){
+            m->rowsl += srs[k].salc[s].d;
+            nnz += srs[k].salc[s].d*srs[k].salc[s].fl;
+        }
+        m->psalcl += srs[k].salcl;
+    }
+    
+    m->psalck = msymCalloc(srsl, sizeof(*m->psalck));
+    m->salcr = msymCalloc(m->psalcl+1, sizeof(*m->salcr));
+    m->rowp = msymCalloc(m->rowsl+1, sizeof(*m->rowp));
+    m->col = msymCalloc(nnz+1, sizeof(*m->col));
+    m->val = msymCalloc(nnz+1, sizeof(*m->val));
+    
+    if(NULL == m->psalck || NULL == m->salcr || NULL == m->rowp || NULL == m->col || NULL == m->val){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for SALC matrix");
+        goto err;
+    }
+    
+    for(int k = 0, psalci = 0, r = 0, i = 0;k < srsl;k++){
+        m->psalck[k] = psalci;
+        for(int s = 0;s < srs[k].salcl;s++, psalci++){
+            msym_salc_t *salc = &srs[k].salc[s];
+            double (*space)[salc->fl] = (double (*)[salc->fl]) salc->pf;
+            m->salcr[psalci] = r;
+            for(int d = 0;d < salc->d;d++, r++){
+                m->rowp[r] = i;
+                for(int j = 0;j < salc->fl;j++, i++){
+                    m->col[i] = (int)(salc->f[j] - basis);
+                    m->val[i] = space[d][j];
+                }
+            }
+            m->rowp[r] = i;
+        }
+    }
+    
+    return ret;
+err:
+    freeSALCMatrix(m);
+    return ret;
+}
+
+void freeSALCMatrix(msym_salc_matrix_t *m){
+    msymFree(m->psalck);
+    msymFree(m->salcr);
+    msymFree(m->rowp);
+    msymFree(m->col);
+    msymFree(m->val);
+    memset(m, 0, sizeof(*m));
+}
+
+msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int *span, int basisl, msym_basis_function_t basis[basisl], double wf[basisl][basisl], double symwf[basisl][basisl], int species[basisl], msym_partner_function_t pfo[basisl]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_salc_matrix_t m;
+    
+    if(MSYM_SUCCESS != (ret = generateSALCMatrix(srsl, srs, basisl, basis, &m))) goto err;
+    
+    ret = symmetrizeWavefunctionMatrix(pg, srsl, srs, span, &m, basisl, basisl, basisl, wf, symwf, species, pfo);
+    
+    freeSALCMatrix(&m);
+err:
+    return ret;
+}
+
+msym_error_t symmetrizeWavefunctionBatchTask(void *data, int task, int worker){
+    msym_symmetrize_wavefunction_batch_t *b = data;
+    double (*c)[b->wfl][b->stride] = b->c;
+    int (*species)[b->wfl] = b->species;
+    msym_partner_function_t (*pf)[b->wfl] = b->pf;
+    return symmetrizeWavefunctionMatrix(b->pg, b->srsl, b->srs, b->span, &b->m, b->wfl, b->basisl, b->stride, c[task], c[task], NULL == species ? NULL : species[task], NULL == pf ? NULL : pf[task]);
+}
+
+/* The SALC matrix is shared by all wave function sets in the batch, which are symmetrized in place in parallel */
+msym_error_t symmetrizeWavefunctionBatch(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int *span, int basisl, msym_basis_function_t basis[basisl], int threads, int batch, int wfl, int stride, double c[batch][wfl][stride], int species[batch][wfl], msym_partner_function_t pf[batch][wfl]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_symmetrize_wavefunction_batch_t b = {.pg = pg, .srsl = srsl, .srs = srs, .span = span, .wfl = wfl, .basisl = basisl, .stride = stride, .c = c, .species = species, .pf = pf};
+    
+    if(MSYM_SUCCESS != (ret = generateSALCMatrix(srsl, srs, basisl, basis, &b.m))) goto err;
+    
+    ret = parallelFor(parallelWorkers(threads, batch), batch, symmetrizeWavefunctionBatchTask, &b);
+    
+    freeSALCMatrix(&b.m);
+err:
+    return ret;
+}
 
+/* Block k of the matrix in the SALC basis, and if the matrix is symmetrized the block times the SALCs of species k.
+ * Within the block rows/columns are ordered by SALC and then component, for an irreducible species the invariant
+ * part of the block is the component diagonal averaged over the components, for the real (reducible) representation
+ * of a complex conjugate pair each 2x2 component block is projected onto the matrices commuting with it */
+msym_error_t symmetrizeMatrixBlockTask(void *data, int k, int worker){
+    msym_symmetrize_matrix_t *sm = data;
+    int basisl = sm->basisl, d = sm->pg->ct->s[k].d, salcl = sm->srs[k].salcl, n = d*salcl;
+    
+    if(n == 0) return MSYM_SUCCESS;
+    
+    int *rowp = sm->m.rowp, *col = sm->m.col;
+    double *val = sm->m.val;
+    int r0 = sm->m.salcr[sm->m.psalck[k]];
+    double (*a)[basisl] = (double (*)[basisl]) sm->a;
+    double (*t)[basisl] = (double (*)[basisl]) &sm->t[(size_t)r0*basisl];
+    double (*b)[n] = (double (*)[n]) &sm->blocks[sm->blocko[k]];
+    
+    for(int r = 0;r < n;r++){
+        memset(t[r], 0, sizeof(double[basisl]));
+        for(int i = rowp[r0+r];i < rowp[r0+r+1];i++){
+            double v = val[i];
+            double *ar = a[col[i]], *tr = t[r];
+            for(int j = 0;j < basisl;j++) tr[j] += v*ar[j];
+        }
+    }
+    
+    for(int r = 0;r < n;r++){
+        for(int q = r;q < n;q++){
+            double c = 0.0;
+            for(int i = rowp[r0+q];i < rowp[r0+q+1];i++) c += t[r][col[i]]*val[i];
+            b[r][q] = c;
+        }
+    }
+    
+    /* the matrix is symmetric, but the block is made exactly so */
+    for(int r = 0;r < n;r++){
+        for(int q = r+1;q < n;q++) b[q][r] = b[r][q];
+    }
+    
+    if(NULL == sm->sa) return MSYM_SUCCESS;
+    
+    /* linear group species are irreducible in the infinite group even if they are not in the finite one */
+    int average = sm->average && (sm->pg->ct->s[k].r == 1 || isLinearPointGroup(sm->pg));
+    int complex = sm->average && !average && d == 2;
+    
+    for(int r = 0;r < n;r++){
+        int s = r / d, dr = r % d;
+        memset(t[r], 0, sizeof(double[basisl]));
+        for(int q = 0;q < n;q++){
+            double c = b[r][q];
+            if(average){
+                if(q % d != dr) continue;
+                c = 0.0;
+                for(int e = 0;e < d;e++) c += b[s*d + e][q - dr + e];
+                c /= d;
+            } else if(complex){
+                /* the 2x2 blocks commuting with the real form of a complex pair are a*I + b*J, J = [[0,-1],[1,0]] */
+                int u = q - q % d, dq = q % d;
+                if(dq == dr) c = (b[s*d][u] + b[s*d + 1][u + 1])/2;
+                else c = (dr - dq)*(b[s*d + 1][u] - b[s*d][u + 1])/2;
+            }
+            for(int i = rowp[r0+q];i < rowp[r0+q+1];i++) t[r][col[i]] += c*val[i];
+        }
+    }
+    
+    return MSYM_SUCCESS;
+}
+
+msym_error_t symmetrizeMatrixRowTask(void *data, int c, int worker){
+    msym_symmetrize_matrix_t *sm = data;
+    int basisl = sm->basisl;
+    double (*t)[basisl] = (double (*)[basisl]) sm->t;
+    double *sr = &sm->sa[(size_t)c*basisl];
+    
+    memset(sr, 0, sizeof(double[basisl]));
+    for(int i = sm->colp[c];i < sm->colp[c+1];i++){
+        double v = sm->cval[i], *tr = t[sm->rowi[i]];
+        for(int j = 0;j < basisl;j++) sr[j] += v*tr[j];
+    }
+    
+    return MSYM_SUCCESS;
+}
+
+/* Transforms the symmetric matrix a to the SALC basis one species block at a time (in parallel) using the sparse
+ * SALCs, the blocks are stored one after the other (each species k has dimension*salcl rows) if blocks is not NULL,
+ * and the matrix projected onto its invariant part (sa) is transformed back with the transposed SALC matrix.
+ * The cost is proportional to the number of nonzero SALC elements times basisl, rather than basisl^3 */
+msym_error_t symmetrizeMatrix(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int basisl, msym_basis_function_t basis[basisl], int threads, double a[basisl][basisl], int bl, double *blocks, double sa[basisl][basisl]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_symmetrize_matrix_t sm = {.pg = pg, .srs = srs, .basisl = basisl, .average = 1, .a = (double *) a, .sa = (double *) sa};
+    size_t rbl = 0;
+    int nnz = 0;
+    
+    memset(&sm.m, 0, sizeof(sm.m));
+    
+    if(srsl != pg->ct->d){
+        ret = MSYM_SYMMETRIZATION_ERROR;
+        msymSetErrorDetails("Unexpected subspace length (expected %d got %d)",pg->ct->d, srsl);
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = generateSALCMatrix(srsl, srs, basisl, basis, &sm.m))) goto err;
+    
+    if(sm.m.rowsl != basisl){
+        ret = MSYM_SYMMETRIZATION_ERROR;
+        msymSetErrorDetails("Number of SALC components (%d) does not match number of basis functions (%d)",sm.m.rowsl,basisl);
+        goto err;
+    }
+    
+    if(NULL == (sm.blocko = msymCalloc(srsl+1, sizeof(*sm.blocko)))){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for matrix symmetrization");
+        goto err;
+    }
+    
+    for(int k = 0;k < srsl;k++){
+        size_t n = (size_t) pg->ct->s[k].d*srs[k].salcl;
+        sm.blocko[k+1] = sm.blocko[k] + n*n;
+    }
+    
+    rbl = sm.blocko[srsl];
+    
+    if(NULL != blocks && (bl < 0 || (size_t) bl < rbl)){
+        ret = MSYM_INVALID_INPUT;
+        msymSetErrorDetails("Supplied block storage (%d) is smaller than the size of the blocks (%zu)",bl,rbl);
+        goto err;
+    }
+    
+    nnz = sm.m.rowp[basisl];
+    sm.blocks = NULL == blocks ? msymMalloc(sizeof(double[rbl+1])) : blocks;
+    sm.t = msymMalloc(sizeof(double[basisl])*basisl);
+    
+    if(NULL == sm.blocks || NULL == sm.t){
+        ret = MSYM_MEMORY_ERROR;
+        msymSetErrorDetails("Could not allocate memory for matrix symmetrization");
+        goto err;
+    }
+    
+    if(MSYM_SUCCESS != (ret = parallelFor(parallelWorkers(threads, srsl), srsl, symmetrizeMatrixBlockTask, &sm))) goto err;
+    
+    if(NULL != sa){
+        sm.colp = msymCalloc(basisl+1, sizeof(*sm.colp));
+        sm.rowi = msymMalloc(sizeof(int[nnz+1]));
+        sm.cval = msymMalloc(sizeof(double[nnz+1]));
+        
+        if(NULL == sm.colp || NULL == sm.rowi || NULL == sm.cval){
+            ret = MSYM_MEMORY_ERROR;
+            msymSetErrorDetails("Could not allocate memory for matrix symmetrization");
+            goto err;
+        }
+        
+        for(int i = 0;i < nnz;i++) sm.colp[sm.m.col[i]+1]++;
+        for(int c = 0;c < basisl;c++) sm.colp[c+1] += sm.colp[c];
+        for(int r = 0;r < basisl;r++){
+            for(int i = sm.m.rowp[r];i < sm.m.rowp[r+1];i++){
+                int j = sm.colp[sm.m.col[i]]++;
+                sm.rowi[j] = r;
+                sm.cval[j] = sm.m.val[i];
+            }
+        }
+        for(int c = basisl;c > 0;c--) sm.colp[c] = sm.colp[c-1];
+        sm.colp[0] = 0;
+        
+        if(MSYM_SUCCESS != (ret = parallelFor(parallelWorkers(threads, basisl), basisl, symmetrizeMatrixRowTask, &sm))) goto err;
+    }
+    
+err:
+    if(sm.blocks != blocks) msymFree(sm.blocks);
+    msymFree(sm.t);
+    msymFree(sm.blocko);
+    msymFree(sm.colp);
+    msymFree(sm.rowi);
+    msymFree(sm.cval);
+    freeSALCMatrix(&sm.m);
     return ret;
 }
 
 msym_error_t symmetrizeTranslation(msym_point_group_t *pg, msym_equivalence_set_t *es, msym_permutation_t *perm, int pi, double translation[3]){
     msym_error_t ret = MSYM_SUCCESS;
-    double (*v)[3] = calloc(es->length,sizeof(double[3]));
+    double (*v)[3] = msymCalloc(es->length,sizeof(double[3]));
     
     for(int j = 0; j < pg->order;j++){
         int p = perm[j].p[pi];
@@ -329,7 +694,7 @@ msym_error_t symmetrizeTranslation(msym_point_group_t *pg, msym_equivalence_set_
     }
     
 //err:
-    free(v);
+    msymFree(v);
     return ret;
 }
 
@@ -17,10 +17,27 @@
 #include "point_group.h"
 #include "permutation.h"
 
+/* SALCs as a sparse matrix with one row for each component (in the order of the subrepresentation spaces),
+ * the SALCs of species k start at psalck[k] and the rows of SALC i at salcr[i] */
+typedef struct _msym_salc_matrix {
+    int psalcl;
+    int rowsl;
+    int *psalck;
+    int *salcr;
+    int *rowp;
+    int *col;
+    double *val;
+} msym_salc_matrix_t;
+
 msym_error_t symmetrizeElements(msym_point_group_t *pg, int esl, msym_equivalence_set_t *es, msym_permutation_t **perm, msym_thresholds_t *thresholds, double *err);
 //msym_error_t symmetrizeOrbitals(msym_point_group_t *pg, int ssl, msym_subspace_t *ss, int *span, int basisl, msym_orbital_t basis[basisl], msym_thresholds_t *thresholds, double orb[basisl][basisl],double symorb[basisl][basisl]);
 msym_error_t symmetrizeTranslation(msym_point_group_t *pg, msym_equivalence_set_t *es, msym_permutation_t *perm, int pi, double translation[3]);
 msym_error_t symmetrizeWavefunctions(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int *span, int basisl, msym_basis_function_t basis[basisl], double wf[basisl][basisl], double symwf[basisl][basisl], int species[basisl], msym_partner_function_t pfo[basisl]);
+msym_error_t generateSALCMatrix(int srsl, msym_subrepresentation_space_t *srs, int basisl, msym_basis_function_t basis[basisl], msym_salc_matrix_t *m);
+void freeSALCMatrix(msym_salc_matrix_t *m);
+msym_error_t symmetrizeWavefunctionMatrix(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int *span, msym_salc_matrix_t *m, int wfl, int basisl, int stride, double wf[wfl][stride], double symwf[wfl][stride], int species[wfl], msym_partner_function_t pfo[wfl]);
+msym_error_t symmetrizeMatrix(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int basisl, msym_basis_function_t basis[basisl], int threads, double a[basisl][basisl], int bl, double *blocks, double sa[basisl][basisl]);
+msym_error_t symmetrizeWavefunctionBatch(msym_point_group_t *pg, int srsl, msym_subrepresentation_space_t *srs, int *span, int basisl, msym_basis_function_t basis[basisl], int threads, int batch, int wfl, int stride, double c[batch][wfl][stride], int species[batch][wfl], msym_partner_function_t pf[batch][wfl]);
 
 
 #endif /* defined(__MSYM__SYMMETRIZE_h) */
@@ -14,6 +14,7 @@
 #include "symop.h"
 #include "geometry.h"
 #include "equivalence_set.h"
+#include "allocator.h"
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
@@ -51,7 +52,7 @@ msym_error_t findSymmetryOperations(int esl, msym_equivalence_set_t es[esl], msy
         if(MSYM_SUCCESS != (ret = findEquivalenceSetSymmetryOperations(&es[i], t, &lrsops, &rsops))) goto err;
         
         if(llsops > 0 && lrsops == 0) {
-            free(rsops);
+            msymFree(rsops);
             rsops = NULL;
             break;
         }
@@ -65,12 +66,29 @@ msym_error_t findSymmetryOperations(int esl, msym_equivalence_set_t es[esl], msy
     *sops = rsops;
     return ret;
 err:
-    free(rsops);
+    msymFree(rsops);
     *sops = NULL;
     *lsops = 0;
     return ret;
 }
 
+/* Only spherical equivalence sets use the equivalence threshold when finding symmetry operations */
+msym_error_t findSphericalEquivalenceSets(int esl, msym_equivalence_set_t es[esl], msym_thresholds_t *t, int *spherical){
+    msym_error_t ret = MSYM_SUCCESS;
+    double cm[3], eigvec[3][3], eigval[3];
+    msym_geometry_t g;
+    
+    *spherical = 0;
+    for(int i = 0;i < esl && !*spherical;i++){
+        if(MSYM_SUCCESS != (ret = findCenterOfMass(es[i].length, es[i].elements, cm))) goto err;
+        if(MSYM_SUCCESS != (ret = findGeometry(es[i].length, es[i].elements, cm, t, &g, eigval, eigvec))) goto err;
+        *spherical = MSYM_GEOMETRY_SPHERICAL == g;
+    }
+    
+err:
+    return ret;
+}
+
 msym_error_t findEquivalenceSetSymmetryOperations(msym_equivalence_set_t *es, msym_thresholds_t *t, int *lsops, msym_symmetry_operation_t **sops){
     //function pointer syntax is a little ambiguous, this is technically less correct, but nicer to read
     
@@ -119,19 +137,19 @@ msym_error_t findEquivalenceSetSymmetryOperations(msym_equivalence_set_t *es, ms
         *lsops = lfsops;
     } else if (lfsops != 0) {
         if(MSYM_SUCCESS != (ret = reduceSymmetry(lfsops, fsops, t, lsops, sops))) goto err;
-        free(fsops);
+        msymFree(fsops);
     } else if (fsops == 0 && es->length > 1) {
         msymSetErrorDetails("No symmetry operations found in equivalence set with %d elements",es->length);
         ret = MSYM_SYMMETRY_ERROR;
         goto err;
     } else {
-        free(fsops);
+        msymFree(fsops);
     }
 
     return ret;
     
 err:
-    free(fsops);
+    msymFree(fsops);
     return ret;
 
 }
@@ -158,7 +176,7 @@ msym_error_t findSymmetryLinear(msym_equivalence_set_t *es, double cm[3], double
         vsub(v,t,v);
         vnorm(v);
         sopsl = 3;
-        sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+        sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
         vcopy(v,sops[0].v);
         vcopy(v,sops[1].v);
         sops[0].type = PROPER_ROTATION;
@@ -174,7 +192,7 @@ msym_error_t findSymmetryLinear(msym_equivalence_set_t *es, double cm[3], double
         
     } else {
         sopsl = 3;
-        sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+        sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
         vcopy(cm,sops[0].v);
         vnorm(sops[0].v);
         vcopy(ev[prim],sops[1].v);
@@ -226,14 +244,14 @@ msym_error_t findSymmetryPlanarRegular(msym_equivalence_set_t *es, double cm[3],
         }
     }
     
-    div = malloc(order*sizeof(int));
+    div = msymMalloc(order*sizeof(int));
     div_len = divisors(order,div);
     
     even = order % 2 == 0;
     inversion = even && sigma_h;
     
     sopsl = (div_len + sigma_h + order + order*sigma_h + inversion + sigma_h*(div_len - even));
-    sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+    sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
     
     for(; n < div_len; n++){
         sops[n].type = PROPER_ROTATION;
@@ -284,7 +302,7 @@ msym_error_t findSymmetryPlanarRegular(msym_equivalence_set_t *es, double cm[3],
         }
     }
     
-    free(div);
+    msymFree(div);
     if(n != sopsl) {
         msymSetErrorDetails("Unexpected number of generated symmetry operations in planar regular polygon. Got %d expected %d",n,sopsl);
         ret = MSYM_SYMMETRY_ERROR;
@@ -297,7 +315,7 @@ msym_error_t findSymmetryPlanarRegular(msym_equivalence_set_t *es, double cm[3],
     return ret;
     
 err:
-    free(sops);
+    msymFree(sops);
     return ret;
 }
 
@@ -317,11 +335,11 @@ msym_error_t findSymmetryPlanarIrregular(msym_equivalence_set_t *es, double cm[3
     if(iscm){
         //3xC2 + 3xSigma + inversion
         sopsl = 7;
-        sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+        sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
     } else {
         // 2xSigma + 1xC2
         sopsl = 3;
-        sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+        sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
     }
     
     //The CM vector must be pointing in the same direction as the largest moment ov inertia vector, otherwise these would not be equal.
@@ -455,7 +473,7 @@ msym_error_t findSymmetrySymmetricPolyhedron(msym_equivalence_set_t *es, double
     even = order % 2 == 0;
     
     inversion = (staggered && !even) || (sigma_h && even);
-    div = malloc(order*sizeof(int));
+    div = msymMalloc(order*sizeof(int));
     div_len = divisors(order,div);
     
     //Symmetry operations:
@@ -467,7 +485,7 @@ msym_error_t findSymmetrySymmetricPolyhedron(msym_equivalence_set_t *es, double
     //Smax*2 if staggerd Sn (n > 2) for sigma_h
     
     sopsl = (div_len + sigma_h + order + order*(sigma_h || staggered) + inversion + staggered + sigma_h*(div_len - even));
-    sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+    sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
     
     int max;
     for(max = 0; n < div_len; n++){
@@ -540,15 +558,15 @@ msym_error_t findSymmetrySymmetricPolyhedron(msym_equivalence_set_t *es, double
         goto err;
     }
     
-    free(div);
+    msymFree(div);
     
     *rsopsl = sopsl;
     *rsops = sops;
     return ret;
     
 err:
-    free(div);
-    free(sops);
+    msymFree(div);
+    msymFree(sops);
     *rsops = NULL;
     *rsopsl = 0;
     return ret;
@@ -577,7 +595,7 @@ msym_error_t findSymmetryAsymmetricPolyhedron(msym_equivalence_set_t *es, double
         goto err;
     }
     
-    sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+    sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
     vcopy(ev[0], sops[0].v);
     vcopy(ev[1], sops[1].v);
     vcopy(ev[2], sops[2].v);
@@ -620,7 +638,7 @@ msym_error_t findSymmetryAsymmetricPolyhedron(msym_equivalence_set_t *es, double
     return ret;
     
 err:
-    free(sops);
+    msymFree(sops);
     *rsops = NULL;
     *rsopsl = 0;
     return ret;
@@ -636,7 +654,7 @@ msym_error_t findSymmetrySpherical(msym_equivalence_set_t *es, double cm[3], dou
             double t[3];
             vcopy(es->elements[0]->v,t);
             sopsl = 1;
-            sops = malloc(sopsl*sizeof(msym_symmetry_operation_t));
+            sops = msymMalloc(sopsl*sizeof(msym_symmetry_operation_t));
             vcopy(t,sops[0].v);
             vnorm(sops[0].v);
             sops[0].type = PROPER_ROTATION;
@@ -663,18 +681,18 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
     /*struct _pair {
         msym_element_t *e[2];
         double d;
-    } *pairs = malloc(sizeof(struct _pair[150]));*/
+    } *pairs = msymMalloc(sizeof(struct _pair[150]));*/
     double c2d = 0, c4d = 0, sigmad = 0;
     int found = 0, nsigma = 0, esigma = 0, inversion = 0, nc[6] = {0,0,0,0,0,0}, ec[6] = {0,0,0,0,0,0}, *ncb = &nsigma, *nc3b = &nsigma;
     msym_symmetry_operation_t **(ac[6]);
     double thetac[6] = {0.0,M_PI,M_PI/2,M_PI/3,M_PI/4,M_PI/5};
     
-    msym_symmetry_operation_t *sops = malloc(sizeof(msym_symmetry_operation_t[120]));
+    msym_symmetry_operation_t *sops = msymMalloc(sizeof(msym_symmetry_operation_t[120]));
     int sopsl = 0;
     
-    double (**esv)[3] = malloc(sizeof(double (*[es->length])[3]));
+    double (**esv)[3] = msymMalloc(sizeof(double (*[es->length])[3]));
     
-    msym_symmetry_operation_t **sigma = malloc(16*sizeof(msym_symmetry_operation_t*)); //only 15, but we can overflow
+    msym_symmetry_operation_t **sigma = msymMalloc(16*sizeof(msym_symmetry_operation_t*)); //only 15, but we can overflow
     
     msym_symmetry_operation_t **c3b = NULL;
     msym_symmetry_operation_t **cb = sigma;
@@ -685,7 +703,7 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
     msym_symmetry_operation_t sopinversion = {.type = INVERSION, .order = 1, .power = 1, .v = {0,0,0}};
     
     //15 C2 (I), 10 C3 (I), 3 C4 (O), 6 C5 (I)
-    ac[0] = malloc((15+10+3+6)*sizeof(msym_symmetry_operation_t*));
+    ac[0] = msymMalloc((15+10+3+6)*sizeof(msym_symmetry_operation_t*));
     ac[1] = ac[0];
     ac[2] = ac[1];
     ac[3] = ac[2] + 15;
@@ -716,8 +734,8 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
                         c4d = d;
                         copySymmetryOperation(&sops[sopsl], &sopc);
                         (ac[4])[nc[4]++] = &sops[sopsl++];
-                        free(perm.p);
-                        free(perm.c);
+                        msymFree(perm.p);
+                        msymFree(perm.c);
                         sopc.order = 2;
                         if(!findSymmetryOperation(&sopc, sops, sopsl, thresholds)){
                             copySymmetryOperation(&sops[sopsl], &sopc);
@@ -731,8 +749,8 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
                             //sigmad = d; //This is a bit dangerous, but the C2 axes dhould generate the rest
                             copySymmetryOperation(&sops[sopsl], &sopsigma);
                             sigma[nsigma++] = &sops[sopsl++];
-                            free(perm.p);
-                            free(perm.c);
+                            msymFree(perm.p);
+                            msymFree(perm.c);
                         }
                     }
                 }
@@ -745,8 +763,8 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
                         c2d = d;
                         copySymmetryOperation(&sops[sopsl], &sopc);
                         (ac[2])[nc[2]++] = &sops[sopsl++];
-                        free(perm.p);
-                        free(perm.c);
+                        msymFree(perm.p);
+                        msymFree(perm.c);
                     }
                 }
             }
@@ -758,8 +776,8 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
                         
                         copySymmetryOperation(&sops[sopsl], &sopsigma);
                         sigma[nsigma++] = &sops[sopsl++];
-                        free(perm.p);
-                        free(perm.c);
+                        msymFree(perm.p);
+                        msymFree(perm.c);
                     }
                 }
             }
@@ -815,8 +833,8 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
     if(MSYM_SUCCESS == findPermutation(&sopinversion, es->length, esv, thresholds, &perm)){
         inversion = 1;
         copySymmetryOperation(&sops[sopsl++], &sopinversion);
-        free(perm.p);
-        free(perm.c);
+        msymFree(perm.p);
+        msymFree(perm.c);
     }
     
     esigma = (((nsigma+2) / 3) + (nsigma / 10) - (nsigma / 13))*3;
@@ -1017,17 +1035,17 @@ msym_error_t findSymmetryCubic(msym_equivalence_set_t *es, double cm[3], double
     *rsopsl = sopsl;
     *rsops = sops;
     
-    free(esv);
-    free(ac[0]);
-    free(sigma);
+    msymFree(esv);
+    msymFree(ac[0]);
+    msymFree(sigma);
     
     return ret;
     
 err:
-    free(ac[0]);
-    free(sigma);
-    free(sops);
-    free(esv);
+    msymFree(ac[0]);
+    msymFree(sigma);
+    msymFree(sops);
+    msymFree(esv);
     *rsopsl = 0;
     *rsops = NULL;
     return ret;
@@ -1066,7 +1084,7 @@ msym_error_t reduceSymmetry(int sopsl, msym_symmetry_operation_t sops[sopsl], ms
         if(inversion && perpendicular){
             double v[3];
             vcopy(cinf[0]->v, v);
-            rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[7]));
+            rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[7]));
             rsopsl = 7;
             
             rsops[0].type = INVERSION;
@@ -1099,7 +1117,7 @@ msym_error_t reduceSymmetry(int sopsl, msym_symmetry_operation_t sops[sopsl], ms
             vcopy(cinf[1]->v, rsops[5].v);
             vcopy(cross, rsops[6].v);
         } else if (inversion & !parallel){
-            rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[3]));
+            rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[3]));
             rsopsl = 3;
             rsops[0].type = INVERSION;
             rsops[0].v[0] = rsops[0].v[1] = rsops[0].v[2] = 0;
@@ -1115,7 +1133,7 @@ msym_error_t reduceSymmetry(int sopsl, msym_symmetry_operation_t sops[sopsl], ms
             vcopy(cross, rsops[1].v);
             vcopy(cross, rsops[2].v);
         } else if(perpendicular && !inv[0] && !inv[1]){
-            rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[1]));
+            rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[1]));
             rsopsl = 1;
             rsops[0].type = REFLECTION;
             vcopy(cross, rsops[0].v);
@@ -1125,7 +1143,7 @@ msym_error_t reduceSymmetry(int sopsl, msym_symmetry_operation_t sops[sopsl], ms
             vcopy(cinf[0]->v, v[0]);
             vcopy(cinf[1]->v, v[1]);
             
-            rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[3]));
+            rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[3]));
             rsopsl = 3;
             rsops[0].type = REFLECTION;
             rsops[1].type = REFLECTION;
@@ -1140,7 +1158,7 @@ msym_error_t reduceSymmetry(int sopsl, msym_symmetry_operation_t sops[sopsl], ms
         } else if (parallel){
             if(MSYM_SUCCESS != (ret = filterSymmetryOperations(sopsl,sops,thresholds,&rsopsl,&rsops))) goto err;
         } else {
-            rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[1]));
+            rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[1]));
             rsopsl = 1;
             rsops[0].type = REFLECTION;
             vcopy(cross, rsops[0].v);
@@ -1156,13 +1174,13 @@ msym_error_t reduceSymmetry(int sopsl, msym_symmetry_operation_t sops[sopsl], ms
                 if(sops[i].order != 2){
                     add = vparallel(sops[i].v,v,thresholds->angle);
                 } else {
-                    add = vparallel(sops[i].v,v,thresholds->angle) || (vperpendicular(sops[i].v,cinf[0]->v,thresholds->angle) && inv[0]);
+                    add = vparallel(sops[i].v,v,thresholds->angle) || (vperpendicular(sops[i].v,v,thresholds->angle) && inv[0]);
                 }
             } else if(sops[i].type == REFLECTION){
                 add = vperpendicular(sops[i].v,v,thresholds->angle);
             }
             if(add){
-                rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[rsopsl+1]));
+                rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[rsopsl+1]));
                 copySymmetryOperation(&rsops[rsopsl], &sops[i]);
                 rsopsl++;
             }
@@ -1187,7 +1205,7 @@ msym_error_t reduceSymmetry(int sopsl, msym_symmetry_operation_t sops[sopsl], ms
                 if(remove){
                     rsopsl--;
                     copySymmetryOperation(&rsops[i], &rsops[rsopsl]);
-                    rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[rsopsl]));
+                    rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[rsopsl]));
                     i--;
                 } else if(vparallel(rsops[i].v,cinf[1]->v,thresholds->angle)){
                     if(vdot(rsops[i].v,cinf[1]->v) < 0){
@@ -1219,7 +1237,7 @@ msym_error_t filterSymmetryOperations(int sopsl, msym_symmetry_operation_t sops[
         if(!fsop){
             rsopsl--;
             copySymmetryOperation(&rsops[i], &rsops[rsopsl]);
-            rsops = realloc(rsops, sizeof(msym_symmetry_operation_t[rsopsl]));
+            rsops = msymRealloc(rsops, sizeof(msym_symmetry_operation_t[rsopsl]));
             i--;
         } else if (rsops[i].type == PROPER_ROTATION || rsops[i].type == IMPROPER_ROTATION || rsops[i].type == REFLECTION){
             if(vdot(rsops[i].v,fsop->v) < 0){
@@ -1253,3 +1271,44 @@ int divisors(int n, int* div){
     }
     return l;
 }
+
+/* Test the only operations an asymmetric top can have (C2 along, and reflections perpendicular to,
+ * the principal axes, and inversion) directly against the equivalence sets.
+ * Elements can only be mapped onto elements of the same set so this is cheap */
+msym_error_t findPrincipalAxesSymmetryOperations(int esl, msym_equivalence_set_t es[esl], double ev[3][3], msym_thresholds_t *t, int *lsops, msym_symmetry_operation_t sops[7]){
+    msym_error_t ret = MSYM_SUCCESS;
+    msym_symmetry_operation_t candidates[7];
+    int sopsl = 0;
+    
+    for(int i = 0;i < 3;i++){
+        msym_symmetry_operation_t c2 = {.type = PROPER_ROTATION, .order = 2, .power = 1, .orientation = NONE};
+        msym_symmetry_operation_t sigma = {.type = REFLECTION, .order = 1, .power = 1, .orientation = NONE};
+        vnorm2(ev[i], c2.v);
+        vnorm2(ev[i], sigma.v);
+        candidates[i] = c2;
+        candidates[3+i] = sigma;
+    }
+    
+    msym_symmetry_operation_t inversion = {.type = INVERSION, .order = 1, .power = 1, .orientation = NONE, .v = {0,0,0}};
+    candidates[6] = inversion;
+    
+    for(int c = 0;c < 7;c++){
+        int found = 1;
+        for(int i = 0;i < esl && found;i++){
+            for(int j = 0;j < es[i].length && found;j++){
+                double v[3];
+                applySymmetryOperation(&candidates[c], es[i].elements[j]->v, v);
+                found = 0;
+                for(int k = 0;k < es[i].length && !found;k++){
+                    found = vequal(v, es[i].elements[k]->v, t->permutation);
+                }
+            }
+        }
+        if(found) sops[sopsl++] = candidates[c];
+    }
+    
+    *lsops = sopsl;
+    
+    return ret;
+}
+
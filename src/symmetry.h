@@ -15,5 +15,7 @@
 #include "symop.h"
 
 msym_error_t findSymmetryOperations(int esl, msym_equivalence_set_t es[esl], msym_thresholds_t *t, int *lsops, msym_symmetry_operation_t **sops);
+msym_error_t findSphericalEquivalenceSets(int esl, msym_equivalence_set_t es[esl], msym_thresholds_t *t, int *spherical);
+msym_error_t findPrincipalAxesSymmetryOperations(int esl, msym_equivalence_set_t es[esl], double ev[3][3], msym_thresholds_t *t, int *lsops, msym_symmetry_operation_t sops[7]);
 
 #endif /* defined(__MSYM_SYMMETRY_h) */
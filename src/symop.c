@@ -276,6 +276,15 @@ void copySymmetryOperation(msym_symmetry_operation_t *dst, msym_symmetry_operati
     vcopy(src->v, dst->v);
 }
 
+/* Exact comparison, two operations that compare equal have the same matrix */
+int identicalSymmetryOperations(int l, msym_symmetry_operation_t a[l], msym_symmetry_operation_t b[l]){
+    for(int i = 0;i < l;i++){
+        if(a[i].type != b[i].type || a[i].order != b[i].order || a[i].power != b[i].power ||
+           a[i].v[0] != b[i].v[0] || a[i].v[1] != b[i].v[1] || a[i].v[2] != b[i].v[2]) return 0;
+    }
+    return 1;
+}
+
 msym_symmetry_operation_t *findSymmetryOperation(msym_symmetry_operation_t *sop, msym_symmetry_operation_t *sops, int l, msym_thresholds_t *thresholds){
     msym_symmetry_operation_t *fsop = NULL;
     for(msym_symmetry_operation_t* s = sops; s < (sops + l);s++){
@@ -34,6 +34,7 @@ void applySymmetryOperation(msym_symmetry_operation_t *sop,double iv[3], double
 void symmetryOperationMatrix(msym_symmetry_operation_t *sop, double m[3][3]);
 double symmetryOperationCharacter(msym_symmetry_operation_t *sop, msym_basis_function_t *f);
 void copySymmetryOperation(msym_symmetry_operation_t *dst, msym_symmetry_operation_t *src);
+int identicalSymmetryOperations(int l, msym_symmetry_operation_t a[l], msym_symmetry_operation_t b[l]);
 msym_symmetry_operation_t *findSymmetryOperation(msym_symmetry_operation_t*, msym_symmetry_operation_t*, int, msym_thresholds_t *thresholds);
 void invertSymmetryOperation(msym_symmetry_operation_t *sop, msym_symmetry_operation_t *isop);
 double symmetryOperationCartesianCharacter(msym_symmetry_operation_t *sop);
@@ -0,0 +1,139 @@
+//
+//  block_projection.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "msym.h"
+#include "subspace.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338327950288419716939937510582
+#endif
+
+/* Generates projection operators of cyclic groups acting on a fixed element and orbits of k and k/2 elements,
+ * the block projection operator must expand to exactly the dense operator, applying it must give the dense product,
+ * and orthogonalizing its rows must give exactly the same subspace as orthogonalizing the dense rows */
+
+int testProjection(int k, int ld, int j, int arbitrary);
+
+int testProjection(int k, int ld, int j, int arbitrary){
+    int pd = 1 + k + k/2, l = pd*ld, d = 0 == j || 2*j == k ? 1 : 2, failed = 0, blocks = 0, dn = 0, bn = 0;
+    double operator = 0.0, product = 0.0, subspace = 0.0, trace = 0.0, t = 1.0e-2;
+    msym_permutation_t *perm = calloc(k, sizeof(*perm));
+    msym_block_projection_t bp = {.pd = 0};
+    double *c = malloc(sizeof(double[k]));
+    double (*lsops)[ld][ld] = malloc(sizeof(double[k][ld][ld]));
+    double (*proj)[l] = malloc(sizeof(double[l][l]));
+    double (*e)[l] = calloc(l, sizeof(double[l]));
+    double (*v)[l] = malloc(sizeof(double[3][l]));
+    double (*y)[l] = malloc(sizeof(double[3][l]));
+    double (*dss)[l] = calloc(l, sizeof(double[l]));
+    double (*bss)[l] = calloc(l, sizeof(double[l]));
+    double (*mgsv)[l] = malloc(sizeof(double[3*MGS_PANEL][l]));
+    double *py = malloc(sizeof(double[l]));
+    
+    /* the operations are rotations about z, either represented on ld functions and projected with the characters
+     * of irreducible representation j, or with arbitrary matrices and coefficients where every third one is zero */
+    for(int s = 0;s < k;s++){
+        double a = 2*M_PI*s/k;
+        perm[s].p_length = pd;
+        perm[s].p = malloc(sizeof(int[pd]));
+        perm[s].p[0] = 0;
+        for(int q = 0;q < k;q++) perm[s].p[1 + q] = 1 + (q + s) % k;
+        for(int q = 0;q < k/2;q++) perm[s].p[1 + k + q] = 1 + k + (q + s) % (k/2);
+        c[s] = arbitrary ? (s % 3 == 1 ? 0.0 : sin(1.3*s + j)) : cos(a*j);
+        for(int li = 0;li < ld;li++){
+            for(int lj = 0;lj < ld;lj++){
+                lsops[s][li][lj] = arbitrary ? cos(0.7*s + 1.1*li - 0.3*lj) : li == lj;
+            }
+        }
+        if(!arbitrary && 3 == ld){
+            lsops[s][0][0] = lsops[s][1][1] = cos(a);
+            lsops[s][0][1] = -sin(a);
+            lsops[s][1][0] = sin(a);
+        }
+    }
+    
+    if(MSYM_SUCCESS != generateProjectionOperator(d, k, c, perm, ld, lsops, proj) ||
+       MSYM_SUCCESS != allocateBlockProjectionOperator(k, perm, ld, &bp) ||
+       MSYM_SUCCESS != generateBlockProjectionOperator(d, k, c, ld, lsops, &bp)){
+        fprintf(stderr, "Could not generate projection operator: %s\n", msymGetErrorDetails());
+        failed = 1;
+        goto err;
+    }
+    
+    for(int pr = 0;pr < pd;pr++){
+        blocks = bp.row[pr+1] - bp.row[pr] > blocks ? bp.row[pr+1] - bp.row[pr] : blocks;
+        for(int i = bp.row[pr];i < bp.row[pr+1];i++){
+            for(int li = 0;li < ld;li++){
+                for(int lj = 0;lj < ld;lj++) e[pr*ld + li][bp.col[i]*ld + lj] += bp.b[(i*ld + li)*ld + lj];
+            }
+        }
+    }
+    
+    for(int i = 0;i < l;i++){
+        trace += proj[i][i];
+        for(int j = 0;j < l;j++) operator = fmax(operator, fabs(e[i][j] - proj[i][j]));
+    }
+    
+    for(int r = 0;r < 3;r++){
+        for(int i = 0;i < l;i++) v[r][i] = cos(r + 0.9*i);
+        for(int i = 0;i < l;i++){
+            y[r][i] = 0.0;
+            for(int j = 0;j < l;j++) y[r][i] += proj[i][j]*v[r][j];
+        }
+    }
+    
+    applyBlockProjectionOperator(&bp, 3, v, py);
+    
+    for(int r = 0;r < 3;r++){
+        for(int i = 0;i < l;i++) product = fmax(product, fabs(v[r][i] - y[r][i]));
+    }
+    
+    dn = mgs2(l, l, proj, dss, 0, t);
+    bn = mgs2BlockProjection(&bp, l, bss, 0, t, mgsv);
+    
+    for(int i = 0;i < l;i++){
+        for(int j = 0;j < l;j++) subspace = fmax(subspace, fabs(dss[i][j] - bss[i][j]));
+    }
+    
+    /* the characters give a projection operator, its rank is its trace */
+    failed = operator != 0.0 || product > 1.0e-12 || subspace != 0.0 || dn != bn || blocks > (k < pd ? k : pd) || (!arbitrary && dn != lround(trace));
+    
+    printf("C%d %s %d (%d functions per element): operator %.3e, product %.3e, subspace %.3e, dimension %d/%d, blocks per row %d%s\n", k, arbitrary ? "arbitrary operator" : "representation", j, ld, operator, product, subspace, bn, dn, blocks, failed ? " FAILED" : "");
+    
+err:
+    freeBlockProjectionOperator(&bp);
+    for(int s = 0;s < k;s++) free(perm[s].p);
+    free(perm);
+    free(c);
+    free(lsops);
+    free(proj);
+    free(e);
+    free(v);
+    free(y);
+    free(dss);
+    free(bss);
+    free(mgsv);
+    free(py);
+    return failed;
+}
+
+int main(int argc, const char * argv[]) {
+    int failed = 0;
+    
+    failed += testProjection(4, 1, 0, 0);
+    failed += testProjection(6, 3, 1, 0);
+    failed += testProjection(6, 3, 3, 0);
+    failed += testProjection(12, 3, 2, 0);
+    failed += testProjection(8, 2, 0, 1);
+    failed += testProjection(20, 5, 1, 1);
+    
+    return failed > 0;
+}
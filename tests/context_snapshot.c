@@ -0,0 +1,279 @@
+//
+//  context_snapshot.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include "msym.h"
+
+/* Loads truncated and corrupted snapshots of methane with s, p and d functions on carbon.
+ * The intact snapshot must give the same results as the original context, truncated ones
+ * must be rejected, and corrupted ones either rejected or usable */
+
+int useContext(msym_context ctx, int l, double c[l][l], double wf[l][l], int species[l]);
+int compareContexts(msym_context ctx, msym_context lctx, int l);
+
+int useContext(msym_context ctx, int l, double c[l][l], double wf[l][l], int species[l]){
+    int sgl = 0;
+    const msym_subgroup_t *sg = NULL;
+    double err = 0.0;
+    if(MSYM_SUCCESS != msymGetSALCs(ctx, l, wf, species, NULL)) return 0;
+    msymGetSubgroups(ctx, &sgl, &sg);
+    for(int i = 0;i < l;i++){
+        for(int j = 0;j < l;j++) wf[i][j] = c[i][j] + 1.0e-4*((i + j) % 3 - 1);
+    }
+    msymSymmetrizeWavefunctions(ctx, l, wf, species, NULL);
+    for(int i = 0;i < l;i++){
+        for(int j = 0;j < l;j++) wf[i][j] = (i == j) + 0.1/(1 + i + j);
+    }
+    msymSymmetrizeMatrix(ctx, l, wf);
+    msymSymmetrizeElements(ctx, &err);
+    return 1;
+}
+
+/* Number of differences between the point group, subgroups, equivalence sets, SALCs and symmetrized
+ * wave functions and matrices of the original context and a context loaded from its snapshot */
+int compareContexts(msym_context ctx, msym_context lctx, int l){
+    int diff = 0, sopsl = 0, lsopsl = 0, sgl = 0, lsgl = 0, esl = 0, lesl = 0;
+    char name[8], lname[8];
+    const msym_symmetry_operation_t *sops = NULL, *lsops = NULL;
+    const msym_subgroup_t *sg = NULL, *lsg = NULL;
+    const msym_equivalence_set_t *es = NULL, *les = NULL;
+    double (*c)[l] = malloc(sizeof(double[l][l])), (*lc)[l] = malloc(sizeof(double[l][l]));
+    int *species = malloc(sizeof(int[l])), *lspecies = malloc(sizeof(int[l]));
+    msym_partner_function_t *pf = malloc(sizeof(msym_partner_function_t[l])), *lpf = malloc(sizeof(msym_partner_function_t[l]));
+    
+    if(MSYM_SUCCESS != msymGetPointGroupName(ctx, sizeof(name), name) ||
+       MSYM_SUCCESS != msymGetPointGroupName(lctx, sizeof(lname), lname) ||
+       0 != strcmp(name, lname)){
+        fprintf(stderr, "Point group differs after loading\n");
+        diff++;
+    }
+    
+    if(MSYM_SUCCESS != msymGetSymmetryOperations(ctx, &sopsl, &sops) ||
+       MSYM_SUCCESS != msymGetSymmetryOperations(lctx, &lsopsl, &lsops) ||
+       sopsl != lsopsl){
+        fprintf(stderr, "Symmetry operations differ after loading\n");
+        diff++;
+    } else {
+        for(int i = 0;i < sopsl;i++){
+            double d = fabs(sops[i].v[0] - lsops[i].v[0]) + fabs(sops[i].v[1] - lsops[i].v[1]) + fabs(sops[i].v[2] - lsops[i].v[2]);
+            if(sops[i].type != lsops[i].type || sops[i].order != lsops[i].order || sops[i].power != lsops[i].power || sops[i].cla != lsops[i].cla || d > 1.0e-12){
+                fprintf(stderr, "Symmetry operation %d differs after loading\n", i);
+                diff++;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != msymGetSubgroups(ctx, &sgl, &sg) ||
+       MSYM_SUCCESS != msymGetSubgroups(lctx, &lsgl, &lsg) ||
+       sgl != lsgl){
+        fprintf(stderr, "Subgroups differ after loading\n");
+        diff++;
+    } else {
+        for(int i = 0;i < sgl;i++){
+            if(sg[i].type != lsg[i].type || sg[i].n != lsg[i].n || sg[i].order != lsg[i].order || 0 != strcmp(sg[i].name, lsg[i].name)){
+                fprintf(stderr, "Subgroup %d differs after loading\n", i);
+                diff++;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != msymGetEquivalenceSets(ctx, &esl, &es) ||
+       MSYM_SUCCESS != msymGetEquivalenceSets(lctx, &lesl, &les) ||
+       esl != lesl){
+        fprintf(stderr, "Equivalence sets differ after loading\n");
+        diff++;
+    } else {
+        for(int i = 0;i < esl;i++){
+            int d = es[i].length != les[i].length;
+            for(int j = 0;!d && j < es[i].length;j++){
+                for(int k = 0;k < 3;k++) d |= fabs(es[i].elements[j]->v[k] - les[i].elements[j]->v[k]) > 1.0e-12;
+                d |= 0 != strcmp(es[i].elements[j]->name, les[i].elements[j]->name);
+            }
+            if(d){
+                fprintf(stderr, "Equivalence set %d differs after loading\n", i);
+                diff++;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != msymGetSALCs(ctx, l, c, species, pf) ||
+       MSYM_SUCCESS != msymGetSALCs(lctx, l, lc, lspecies, lpf)){
+        fprintf(stderr, "Could not get SALCs to compare\n");
+        diff++;
+        goto err;
+    }
+    
+    for(int i = 0;i < l;i++){
+        double d = 0.0;
+        for(int j = 0;j < l;j++) d = fmax(d, fabs(c[i][j] - lc[i][j]));
+        if(d > 1.0e-12 || species[i] != lspecies[i] || pf[i].i != lpf[i].i || pf[i].d != lpf[i].d){
+            fprintf(stderr, "SALC %d differs after loading\n", i);
+            diff++;
+        }
+    }
+    
+    for(int i = 0;i < l;i++){
+        for(int j = 0;j < l;j++) lc[i][j] = c[i][j] = lc[i][j] + 1.0e-4*((i + j) % 3 - 1);
+    }
+    
+    if(MSYM_SUCCESS != msymSymmetrizeWavefunctions(ctx, l, c, species, pf) ||
+       MSYM_SUCCESS != msymSymmetrizeWavefunctions(lctx, l, lc, lspecies, lpf)){
+        fprintf(stderr, "Could not symmetrize wave functions to compare\n");
+        diff++;
+        goto err;
+    }
+    
+    for(int i = 0;i < l;i++){
+        double d = 0.0;
+        for(int j = 0;j < l;j++) d = fmax(d, fabs(c[i][j] - lc[i][j]));
+        if(d > 1.0e-12 || species[i] != lspecies[i] || pf[i].i != lpf[i].i || pf[i].d != lpf[i].d){
+            fprintf(stderr, "Symmetrized wave function %d differs after loading\n", i);
+            diff++;
+        }
+    }
+    
+    for(int i = 0;i < l;i++){
+        for(int j = 0;j < l;j++) lc[i][j] = c[i][j] = (i == j) + 0.1/(1 + i + j);
+    }
+    
+    if(MSYM_SUCCESS != msymSymmetrizeMatrix(ctx, l, c) ||
+       MSYM_SUCCESS != msymSymmetrizeMatrix(lctx, l, lc)){
+        fprintf(stderr, "Could not symmetrize matrices to compare\n");
+        diff++;
+        goto err;
+    }
+    
+    for(int i = 0;i < l;i++){
+        for(int j = 0;j < l;j++){
+            if(fabs(c[i][j] - lc[i][j]) > 1.0e-12){
+                fprintf(stderr, "Symmetrized matrix element %d,%d differs after loading\n", i, j);
+                diff++;
+            }
+        }
+    }
+    
+err:
+    free(c);
+    free(lc);
+    free(species);
+    free(lspecies);
+    free(pf);
+    free(lpf);
+    return diff;
+}
+
+int main(int argc, const char * argv[]) {
+    double a = 0.629;
+    msym_element_t elements[5] = {
+        {.name = "C", .v = {0, 0, 0}},
+        {.name = "H", .v = {a, a, a}},
+        {.name = "H", .v = {-a, -a, a}},
+        {.name = "H", .v = {-a, a, -a}},
+        {.name = "H", .v = {a, -a, -a}}
+    };
+    msym_basis_function_t basis[13];
+    int basisl = 0, sgl = 0, failed = 0, rejected = 0, used = 0;
+    const msym_subgroup_t *sg = NULL;
+    msym_context ctx = msymCreateContext(), lctx = NULL;
+    size_t size = 0;
+    unsigned char *buf = NULL, *cbuf = NULL;
+    
+    memset(basis, 0, sizeof(basis));
+    for(int l = 0;l <= 2;l++){
+        for(int m = -l;m <= l;m++, basisl++){
+            basis[basisl].element = &elements[0];
+            basis[basisl].type = MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC;
+            basis[basisl].f.rsh.n = 3;
+            basis[basisl].f.rsh.l = l;
+            basis[basisl].f.rsh.m = m;
+        }
+    }
+    for(int i = 1;i < 5;i++, basisl++){
+        basis[basisl].element = &elements[i];
+        basis[basisl].type = MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC;
+        basis[basisl].f.rsh.n = 1;
+    }
+    
+    double (*c)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*wf)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    int *species = malloc(sizeof(int[basisl]));
+    
+    if(MSYM_SUCCESS != msymSetElements(ctx, 5, elements) ||
+       MSYM_SUCCESS != msymSetBasisFunctions(ctx, basisl, basis) ||
+       MSYM_SUCCESS != msymFindSymmetry(ctx) ||
+       MSYM_SUCCESS != msymGetSubgroups(ctx, &sgl, &sg) ||
+       MSYM_SUCCESS != msymGetSALCs(ctx, basisl, c, species, NULL) ||
+       MSYM_SUCCESS != msymSaveContext(ctx, 0, NULL, &size)){
+        fprintf(stderr, "Could not create snapshot: %s\n", msymGetContextErrorDetails(ctx));
+        return 1;
+    }
+    
+    buf = malloc(size);
+    cbuf = malloc(size);
+    if(MSYM_SUCCESS != msymSaveContext(ctx, size, buf, NULL)){
+        fprintf(stderr, "Could not save snapshot: %s\n", msymGetContextErrorDetails(ctx));
+        return 1;
+    }
+    
+    lctx = msymCreateContext();
+    if(MSYM_SUCCESS != msymLoadContext(lctx, size, buf) || !useContext(lctx, basisl, c, wf, species)){
+        fprintf(stderr, "Could not load snapshot: %s\n", msymGetContextErrorDetails(lctx));
+        failed++;
+    }
+    msymReleaseContext(lctx);
+    
+    lctx = msymCreateContext();
+    if(MSYM_SUCCESS != msymLoadContext(lctx, size, buf)){
+        fprintf(stderr, "Could not load snapshot: %s\n", msymGetContextErrorDetails(lctx));
+        failed++;
+    } else {
+        failed += compareContexts(ctx, lctx, basisl);
+    }
+    msymReleaseContext(lctx);
+    
+    for(size_t l = 0;l < size;l++){
+        lctx = msymCreateContext();
+        if(MSYM_SUCCESS == msymLoadContext(lctx, l, buf)){
+            fprintf(stderr, "Loaded snapshot of %lu bytes truncated at %lu bytes\n", (unsigned long) size, (unsigned long) l);
+            failed++;
+        }
+        msymReleaseContext(lctx);
+    }
+    
+    /* every 4 bytes after the header replaced by the stored value plus one, or by values that are out of range for most fields */
+    int32_t values[] = {0, -1, 1000, INT_MAX, INT_MIN};
+    for(size_t off = 24;off + sizeof(int32_t) <= size;off++){
+        for(int v = 0;v < sizeof(values)/sizeof(values[0]);v++){
+            int32_t value = values[v];
+            if(0 == v){
+                memcpy(&value, buf + off, sizeof(value));
+                value++;
+            }
+            memcpy(cbuf, buf, size);
+            memcpy(cbuf + off, &value, sizeof(value));
+            lctx = msymCreateContext();
+            if(MSYM_SUCCESS == msymLoadContext(lctx, size, cbuf)) used += useContext(lctx, basisl, c, wf, species);
+            else rejected++;
+            msymReleaseContext(lctx);
+        }
+    }
+    
+    printf("%lu byte snapshot, %d corrupted snapshots rejected, %d used, %d failures\n", (unsigned long) size, rejected, used, failed);
+    
+    msymReleaseContext(ctx);
+    free(buf);
+    free(cbuf);
+    free(c);
+    free(wf);
+    free(species);
+    return failed > 0;
+}
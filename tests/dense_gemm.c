@@ -0,0 +1,128 @@
+//
+//  dense_gemm.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "msym.h"
+#include "dense.h"
+
+/* Multiplies matrices below and above the size where the dense kernels switch to cache blocking, and across
+ * the block boundaries, with and without transposing B and scaling C, the result must be exactly that of the
+ * naive loops unless the kernels are provided by the system BLAS */
+
+#ifdef MSYM_USE_BLAS
+#define DENSE_TOLERANCE 1.0e-12
+#define DENSE_TOLERANCE_SINGLE 1.0e-4
+#else
+#define DENSE_TOLERANCE 0.0
+#define DENSE_TOLERANCE_SINGLE 0.0
+#endif
+
+int testGemm(int transb, int m, int n, int k, double beta);
+int testVector(int n);
+
+int testGemm(int transb, int m, int n, int k, double beta){
+    int lda = k + 3, ldb = (transb ? k : n) + 2, ldc = n + 1, bl = (transb ? n : k)*ldb, failed = 0;
+    double diff = 0.0, diffs = 0.0;
+    double *A = malloc(sizeof(double[m*lda])), *B = malloc(sizeof(double[bl])), *C = malloc(sizeof(double[m*ldc])), *R = malloc(sizeof(double[m*ldc]));
+    float *Af = malloc(sizeof(float[m*lda])), *Bf = malloc(sizeof(float[bl])), *Cf = malloc(sizeof(float[m*ldc])), *Rf = malloc(sizeof(float[m*ldc]));
+    
+    for(int i = 0;i < m*lda;i++) Af[i] = A[i] = sin(0.37*i + 0.1);
+    for(int i = 0;i < bl;i++) Bf[i] = B[i] = cos(0.53*i - 0.2);
+    
+    /* C is not read when beta is zero */
+    for(int i = 0;i < m*ldc;i++) Cf[i] = Rf[i] = C[i] = R[i] = beta == 0.0 ? NAN : sin(1.1*i);
+    
+    for(int r = 0;r < m;r++){
+        for(int c = 0;c < n;c++){
+            double s = beta == 0.0 ? 0.0 : beta*R[r*ldc + c];
+            float sf = beta == 0.0 ? 0.0f : (float) beta*Rf[r*ldc + c];
+            for(int i = 0;i < k;i++){
+                s += A[r*lda + i]*B[transb ? c*ldb + i : i*ldb + c];
+                sf += Af[r*lda + i]*Bf[transb ? c*ldb + i : i*ldb + c];
+            }
+            R[r*ldc + c] = s;
+            Rf[r*ldc + c] = sf;
+        }
+    }
+    
+    denseGemm(transb, m, n, k, A, lda, B, ldb, beta, C, ldc);
+    denseGemmf(transb, m, n, k, Af, lda, Bf, ldb, (float) beta, Cf, ldc);
+    
+    for(int r = 0;r < m;r++){
+        for(int c = 0;c < n;c++){
+            diff = fmax(diff, fabs(C[r*ldc + c] - R[r*ldc + c]));
+            diffs = fmax(diffs, fabs(Cf[r*ldc + c] - Rf[r*ldc + c]));
+        }
+        /* padding between rows must be left untouched */
+        if(!(C[r*ldc + n] == R[r*ldc + n] || (isnan(C[r*ldc + n]) && isnan(R[r*ldc + n])))) diff = INFINITY;
+    }
+    
+    failed = isnan(diff) || isnan(diffs) || diff > DENSE_TOLERANCE*k || diffs > DENSE_TOLERANCE_SINGLE*k;
+    
+    printf("gemm %dx%dx%d%s beta %.1f: double %.3e, single %.3e%s\n", m, n, k, transb ? " transposed" : "", beta, diff, diffs, failed ? " FAILED" : "");
+    
+    free(A);
+    free(B);
+    free(C);
+    free(R);
+    free(Af);
+    free(Bf);
+    free(Cf);
+    free(Rf);
+    return failed;
+}
+
+int testVector(int n){
+    int failed = 0;
+    double dot = 0.0, dotd = 0.0, axpy = 0.0, dotf = 0.0;
+    double *x = malloc(sizeof(double[n])), *y = malloc(sizeof(double[n])), *z = malloc(sizeof(double[n]));
+    float *xf = malloc(sizeof(float[n])), *yf = malloc(sizeof(float[n]));
+    
+    for(int i = 0;i < n;i++){
+        xf[i] = x[i] = sin(0.71*i);
+        yf[i] = y[i] = z[i] = cos(0.29*i + 0.5);
+        dot += x[i]*y[i];
+        dotf += (double) xf[i]*yf[i];
+    }
+    
+    dotd = fabs(denseDot(n, x, y) - dot);
+    dotf = fabs(denseDotf(n, xf, yf) - dotf);
+    
+    denseAxpy(n, -0.75, x, y);
+    for(int i = 0;i < n;i++) axpy = fmax(axpy, fabs(y[i] - (z[i] + -0.75*x[i])));
+    
+    /* the single precision dot product is summed in partial sums */
+    failed = dotd > DENSE_TOLERANCE*n || axpy > DENSE_TOLERANCE || dotf > 1.0e-6*n;
+    
+    printf("vectors of %d: dot %.3e, axpy %.3e, single dot %.3e%s\n", n, dotd, axpy, dotf, failed ? " FAILED" : "");
+    
+    free(x);
+    free(y);
+    free(z);
+    free(xf);
+    free(yf);
+    return failed;
+}
+
+int main(int argc, const char * argv[]) {
+    int failed = 0;
+    
+    for(int transb = 0;transb <= 1;transb++){
+        failed += testGemm(transb, 3, 5, 7, 0.0);
+        failed += testGemm(transb, 37, 45, 29, 0.0);
+        failed += testGemm(transb, 37, 45, 29, 1.0);
+        failed += testGemm(transb, 64, 300, 270, 0.5);
+        failed += testGemm(transb, 9, 257, 600, 0.0);
+    }
+    
+    failed += testVector(5);
+    failed += testVector(1001);
+    
+    return failed > 0;
+}
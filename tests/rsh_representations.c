@@ -0,0 +1,186 @@
+//
+//  rsh_representations.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "msym.h"
+#include "symop.h"
+#include "point_group.h"
+#include "rsh.h"
+
+#ifndef M_SQRT2
+#define M_SQRT2 1.41421356237309504880
+#endif
+
+/* Generates real spherical harmonic representations of point groups in their canonical orientation and rotated,
+ * they must match the scalar recurrence they are computed with, be orthogonal, multiply like the operations,
+ * have the characters of the operations, and be exactly the same when generated again from the cache */
+
+double referenceP(int l, int i, int m1, int m2, double r1[3][3], double rl[2*l-1][2*l-1]);
+void referenceRepresentation(msym_symmetry_operation_t *sop, int l, double r1[3][3], double rl[2*l-1][2*l-1], double r[2*l+1][2*l+1]);
+int testPointGroup(const char *name, const char *orientation, double transform[3][3], int lmax);
+
+double referenceP(int l, int i, int m1, int m2, double r1[3][3], double rl[2*l-1][2*l-1]){
+    int o = l - 1;
+    if(m2 == l) return r1[i + 1][2]*rl[m1 + o][l - 1 + o] - r1[i + 1][0]*rl[m1 + o][1 - l + o];
+    if(m2 == -l) return r1[i + 1][2]*rl[m1 + o][1 - l + o] + r1[i + 1][0]*rl[m1 + o][l - 1 + o];
+    return r1[i + 1][1]*rl[m1 + o][m2 + o];
+}
+
+/* Representation of one operation from that of l - 1, each element calculated separately (Ivanic and Ruedenberg) */
+void referenceRepresentation(msym_symmetry_operation_t *sop, int l, double r1[3][3], double rl[2*l-1][2*l-1], double r[2*l+1][2*l+1]){
+    int d = 2*l+1;
+    if(IDENTITY == sop->type || (INVERSION == sop->type && !(l & 1))){
+        for(int i = 0;i < d;i++){
+            for(int j = 0;j < d;j++) r[i][j] = i == j;
+        }
+        return;
+    } else if(INVERSION == sop->type){
+        for(int i = 0;i < d;i++){
+            for(int j = 0;j < d;j++) r[i][j] = -(i == j);
+        }
+        return;
+    }
+    for(int m1 = -l;m1 <= l;m1++){
+        for(int m2 = -l;m2 <= l;m2++){
+            double u, v, w, am1 = abs(m1);
+            if(0 == m1){
+                if(abs(m2) == l){
+                    u = sqrt(l/(4*l - 2.0));
+                    v = -0.5*sqrt((l - 1.0)/(2*l - 1.0));
+                } else {
+                    u = sqrt(l*l/(l*l - (double) m2*m2));
+                    v = -0.5*sqrt(2*(l*l - l)/(l*l - (double) m2*m2));
+                }
+                w = 0;
+            } else {
+                double div = abs(m2) == l ? 2.0*l*(2.0*l - 1) : (l + m2)*(l - m2);
+                u = sqrt((l + m1)*(l - m1)/div);
+                v = 0.5*sqrt((l + am1 - 1)*(l + am1)/div);
+                w = -0.5*sqrt((l - am1 - 1)*(l - am1)/div);
+            }
+            if(u != 0) u *= referenceP(l, 0, m1, m2, r1, rl);
+            if(v != 0){
+                if(0 == m1) v *= referenceP(l, 1, 1, m2, r1, rl) + referenceP(l, -1, -1, m2, r1, rl);
+                else if(1 == m1) v *= M_SQRT2*referenceP(l, 1, 0, m2, r1, rl);
+                else if(-1 == m1) v *= M_SQRT2*referenceP(l, -1, 0, m2, r1, rl);
+                else if(m1 > 0) v *= referenceP(l, 1, m1 - 1, m2, r1, rl) - referenceP(l, -1, -m1 + 1, m2, r1, rl);
+                else v *= referenceP(l, 1, m1 + 1, m2, r1, rl) + referenceP(l, -1, -m1 - 1, m2, r1, rl);
+            }
+            if(w != 0){
+                if(m1 > 0) w *= referenceP(l, 1, m1 + 1, m2, r1, rl) + referenceP(l, -1, -m1 - 1, m2, r1, rl);
+                else w *= referenceP(l, 1, m1 - 1, m2, r1, rl) - referenceP(l, -1, -m1 + 1, m2, r1, rl);
+            }
+            r[m1 + l][m2 + l] = u + v + w;
+        }
+    }
+}
+
+int testPointGroup(const char *name, const char *orientation, double transform[3][3], int lmax){
+    msym_thresholds_t thresholds = *msymGetDefaultThresholds();
+    msym_point_group_t *pg = NULL;
+    rsh_representations_t *lrs = calloc(lmax+1, sizeof(*lrs)), *clrs = calloc(lmax+1, sizeof(*clrs));
+    int failed = 0, cached = 0;
+    double reference = 0.0, orthogonality = 0.0, product = 0.0, character = 0.0;
+    
+    if(MSYM_SUCCESS != generatePointGroupFromName(name, transform, &thresholds, &pg)){
+        fprintf(stderr, "Could not generate point group %s: %s\n", name, msymGetErrorDetails());
+        failed = 1;
+        goto err;
+    }
+    
+    int order = pg->order;
+    
+    for(int l = 0;l <= lmax;l++){
+        lrs[l].d = clrs[l].d = 2*l+1;
+        lrs[l].t = malloc(sizeof(double[order][2*l+1][2*l+1]));
+        clrs[l].t = malloc(sizeof(double[order][2*l+1][2*l+1]));
+    }
+    
+    /* the first call calculates the representations of this orientation, the second finds them in the cache */
+    if(MSYM_SUCCESS != generateRSHRepresentations(order, pg->sops, lmax, lrs) ||
+       MSYM_SUCCESS != generateRSHRepresentations(order, pg->sops, lmax, clrs)){
+        fprintf(stderr, "Could not generate representations of %s: %s\n", name, msymGetErrorDetails());
+        failed = 1;
+        goto err;
+    }
+    
+    for(int l = 0;l <= lmax;l++){
+        int d = 2*l+1, pd = l > 0 ? 2*l-1 : 1;
+        double (*r)[d][d] = lrs[l].t, (*cr)[d][d] = clrs[l].t, (*r1)[3][3] = lrs[1 < lmax ? 1 : lmax].t, (*rl)[pd][pd] = lrs[l > 0 ? l-1 : 0].t;
+        double (*ref)[d] = malloc(sizeof(double[d][d]));
+        cached += 0 != memcmp(r, cr, sizeof(double[order][d][d]));
+        for(int s = 0;s < order;s++){
+            double t = 0.0;
+            if(0 == l){
+                ref[0][0] = 1.0;
+            } else if(1 == l){
+                double m[3][3];
+                int yzx[3] = {1, 2, 0};
+                symmetryOperationMatrix(&pg->sops[s], m);
+                for(int i = 0;i < 3;i++){
+                    for(int j = 0;j < 3;j++) ref[i][j] = m[yzx[i]][yzx[j]];
+                }
+            } else {
+                referenceRepresentation(&pg->sops[s], l, r1[s], rl[s], ref);
+            }
+            for(int i = 0;i < d;i++){
+                t += r[s][i][i];
+                for(int j = 0;j < d;j++){
+                    double o = 0.0;
+                    for(int q = 0;q < d;q++) o += r[s][i][q]*r[s][j][q];
+                    reference = fmax(reference, fabs(r[s][i][j] - ref[i][j]));
+                    orthogonality = fmax(orthogonality, fabs(o - (i == j)));
+                }
+            }
+            character = fmax(character, fabs(t - symmetryOperationYCharacter(&pg->sops[s], l)));
+    
+            /* the multiplication table of the point group has the product of operations s and u at perm[s].p[u] */
+            for(int u = 0;u < order;u++){
+                int k = pg->perm[s].p[u];
+                for(int i = 0;i < d;i++){
+                    for(int j = 0;j < d;j++){
+                        double p = 0.0;
+                        for(int q = 0;q < d;q++) p += r[s][i][q]*r[u][q][j];
+                        product = fmax(product, fabs(p - r[k][i][j]));
+                    }
+                }
+            }
+        }
+        free(ref);
+    }
+    
+    failed = cached > 0 || reference > 1.0e-12 || orthogonality > 1.0e-10 || product > 1.0e-10 || character > 1.0e-10;
+    
+    printf("%s %s (l <= %d): reference %.3e, orthogonality %.3e, products %.3e, characters %.3e, cache mismatches %d%s\n", name, orientation, lmax, reference, orthogonality, product, character, cached, failed ? " FAILED" : "");
+    
+err:
+    for(int l = 0;l <= lmax;l++){
+        free(lrs[l].t);
+        free(clrs[l].t);
+    }
+    free(lrs);
+    free(clrs);
+    if(NULL != pg) freePointGroup(pg);
+    return failed;
+}
+
+int main(int argc, const char * argv[]) {
+    int failed = 0;
+    double e[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}, r[3][3] = {{0.36, 0.48, -0.8}, {-0.8, 0.6, 0.0}, {0.48, 0.64, 0.6}};
+    
+    failed += testPointGroup("Ih", "canonical", e, 8);
+    failed += testPointGroup("Ih", "rotated", r, 8);
+    failed += testPointGroup("Oh", "canonical", e, 6);
+    failed += testPointGroup("Oh", "rotated", r, 6);
+    failed += testPointGroup("D6h", "rotated", r, 6);
+    failed += testPointGroup("Td", "rotated", r, 4);
+    
+    return failed > 0;
+}
@@ -0,0 +1,123 @@
+//
+//  single_precision.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "msym.h"
+
+/* Generates SALCs of tetrahedral, octahedral and icosahedral molecules in single and double precision,
+ * the refined single precision SALCs must be the same as the double precision ones */
+
+int getSALCs(int elementsl, msym_element_t elements[elementsl], int lmax, msym_precision_t precision, int basisl, double c[basisl][basisl], int species[basisl], msym_partner_function_t pf[basisl], char *pgname);
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax);
+
+int getSALCs(int elementsl, msym_element_t elements[elementsl], int lmax, msym_precision_t precision, int basisl, double c[basisl][basisl], int species[basisl], msym_partner_function_t pf[basisl], char *pgname){
+    msym_context ctx = msymCreateContext();
+    msym_basis_function_t *basis = calloc(basisl, sizeof(*basis));
+    int failed = 0;
+    
+    for(int e = 0, b = 0;e < elementsl;e++){
+        for(int l = 0;l <= lmax;l++){
+            for(int m = -l;m <= l;m++, b++){
+                basis[b].element = &elements[e];
+                basis[b].type = MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC;
+                basis[b].f.rsh.n = l + 1;
+                basis[b].f.rsh.l = l;
+                basis[b].f.rsh.m = m;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != msymSetElements(ctx, elementsl, elements) ||
+       MSYM_SUCCESS != msymSetBasisFunctions(ctx, basisl, basis) ||
+       MSYM_SUCCESS != msymFindSymmetry(ctx) ||
+       MSYM_SUCCESS != msymGetPointGroupName(ctx, 8, pgname) ||
+       MSYM_SUCCESS != msymSetPrecision(ctx, precision) ||
+       MSYM_SUCCESS != msymGetSALCs(ctx, basisl, c, species, pf)){
+        fprintf(stderr, "Could not get %s precision SALCs: %s\n", MSYM_PRECISION_SINGLE == precision ? "single" : "double", msymGetContextErrorDetails(ctx));
+        failed = 1;
+    }
+    
+    msymReleaseContext(ctx);
+    free(basis);
+    return failed;
+}
+
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax){
+    int basisl = elementsl*(lmax+1)*(lmax+1), failed = 0, mismatch = 0;
+    double diff = 0.0;
+    char pgname[8];
+    double (*sc)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*dc)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    int *sspecies = malloc(sizeof(int[basisl]));
+    int *dspecies = malloc(sizeof(int[basisl]));
+    msym_partner_function_t *spf = malloc(sizeof(msym_partner_function_t[basisl]));
+    msym_partner_function_t *dpf = malloc(sizeof(msym_partner_function_t[basisl]));
+    
+    if(getSALCs(elementsl, elements, lmax, MSYM_PRECISION_DOUBLE, basisl, dc, dspecies, dpf, pgname) ||
+       getSALCs(elementsl, elements, lmax, MSYM_PRECISION_SINGLE, basisl, sc, sspecies, spf, pgname)){
+        failed = 1;
+        goto err;
+    }
+    
+    for(int i = 0;i < basisl;i++){
+        mismatch += sspecies[i] != dspecies[i] || spf[i].i != dpf[i].i || spf[i].d != dpf[i].d;
+        for(int j = 0;j < basisl;j++) diff = fmax(diff, fabs(sc[i][j] - dc[i][j]));
+    }
+    
+    failed = mismatch > 0 || diff > 1.0e-12;
+    
+    printf("%s (%s, %d basis functions): coefficients %.3e, species or partner function mismatches %d%s\n", name, pgname, basisl, diff, mismatch, failed ? " FAILED" : "");
+    
+err:
+    free(sc);
+    free(dc);
+    free(sspecies);
+    free(dspecies);
+    free(spf);
+    free(dpf);
+    return failed;
+}
+
+int main(int argc, const char * argv[]) {
+    int failed = 0;
+    double a = 0.629, p = (1 + sqrt(5))/2;
+    msym_element_t ch4[5] = {
+        {.name = "C", .v = {0, 0, 0}},
+        {.name = "H", .v = {a, a, a}},
+        {.name = "H", .v = {-a, -a, a}},
+        {.name = "H", .v = {-a, a, -a}},
+        {.name = "H", .v = {a, -a, -a}}
+    };
+    msym_element_t sf6[7] = {
+        {.name = "S", .v = {0, 0, 0}},
+        {.name = "F", .v = {1.56, 0, 0}},
+        {.name = "F", .v = {-1.56, 0, 0}},
+        {.name = "F", .v = {0, 1.56, 0}},
+        {.name = "F", .v = {0, -1.56, 0}},
+        {.name = "F", .v = {0, 0, 1.56}},
+        {.name = "F", .v = {0, 0, -1.56}}
+    };
+    msym_element_t c20[20] = {{.name = ""}};
+    
+    /* dodecahedron, (±1,±1,±1) and cyclic permutations of (0,±1/p,±p) */
+    for(int i = 0;i < 8;i++){
+        c20[i] = (msym_element_t) {.name = "C", .v = {i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1}};
+        if(i >= 4) continue;
+        for(int j = 0;j < 3;j++){
+            double v[3] = {0, i & 1 ? 1/p : -1/p, i & 2 ? p : -p};
+            c20[8 + 3*i + j] = (msym_element_t) {.name = "C", .v = {v[j], v[(j+1) % 3], v[(j+2) % 3]}};
+        }
+    }
+    
+    failed += testMolecule("CH4", 5, ch4, 3);
+    failed += testMolecule("SF6", 7, sf6, 3);
+    failed += testMolecule("C20", 20, c20, 2);
+    
+    return failed > 0;
+}
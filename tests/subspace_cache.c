@@ -0,0 +1,165 @@
+//
+//  subspace_cache.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "msym.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338327950288419716939937510582
+#endif
+
+/* Generates SALCs of the same molecules twice in one process, the first molecule of each point group is generated
+ * without cached operations or subspaces, and every later one must give exactly the same point group, symmetry
+ * operations and SALCs as the first. The molecules are then rotated, which changes the representation matrices
+ * the subspaces are cached with, and the SALCs must still be left unchanged by symmetrizing them */
+
+#define MAX_SOPS 120
+
+int getSALCs(int elementsl, msym_element_t elements[elementsl], int lmax, int basisl, double c[basisl][basisl], int species[basisl], msym_partner_function_t pf[basisl], char *pgname, int *sopsl, msym_symmetry_operation_t sops[MAX_SOPS], double *symmetric);
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax);
+
+/* SALCs of the molecule, and the largest change when symmetrizing them as wave functions */
+int getSALCs(int elementsl, msym_element_t elements[elementsl], int lmax, int basisl, double c[basisl][basisl], int species[basisl], msym_partner_function_t pf[basisl], char *pgname, int *sopsl, msym_symmetry_operation_t sops[MAX_SOPS], double *symmetric){
+    msym_context ctx = msymCreateContext();
+    msym_basis_function_t *basis = calloc(basisl, sizeof(*basis));
+    double (*wf)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    int *wfspecies = malloc(sizeof(int[basisl]));
+    const msym_symmetry_operation_t *csops = NULL;
+    int failed = 0;
+    
+    for(int e = 0, b = 0;e < elementsl;e++){
+        for(int l = 0;l <= lmax;l++){
+            for(int m = -l;m <= l;m++, b++){
+                basis[b].element = &elements[e];
+                basis[b].type = MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC;
+                basis[b].f.rsh.n = l + 1;
+                basis[b].f.rsh.l = l;
+                basis[b].f.rsh.m = m;
+            }
+        }
+    }
+    
+    if(MSYM_SUCCESS != msymSetElements(ctx, elementsl, elements) ||
+       MSYM_SUCCESS != msymSetBasisFunctions(ctx, basisl, basis) ||
+       MSYM_SUCCESS != msymFindSymmetry(ctx) ||
+       MSYM_SUCCESS != msymGetPointGroupName(ctx, 8, pgname) ||
+       MSYM_SUCCESS != msymGetSymmetryOperations(ctx, sopsl, &csops) ||
+       *sopsl > MAX_SOPS ||
+       MSYM_SUCCESS != msymGetSALCs(ctx, basisl, c, species, pf)){
+        fprintf(stderr, "Could not get SALCs: %s\n", msymGetContextErrorDetails(ctx));
+        failed = 1;
+        goto err;
+    }
+    
+    memcpy(sops, csops, sizeof(msym_symmetry_operation_t[*sopsl]));
+    memcpy(wf, c, sizeof(double[basisl][basisl]));
+    
+    if(MSYM_SUCCESS != msymSymmetrizeWavefunctions(ctx, basisl, wf, wfspecies, NULL)){
+        fprintf(stderr, "Could not symmetrize SALCs: %s\n", msymGetContextErrorDetails(ctx));
+        failed = 1;
+        goto err;
+    }
+    
+    *symmetric = 0.0;
+    for(int i = 0;i < basisl;i++){
+        if(wfspecies[i] != species[i]) *symmetric = INFINITY;
+        for(int j = 0;j < basisl;j++) *symmetric = fmax(*symmetric, fabs(wf[i][j] - c[i][j]));
+    }
+    
+err:
+    msymReleaseContext(ctx);
+    free(basis);
+    free(wf);
+    free(wfspecies);
+    return failed;
+}
+
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax){
+    int basisl = elementsl*(lmax+1)*(lmax+1), failed = 0, mismatch = 0, sopsl[3];
+    double symmetric[3] = {0.0}, r[3][3] = {{0.36, 0.48, -0.8}, {-0.8, 0.6, 0.0}, {0.48, 0.64, 0.6}};
+    char pgname[3][8];
+    msym_symmetry_operation_t (*sops)[MAX_SOPS] = malloc(sizeof(msym_symmetry_operation_t[3][MAX_SOPS]));
+    double (*c)[basisl][basisl] = malloc(sizeof(double[3][basisl][basisl]));
+    int (*species)[basisl] = malloc(sizeof(int[3][basisl]));
+    msym_partner_function_t (*pf)[basisl] = malloc(sizeof(msym_partner_function_t[3][basisl]));
+    msym_element_t *rotated = malloc(sizeof(msym_element_t[elementsl]));
+    
+    for(int e = 0;e < elementsl;e++){
+        rotated[e] = elements[e];
+        for(int i = 0;i < 3;i++) rotated[e].v[i] = r[i][0]*elements[e].v[0] + r[i][1]*elements[e].v[1] + r[i][2]*elements[e].v[2];
+    }
+    
+    if(getSALCs(elementsl, elements, lmax, basisl, c[0], species[0], pf[0], pgname[0], &sopsl[0], sops[0], &symmetric[0]) ||
+       getSALCs(elementsl, elements, lmax, basisl, c[1], species[1], pf[1], pgname[1], &sopsl[1], sops[1], &symmetric[1]) ||
+       getSALCs(elementsl, rotated, lmax, basisl, c[2], species[2], pf[2], pgname[2], &sopsl[2], sops[2], &symmetric[2])){
+        failed = 1;
+        goto err;
+    }
+    
+    mismatch += 0 != strcmp(pgname[0], pgname[1]) || 0 != strcmp(pgname[0], pgname[2]) || sopsl[0] != sopsl[1] || sopsl[0] != sopsl[2];
+    
+    for(int i = 0;i < sopsl[0] && i < sopsl[1];i++){
+        msym_symmetry_operation_t *s0 = &sops[0][i], *s1 = &sops[1][i];
+        mismatch += s0->type != s1->type || s0->order != s1->order || s0->power != s1->power || s0->orientation != s1->orientation || s0->cla != s1->cla || 0 != memcmp(s0->v, s1->v, sizeof(s0->v));
+    }
+    
+    for(int i = 0;i < basisl;i++){
+        mismatch += species[0][i] != species[1][i] || pf[0][i].i != pf[1][i].i || pf[0][i].d != pf[1][i].d;
+        mismatch += 0 != memcmp(c[0][i], c[1][i], sizeof(double[basisl]));
+    }
+    
+    failed = mismatch > 0 || symmetric[0] > 1.0e-10 || symmetric[1] > 1.0e-10 || symmetric[2] > 1.0e-10;
+    
+    printf("%s (%s, %d basis functions): mismatches %d, symmetrized SALCs %.3e, repeated %.3e, rotated %.3e%s\n", name, pgname[0], basisl, mismatch, symmetric[0], symmetric[1], symmetric[2], failed ? " FAILED" : "");
+    
+err:
+    free(sops);
+    free(c);
+    free(species);
+    free(pf);
+    free(rotated);
+    return failed;
+}
+
+int main(int argc, const char * argv[]) {
+    int failed = 0;
+    double a = 0.629, cc = 1.39, ch = 2.47;
+    msym_element_t ch4[5] = {
+        {.name = "C", .v = {0, 0, 0}},
+        {.name = "H", .v = {a, a, a}},
+        {.name = "H", .v = {-a, -a, a}},
+        {.name = "H", .v = {-a, a, -a}},
+        {.name = "H", .v = {a, -a, -a}}
+    };
+    msym_element_t sf6[7] = {
+        {.name = "S", .v = {0, 0, 0}},
+        {.name = "F", .v = {1.56, 0, 0}},
+        {.name = "F", .v = {-1.56, 0, 0}},
+        {.name = "F", .v = {0, 1.56, 0}},
+        {.name = "F", .v = {0, -1.56, 0}},
+        {.name = "F", .v = {0, 0, 1.56}},
+        {.name = "F", .v = {0, 0, -1.56}}
+    };
+    msym_element_t c6h6[12];
+    
+    /* the carbon and hydrogen sets of benzene have the same permutations, so hydrogen reuses the carbon subspaces */
+    for(int i = 0;i < 6;i++){
+        double t = M_PI*i/3;
+        c6h6[i] = (msym_element_t) {.name = "C", .v = {cc*cos(t), cc*sin(t), 0}};
+        c6h6[6 + i] = (msym_element_t) {.name = "H", .v = {ch*cos(t), ch*sin(t), 0}};
+    }
+    
+    failed += testMolecule("CH4", 5, ch4, 2);
+    failed += testMolecule("SF6", 7, sf6, 2);
+    failed += testMolecule("C6H6", 12, c6h6, 1);
+    failed += testMolecule("CH4", 5, ch4, 3);
+    
+    return failed > 0;
+}
@@ -0,0 +1,150 @@
+//
+//  symmetrize_matrix.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "msym.h"
+
+/* Symmetrizes a matrix in bases of s to d functions on linear and tetrahedral molecules, in the SALC basis the result
+ * must not couple different species or components of the same SALC, symmetrizing it again must not change it,
+ * and adding an invariant matrix before symmetrizing must add it unchanged */
+
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax);
+
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax){
+    msym_context ctx = msymCreateContext();
+    msym_basis_function_t *basis = calloc(elementsl*(lmax+1)*(lmax+1), sizeof(*basis));
+    int basisl = 0, failed = 0;
+    double coupling = 0.0, idempotence = 0.0, invariance = 0.0;
+    char pgname[8];
+    
+    for(int e = 0;e < elementsl;e++){
+        for(int l = 0;l <= lmax;l++){
+            for(int m = -l;m <= l;m++, basisl++){
+                basis[basisl].element = &elements[e];
+                basis[basisl].type = MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC;
+                basis[basisl].f.rsh.n = l + 1;
+                basis[basisl].f.rsh.l = l;
+                basis[basisl].f.rsh.m = m;
+            }
+        }
+    }
+    
+    double (*c)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*a)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*sa)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*d)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*t)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    int *species = malloc(sizeof(int[basisl]));
+    msym_partner_function_t *pf = malloc(sizeof(msym_partner_function_t[basisl]));
+    
+    if(MSYM_SUCCESS != msymSetElements(ctx, elementsl, elements) ||
+       MSYM_SUCCESS != msymSetBasisFunctions(ctx, basisl, basis) ||
+       MSYM_SUCCESS != msymFindSymmetry(ctx) ||
+       MSYM_SUCCESS != msymGetPointGroupName(ctx, sizeof(pgname), pgname) ||
+       MSYM_SUCCESS != msymGetSALCs(ctx, basisl, c, species, pf)){
+        fprintf(stderr, "Could not get SALCs of %s: %s\n", name, msymGetContextErrorDetails(ctx));
+        failed = 1;
+        goto err;
+    }
+    
+    /* an arbitrary symmetric matrix, and an invariant one coupling only s functions by their distance */
+    for(int i = 0;i < basisl;i++){
+        for(int j = 0;j < basisl;j++){
+            double *vi = basis[i].element->v, *vj = basis[j].element->v;
+            double r = sqrt((vi[0]-vj[0])*(vi[0]-vj[0]) + (vi[1]-vj[1])*(vi[1]-vj[1]) + (vi[2]-vj[2])*(vi[2]-vj[2]));
+            sa[i][j] = a[i][j] = cos(i + j) + sin(0.7*i*j) + (i == j);
+            d[i][j] = 0 == basis[i].f.rsh.l && 0 == basis[j].f.rsh.l ? exp(-r) : 0.0;
+        }
+    }
+    
+    if(MSYM_SUCCESS != msymSymmetrizeMatrix(ctx, basisl, sa)){
+        fprintf(stderr, "Could not symmetrize matrix of %s: %s\n", name, msymGetContextErrorDetails(ctx));
+        failed = 1;
+        goto err;
+    }
+    
+    /* S*A*S^T */
+    for(int i = 0;i < basisl;i++){
+        for(int j = 0;j < basisl;j++){
+            t[i][j] = 0.0;
+            for(int k = 0;k < basisl;k++) t[i][j] += c[i][k]*sa[k][j];
+        }
+    }
+    for(int i = 0;i < basisl;i++){
+        for(int j = 0;j < basisl;j++){
+            double b = 0.0;
+            for(int k = 0;k < basisl;k++) b += t[i][k]*c[j][k];
+            if(i != j && (species[i] != species[j] || pf[i].i == pf[j].i)) coupling = fmax(coupling, fabs(b));
+        }
+    }
+    
+    for(int i = 0;i < basisl;i++){
+        for(int j = 0;j < basisl;j++){
+            t[i][j] = sa[i][j];
+            a[i][j] += d[i][j];
+        }
+    }
+    
+    if(MSYM_SUCCESS != msymSymmetrizeMatrix(ctx, basisl, t) || MSYM_SUCCESS != msymSymmetrizeMatrix(ctx, basisl, a)){
+        fprintf(stderr, "Could not symmetrize matrix of %s: %s\n", name, msymGetContextErrorDetails(ctx));
+        failed = 1;
+        goto err;
+    }
+    
+    for(int i = 0;i < basisl;i++){
+        for(int j = 0;j < basisl;j++){
+            idempotence = fmax(idempotence, fabs(t[i][j] - sa[i][j]));
+            invariance = fmax(invariance, fabs(a[i][j] - sa[i][j] - d[i][j]));
+        }
+    }
+    
+    failed = coupling > 1.0e-10 || idempotence > 1.0e-10 || invariance > 1.0e-10;
+    
+    printf("%s (%s, %d basis functions): coupling %.3e, idempotence %.3e, invariance %.3e%s\n", name, pgname, basisl, coupling, idempotence, invariance, failed ? " FAILED" : "");
+    
+err:
+    msymReleaseContext(ctx);
+    free(basis);
+    free(c);
+    free(a);
+    free(sa);
+    free(d);
+    free(t);
+    free(species);
+    free(pf);
+    return failed;
+}
+
+int main(int argc, const char * argv[]) {
+    int failed = 0;
+    double a = 0.629;
+    msym_element_t co2[3] = {
+        {.name = "C", .v = {0, 0, 0}},
+        {.name = "O", .v = {0, 0, 1.16}},
+        {.name = "O", .v = {0, 0, -1.16}}
+    };
+    msym_element_t ocs[3] = {
+        {.name = "C", .v = {0, 0, 0}},
+        {.name = "O", .v = {0, 0, 1.16}},
+        {.name = "S", .v = {0, 0, -1.56}}
+    };
+    msym_element_t ch4[5] = {
+        {.name = "C", .v = {0, 0, 0}},
+        {.name = "H", .v = {a, a, a}},
+        {.name = "H", .v = {-a, -a, a}},
+        {.name = "H", .v = {-a, a, -a}},
+        {.name = "H", .v = {a, -a, -a}}
+    };
+    
+    failed += testMolecule("CO2", 3, co2, 2);
+    failed += testMolecule("OCS", 3, ocs, 2);
+    failed += testMolecule("CH4", 5, ch4, 2);
+    
+    return failed > 0;
+}
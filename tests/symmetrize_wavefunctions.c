@@ -0,0 +1,217 @@
+//
+//  symmetrize_wavefunctions.c
+//  libmsym
+//
+//  Distributed under the MIT License ( See LICENSE file or copy at http://opensource.org/licenses/MIT )
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "msym.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338327950288419716939937510582
+#endif
+
+/* Symmetrizes orbitals made from orthogonal mixtures of the SALCs of each species and component, with added noise
+ * and in shuffled order. Every orbital must get the species it was made from, be the dense projection onto the SALCs
+ * with the magnitudes averaged over its partner functions, be close to the orbital without noise, and symmetrizing
+ * the orbitals in a batch must give exactly the same result */
+
+int orthogonalMatrix(int n, int seed, double q[n][n]);
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax, double noise);
+
+/* Gram-Schmidt on an arbitrary nonsingular matrix */
+int orthogonalMatrix(int n, int seed, double q[n][n]){
+    for(int i = 0;i < n;i++){
+        for(int j = 0;j < n;j++) q[i][j] = cos(1.7*i + 0.6*j + seed) + 2.0*(i == j);
+        for(int p = 0;p < i;p++){
+            double d = 0.0;
+            for(int j = 0;j < n;j++) d += q[i][j]*q[p][j];
+            for(int j = 0;j < n;j++) q[i][j] -= d*q[p][j];
+        }
+        double d = 0.0;
+        for(int j = 0;j < n;j++) d += q[i][j]*q[i][j];
+        if(d < 1.0e-6) return 1;
+        for(int j = 0;j < n;j++) q[i][j] /= sqrt(d);
+    }
+    return 0;
+}
+
+int testMolecule(const char *name, int elementsl, msym_element_t elements[elementsl], int lmax, double noise){
+    msym_context ctx = msymCreateContext();
+    msym_basis_function_t *basis = calloc(elementsl*(lmax+1)*(lmax+1), sizeof(*basis));
+    int basisl = 0, failed = 0, mismatch = 0, shuffle = 7;
+    double reference = 0.0, exact = 0.0;
+    char pgname[8];
+    
+    for(int e = 0;e < elementsl;e++){
+        for(int l = 0;l <= lmax;l++){
+            for(int m = -l;m <= l;m++, basisl++){
+                basis[basisl].element = &elements[e];
+                basis[basisl].type = MSYM_BASIS_TYPE_REAL_SPHERICAL_HARMONIC;
+                basis[basisl].f.rsh.n = l + 1;
+                basis[basisl].f.rsh.l = l;
+                basis[basisl].f.rsh.m = m;
+            }
+        }
+    }
+    
+    double (*c)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*ewf)[basisl] = calloc(basisl, sizeof(double[basisl]));
+    double (*wf)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*swf)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    double (*ref)[basisl] = calloc(basisl, sizeof(double[basisl]));
+    double (*bwf)[basisl][basisl+1] = malloc(sizeof(double[2][basisl][basisl+1]));
+    double (*q)[basisl] = malloc(sizeof(double[basisl][basisl]));
+    int *species = malloc(sizeof(int[basisl])), *especies = malloc(sizeof(int[basisl])), *wfspecies = malloc(sizeof(int[basisl]));
+    int (*bspecies)[basisl] = malloc(sizeof(int[2][basisl]));
+    int *set = malloc(sizeof(int[basisl])), *sets = calloc(basisl, sizeof(int)), *salc = malloc(sizeof(int[basisl]));
+    msym_partner_function_t *pf = malloc(sizeof(msym_partner_function_t[basisl])), *wfpf = malloc(sizeof(msym_partner_function_t[basisl]));
+    msym_partner_function_t (*bpf)[basisl] = malloc(sizeof(msym_partner_function_t[2][basisl]));
+    
+    if(MSYM_SUCCESS != msymSetElements(ctx, elementsl, elements) ||
+       MSYM_SUCCESS != msymSetBasisFunctions(ctx, basisl, basis) ||
+       MSYM_SUCCESS != msymFindSymmetry(ctx) ||
+       MSYM_SUCCESS != msymGetPointGroupName(ctx, sizeof(pgname), pgname) ||
+       MSYM_SUCCESS != msymGetSALCs(ctx, basisl, c, species, pf)){
+        fprintf(stderr, "Could not get SALCs of %s: %s\n", name, msymGetContextErrorDetails(ctx));
+        failed = 1;
+        goto err;
+    }
+    
+    /* number each SALC within its species, the components of a SALC all have the index of the first as partner function */
+    for(int r = 0;r < basisl;r++){
+        if(pf[r].i == r) salc[r] = sets[species[r]]++;
+    }
+    for(int r = 0;r < basisl;r++) set[r] = salc[pf[r].i];
+    
+    while(basisl % shuffle == 0) shuffle += 2;
+    
+    /* orbital of SALC row r mixes all rows of the same species and component, and is stored at a shuffled position */
+    for(int r = 0;r < basisl;r++){
+        int o = (r*shuffle + 3) % basisl, k = species[r], n = sets[k];
+        double (*qk)[n] = (double (*)[n]) q;
+        if(orthogonalMatrix(n, k, qk)){
+            fprintf(stderr, "Could not generate orthogonal matrix\n");
+            failed = 1;
+            goto err;
+        }
+        especies[o] = k;
+        for(int s = 0;s < basisl;s++){
+            if(species[s] != k || pf[s].d != pf[r].d) continue;
+            for(int j = 0;j < basisl;j++) ewf[o][j] += qk[set[r]][set[s]]*c[s][j];
+        }
+        for(int j = 0;j < basisl;j++){
+            wf[o][j] = swf[o][j] = ewf[o][j] + noise*cos(3.1*o + 1.3*j);
+            bwf[0][o][j] = bwf[1][o][j] = wf[o][j];
+        }
+        bwf[0][o][basisl] = bwf[1][o][basisl] = 0.0;
+    }
+    
+    if(MSYM_SUCCESS != msymSymmetrizeWavefunctions(ctx, basisl, swf, wfspecies, wfpf) ||
+       MSYM_SUCCESS != msymSymmetrizeWavefunctionsBatch(ctx, 2, basisl, basisl, basisl+1, bwf, bspecies, bpf)){
+        fprintf(stderr, "Could not symmetrize wave functions of %s: %s\n", name, msymGetContextErrorDetails(ctx));
+        failed = 1;
+        goto err;
+    }
+    
+    /* dense projection onto the SALCs of each species, with component magnitudes averaged over the partner functions */
+    for(int o = 0;o < basisl;o++){
+        int k = wfspecies[o], d = wfpf[o].d, dim = 0;
+        mismatch += k != especies[o];
+        for(int p = 0;p < basisl;p++) dim += wfpf[p].i == wfpf[o].i;
+        for(int r = 0;r < basisl;r++){
+            double avg = 0.0, co = 0.0;
+            if(species[r] != k || pf[r].d != d) continue;
+            for(int p = 0;p < basisl;p++){
+                double m = 0.0;
+                if(wfpf[p].i != wfpf[o].i) continue;
+                for(int s = 0;s < basisl;s++){
+                    double cs = 0.0;
+                    if(pf[s].i != pf[r].i) continue;
+                    for(int j = 0;j < basisl;j++) cs += wf[p][j]*c[s][j];
+                    m += cs*cs;
+                }
+                avg += sqrt(m)/dim;
+            }
+            for(int j = 0;j < basisl;j++) co += wf[o][j]*c[r][j];
+            for(int j = 0;j < basisl;j++) ref[o][j] += copysign(avg, co)*c[r][j];
+        }
+    }
+    
+    for(int o = 0;o < basisl;o++){
+        for(int b = 0;b < 2;b++){
+            mismatch += bspecies[b][o] != wfspecies[o] || bpf[b][o].i != wfpf[o].i || bpf[b][o].d != wfpf[o].d;
+            mismatch += 0 != memcmp(bwf[b][o], swf[o], sizeof(double[basisl])) || 0.0 != bwf[b][o][basisl];
+        }
+        for(int j = 0;j < basisl;j++){
+            reference = fmax(reference, fabs(swf[o][j] - ref[o][j]));
+            exact = fmax(exact, fabs(swf[o][j] - ewf[o][j]));
+        }
+    }
+    
+    failed = mismatch > 0 || reference > 1.0e-12 || exact > 10*noise + 1.0e-12;
+    
+    printf("%s (%s, %d basis functions, noise %.0e): mismatches %d, reference %.3e, exact %.3e%s\n", name, pgname, basisl, noise, mismatch, reference, exact, failed ? " FAILED" : "");
+    
+err:
+    msymReleaseContext(ctx);
+    free(basis);
+    free(c);
+    free(ewf);
+    free(wf);
+    free(swf);
+    free(ref);
+    free(bwf);
+    free(q);
+    free(species);
+    free(especies);
+    free(wfspecies);
+    free(bspecies);
+    free(set);
+    free(sets);
+    free(salc);
+    free(pf);
+    free(wfpf);
+    free(bpf);
+    return failed;
+}
+
+int main(int argc, const char * argv[]) {
+    int failed = 0;
+    double a = 0.629, p = (1 + sqrt(5))/2, cc = 1.39, ch = 2.47;
+    msym_element_t ch4[5] = {
+        {.name = "C", .v = {0, 0, 0}},
+        {.name = "H", .v = {a, a, a}},
+        {.name = "H", .v = {-a, -a, a}},
+        {.name = "H", .v = {-a, a, -a}},
+        {.name = "H", .v = {a, -a, -a}}
+    };
+    msym_element_t c6h6[12], c20[20];
+    
+    for(int i = 0;i < 6;i++){
+        double t = M_PI*i/3;
+        c6h6[i] = (msym_element_t) {.name = "C", .v = {cc*cos(t), cc*sin(t), 0}};
+        c6h6[6 + i] = (msym_element_t) {.name = "H", .v = {ch*cos(t), ch*sin(t), 0}};
+    }
+    
+    /* dodecahedron, (±1,±1,±1) and cyclic permutations of (0,±1/p,±p) */
+    for(int i = 0;i < 8;i++){
+        c20[i] = (msym_element_t) {.name = "C", .v = {i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1}};
+        if(i >= 4) continue;
+        for(int j = 0;j < 3;j++){
+            double v[3] = {0, i & 1 ? 1/p : -1/p, i & 2 ? p : -p};
+            c20[8 + 3*i + j] = (msym_element_t) {.name = "C", .v = {v[j], v[(j+1) % 3], v[(j+2) % 3]}};
+        }
+    }
+    
+    failed += testMolecule("C6H6", 12, c6h6, 1, 0.0);
+    failed += testMolecule("C6H6", 12, c6h6, 1, 1.0e-4);
+    failed += testMolecule("CH4", 5, ch4, 2, 1.0e-4);
+    failed += testMolecule("C20", 20, c20, 1, 1.0e-4);
+    
+    return failed > 0;
+}